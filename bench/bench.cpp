@@ -0,0 +1,675 @@
+// terram_bench: throughput and latency of the core paths, written as one
+// `name value unit` line per metric so runs can be diffed across releases.
+//
+//   terram_bench [output-path] [--quick] [--trace trace.json]
+//
+// The output defaults to bench_output.txt in the working directory.
+// --trace records a Chrome trace of the run (chrome://tracing, Perfetto)
+// and prints the library's metrics when done. Lines
+// starting with '#' are comments. Metric names and their order are stable:
+// new metrics are added, and a rename or removal bumps kFormatVersion.
+// Every rate is the median of several timed rounds of at least
+// Config::min_seconds each.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include "terram/async.hpp"
+#include "terram/biome.hpp"
+#include "terram/caves.hpp"
+#include "terram/chunk_cache.hpp"
+#include "terram/erosion.hpp"
+#include "terram/heightfield.hpp"
+#include "terram/mesh.hpp"
+#include "terram/metrics.hpp"
+#include "terram/noise.hpp"
+#include "terram/noise_graph.hpp"
+#include "terram/noise_program.hpp"
+#include "terram/region_store.hpp"
+#include "terram/requests.hpp"
+#include "terram/scheduler.hpp"
+#include "terram/simd.hpp"
+#include "terram/stages.hpp"
+#include "terram/surface.hpp"
+#include "terram/thread_pool.hpp"
+#include "terram/world.hpp"
+
+using namespace terram;
+
+namespace {
+
+constexpr int kFormatVersion = 1;
+
+using Clock = std::chrono::steady_clock;
+
+struct Config {
+  const char* output = "bench_output.txt";
+  double min_seconds = 0.25;
+  int rounds = 5;
+  int grid = 8;  // generation targets are grid x grid chunks
+};
+
+struct Metric {
+  std::string name;
+  double value;
+  std::string unit;
+};
+
+class Report {
+ public:
+  void add(std::string name, double value, std::string unit) {
+    std::printf("%-36s %14.6g %s\n", name.c_str(), value, unit.c_str());
+    std::fflush(stdout);
+    metrics_.push_back({std::move(name), value, std::move(unit)});
+  }
+  void note(std::string key, std::string value) {
+    notes_.emplace_back(std::move(key), std::move(value));
+  }
+
+  bool write(const char* path) const {
+    std::FILE* f = std::fopen(path, "w");
+    if (!f) return false;
+    std::fprintf(f, "# terram-bench %d\n", kFormatVersion);
+    for (const auto& [key, value] : notes_) {
+      std::fprintf(f, "# %s %s\n", key.c_str(), value.c_str());
+    }
+    for (const Metric& m : metrics_) {
+      std::fprintf(f, "%s %.6g %s\n", m.name.c_str(), m.value, m.unit.c_str());
+    }
+    return std::fclose(f) == 0;
+  }
+
+ private:
+  std::vector<std::pair<std::string, std::string>> notes_;
+  std::vector<Metric> metrics_;
+};
+
+double seconds_since(Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Median over rounds of ops/second, where one call of `fn` performs `ops`
+// operations. Each round repeats `fn` until it has run for min_seconds.
+template <typename F>
+double rate(const Config& cfg, double ops, F&& fn) {
+  fn();  // warm caches, arenas and page tables
+  std::vector<double> rates;
+  for (int r = 0; r < cfg.rounds; ++r) {
+    std::size_t calls = 0;
+    const auto start = Clock::now();
+    double elapsed = 0.0;
+    do {
+      fn();
+      ++calls;
+      elapsed = seconds_since(start);
+    } while (elapsed < cfg.min_seconds);
+    rates.push_back(ops * static_cast<double>(calls) / elapsed);
+  }
+  std::nth_element(rates.begin(), rates.begin() + rates.size() / 2, rates.end());
+  return rates[rates.size() / 2];
+}
+
+// Defeats dead-code elimination of benchmarked reads.
+volatile float g_sink;
+
+void bench_noise(const Config& cfg, Report& report) {
+  const SimplexNoise noise(1);
+  const FbmParams params;
+  const SimdIsa initial = noise_isa();
+
+  float acc = 0.0f;
+  report.add("noise.point.scalar", rate(cfg, 4096, [&] {
+               for (int i = 0; i < 4096; ++i) acc += noise.sample(i * 0.37f, i * 0.11f);
+             }),
+             "samples/s");
+
+  // One fill evaluates octaves simplex samples per cell.
+  TiledPlane<float> plane;
+  const double samples = static_cast<double>(kChunkCells) * params.octaves;
+  for (SimdIsa isa : {SimdIsa::Scalar, SimdIsa::Avx2, SimdIsa::Avx512, SimdIsa::Neon}) {
+    if (!set_noise_isa(isa)) continue;
+    int i = 0;
+    report.add(std::string("noise.fbm.") + to_string(isa), rate(cfg, samples, [&] {
+                 noise.fill({i, -i}, params, plane);
+                 ++i;
+               }),
+               "samples/s");
+  }
+  set_noise_isa(initial);
+  g_sink = acc + std::as_const(plane).at(0, 0);
+}
+
+void bench_biomes(const Config& cfg, Report& report) {
+  // Climate and heights of a real chunk, so the bins hit are typical.
+  const FbmParams terrain;
+  const BiomeOptions climate;
+  TiledPlane<float> t, m, h;
+  SimplexNoise(11).fill({3, 5}, climate.temperature, t);
+  SimplexNoise(12).fill({3, 5}, climate.moisture, m);
+  SimplexNoise(13).fill({3, 5}, terrain, h);
+  const auto table = standard_biome_table();
+  TiledPlane<BiomeId> out;
+  const SimdIsa initial = noise_isa();
+
+  // Per-cell classification, the branchy code the table replaces.
+  report.add("biome.branchy", rate(cfg, kChunkCells, [&] {
+               for (int i = 0; i < kChunkCells; ++i) {
+                 out.data()[i] = standard_biome(t.data()[i], m.data()[i], h.data()[i]);
+               }
+             }),
+             "cells/s");
+  for (SimdIsa isa : {SimdIsa::Scalar, SimdIsa::Avx2, SimdIsa::Avx512, SimdIsa::Neon}) {
+    if (!set_noise_isa(isa)) continue;
+    report.add(std::string("biome.lut.") + to_string(isa), rate(cfg, kChunkCells, [&] {
+                 table->classify(t.data(), m.data(), h.data(), kChunkCells, out.data());
+               }),
+               "cells/s");
+  }
+  set_noise_isa(initial);
+  g_sink = std::as_const(out).at(0, 0);
+}
+
+void bench_caves(const Config& cfg, Report& report) {
+  const SimplexNoise terrain(21), first(22), second(23);
+  const CaveOptions options;
+  TiledPlane<float> height;
+  terrain.fill({2, 7}, FbmParams{}, height);
+  Arena scratch;
+  BrickMap voxels;
+  report.add("caves.carve", rate(cfg, 1, [&] {
+               carve_caves(first, second, {2, 7}, height, options, scratch, voxels);
+             }),
+             "chunks/s");
+  // Sparse storage against dense bytes for the same covered layers.
+  report.add("caves.dense_bricks",
+             100.0 * static_cast<double>(voxels.dense_bricks()) /
+                 static_cast<double>(voxels.brick_count()),
+             "%");
+  report.add("caves.bytes", static_cast<double>(voxels.memory_bytes()), "bytes/chunk");
+}
+
+void bench_surface(const Config& cfg, Report& report) {
+  const SimplexNoise terrain(21), first(22), second(23);
+  const CaveOptions options;
+  Arena scratch;
+  std::vector<std::unique_ptr<Chunk>> chunks;
+  ChunkNeighborhood neighbors;
+  for (int dz = -1; dz <= 1; ++dz) {
+    for (int dx = -1; dx <= 1; ++dx) {
+      auto c = std::make_unique<Chunk>(ChunkCoord{2 + dx, 7 + dz});
+      terrain.fill(c->coord(), FbmParams{}, c->height());
+      carve_caves(first, second, c->coord(), std::as_const(*c).height(), options, scratch,
+                  c->ensure_voxels());
+      neighbors.set(dx, dz, c.get());
+      chunks.push_back(std::move(c));
+    }
+  }
+  SurfaceMesh mesh;
+  const SurfaceExtractor extractor;
+  report.add("surface.extract", rate(cfg, 1, [&] { extractor.extract(neighbors, mesh); }),
+             "chunks/s");
+  ThreadPool pool;
+  report.add("surface.extract.pool",
+             rate(cfg, 1, [&] { extractor.extract(neighbors, mesh, &pool); }), "chunks/s");
+  report.add("surface.triangles", static_cast<double>(mesh.triangle_count()), "tris/chunk");
+}
+
+// Normals and biomes over a batch of chunks as two passes, the way the
+// scheduler runs stages, against one fused pass that keeps each tile's
+// heights in cache between them. The batch is sized past L2 so the second
+// pass of the separate run finds its chunks cold.
+void bench_fusion(const Config& cfg, Report& report) {
+  constexpr int kSide = 8;
+  const SimplexNoise terrain(31);
+  Heightfield field;
+  for (int z = -1; z <= kSide; ++z) {
+    for (int x = -1; x <= kSide; ++x) {
+      auto c = std::make_shared<Chunk>(ChunkCoord{x, z});
+      terrain.fill(c->coord(), FbmParams{}, c->height());
+      field.insert(std::move(c));
+    }
+  }
+  std::vector<ChunkNeighborhood> batch;
+  for (int z = 0; z < kSide; ++z) {
+    for (int x = 0; x < kSide; ++x) batch.push_back(field.neighborhood({x, z}));
+  }
+  Arena scratch;
+  auto run = [&](const Stage& stage) {
+    for (ChunkNeighborhood& n : batch) {
+      StageContext ctx{*n.center(), n, 0, 0, scratch};
+      stage.run(ctx);
+      scratch.reset();
+    }
+  };
+  const Pipeline separate{stages::normals(), stages::biomes(31, BiomeOptions{})};
+  const Stage fused = stages::fuse(separate);
+  const double chunks = static_cast<double>(batch.size());
+  report.add("fuse.separate", rate(cfg, chunks, [&] {
+               for (const Stage& stage : separate) run(stage);
+             }),
+             "chunks/s");
+  report.add("fuse.fused", rate(cfg, chunks, [&] { run(fused); }), "chunks/s");
+}
+
+// Wraps every stage to add its run time to a per-stage counter, so one
+// batch yields a chunks/sec figure per stage.
+struct StageTimer {
+  std::vector<std::unique_ptr<std::atomic<std::int64_t>>> nanos;
+  std::vector<std::unique_ptr<std::atomic<std::int64_t>>> runs;
+
+  Pipeline wrap(Pipeline pipeline) {
+    for (Stage& stage : pipeline) {
+      nanos.push_back(std::make_unique<std::atomic<std::int64_t>>(0));
+      runs.push_back(std::make_unique<std::atomic<std::int64_t>>(0));
+      auto* ns = nanos.back().get();
+      auto* count = runs.back().get();
+      stage.run = [run = std::move(stage.run), ns, count](StageContext& ctx) {
+        const auto start = Clock::now();
+        run(ctx);
+        ns->fetch_add((Clock::now() - start).count(), std::memory_order_relaxed);
+        count->fetch_add(1, std::memory_order_relaxed);
+      };
+    }
+    return pipeline;
+  }
+};
+
+void bench_generation(const Config& cfg, Report& report, ThreadPool& pool) {
+  auto noise = std::make_shared<const SimplexNoise>(7);
+  StageTimer timer;
+  Pipeline pipeline = timer.wrap({
+      stages::heightmap(noise, FbmParams{}),
+      stages::erosion(ErosionParams{}, stages::fbm_source(noise, FbmParams{})),
+      stages::normals(),
+  });
+
+  std::vector<ChunkCoord> targets;
+  for (int z = 0; z < cfg.grid; ++z) {
+    for (int x = 0; x < cfg.grid; ++x) targets.push_back({x, z});
+  }
+
+  // Fresh fields each round so every stage really runs.
+  std::vector<double> wall;
+  for (int r = 0; r < std::max(cfg.rounds / 2, 1); ++r) {
+    Heightfield field;
+    ChunkScheduler scheduler(pool, field, pipeline);
+    const GenerationStats stats = scheduler.generate(targets);
+    wall.push_back(static_cast<double>(targets.size()) / stats.seconds);
+  }
+  std::sort(wall.begin(), wall.end());
+  report.add("generate.pipeline", wall[wall.size() / 2], "chunks/s");
+
+  // Per-stage rates are per worker: chunks over summed task time.
+  for (std::size_t s = 0; s < pipeline.size(); ++s) {
+    const double secs = static_cast<double>(timer.nanos[s]->load()) * 1e-9;
+    const double runs = static_cast<double>(timer.runs[s]->load());
+    report.add("generate.stage." + pipeline[s].name, secs > 0.0 ? runs / secs : 0.0,
+               "chunks/s/worker");
+  }
+
+  // A Visible batch arriving while a background bake runs: the bake yields
+  // at its next stage boundary.
+  Heightfield field;
+  ChunkScheduler scheduler(pool, field, pipeline);
+  std::vector<ChunkCoord> bake;
+  for (int z = 0; z < 4 * cfg.grid; ++z) {
+    for (int x = 0; x < 4 * cfg.grid; ++x) bake.push_back({x + 1000, z});
+  }
+  GenerateOptions background;
+  background.priority = Priority::Background;
+  auto visible_ms = [&](int x0) {
+    const std::vector<ChunkCoord> visible{{x0, 0}, {x0 + 1, 0}, {x0, 1}, {x0 + 1, 1}};
+    const auto start = std::chrono::steady_clock::now();
+    scheduler.generate(visible);
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start)
+        .count();
+  };
+  report.add("generate.visible_idle", visible_ms(-16), "ms");
+  std::thread baker([&] { scheduler.generate(bake, background); });
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  const double under_bake = visible_ms(-8);
+  baker.join();
+  report.add("generate.visible_under_bake", under_bake, "ms");
+}
+
+void bench_cache(const Config& cfg, Report& report) {
+  Heightfield field;
+  ChunkCache cache(field, std::size_t{1} << 30);
+  std::vector<ChunkCoord> coords;
+  for (int z = 0; z < 32; ++z) {
+    for (int x = 0; x < 32; ++x) {
+      coords.push_back({x, z});
+      field.insert(std::make_shared<Chunk>(ChunkCoord{x, z}));
+    }
+  }
+  std::shuffle(coords.begin(), coords.end(), std::mt19937(3));
+
+  std::size_t hits = 0;
+  const double per_sec = rate(cfg, static_cast<double>(coords.size()), [&] {
+    for (ChunkCoord c : coords) hits += cache.lookup(c) != nullptr;
+  });
+  report.add("cache.hit", 1e9 / per_sec, "ns/op");
+  g_sink = static_cast<float>(hits);
+}
+
+void bench_store(const Config& cfg, Report& report) {
+  const auto dir = std::filesystem::temp_directory_path() /
+                   ("terram-bench-" + std::to_string(::getpid()));
+  std::filesystem::remove_all(dir);
+  std::vector<std::unique_ptr<Chunk>> chunks;
+  std::vector<ChunkCoord> coords;
+  const SimplexNoise noise(11);
+  for (int z = 0; z < 16; ++z) {
+    for (int x = 0; x < 16; ++x) {
+      auto chunk = std::make_unique<Chunk>(ChunkCoord{x, z});
+      noise.fill(chunk->coord(), FbmParams{}, chunk->height());
+      coords.push_back(chunk->coord());
+      chunks.push_back(std::move(chunk));
+    }
+  }
+  const auto n = static_cast<double>(coords.size());
+
+  // One batch of saves and the flush that makes them durable, per backend.
+  for (bool force_threads : {false, true}) {
+    RegionStore store(dir, IoQueueOptions{.force_threads = force_threads});
+    const double per_sec = rate(cfg, n, [&] {
+      for (const auto& chunk : chunks) store.queue_save(*chunk, 1);
+      store.flush();
+    });
+    report.add(std::string("store.save.") + to_string(store.io_backend()), 1e6 / per_sec,
+               "us/chunk");
+  }
+
+  RegionStore store(dir);
+  // load() maps the record without copying; touching every cell adds the
+  // page-cache faults a first read pays.
+  report.add("store.load", 1e6 / rate(cfg, n, [&] {
+               for (ChunkCoord c : coords) g_sink = store.load(c) != nullptr;
+             }),
+             "us/chunk");
+  report.add("store.load_touch", 1e6 / rate(cfg, n, [&] {
+               float sum = 0.0f;
+               for (ChunkCoord c : coords) {
+                 auto chunk = store.load(c);
+                 const float* h = std::as_const(*chunk).height().data();
+                 for (int i = 0; i < kChunkCells; i += 16) sum += h[i];
+               }
+               g_sink = sum;
+             }),
+             "us/chunk");
+  std::filesystem::remove_all(dir);
+}
+
+// A restarted world brought back to a warm cache from a snapshot, against
+// regenerating the same chunks.
+void bench_snapshot(const Config& cfg, Report& report) {
+  const auto path = std::filesystem::temp_directory_path() /
+                    ("terram-bench-" + std::to_string(::getpid()) + ".snap");
+  WorldOptions options;
+  options.seed = 5;
+  options.biomes = BiomeOptions{};
+  options.mesh = MeshOptions{};
+  std::vector<ChunkCoord> coords;
+  for (int z = 0; z < cfg.grid; ++z) {
+    for (int x = 0; x < cfg.grid; ++x) coords.push_back({x, z});
+  }
+  const auto n = static_cast<double>(coords.size());
+  auto ms_per_chunk = [&](Clock::time_point start) { return 1e3 * seconds_since(start) / n; };
+
+  double regenerate = 0.0;
+  {
+    World world(options);
+    const auto start = Clock::now();
+    world.chunks(coords);
+    regenerate = ms_per_chunk(start);
+    world.save_snapshot(path);
+  }
+  World world(options);
+  const auto start = Clock::now();
+  world.load_snapshot(path);
+  for (const auto& chunk : world.chunks(coords)) g_sink = std::as_const(*chunk).height().at(0, 0);
+  report.add("snapshot.restore", ms_per_chunk(start), "ms/chunk");
+  report.add("snapshot.regenerate", regenerate, "ms/chunk");
+  std::filesystem::remove(path);
+}
+
+// Scattered point queries over resident chunks: one batched call against
+// a Heightfield::sample() per point.
+void bench_query(const Config& cfg, Report& report) {
+  WorldOptions options;
+  options.seed = 5;
+  options.biomes = BiomeOptions{};
+  World world(options);
+  std::vector<ChunkCoord> coords;
+  for (int z = 0; z < cfg.grid; ++z) {
+    for (int x = 0; x < cfg.grid; ++x) coords.push_back({x, z});
+  }
+  world.chunks(coords);
+  std::mt19937 rng(17);
+  std::uniform_real_distribution<double> cell(1.0, cfg.grid * kChunkSize - 2.0);
+  std::vector<double> xs(1 << 18), zs(xs.size());
+  for (std::size_t i = 0; i < xs.size(); ++i) {
+    xs[i] = cell(rng);
+    zs[i] = cell(rng);
+  }
+  const auto n = static_cast<double>(xs.size());
+  PointSamples samples;
+  report.add("query.points", rate(cfg, n, [&] { world.sample_points(xs, zs, samples); }),
+             "points/s");
+  report.add("query.single", rate(cfg, n, [&] {
+               float sum = 0.0f;
+               for (std::size_t i = 0; i < xs.size(); ++i) {
+                 sum += world.field().sample(xs[i], zs[i]).value_or(0.0f);
+               }
+               g_sink = sum;
+             }),
+             "points/s");
+}
+
+// Starts running on call and frees itself when done.
+struct Detached {
+  struct promise_type {
+    Detached get_return_object() { return {}; }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() { std::terminate(); }
+  };
+};
+
+Detached consume(ChunkStream& stream, Clock::time_point start, double& first,
+                 std::promise<void>& done) {
+  while (auto c = co_await stream.next()) {
+    if (first == 0.0) first = seconds_since(start);
+    if (c->chunk) g_sink = std::as_const(*c->chunk).height().at(0, 0);
+  }
+  done.set_value();
+}
+
+// A region streamed through the request queue to a coroutine, against one
+// blocking chunks() call, whose first chunk is ready only with its last.
+void bench_stream(const Config& cfg, Report& report) {
+  WorldOptions options;
+  options.seed = 5;
+  std::vector<ChunkCoord> coords;
+  for (int z = 0; z < cfg.grid; ++z) {
+    for (int x = 0; x < cfg.grid; ++x) coords.push_back({x, z});
+  }
+  const auto n = static_cast<double>(coords.size());
+
+  double blocking = 0.0;
+  {
+    World world(options);
+    const auto start = Clock::now();
+    world.chunks(coords);
+    blocking = seconds_since(start);
+  }
+  World world(options);
+  ChunkRequestQueue queue(world);
+  std::promise<void> done;
+  auto finished = done.get_future();
+  double first = 0.0;
+  const auto start = Clock::now();
+  ChunkStream stream(queue, coords, ChunkStreamOptions{.window = 8});
+  consume(stream, start, first, done);
+  finished.wait();
+  const double total = seconds_since(start);
+  report.add("stream.first", 1e3 * first, "ms");
+  report.add("stream.chunks", 1e3 * total / n, "ms/chunk");
+  report.add("stream.blocking", 1e3 * blocking / n, "ms/chunk");
+}
+
+void bench_mesh(const Config& cfg, Report& report) {
+  Heightfield field;
+  const SimplexNoise noise(5);
+  for (int z = -1; z <= 1; ++z) {
+    for (int x = -1; x <= 1; ++x) {
+      auto chunk = std::make_shared<Chunk>(ChunkCoord{x, z});
+      noise.fill(chunk->coord(), FbmParams{}, chunk->height());
+      field.insert(chunk);
+    }
+  }
+  const ChunkNeighborhood neighbors = field.neighborhood({0, 0}, nullptr);
+  const MeshOptions options;
+  Arena scratch;
+  MeshBuffers buffers;
+  mesh_chunk(neighbors, options, scratch, buffers);
+  const auto triangles = static_cast<double>(buffers.triangle_count());
+  report.add("mesh.rtin", rate(cfg, triangles, [&] {
+               mesh_chunk(neighbors, options, scratch, buffers);
+             }),
+             "tris/s");
+  // Simplification quality: a change here moves tris/s without any
+  // change in speed.
+  report.add("mesh.rtin.triangles", triangles, "tris/chunk");
+}
+
+// A composed graph per cell, against noise.fbm's six octaves of one.
+void bench_graph(const Config& cfg, Report& report) {
+  const SimplexNoise noise(1);
+  const auto alpine = graph::presets::alpine();
+  TiledPlane<float> plane;
+  int i = 0;
+  report.add("noise.graph.alpine", rate(cfg, kChunkCells, [&] {
+               graph::fill(alpine, noise, {i, -i}, plane);
+               ++i;
+             }),
+             "cells/s");
+  g_sink = std::as_const(plane).at(0, 0);
+}
+
+// presets::alpine() transcribed to bytecode; see noise.graph.alpine for
+// the compiled graph it matches bit for bit.
+NoiseProgram alpine_program() {
+  using enum Opcode;
+  constexpr std::uint8_t G = NoiseProgram::kGrid;
+  const FbmParams peaks{.frequency = 1.0f / 384.0f, .octaves = 6, .amplitude = 90.0f};
+  const FbmParams wobble{.frequency = 1.0f / 512.0f, .octaves = 3, .amplitude = 1.0f};
+  const FbmParams hills{.frequency = 1.0f / 160.0f, .octaves = 4, .amplitude = 14.0f};
+  return NoiseProgram({peaks, wobble, hills},
+                      {
+                          {.op = GridX, .dst = 0},
+                          {.op = GridZ, .dst = 1},
+                          {.op = Fbm, .dst = 2, .a = G, .b = G, .param = 1},
+                          {.op = Fbm,
+                           .dst = 3,
+                           .a = G,
+                           .b = G,
+                           .param = 1,
+                           .k0 = 7919,
+                           .k1 = -3571},
+                          {.op = MulAdd, .dst = 2, .a = 2, .b = 0, .k0 = 48},
+                          {.op = MulAdd, .dst = 3, .a = 3, .b = 1, .k0 = 48},
+                          {.op = Ridged, .dst = 4, .a = 2, .b = 3, .param = 0},
+                          {.op = ScaleBias, .dst = 4, .a = 4, .k0 = 0.8f},
+                          {.op = Billow, .dst = 5, .a = G, .b = G, .param = 2},
+                          {.op = Add, .dst = 4, .a = 4, .b = 5},
+                          {.op = ScaleBias, .dst = 4, .a = 4, .k0 = 1, .k1 = -20},
+                          {.op = Const, .dst = 6},
+                          {.op = Min, .dst = 7, .a = 4, .b = 6},
+                          {.op = Max, .dst = 5, .a = 4, .b = 6},
+                          {.op = MulAdd, .dst = 4, .a = 7, .b = 5, .k0 = 0.25f},
+                      },
+                      4);
+}
+
+void bench_program(const Config& cfg, Report& report) {
+  const SimplexNoise noise(1);
+  const NoiseProgram program = alpine_program();
+  TiledPlane<float> plane;
+  int i = 0;
+  report.add("noise.program.alpine", rate(cfg, kChunkCells, [&] {
+               program.fill(noise, {i, -i}, plane);
+               ++i;
+             }),
+             "cells/s");
+  g_sink = std::as_const(plane).at(0, 0);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  Config cfg;
+  const char* trace_path = nullptr;
+  for (int i = 1; i < argc; ++i) {
+    if (std::strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+      trace_path = argv[++i];
+    } else if (std::strcmp(argv[i], "--quick") == 0) {
+      cfg.min_seconds = 0.05;
+      cfg.rounds = 3;
+      cfg.grid = 4;
+    } else {
+      cfg.output = argv[i];
+    }
+  }
+
+  if (trace_path) trace::start();
+  ThreadPool pool;
+  Report report;
+  report.note("version", TERRAM_VERSION);
+  report.note("simd", to_string(detect_simd()));
+  report.note("threads", std::to_string(pool.size()));
+
+  bench_noise(cfg, report);
+  bench_biomes(cfg, report);
+  bench_caves(cfg, report);
+  bench_surface(cfg, report);
+  bench_fusion(cfg, report);
+  bench_generation(cfg, report, pool);
+  bench_cache(cfg, report);
+  bench_store(cfg, report);
+  bench_snapshot(cfg, report);
+  bench_query(cfg, report);
+  bench_stream(cfg, report);
+  bench_mesh(cfg, report);
+  bench_graph(cfg, report);
+  bench_program(cfg, report);
+
+  if (!report.write(cfg.output)) {
+    std::fprintf(stderr, "terram_bench: cannot write %s\n", cfg.output);
+    return 1;
+  }
+  if (trace_path) {
+    trace::stop();
+    if (!trace::write_json(trace_path)) {
+      std::fprintf(stderr, "terram_bench: cannot write %s\n", trace_path);
+      return 1;
+    }
+    Metrics::global().snapshot().write(std::cout);
+  }
+  return 0;
+}
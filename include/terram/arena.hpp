@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+#include "terram/types.hpp"
+
+namespace terram {
+
+/// Bump allocator for short-lived scratch buffers. Allocation is a pointer
+/// increment; nothing is freed individually, and reset() releases
+/// everything at once. When a run outgrows the current block, a larger one
+/// is chained on; the next reset() folds the chain into a single block of
+/// the combined size, so after warm-up a steady workload allocates nothing
+/// from the heap.
+///
+/// Not thread-safe; give each worker its own arena.
+class Arena {
+ public:
+  explicit Arena(std::size_t initial_bytes = std::size_t{256} << 10);
+  ~Arena();
+
+  Arena(const Arena&) = delete;
+  Arena& operator=(const Arena&) = delete;
+  Arena(Arena&& other) noexcept;
+  Arena& operator=(Arena&& other) noexcept;
+
+  /// `align` must be a power of two. Never returns null; throws
+  /// std::bad_alloc if a new block cannot be obtained.
+  void* allocate(std::size_t bytes, std::size_t align = alignof(std::max_align_t));
+
+  /// Uninitialised array of `count` T, cache-line aligned.
+  template <typename T>
+  T* allocate_array(std::size_t count) {
+    static_assert(std::is_trivially_destructible_v<T>,
+                  "arena memory is released without running destructors");
+    return static_cast<T*>(allocate(count * sizeof(T), alignof(T) > kCacheLine ? alignof(T)
+                                                                               : kCacheLine));
+  }
+
+  void reset();
+
+  /// Takes the arena's blocks, current and future, from NUMA node `node`'s
+  /// pool (see node_alloc()), for an arena that serves one pinned worker.
+  /// Drops what was allocated since the last reset().
+  void set_numa_node(int node);
+  /// -1 unless set_numa_node() was called.
+  int numa_node() const { return node_; }
+
+  /// Bytes handed out since the last reset.
+  std::size_t used() const { return used_; }
+  std::size_t capacity() const;
+  /// Largest used() seen between two resets.
+  std::size_t high_water() const { return high_water_; }
+  /// Blocks taken from the heap over the arena's lifetime.
+  std::uint64_t heap_allocations() const { return heap_allocations_; }
+
+ private:
+  struct Block {
+    char* data;
+    std::size_t size;
+    /// Pool the block came from, or -1 for the heap.
+    int node;
+  };
+
+  friend class ArenaScope;
+
+  void next_block(std::size_t min_bytes);
+  Block new_block(std::size_t bytes);
+  void release();
+
+  std::vector<Block> blocks_;
+  std::size_t current_ = 0;
+  std::size_t offset_ = 0;  // into blocks_[current_]
+  std::size_t used_ = 0;
+  std::size_t high_water_ = 0;
+  std::uint64_t heap_allocations_ = 0;
+  int node_ = -1;
+};
+
+/// Restores an arena to its current position on destruction, for scratch
+/// that should not outlive a scope inside a larger run.
+class ArenaScope {
+ public:
+  explicit ArenaScope(Arena& arena);
+  ~ArenaScope();
+
+  ArenaScope(const ArenaScope&) = delete;
+  ArenaScope& operator=(const ArenaScope&) = delete;
+
+ private:
+  Arena& arena_;
+  std::size_t current_;
+  std::size_t offset_;
+  std::size_t used_;
+};
+
+}  // namespace terram
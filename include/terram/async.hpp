@@ -0,0 +1,117 @@
+#pragma once
+
+#include <coroutine>
+#include <cstddef>
+#include <optional>
+#include <span>
+#include <utility>
+
+#include "terram/requests.hpp"
+
+namespace terram {
+
+// Coroutine front end to ChunkRequestQueue. Awaiting never blocks a thread:
+// the awaiting coroutine is resumed from the request's completion callback,
+// on the dispatcher thread of its priority class. Like a ChunkCallback,
+// what it then runs up to its next suspension delays that class's later
+// completions; a consumer that does more than hand a chunk on (say, to a
+// network send) should hop to its own executor first.
+//
+// These are plain awaitables with no promise type of their own, so they
+// work from any coroutine type that does not restrict await_transform.
+
+/// `co_await ChunkAwaitable(queue, request)` queues `request` and suspends
+/// until it completes. The request's callback and user are replaced.
+class ChunkAwaitable {
+ public:
+  ChunkAwaitable(ChunkRequestQueue& queue, const ChunkRequest& request)
+      : queue_(queue), request_(request) {}
+
+  bool await_ready() const noexcept { return false; }
+  bool await_suspend(std::coroutine_handle<> handle);
+  /// Throws std::runtime_error if the queue refused the request.
+  ChunkCompletion await_resume();
+
+ private:
+  static void complete(const ChunkCompletion& completion, void* user);
+
+  ChunkRequestQueue& queue_;
+  ChunkRequest request_;
+  std::coroutine_handle<> handle_;
+  ChunkCompletion completion_;
+  bool rejected_ = false;
+};
+
+/// Awaits the chunk at `c`, requested at `priority`.
+inline ChunkAwaitable request_chunk(ChunkRequestQueue& queue, ChunkCoord c,
+                                    Priority priority = Priority::Visible) {
+  return ChunkAwaitable(queue, ChunkRequest{.coord = c, .priority = priority});
+}
+
+struct ChunkStreamOptions {
+  Priority priority = Priority::Visible;
+  Deadline deadline = kNoDeadline;
+  /// Requests kept in flight. The dispatcher batches them, so a wider
+  /// window means larger generator batches; a narrower one, earlier first
+  /// chunks.
+  std::size_t window = 32;
+};
+
+/// Asynchronous stream of a region's chunks, in completion order, so a
+/// consumer sends each one while later ones are still generating:
+///
+///   ChunkStream stream(queue, coords);
+///   while (auto c = co_await stream.next()) send(*c);
+///
+/// The stream keeps `window` requests in flight and tops the window up from
+/// the completion callbacks. Each completion's tag is the index of its
+/// coord in `coords`. Only one coroutine may await next() at a time.
+class ChunkStream {
+  struct State;
+
+ public:
+  class Next {
+   public:
+    bool await_ready() const noexcept { return false; }
+    bool await_suspend(std::coroutine_handle<> handle);
+    /// The next completion, or nullopt once every coord has been answered.
+    std::optional<ChunkCompletion> await_resume() { return std::move(result_); }
+
+   private:
+    friend class ChunkStream;
+    friend struct ChunkStream::State;
+
+    explicit Next(State* state) : state_(state) {}
+
+    State* state_;
+    std::coroutine_handle<> handle_;
+    std::optional<ChunkCompletion> result_;
+  };
+
+  ChunkStream(ChunkRequestQueue& queue, std::span<const ChunkCoord> coords,
+              ChunkStreamOptions options = {});
+  /// Stops requesting. Requests in flight still complete, unseen; the
+  /// stream must not be destroyed while a coroutine awaits next().
+  ~ChunkStream();
+
+  ChunkStream(ChunkStream&& other) noexcept;
+  ChunkStream& operator=(ChunkStream&& other) noexcept;
+  ChunkStream(const ChunkStream&) = delete;
+  ChunkStream& operator=(const ChunkStream&) = delete;
+
+  /// Awaits the next completed chunk. Coords the queue refuses are requested
+  /// again as the stream's own requests complete; one refused while none are
+  /// in flight is answered at once, with `refused` set and a null chunk,
+  /// rather than waited on.
+  Next next() { return Next(state_); }
+
+  /// Coords in the stream.
+  std::size_t size() const;
+
+ private:
+  void release();
+
+  State* state_;
+};
+
+}  // namespace terram
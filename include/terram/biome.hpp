@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <span>
+#include <vector>
+
+#include "terram/chunk.hpp"
+#include "terram/noise.hpp"
+
+namespace terram {
+
+/// The biomes standard_biome() assigns. Tables built from other classifiers
+/// may use any BiomeId values.
+enum class Biome : BiomeId {
+  Ocean,
+  Beach,
+  Desert,
+  Savanna,
+  Rainforest,
+  Shrubland,
+  Grassland,
+  Forest,
+  Taiga,
+  Tundra,
+  Snow,
+  Rock,
+};
+
+inline constexpr int kBiomeCount = 12;
+
+const char* to_string(Biome biome);
+
+/// One dimension of a biome table: values in [min, max) fall into `bins`
+/// equal bins; values outside clamp to the first or last bin.
+struct BiomeAxis {
+  float min = -1.0f;
+  float max = 1.0f;
+  int bins = 16;
+};
+
+/// Biome classification precomputed over a temperature x moisture x height
+/// grid, so classifying a cell is three quantisations and a table load
+/// instead of a chain of comparisons. A height axis of one bin makes it a
+/// 2D table. Tables of a few KiB stay in L1 while a chunk is classified.
+class BiomeTable {
+ public:
+  using Classifier = std::function<BiomeId(float temperature, float moisture, float height)>;
+
+  /// Largest table, in cells.
+  static constexpr int kMaxCells = 1 << 16;
+
+  /// Evaluates `classify` at the centre of every bin. Throws
+  /// std::invalid_argument if an axis is empty or has more than 256 bins,
+  /// if min >= max, or if the table exceeds kMaxCells.
+  BiomeTable(BiomeAxis temperature, BiomeAxis moisture, BiomeAxis height,
+             const Classifier& classify);
+
+  const BiomeAxis& temperature() const { return axes_[0]; }
+  const BiomeAxis& moisture() const { return axes_[1]; }
+  const BiomeAxis& height() const { return axes_[2]; }
+
+  /// The classified bins, temperature fastest, then moisture, then height.
+  std::span<const BiomeId> cells() const {
+    return {cells_.data(), cells_.size() - kPadding};
+  }
+
+  /// Biome of one cell.
+  BiomeId lookup(float temperature, float moisture, float height) const;
+
+  /// out[i] = lookup(temperature[i], moisture[i], height[i]) for `count`
+  /// cells, on the instruction set noise_isa() selects (gathers on AVX2 and
+  /// AVX-512). Every path gives identical results.
+  void classify(const float* temperature, const float* moisture, const float* height,
+                int count, BiomeId* out) const;
+
+ private:
+  /// Gathers load four bytes at a time; the last cell's load stays inside
+  /// the allocation.
+  static constexpr std::size_t kPadding = 3;
+
+  BiomeAxis axes_[3];
+  float scale_[3];
+  std::vector<BiomeId> cells_;
+};
+
+/// Whittaker-style classification for the built-in terrain: ocean and
+/// beach by height, then by temperature and moisture, with rock and snow on
+/// high ground. Heights are relative to sea level; temperature and
+/// moisture are in roughly [-1, 1].
+BiomeId standard_biome(float temperature, float moisture, float height);
+
+/// standard_biome() over 16 x 16 temperature and moisture bins and 32
+/// height bins of four units from -8 (8 KiB). Built once and shared.
+std::shared_ptr<const BiomeTable> standard_biome_table();
+
+/// Inputs of the biomes stage (stages::biomes()).
+struct BiomeOptions {
+  /// Climate fields, each fBm from its own seed derived from the world's.
+  FbmParams temperature{1.0f / 2048.0f, 4, 2.0f, 0.5f, 1.0f, 0.0f};
+  FbmParams moisture{1.0f / 1024.0f, 4, 2.0f, 0.5f, 1.0f, 0.0f};
+  /// Heights are classified relative to this.
+  float sea_level = 0.0f;
+  /// Temperature drop per height unit above sea level.
+  float lapse_rate = 1.0f / 128.0f;
+  /// Null picks standard_biome_table().
+  std::shared_ptr<const BiomeTable> table;
+};
+
+}  // namespace terram
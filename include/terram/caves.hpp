@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+
+#include "terram/arena.hpp"
+#include "terram/chunk.hpp"
+#include "terram/noise.hpp"
+#include "terram/voxels.hpp"
+
+namespace terram {
+
+struct CaveOptions {
+  /// Two fBm fields whose zero sets are sheets; the tunnels are where both
+  /// are near zero. Each field's domain drifts with height by `shear`, so
+  /// the sheets are tilted and the tunnels wind through three dimensions.
+  FbmParams tunnels{1.0f / 128.0f, 2, 2.0f, 0.5f, 1.0f, 0.0f};
+  float shear = 0.75f;
+  /// Tunnel radius in field units; larger opens wider and more connected
+  /// caves.
+  float radius = 0.1f;
+  /// How far below the chunk's lowest surface cell the layer reaches.
+  int depth = 48;
+  /// Densities are distances to the surface, roughly in cells, divided by
+  /// this and clamped to [-1, 1]. Bricks further than `band` from the
+  /// surface are then uniform and stored as one value.
+  float band = 2.0f;
+};
+
+/// Builds the chunk's density volume: solid below the heightfield, minus a
+/// network of tunnels that may break through the surface into overhangs.
+/// Covers from `depth` below the lowest height to just above the highest.
+/// `first` and `second` drive the two tunnel fields. Temporary buffers
+/// come from `scratch`.
+void carve_caves(const SimplexNoise& first, const SimplexNoise& second, ChunkCoord coord,
+                 const TiledPlane<float>& height, const CaveOptions& options, Arena& scratch,
+                 BrickMap& out);
+
+}  // namespace terram
@@ -0,0 +1,261 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+#include "terram/memory.hpp"
+#include "terram/mesh_buffers.hpp"
+#include "terram/numa.hpp"
+#include "terram/types.hpp"
+#include "terram/voxels.hpp"
+
+namespace terram {
+
+/// One kChunkSize x kChunkSize plane of per-cell values, stored as
+/// kTileSize x kTileSize tiles in a single 64-byte aligned allocation.
+/// A tile of floats is 1 KiB and each of its rows is one cache line, so
+/// stencils over a tile and its neighbours stay resident in L1.
+///
+/// A plane can also borrow read-only memory in the same layout (a mapped
+/// region record, for instance) without copying it. Const access reads the
+/// borrowed cells in place; the first non-const access copies them into an
+/// owned allocation.
+///
+/// Owned cells come from the heap, or from a NUMA node's pool (see
+/// node_alloc()) for a plane placed on that node; copies stay on the
+/// source's node.
+template <typename T>
+class TiledPlane {
+  static_assert(std::is_trivially_copyable_v<T>);
+
+ public:
+  static constexpr std::size_t kBytes = sizeof(T) * kChunkCells;
+
+  TiledPlane() : owned_(allocate(-1)), data_(owned_.get()) { fill(T{}); }
+  /// Zeroed, on NUMA node `node`, or the heap for -1.
+  explicit TiledPlane(int node) : owned_(allocate(node)), data_(owned_.get()) { fill(T{}); }
+
+  /// Borrows `cells` (kChunkCells values in tiled order). `keepalive` owns
+  /// whatever backs them and is held for as long as they are borrowed.
+  TiledPlane(const T* cells, std::shared_ptr<const void> keepalive)
+      : keepalive_(std::move(keepalive)), data_(const_cast<T*>(cells)) {}
+
+  TiledPlane(const TiledPlane& other) : owned_(allocate(other.node())), data_(owned_.get()) {
+    copy_from(other);
+  }
+  TiledPlane& operator=(const TiledPlane& other) {
+    if (this != &other) copy_from(other);
+    return *this;
+  }
+  TiledPlane(TiledPlane&& other) noexcept
+      : owned_(std::move(other.owned_)),
+        keepalive_(std::move(other.keepalive_)),
+        data_(std::exchange(other.data_, nullptr)) {}
+  TiledPlane& operator=(TiledPlane&& other) noexcept {
+    owned_ = std::move(other.owned_);
+    keepalive_ = std::move(other.keepalive_);
+    data_ = std::exchange(other.data_, nullptr);
+    return *this;
+  }
+
+  T& at(int x, int z) { return mutable_data()[tiled_index(x, z)]; }
+  const T& at(int x, int z) const { return data_[tiled_index(x, z)]; }
+
+  /// First cell of tile (tx, tz); the tile's kTileCells cells follow
+  /// contiguously in row-major order.
+  T* tile(int tx, int tz) { return mutable_data() + (tz * kTilesPerSide + tx) * kTileCells; }
+  const T* tile(int tx, int tz) const {
+    return data_ + (tz * kTilesPerSide + tx) * kTileCells;
+  }
+
+  /// Row `row` of tile (tx, tz): kTileSize contiguous cells.
+  T* tile_row(int tx, int tz, int row) { return tile(tx, tz) + row * kTileSize; }
+  const T* tile_row(int tx, int tz, int row) const { return tile(tx, tz) + row * kTileSize; }
+
+  T* data() { return mutable_data(); }
+  const T* data() const { return data_; }
+  static constexpr std::size_t size() { return kChunkCells; }
+  static constexpr std::size_t size_bytes() { return kBytes; }
+
+  /// Whether the cells are borrowed rather than owned.
+  bool borrowed() const { return !owned_; }
+  /// Heap bytes owned by this plane; zero while borrowed.
+  std::size_t owned_bytes() const { return owned_ ? kBytes : 0; }
+  /// NUMA node the owned cells were placed on; -1 on the heap or borrowed.
+  int node() const { return owned_ ? owned_.get_deleter().node : -1; }
+
+  /// Moves owned cells to NUMA node `node`; borrowed cells stay in place.
+  /// Frees the old cells, so nothing may be reading them.
+  void move_to_node(int node) {
+    if (!owned_ || node < 0 || this->node() == node) return;
+    Storage moved = allocate(node);
+    std::copy(data_, data_ + kChunkCells, moved.get());
+    owned_ = std::move(moved);
+    data_ = owned_.get();
+  }
+
+  void fill(T value) {
+    T* d = mutable_data();
+    for (int i = 0; i < kChunkCells; ++i) d[i] = value;
+  }
+
+  void copy_from(const TiledPlane& other) {
+    T* d = mutable_data();
+    std::copy(other.data(), other.data() + kChunkCells, d);
+  }
+
+  /// Converts to/from a row-major kChunkSize x kChunkSize array with a row
+  /// stride of `stride` elements, for callers that want the flat layout.
+  void copy_to_row_major(T* out, std::size_t stride = kChunkSize) const {
+    for (int z = 0; z < kChunkSize; ++z) {
+      const int tz = z >> kTileShift;
+      const int row = z & (kTileSize - 1);
+      for (int tx = 0; tx < kTilesPerSide; ++tx) {
+        const T* src = tile_row(tx, tz, row);
+        std::copy(src, src + kTileSize, out + z * stride + tx * kTileSize);
+      }
+    }
+  }
+
+  void copy_from_row_major(const T* in, std::size_t stride = kChunkSize) {
+    for (int z = 0; z < kChunkSize; ++z) {
+      const int tz = z >> kTileShift;
+      const int row = z & (kTileSize - 1);
+      for (int tx = 0; tx < kTilesPerSide; ++tx) {
+        const T* src = in + z * stride + tx * kTileSize;
+        std::copy(src, src + kTileSize, tile_row(tx, tz, row));
+      }
+    }
+  }
+
+ private:
+  T* mutable_data() {
+    if (!owned_) {
+      owned_ = allocate(-1);
+      std::copy(data_, data_ + kChunkCells, owned_.get());
+      data_ = owned_.get();
+      keepalive_.reset();
+    }
+    return data_;
+  }
+
+  using Storage = std::unique_ptr<T[], NodeDeleter>;
+
+  static Storage allocate(int node) {
+    if (node < 0) return Storage(static_cast<T*>(aligned_alloc_bytes(kBytes)));
+    return Storage(static_cast<T*>(node_alloc(kBytes, node)), NodeDeleter{node, kBytes});
+  }
+
+  Storage owned_;
+  std::shared_ptr<const void> keepalive_;
+  T* data_ = nullptr;
+};
+
+/// Unit surface normal packed as two snorm16 components; y is implied
+/// positive, which always holds for a heightfield.
+struct PackedNormal {
+  std::int16_t x = 0;
+  std::int16_t z = 0;
+};
+
+inline PackedNormal pack_normal(float nx, float nz) {
+  auto q = [](float v) {
+    const float c = v < -1.0f ? -1.0f : (v > 1.0f ? 1.0f : v);
+    return static_cast<std::int16_t>(c * 32767.0f + (c < 0.0f ? -0.5f : 0.5f));
+  };
+  return {q(nx), q(nz)};
+}
+
+/// Biome of a cell; see biome.hpp.
+using BiomeId = std::uint8_t;
+
+/// A square chunk of terrain. Owns its planes; the heightfield and every
+/// pipeline stage address cells through the tiled layout. Once its last
+/// stage has run, a chunk the field has handed out is never written again.
+class Chunk {
+ public:
+  explicit Chunk(ChunkCoord coord) : coord_(coord) {}
+  Chunk(ChunkCoord coord, TiledPlane<float> height, int stage = 0)
+      : coord_(coord), stage_(stage), height_(std::move(height)) {}
+
+  Chunk(const Chunk&) = delete;
+  Chunk& operator=(const Chunk&) = delete;
+
+  /// Deep copy of every plane, mesh and volume, at `stage`. Edits change a
+  /// copy and publish it in place of the original, so whoever still holds
+  /// the original keeps reading it unchanged.
+  std::shared_ptr<Chunk> copy(int stage) const;
+
+  ChunkCoord coord() const { return coord_; }
+
+  /// Number of generation pipeline stages completed for this chunk.
+  int stage() const { return stage_.load(std::memory_order_acquire); }
+  void set_stage(int stage) { stage_.store(stage, std::memory_order_release); }
+
+  /// Access bit for CLOCK eviction: set on every cache hit, cleared by the
+  /// sweeping hand. Lock-free so hits never touch the cache's mutex.
+  void mark_accessed() { accessed_.store(true, std::memory_order_relaxed); }
+  bool clear_accessed() { return accessed_.exchange(false, std::memory_order_relaxed); }
+
+  /// NUMA node (see NumaTopology) the chunk's memory was placed on, or -1
+  /// until a worker places it. Later stages prefer workers on this node.
+  int home_node() const { return home_node_.load(std::memory_order_relaxed); }
+  /// Makes `node` the chunk's home: planes added from then on are placed
+  /// there. Called by the worker about to run a stage on it. Before any
+  /// stage has run, the owned planes hold nothing yet and move there too;
+  /// after, they stay where they are, like borrowed planes, as neighbours'
+  /// stages may be reading them.
+  void place_on_node(int node);
+
+  TiledPlane<float>& height() { return height_; }
+  const TiledPlane<float>& height() const { return height_; }
+
+  /// Surface normals, once a normals stage has produced them.
+  const TiledPlane<PackedNormal>* normals() const { return normals_.get(); }
+  TiledPlane<PackedNormal>& ensure_normals();
+  /// Replaces the normals, e.g. with a plane borrowing a snapshot.
+  void set_normals(TiledPlane<PackedNormal> normals);
+
+  /// Per-cell biomes, once a biomes stage has classified them.
+  const TiledPlane<BiomeId>* biomes() const { return biomes_.get(); }
+  TiledPlane<BiomeId>& ensure_biomes();
+  void set_biomes(TiledPlane<BiomeId> biomes);
+
+  /// Sparse 3D density (caves, overhangs), once a caves stage has built it.
+  const BrickMap* voxels() const { return voxels_.get(); }
+  BrickMap& ensure_voxels();
+
+  /// Render mesh, once a meshing stage has built it. Rebuilds reuse the
+  /// same buffers.
+  const MeshBuffers* mesh() const { return mesh_ ? &*mesh_ : nullptr; }
+  MeshBuffers& ensure_mesh();
+
+  /// Isosurface of the density volume, once a surface stage has built it.
+  const SurfaceMesh* surface() const { return surface_.get(); }
+  SurfaceMesh& ensure_surface();
+
+  /// Bytes of cell storage this chunk keeps resident, whether owned or
+  /// borrowed from a mapping (touched mapped pages count towards RSS too).
+  std::size_t memory_bytes() const;
+
+ private:
+  ChunkCoord coord_;
+  std::atomic<int> stage_{0};
+  std::atomic<bool> accessed_{true};
+  std::atomic<int> home_node_{-1};
+  TiledPlane<float> height_;
+  std::unique_ptr<TiledPlane<PackedNormal>> normals_;
+  std::unique_ptr<TiledPlane<BiomeId>> biomes_;
+  std::unique_ptr<BrickMap> voxels_;
+  // Inline: a fresh chunk's mesh then costs only its buffer's allocation.
+  std::optional<MeshBuffers> mesh_;
+  std::unique_ptr<SurfaceMesh> surface_;
+};
+
+}  // namespace terram
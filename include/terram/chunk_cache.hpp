@@ -0,0 +1,119 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "terram/chunk.hpp"
+#include "terram/heightfield.hpp"
+
+namespace terram {
+
+struct CacheStats {
+  std::uint64_t hits = 0;
+  std::uint64_t misses = 0;
+  std::uint64_t evictions = 0;
+  std::uint64_t evicted_bytes = 0;
+  std::size_t resident_chunks = 0;
+  std::size_t resident_bytes = 0;
+  std::size_t pinned_chunks = 0;
+  std::size_t budget_bytes = 0;
+};
+
+/// Byte-budgeted residency policy for a Heightfield. Every chunk that
+/// enters the field is charged against the budget; when the total goes
+/// over, a CLOCK hand sweeps the resident chunks, giving each one whose
+/// access bit is set a second chance and evicting the rest. Pinned chunks,
+/// including everything within a viewer's radius, are never evicted.
+///
+/// A hit costs one shared-locked map lookup and a relaxed store; the
+/// cache's own mutex is only taken on insertion, eviction and pinning.
+///
+/// A chunk is only measured when it is inserted and when its writer
+/// reports it resized (the scheduler does after every stage), never by the
+/// sweep: stage workers may be filling it in at any time.
+class ChunkCache final : public HeightfieldListener {
+ public:
+  /// Called for each evicted chunk before it leaves the field, e.g. to
+  /// write it back to a RegionStore. Runs without the cache lock held.
+  using EvictFn = std::function<void(const std::shared_ptr<Chunk>&)>;
+
+  ChunkCache(Heightfield& field, std::size_t budget_bytes);
+  ~ChunkCache() override;
+
+  ChunkCache(const ChunkCache&) = delete;
+  ChunkCache& operator=(const ChunkCache&) = delete;
+
+  /// Resident chunk at `c`, counting a hit or a miss.
+  std::shared_ptr<Chunk> lookup(ChunkCoord c);
+
+  std::size_t budget() const { return budget_.load(std::memory_order_relaxed); }
+  /// Bytes `chunk` counts against the budget.
+  static std::size_t charge(const Chunk& chunk);
+  /// Changes the budget and evicts down to it.
+  void set_budget(std::size_t bytes);
+  void set_evict_callback(EvictFn fn);
+
+  /// Pins nest; a chunk stays pinned until every pin is released. Pins may
+  /// be taken before the chunk is resident.
+  void pin(ChunkCoord c);
+  void unpin(ChunkCoord c);
+  bool pinned(ChunkCoord c) const;
+
+  /// Pins every chunk within `radius` chunks (square) of `center` for
+  /// viewer `id`, replacing that viewer's previous pins.
+  void set_viewer(std::uint32_t id, ChunkCoord center, int radius);
+  void remove_viewer(std::uint32_t id);
+
+  /// Evicts until the resident bytes fit the budget. Returns the number
+  /// of chunks evicted.
+  std::size_t trim();
+
+  CacheStats stats() const;
+
+  void on_insert(const std::shared_ptr<Chunk>& chunk) override;
+  void on_erase(ChunkCoord coord) override;
+  /// Recharges a resident chunk. The next insertion or trim evicts for it.
+  void on_resize(const std::shared_ptr<Chunk>& chunk) override;
+
+ private:
+  struct Entry {
+    std::shared_ptr<Chunk> chunk;
+    std::size_t charged = 0;
+  };
+  struct Viewer {
+    ChunkCoord center;
+    int radius;
+  };
+
+  void remove_slot_locked(std::size_t slot);
+  void pin_locked(ChunkCoord c, int delta);
+  void pin_square_locked(const Viewer& v, int delta);
+  /// Picks victims under the lock; the caller evicts them after unlocking.
+  std::vector<Entry> select_victims_locked();
+  std::size_t evict(std::vector<Entry> victims);
+
+  Heightfield& field_;
+  std::atomic<std::size_t> budget_;
+  EvictFn on_evict_;
+
+  mutable std::mutex mutex_;
+  std::vector<Entry> ring_;
+  std::unordered_map<ChunkCoord, std::size_t, ChunkCoordHash> slots_;
+  std::unordered_map<ChunkCoord, int, ChunkCoordHash> pins_;
+  std::unordered_map<std::uint32_t, Viewer> viewers_;
+  std::size_t hand_ = 0;
+  std::size_t resident_bytes_ = 0;
+
+  std::atomic<std::uint64_t> hits_{0};
+  std::atomic<std::uint64_t> misses_{0};
+  std::atomic<std::uint64_t> evictions_{0};
+  std::atomic<std::uint64_t> evicted_bytes_{0};
+};
+
+}  // namespace terram
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <span>
+#include <unordered_set>
+#include <vector>
+
+#include "terram/heightfield.hpp"
+#include "terram/scheduler.hpp"
+#include "terram/types.hpp"
+
+namespace terram {
+
+/// Half-open rectangle of world cells, [x0, x1) x [z0, z1).
+struct CellRect {
+  std::int64_t x0 = 0;
+  std::int64_t z0 = 0;
+  std::int64_t x1 = 0;
+  std::int64_t z1 = 0;
+
+  bool empty() const { return x1 <= x0 || z1 <= z0; }
+  /// Every chunk with at least one cell inside the rectangle.
+  std::vector<ChunkCoord> chunks() const;
+};
+
+/// A height edit: `apply` is called once for every cell inside `bounds`
+/// with the cell's world coordinate and its height.
+struct Edit {
+  CellRect bounds;
+  std::function<void(std::int64_t wx, std::int64_t wz, float& height)> apply;
+};
+
+namespace brushes {
+
+/// Raises (or, with negative `amount`, lowers) a smooth round mound.
+Edit raise(double x, double z, double radius, float amount);
+/// Moves heights within `radius` towards `level` by `strength` in [0, 1].
+Edit flatten(double x, double z, double radius, float level, float strength);
+/// A bowl of `depth` with a raised rim, like an impact crater.
+Edit crater(double x, double z, double radius, float depth);
+
+}  // namespace brushes
+
+/// Tracks chunks whose derived stages are stale after edits. Marking an
+/// edited chunk replaces every resident chunk whose derived output depends
+/// on it with a copy rolled back to the stage it must rerun from: the
+/// chunk itself from the first derived stage, and for each later
+/// neighbour-reading stage, the one-ring of whatever that stage's input
+/// invalidated. A chunk then reruns only the stages it actually needs,
+/// either on its next access or in one regeneration batch over everything
+/// pending().
+class DirtyTracker {
+ public:
+  explicit DirtyTracker(const Pipeline& pipeline);
+
+  /// Call with the scheduler held exclusive, after `edited`'s heights changed.
+  void mark_edited(Heightfield& field, std::span<const ChunkCoord> edited);
+
+  std::size_t size() const;
+  /// Removes and returns every chunk marked since the last call.
+  std::vector<ChunkCoord> take();
+
+ private:
+  std::vector<bool> reads_neighbors_;  // per stage
+  int first_derived_;
+
+  mutable std::mutex mutex_;
+  std::unordered_set<ChunkCoord, ChunkCoordHash> pending_;
+};
+
+}  // namespace terram
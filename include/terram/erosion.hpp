@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+#include "terram/arena.hpp"
+#include "terram/chunk.hpp"
+#include "terram/heightfield.hpp"
+
+namespace terram {
+
+/// Grid-based hydraulic erosion (virtual-pipe water model, Mei et al. 2007)
+/// followed by thermal weathering, per iteration. Rates are per iteration
+/// with a cell spacing of one.
+struct ErosionParams {
+  int iterations = 20;
+  float dt = 0.05f;
+  /// Water added per cell per unit time, on average.
+  float rain = 0.02f;
+  /// Each cell's rainfall is rain * (1 + variation * r) for a fixed random
+  /// r in [-1, 1) drawn from `seed` and the cell's chunk (see ChunkRandom).
+  float rain_variation = 0.25f;
+  /// World sets this to WorldOptions::seed.
+  std::uint64_t seed = 0;
+  float evaporation = 0.05f;
+  /// Pipe cross-section times gravity over pipe length.
+  float pipe = 20.0f;
+  /// Sediment capacity per unit of water depth, speed and slope.
+  float capacity = 1.5f;
+  float dissolving = 0.3f;
+  float deposition = 0.3f;
+  /// Lower bound on the slope term, so flat water still carries sediment.
+  float min_slope = 0.05f;
+  /// Largest stable height difference between neighbours.
+  float talus = 1.2f;
+  float thermal_rate = 0.1f;
+  /// Simulated ghost cells around the chunk. 0 picks the exact width, three
+  /// cells per iteration plus one, so seams are exact at any iteration
+  /// count; a wider halo is capped to it. A narrower one trades seam
+  /// accuracy for speed.
+  int halo = 0;
+  /// Chunks of pre-erosion heights stages::erosion() keeps for the
+  /// neighbours that read them again (see cached_source()), at 16 KiB each
+  /// outside the cache budget; 0 regenerates them every time.
+  std::size_t source_cache = 512;
+};
+
+/// Ghost-zone width erode() uses for `params`.
+int erosion_halo(const ErosionParams& params);
+
+/// Writes the pre-erosion heights of the chunk at a coordinate into
+/// kChunkCells floats in the tiled layout. Must be a pure function of the
+/// coordinate, e.g. regenerating them from the seed.
+using HeightSource = std::function<void(ChunkCoord, float*)>;
+
+/// `source` behind a thread-safe cache of the last `chunks` chunks it
+/// wrote, oldest out first, allocated on the first call. Erosion reads
+/// each chunk's heights once per chunk whose halo it overlaps, nine times
+/// or more; this generates them once. Plain `source` if `chunks` is 0.
+HeightSource cached_source(HeightSource source, std::size_t chunks);
+
+/// Erodes the chunk at `center`, writing its new heights to `out`. The
+/// simulation covers the chunk plus a halo, with the input heights of the
+/// chunk and the neighbours the halo overlaps taken from `source`, all as
+/// structure-of-arrays fields in `scratch`. Information travels at most
+/// three cells per iteration, so with the exact halo the centre never sees
+/// the domain edge and every chunk computes the same values a whole-world
+/// simulation would: erosion runs as independent chunk tasks with no
+/// exchange between iterations, and borders match bit for bit. Since the
+/// input never comes from other chunks' planes, the result also does not
+/// depend on which neighbours were generated, eroded, evicted or edited
+/// first.
+void erode(ChunkCoord center, const HeightSource& source, const ErosionParams& params,
+           Arena& scratch, TiledPlane<float>& out);
+
+}  // namespace terram
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+
+#include "terram/chunk.hpp"
+
+namespace terram {
+
+/// 64-bit content hash of `size` bytes. Stable across platforms and
+/// releases of the same format, so it can be checked into golden files.
+std::uint64_t hash_bytes(const void* data, std::size_t size, std::uint64_t seed = 0);
+
+/// Hash of a chunk's coordinate, stage count and the bit patterns of its
+/// heights, plus its normals, biomes, voxels and mesh when present.
+std::uint64_t hash_chunk(const Chunk& chunk);
+
+/// Combines chunk hashes in coordinate order (z, then x), whatever order
+/// `chunks` lists them in, so a world hash does not depend on how requests
+/// were batched or which worker finished first.
+std::uint64_t hash_chunks(std::span<const std::shared_ptr<Chunk>> chunks);
+
+}  // namespace terram
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <shared_mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "terram/chunk.hpp"
+#include "terram/types.hpp"
+
+namespace terram {
+
+/// A chunk together with its one-ring of neighbours, for stencils that read
+/// across chunk borders. Missing neighbours are null; reads that land in a
+/// missing chunk clamp to the centre chunk's edge.
+class ChunkNeighborhood {
+ public:
+  ChunkNeighborhood() = default;
+
+  /// Neighbour at offset (dx, dz) in [-1, 1]; (0, 0) is the centre. Read
+  /// through a const neighbourhood, chunks are const too: a non-const
+  /// plane read copies a borrowed plane out of its mapping.
+  Chunk* at(int dx, int dz) { return chunks_[(dz + 1) * 3 + (dx + 1)]; }
+  const Chunk* at(int dx, int dz) const { return chunks_[(dz + 1) * 3 + (dx + 1)]; }
+  void set(int dx, int dz, Chunk* c) { chunks_[(dz + 1) * 3 + (dx + 1)] = c; }
+  Chunk* center() { return at(0, 0); }
+  const Chunk* center() const { return at(0, 0); }
+  bool complete() const;
+
+  /// Height at local cell (x, z) of the centre chunk, where x and z may lie
+  /// anywhere in [-kChunkSize, 2 * kChunkSize).
+  float height(int x, int z) const;
+
+ private:
+  std::array<Chunk*, 9> chunks_{};
+};
+
+/// Observes chunks entering and leaving a Heightfield. Callbacks run on the
+/// mutating thread after the map lock is released.
+class HeightfieldListener {
+ public:
+  virtual ~HeightfieldListener() = default;
+  virtual void on_insert(const std::shared_ptr<Chunk>& chunk) = 0;
+  virtual void on_erase(ChunkCoord coord) = 0;
+  /// `chunk`'s memory changed. Called on the thread that changed it.
+  virtual void on_resize(const std::shared_ptr<Chunk>& chunk) = 0;
+};
+
+/// The resident set of chunks that make up a world. Chunks are shared so a
+/// reader can keep one alive while the map moves on. Thread-safe; lookups
+/// take a shared lock.
+class Heightfield {
+ public:
+  Heightfield() = default;
+  Heightfield(const Heightfield&) = delete;
+  Heightfield& operator=(const Heightfield&) = delete;
+
+  std::shared_ptr<Chunk> find(ChunkCoord c) const;
+  /// Returns the chunk at `c`, creating a zero-height one if absent.
+  std::shared_ptr<Chunk> get_or_create(ChunkCoord c);
+  /// Inserts `chunk`, replacing any chunk already at its coordinate.
+  void insert(std::shared_ptr<Chunk> chunk);
+  bool erase(ChunkCoord c);
+  /// Erases the chunk at `c` only if it is still `expected`.
+  bool erase_if_same(ChunkCoord c, const Chunk* expected);
+  void clear();
+  /// Tells the listener that `chunk` grew or shrank. A chunk's writer calls
+  /// this once done with it, so the listener never reads it mid-write.
+  void resized(const std::shared_ptr<Chunk>& chunk);
+
+  /// At most one listener; null detaches. Set before the map is shared.
+  void set_listener(HeightfieldListener* listener) { listener_ = listener; }
+
+  std::size_t size() const;
+  std::size_t memory_bytes() const;
+  std::vector<ChunkCoord> coords() const;
+
+  /// Height at world cell (wx, wz), or nullopt if its chunk is not resident.
+  std::optional<float> height_at(std::int64_t wx, std::int64_t wz) const;
+  /// Bilinearly interpolated height at world position (x, z), in cells.
+  std::optional<float> sample(double x, double z) const;
+
+  /// The chunk at `c` and whichever of its eight neighbours are resident.
+  /// The pointers stay valid while the returned owners are held.
+  ChunkNeighborhood neighborhood(ChunkCoord c,
+                                 std::array<std::shared_ptr<Chunk>, 9>* owners = nullptr) const;
+
+ private:
+  HeightfieldListener* listener_ = nullptr;
+  mutable std::shared_mutex mutex_;
+  std::unordered_map<ChunkCoord, std::shared_ptr<Chunk>, ChunkCoordHash> chunks_;
+};
+
+}  // namespace terram
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+namespace terram {
+
+enum class IoBackend : std::uint8_t {
+  Threads,
+  IoUring,
+};
+
+const char* to_string(IoBackend backend);
+
+struct IoQueueOptions {
+  /// Submission ring entries for io_uring, rounded up to a power of two.
+  /// Operations beyond what the rings hold wait in a backlog.
+  unsigned entries = 256;
+  /// Workers of the thread backend.
+  unsigned threads = 4;
+  /// Use the thread backend even where io_uring works. TERRAM_IO=threads
+  /// in the environment does the same.
+  bool force_threads = false;
+};
+
+/// Result of one operation: bytes transferred, or -errno.
+using IoCompletion = std::function<void(std::int64_t result)>;
+
+/// Batched asynchronous file I/O, so callers hand reads, writes and syncs
+/// off without waiting on the disk. On Linux it drives io_uring through
+/// the raw syscalls: queued operations enter the submission ring and
+/// submit() issues the whole batch with one io_uring_enter(), with up to
+/// `entries` operations in flight. Where io_uring is missing or blocked
+/// (old kernels, seccomp, other systems) a few I/O threads run the same
+/// operations with pread() / pwrite(). Short transfers are resumed, so
+/// completions report the full byte count or an error.
+///
+/// Completions run in no particular order, and must not throw; they may
+/// queue and submit further operations. They run on an I/O thread, or on
+/// the caller's, inside submit(), drain() or the destructor, when io_uring
+/// reaps to make room in a full ring: never submit while holding a lock a
+/// completion takes. Buffers must stay valid until their operation
+/// completes. Thread-safe.
+class IoQueue {
+ public:
+  explicit IoQueue(IoQueueOptions options = {});
+  /// Waits for every queued operation.
+  ~IoQueue();
+
+  IoQueue(const IoQueue&) = delete;
+  IoQueue& operator=(const IoQueue&) = delete;
+
+  IoBackend backend() const;
+
+  void read(int fd, void* data, std::size_t bytes, std::uint64_t offset, IoCompletion done);
+  void write(int fd, const void* data, std::size_t bytes, std::uint64_t offset,
+             IoCompletion done);
+  /// fdatasync(fd).
+  void sync(int fd, IoCompletion done);
+  /// POSIX_FADV_WILLNEED over the range: starts reading it into the page
+  /// cache.
+  void advise(int fd, std::uint64_t offset, std::size_t bytes, IoCompletion done = {});
+
+  /// Issues every operation queued since the last submit(). May run
+  /// completions on the calling thread.
+  void submit();
+  /// Submits, then waits until every operation, including ones queued by
+  /// completions, has completed.
+  void drain();
+  /// Operations queued and not yet completed.
+  std::size_t pending() const;
+
+  struct Op;
+  class Backend;
+
+ private:
+  void queue(std::unique_ptr<Op> op);
+  void finish(Op* op, std::int64_t result);
+
+  std::unique_ptr<Backend> backend_;
+  mutable std::mutex mutex_;
+  std::condition_variable idle_;
+  std::size_t pending_ = 0;
+};
+
+}  // namespace terram
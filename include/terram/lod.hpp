@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+#include "terram/chunk.hpp"
+#include "terram/types.hpp"
+
+namespace terram {
+
+class World;
+
+/// Levels are capped so a level-L tile's chunk span, 2^L, stays small.
+inline constexpr int kMaxLodLevels = 16;
+
+/// A node of the LOD quadtree: at `level`, `coord` counts tiles of
+/// 2^level x 2^level full-resolution chunks, and each of the tile's 64x64
+/// samples covers 2^level x 2^level cells. Level 0 is the chunk grid.
+struct LodKey {
+  int level = 0;
+  ChunkCoord coord;
+
+  bool operator==(const LodKey&) const = default;
+
+  LodKey parent() const { return {level + 1, {coord.x >> 1, coord.z >> 1}}; }
+  LodKey child(int qx, int qz) const {
+    return {level - 1, {coord.x * 2 + qx, coord.z * 2 + qz}};
+  }
+  /// World cells along one side of the tile.
+  std::int64_t size_cells() const { return std::int64_t{kChunkSize} << level; }
+  /// World cell of the tile's first sample.
+  std::int64_t origin_x() const { return static_cast<std::int64_t>(coord.x) * size_cells(); }
+  std::int64_t origin_z() const { return static_cast<std::int64_t>(coord.z) * size_cells(); }
+};
+
+struct LodKeyHash {
+  std::size_t operator()(const LodKey& k) const noexcept {
+    return ChunkCoordHash{}(k.coord) ^ (static_cast<std::size_t>(k.level) * 0x9e3779b97f4a7c15ull);
+  }
+};
+
+/// The tile of LOD node `key`: sample (x, z) is the height at world cell
+/// (origin + x * 2^level, origin + z * 2^level).
+struct LodTile {
+  LodKey key;
+  TiledPlane<float> height;
+  /// Built from generated chunks (level 0) or from four exact children
+  /// (box filtered). Otherwise synthesized straight from the terrain noise:
+  /// the right shape, but missing later stages and edits.
+  bool exact = false;
+  float min_height = 0.0f;
+  float max_height = 0.0f;
+};
+
+struct LodOptions {
+  int levels = 6;
+  /// Tiles kept resident before the least recently used are dropped.
+  std::size_t max_tiles = 4096;
+  /// A node is split while the viewer is closer than this many node sizes.
+  double split_distance = 1.5;
+};
+
+/// Quadtree of downsampled heightfields over a World. Coarse tiles come
+/// straight from the noise at their sampling rate, so distant terrain never
+/// generates full-resolution chunks; as level-0 tiles are generated near a
+/// viewer, their ancestors are rebuilt from the real data. Thread-safe.
+class LodPyramid {
+ public:
+  LodPyramid(World& world, LodOptions options = {});
+
+  LodPyramid(const LodPyramid&) = delete;
+  LodPyramid& operator=(const LodPyramid&) = delete;
+
+  const LodOptions& options() const { return options_; }
+
+  /// The tile for `key`, building it if needed. Level 0 generates the
+  /// chunk through the world; coarser levels filter four cached children
+  /// when all are exact and synthesize otherwise.
+  std::shared_ptr<const LodTile> tile(LodKey key);
+  /// The cached tile, or null; never builds.
+  std::shared_ptr<const LodTile> find(LodKey key) const;
+
+  /// The leaves of a quadtree refined around viewer (x, z), covering the
+  /// square of half-width `radius` cells. Nodes split by distance, so the
+  /// result runs from level 0 under the viewer to coarse tiles far away.
+  std::vector<LodKey> select(double x, double z, double radius) const;
+
+  /// Drops the level-0 tiles of `chunks` and every ancestor, e.g. after
+  /// World::apply() edited them.
+  void invalidate(std::span<const ChunkCoord> chunks);
+
+  std::size_t size() const;
+
+ private:
+  struct Entry {
+    std::shared_ptr<const LodTile> tile;
+    std::uint64_t last_used = 0;
+  };
+
+  std::shared_ptr<const LodTile> build(LodKey key);
+  std::shared_ptr<const LodTile> insert(std::shared_ptr<LodTile> tile);
+  void evict_locked();
+
+  World& world_;
+  LodOptions options_;
+  mutable std::mutex mutex_;
+  std::unordered_map<LodKey, Entry, LodKeyHash> tiles_;
+  std::uint64_t clock_ = 0;
+};
+
+}  // namespace terram
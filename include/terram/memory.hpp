@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <new>
+
+#include "terram/types.hpp"
+
+namespace terram {
+
+/// Allocates `bytes` rounded up to a multiple of `align`. Throws
+/// std::bad_alloc on failure.
+void* aligned_alloc_bytes(std::size_t bytes, std::size_t align = kCacheLine);
+void aligned_free(void* p) noexcept;
+
+struct AlignedDeleter {
+  void operator()(void* p) const noexcept { aligned_free(p); }
+};
+
+template <typename T>
+using AlignedArray = std::unique_ptr<T[], AlignedDeleter>;
+
+/// Uninitialised, cache-line aligned array of `count` trivially copyable T.
+template <typename T>
+AlignedArray<T> make_aligned_array(std::size_t count) {
+  return AlignedArray<T>(static_cast<T*>(aligned_alloc_bytes(count * sizeof(T))));
+}
+
+}  // namespace terram
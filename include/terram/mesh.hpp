@@ -0,0 +1,51 @@
+#pragma once
+
+#include "terram/arena.hpp"
+#include "terram/heightfield.hpp"
+#include "terram/lod.hpp"
+#include "terram/mesh_buffers.hpp"
+
+namespace terram {
+
+/// Samples per side of a mesh grid: a chunk's cells plus the first row and
+/// column of its +x / +z neighbours, so adjacent meshes share edges.
+inline constexpr int kMeshGrid = kChunkSize + 1;
+
+struct MeshOptions {
+  /// Split threshold, in height units: a triangle is split while the
+  /// interpolation error at its hypotenuse midpoint, or at any midpoint
+  /// below it in the hierarchy, exceeds this. Other cells are not checked,
+  /// so it bounds the error closely but not strictly.
+  float max_error = 0.5f;
+  /// Depth of the skirts hung from the mesh border. Skirts cover the gaps
+  /// where a neighbour, at the same or another level of detail, kept a
+  /// different set of border vertices. 0 picks four times the mesh's own
+  /// scaled bound, max_error * 2^level * 4, so the coarser side of a seam
+  /// hangs the deeper skirt.
+  float skirt_depth = 0.0f;
+};
+
+/// Right-triangulated irregular network (RTIN) mesher: the grid is split
+/// recursively along the hypotenuse of right isosceles triangles wherever
+/// the midpoint's error exceeds the bound, so flat ground takes a handful
+/// of triangles and detail goes where the relief is. Errors are computed
+/// bottom-up once per call; all scratch comes from `scratch`.
+///
+/// `grid` is row-major kMeshGrid x kMeshGrid; vertices are spaced
+/// `cell_size` apart. `out` is cleared first and keeps its capacity.
+/// Triangles wind counter-clockwise seen from +y.
+void build_mesh(const float* grid, float cell_size, float max_error, float skirt_depth,
+                Arena& scratch, MeshBuffers& out);
+
+/// build_mesh() over a chunk, taking the extra row and column from its
+/// neighbours (clamped at the edge where a neighbour is missing).
+void mesh_chunk(const ChunkNeighborhood& neighbors, const MeshOptions& options, Arena& scratch,
+                MeshBuffers& out);
+
+/// build_mesh() over a LOD tile in tile-local cells: sample spacing and
+/// error bound both scale with 2^level. Border samples come from the
+/// cached +x / +z neighbour tiles at the same level, if any.
+void mesh_lod_tile(const LodPyramid& pyramid, const LodTile& tile, const MeshOptions& options,
+                   Arena& scratch, MeshBuffers& out);
+
+}  // namespace terram
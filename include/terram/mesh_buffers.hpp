@@ -0,0 +1,120 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <span>
+#include <utility>
+#include <vector>
+
+namespace terram {
+
+/// Position in chunk-local cells scaled by the mesh's cell size; y is the
+/// height.
+struct MeshVertex {
+  float x;
+  float y;
+  float z;
+};
+
+/// Vertex and 16-bit index buffers of one chunk mesh (a 65x65 grid plus
+/// skirts always fits), held in one allocation: the vertices, then the
+/// indices. Rebuilding reuses the allocation whenever the new mesh fits,
+/// so its capacity carries over from frame to frame.
+class MeshBuffers {
+ public:
+  std::span<const MeshVertex> vertices() const {
+    return {reinterpret_cast<const MeshVertex*>(storage_.data()), vertex_count_};
+  }
+  std::span<const std::uint16_t> indices() const {
+    return {reinterpret_cast<const std::uint16_t*>(storage_.data() + index_offset()),
+            index_count_};
+  }
+
+  /// Replaces the mesh with copies of `vertices` and `indices`.
+  void assign(std::span<const MeshVertex> vertices, std::span<const std::uint16_t> indices) {
+    vertex_count_ = vertices.size();
+    index_count_ = indices.size();
+    const std::size_t bytes = index_offset() + indices.size_bytes();
+    if (storage_.size() < bytes) storage_.resize(bytes);
+    if (!vertices.empty()) std::memcpy(storage_.data(), vertices.data(), vertices.size_bytes());
+    if (!indices.empty()) {
+      std::memcpy(storage_.data() + index_offset(), indices.data(), indices.size_bytes());
+    }
+  }
+
+  void clear() { vertex_count_ = index_count_ = 0; }
+  std::size_t triangle_count() const { return index_count_ / 3; }
+  std::size_t capacity_bytes() const { return storage_.capacity(); }
+
+ private:
+  std::size_t index_offset() const { return vertex_count_ * sizeof(MeshVertex); }
+
+  std::vector<std::byte> storage_;
+  std::size_t vertex_count_ = 0;
+  std::size_t index_count_ = 0;
+};
+
+/// Isosurface vertex in chunk-local cells (y is the absolute height), with
+/// the unit normal pointing out of the solid.
+struct SurfaceVertex {
+  float x;
+  float y;
+  float z;
+  float nx;
+  float ny;
+  float nz;
+};
+
+/// Vertex and 32-bit index buffers of a chunk's isosurface: caves can
+/// take far more vertices than a 16-bit index reaches. Like MeshBuffers,
+/// rebuilding only clears them.
+struct SurfaceMesh {
+  std::vector<SurfaceVertex> vertices;
+  std::vector<std::uint32_t> indices;
+
+  void clear() {
+    vertices.clear();
+    indices.clear();
+  }
+  std::size_t triangle_count() const { return indices.size() / 3; }
+  std::size_t capacity_bytes() const {
+    return vertices.capacity() * sizeof(SurfaceVertex) +
+           indices.capacity() * sizeof(std::uint32_t);
+  }
+};
+
+/// Free list of MeshBuffers for callers that mesh many tiles per frame:
+/// buffers released after upload are handed back out with their capacity
+/// intact. Thread-safe.
+class MeshBufferPool {
+ public:
+  explicit MeshBufferPool(std::size_t max_free = 256) : max_free_(max_free) {}
+
+  MeshBuffers acquire() {
+    std::lock_guard lock(mutex_);
+    if (free_.empty()) return {};
+    MeshBuffers buffers = std::move(free_.back());
+    free_.pop_back();
+    return buffers;
+  }
+
+  void release(MeshBuffers buffers) {
+    buffers.clear();
+    std::lock_guard lock(mutex_);
+    if (free_.size() < max_free_) free_.push_back(std::move(buffers));
+  }
+
+  std::size_t free_count() const {
+    std::lock_guard lock(mutex_);
+    return free_.size();
+  }
+
+ private:
+  std::size_t max_free_;
+  mutable std::mutex mutex_;
+  std::vector<MeshBuffers> free_;
+};
+
+}  // namespace terram
@@ -0,0 +1,183 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "terram/types.hpp"
+
+namespace terram {
+
+/// Stripes per metric. Threads are spread over them round-robin, so
+/// updates from different threads rarely share a cache line; reads sum
+/// every stripe.
+inline constexpr int kMetricShards = 16;
+/// Histogram bucket b > 0 counts values in [2^(b-1), 2^b); bucket 0 counts
+/// zero. With nanoseconds the top bucket starts at about nine minutes.
+inline constexpr int kHistogramBuckets = 41;
+
+namespace detail {
+/// The calling thread's stripe.
+unsigned metric_shard();
+}  // namespace detail
+
+/// Monotonic nanoseconds, the time base of histograms and traces.
+std::uint64_t now_ns();
+
+class Counter {
+ public:
+  void add(std::uint64_t n = 1) {
+    shards_[detail::metric_shard()].value.fetch_add(n, std::memory_order_relaxed);
+  }
+  std::uint64_t value() const;
+
+ private:
+  struct alignas(kCacheLine) Shard {
+    std::atomic<std::uint64_t> value{0};
+  };
+  std::array<Shard, kMetricShards> shards_;
+};
+
+struct HistogramSnapshot {
+  std::uint64_t count = 0;
+  std::uint64_t sum = 0;
+  std::uint64_t max = 0;
+  std::array<std::uint64_t, kHistogramBuckets> buckets{};
+
+  double mean() const {
+    return count ? static_cast<double>(sum) / static_cast<double>(count) : 0.0;
+  }
+  /// Upper bound of the bucket holding quantile `q` in [0, 1], capped at
+  /// max: within a factor of two of the true value.
+  std::uint64_t quantile(double q) const;
+};
+
+/// Log2-bucketed distribution, by convention of durations in nanoseconds.
+class Histogram {
+ public:
+  void record(std::uint64_t value);
+  HistogramSnapshot snapshot() const;
+
+ private:
+  struct alignas(kCacheLine) Shard {
+    std::atomic<std::uint64_t> count{0};
+    std::atomic<std::uint64_t> sum{0};
+    std::atomic<std::uint64_t> max{0};
+    std::array<std::atomic<std::uint64_t>, kHistogramBuckets> buckets{};
+  };
+  std::array<Shard, kMetricShards> shards_;
+};
+
+struct MetricsSnapshot {
+  std::vector<std::pair<std::string, std::uint64_t>> counters;
+  std::vector<std::pair<std::string, HistogramSnapshot>> histograms;
+
+  /// One line per metric: counters as values, histograms as count, mean,
+  /// p50, p99 and max.
+  void write(std::ostream& out) const;
+};
+
+/// Process-wide named metrics, sorted by name. Lookups lock; instrumented
+/// code looks its metrics up once and keeps the references, which stay
+/// valid for the life of the process. Updates are a relaxed atomic add on
+/// the calling thread's stripe.
+///
+/// Library metrics, with durations in nanoseconds:
+///   stage.<name>              histogram per pipeline stage, per chunk
+///   scheduler.batch           histogram of generate() wall time
+///   scheduler.tasks, .preemptions, .cancelled
+///   cache.hits, .misses, .evictions
+///   requests.latency          histogram, request() to completion
+///   requests.accepted, .rejected, .cancelled
+///   io.read, io.write, io.sync, io.advise
+///                             histograms, queued to completed
+///   io.read_bytes, io.write_bytes, io.errors
+class Metrics {
+ public:
+  static Metrics& global();
+
+  Counter& counter(std::string_view name);
+  Histogram& histogram(std::string_view name);
+
+  MetricsSnapshot snapshot() const;
+
+ private:
+  mutable std::mutex mutex_;
+  std::map<std::string, std::unique_ptr<Counter>, std::less<>> counters_;
+  std::map<std::string, std::unique_ptr<Histogram>, std::less<>> histograms_;
+};
+
+/// Chrome trace recording ("Trace Event Format"), loadable by
+/// chrome://tracing and ui.perfetto.dev. Off by default; while off, a
+/// traced scope costs one relaxed load. Each thread appends to its own
+/// buffer, so recording takes no lock.
+namespace trace {
+
+/// Starts a new recording, discarding the previous one. Each thread keeps
+/// up to `events_per_thread` events and drops the rest.
+void start(std::size_t events_per_thread = std::size_t{1} << 16);
+void stop();
+
+namespace detail {
+extern std::atomic<bool> g_enabled;
+}
+inline bool enabled() { return detail::g_enabled.load(std::memory_order_relaxed); }
+
+/// Stable copy of `name` for events; interning the same name twice
+/// returns the same pointer.
+const char* intern(std::string_view name);
+
+/// Records a complete event. `name` and `category` must outlive the
+/// recording: literals or intern() results. A chunk coordinate, if given,
+/// is shown as the event's arguments.
+void complete(const char* name, const char* category, std::uint64_t start_ns,
+              std::uint64_t duration_ns, const ChunkCoord* chunk = nullptr);
+
+/// Writes the recording so far. Call after stop(), or at least not
+/// concurrently with start().
+void write_json(std::ostream& out);
+/// Returns false if the file cannot be written.
+bool write_json(const std::filesystem::path& path);
+
+/// Events dropped because a thread's buffer was full.
+std::uint64_t dropped();
+
+}  // namespace trace
+
+/// Times a scope into a histogram (if not null) and, while tracing, a
+/// trace event.
+class ScopedTimer {
+ public:
+  ScopedTimer(Histogram* histogram, const char* name, const char* category,
+              const ChunkCoord* chunk = nullptr)
+      : histogram_(histogram), name_(name), category_(category), chunk_(chunk),
+        start_(histogram || trace::enabled() ? now_ns() : 0) {}
+  ~ScopedTimer() {
+    if (start_ == 0) return;
+    const std::uint64_t elapsed = now_ns() - start_;
+    if (histogram_) histogram_->record(elapsed);
+    if (trace::enabled()) trace::complete(name_, category_, start_, elapsed, chunk_);
+  }
+
+  ScopedTimer(const ScopedTimer&) = delete;
+  ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+ private:
+  Histogram* histogram_;
+  const char* name_;
+  const char* category_;
+  const ChunkCoord* chunk_;
+  std::uint64_t start_;
+};
+
+}  // namespace terram
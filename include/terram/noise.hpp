@@ -0,0 +1,89 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include "terram/chunk.hpp"
+#include "terram/simd.hpp"
+#include "terram/types.hpp"
+
+namespace terram {
+
+/// Fractal Brownian motion over simplex noise. Frequencies are in cycles per
+/// cell; the result is offset + amplitude * sum(gain^o * noise(lacunarity^o)).
+struct FbmParams {
+  float frequency = 1.0f / 256.0f;
+  int octaves = 6;
+  float lacunarity = 2.0f;
+  float gain = 0.5f;
+  float amplitude = 64.0f;
+  float offset = 0.0f;
+};
+
+/// Instruction set the batched noise kernels, and the biome table lookup,
+/// currently run on. Chosen from
+/// CPU detection when the library loads; TERRAM_SIMD=scalar|avx2|avx512|neon
+/// in the environment overrides the choice.
+SimdIsa noise_isa();
+/// Switches the batched kernels to `isa`. Returns false, leaving the
+/// current choice, if the CPU or build cannot run it. Every path produces
+/// bit-identical results, so this only changes speed.
+bool set_noise_isa(SimdIsa isa);
+
+/// Seeded 2D simplex noise. Batched calls fill a block of samples at a time
+/// through the dispatched SIMD kernel; the single-point calls are scalar.
+class SimplexNoise {
+ public:
+  /// fBm shifts the lattice of octave o by o * kOctaveShift so octaves do
+  /// not share an origin.
+  static constexpr double kOctaveShift = 37.171;
+
+  explicit SimplexNoise(std::uint64_t seed);
+
+  std::uint64_t seed() const { return seed_; }
+  const std::int32_t* permutation() const { return perm_.data(); }
+
+  /// Noise at (x, z), in roughly [-1, 1].
+  float sample(float x, float z) const;
+
+  /// out[r * width + i] += amplitude * noise(x0 + i * step, z0 + r * step)
+  /// for a width x rows block.
+  void accumulate_block(float x0, float z0, float step, int width, int rows, float amplitude,
+                        float* out) const;
+  /// One row of `count` samples; a block with rows == 1.
+  void accumulate_row(float x0, float z, float step, int count, float amplitude,
+                      float* out) const {
+    accumulate_block(x0, z, step, count, 1, amplitude, out);
+  }
+
+  /// out[i] += amplitude * noise(x0 + dx[i] * step, z0 + dz[i] * step) for
+  /// `count` samples at arbitrary offsets, e.g. a warped domain. Offsets of
+  /// a grid give exactly what accumulate_block() does.
+  void accumulate_points(float x0, float z0, float step, const float* dx, const float* dz,
+                         int count, float amplitude, float* out) const;
+
+  /// fBm at world cell (wx, wz), matching what fill() writes for that cell.
+  float fbm(std::int64_t wx, std::int64_t wz, const FbmParams& params) const;
+
+  /// Writes fBm heights for every cell of the chunk at `coord`, one tile at
+  /// a time.
+  void fill(ChunkCoord coord, const FbmParams& params, TiledPlane<float>& out) const;
+  /// fill() at a coarser level: `coord` counts level-`level` chunks, each
+  /// sampling every 2^level-th cell of 2^level x 2^level full chunks.
+  /// Octaves above the sampling rate's Nyquist limit are dropped. Level 0
+  /// is exactly fill().
+  void fill_level(ChunkCoord coord, int level, const FbmParams& params,
+                  TiledPlane<float>& out) const;
+  /// fill_level() into kChunkCells floats of caller memory in the tiled
+  /// layout (see tiled_index()), e.g. from an arena.
+  void fill_tiles(ChunkCoord coord, int level, const FbmParams& params, float* out) const;
+  /// Tile (tx, tz) of fill(): the same kTileCells values, row-major.
+  void fill_tile(ChunkCoord coord, int tx, int tz, const FbmParams& params, float* out) const;
+
+ private:
+  std::uint64_t seed_;
+  // Doubled so lookups of perm[i + perm[j]] never need a second mask.
+  alignas(kCacheLine) std::array<std::int32_t, 512> perm_;
+};
+
+}  // namespace terram
@@ -0,0 +1,297 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <utility>
+
+#include "terram/chunk.hpp"
+#include "terram/noise.hpp"
+#include "terram/types.hpp"
+
+/// Noise pipelines composed as expression types. Every node is a small
+/// aggregate whose eval() fills one tile of values, so a whole graph such as
+///
+///   warp(ridged(peaks), fbm(wobble), 24.0f) * 0.8f + billow(hills)
+///
+/// is a single concrete type: the compiler sees through every node, inlines
+/// the graph into one evaluation per tile, and the per-node loops over a
+/// tile's 256 values vectorize. Noise itself goes through the dispatched
+/// SIMD kernels one octave at a time; all of a tile's intermediate values
+/// stay in L1. There is no per-sample or per-octave indirection, unlike a
+/// runtime node graph.
+namespace terram::graph {
+
+/// Positions of the kTileCells samples of one tile, in world cells: origin
+/// (x0, z0) plus per-sample offsets (dx[i], dz[i]). Offsets stay small and
+/// local to the tile, so precision does not fall off far from the world
+/// origin.
+struct Samples {
+  const SimplexNoise* noise;
+  std::int64_t x0;
+  std::int64_t z0;
+  const float* dx;
+  const float* dz;
+
+  /// out[i] += amplitude * noise at sample i, on the lattice that octave
+  /// `octave` of SimplexNoise::fill() uses at `frequency`.
+  void accumulate(int octave, double frequency, float amplitude, float* out) const {
+    const double shift = octave * SimplexNoise::kOctaveShift;
+    noise->accumulate_points(static_cast<float>(static_cast<double>(x0) * frequency + shift),
+                             static_cast<float>(static_cast<double>(z0) * frequency + shift),
+                             static_cast<float>(frequency), dx, dz, kTileCells, amplitude, out);
+  }
+};
+
+/// A graph node: writes its value at each of the tile's samples to out[i].
+template <class E>
+concept Expression = std::copy_constructible<E> &&
+                     requires(const E& e, const Samples& s, float* out) { e.eval(s, out); };
+
+/// Tile-sized temporary for nodes with more than one input.
+struct alignas(kCacheLine) TileValues {
+  float v[kTileCells];
+};
+
+/// Offsets of the regular tile grid, in the tiled layout's row-major order.
+struct TileGrid {
+  alignas(kCacheLine) float dx[kTileCells];
+  alignas(kCacheLine) float dz[kTileCells];
+};
+
+inline constexpr TileGrid kTileGrid = [] {
+  TileGrid g{};
+  for (int i = 0; i < kTileCells; ++i) {
+    g.dx[i] = static_cast<float>(i % kTileSize);
+    g.dz[i] = static_cast<float>(i / kTileSize);
+  }
+  return g;
+}();
+
+struct Constant {
+  float value = 0.0f;
+
+  void eval(const Samples&, float* out) const {
+    for (int i = 0; i < kTileCells; ++i) out[i] = value;
+  }
+};
+
+/// fBm exactly as SimplexNoise::fill() computes it; on an unwarped grid
+/// the values match fill() bit for bit.
+struct Fbm {
+  FbmParams params;
+
+  void eval(const Samples& s, float* out) const {
+    for (int i = 0; i < kTileCells; ++i) out[i] = params.offset;
+    double freq = params.frequency;
+    float amp = params.amplitude;
+    for (int o = 0; o < params.octaves; ++o) {
+      s.accumulate(o, freq, amp, out);
+      freq *= params.lacunarity;
+      amp *= params.gain;
+    }
+  }
+};
+
+/// fBm over octaves reshaped by `Shape` before they are summed.
+template <class Shape>
+struct ShapedFbm {
+  FbmParams params;
+
+  void eval(const Samples& s, float* out) const {
+    for (int i = 0; i < kTileCells; ++i) out[i] = params.offset;
+    TileValues octave;
+    double freq = params.frequency;
+    float amp = params.amplitude;
+    for (int o = 0; o < params.octaves; ++o) {
+      for (float& v : octave.v) v = 0.0f;
+      s.accumulate(o, freq, 1.0f, octave.v);
+      for (int i = 0; i < kTileCells; ++i) out[i] += amp * Shape{}(octave.v[i]);
+      freq *= params.lacunarity;
+      amp *= params.gain;
+    }
+  }
+};
+
+/// (1 - |n|)^2: sharp crests where the noise crosses zero.
+struct RidgeShape {
+  float operator()(float n) const {
+    const float r = 1.0f - std::fabs(n);
+    return r * r;
+  }
+};
+
+/// 2|n| - 1: rounded hills with creased valleys.
+struct BillowShape {
+  float operator()(float n) const { return 2.0f * std::fabs(n) - 1.0f; }
+};
+
+using Ridged = ShapedFbm<RidgeShape>;
+using Billow = ShapedFbm<BillowShape>;
+
+/// Evaluates `inner` at the samples displaced by `strength` cells times
+/// `offset`. The z displacement evaluates `offset` a fixed whole number of
+/// cells away, so the two axes are not correlated.
+template <Expression Inner, Expression Offset>
+struct Warp {
+  static constexpr std::int64_t kShiftX = 7919;
+  static constexpr std::int64_t kShiftZ = -3571;
+
+  Inner inner;
+  Offset offset;
+  float strength = 1.0f;
+
+  void eval(const Samples& s, float* out) const {
+    TileValues wx;
+    TileValues wz;
+    offset.eval(s, wx.v);
+    offset.eval(Samples{s.noise, s.x0 + kShiftX, s.z0 + kShiftZ, s.dx, s.dz}, wz.v);
+    for (int i = 0; i < kTileCells; ++i) {
+      wx.v[i] = s.dx[i] + strength * wx.v[i];
+      wz.v[i] = s.dz[i] + strength * wz.v[i];
+    }
+    inner.eval(Samples{s.noise, s.x0, s.z0, wx.v, wz.v}, out);
+  }
+};
+
+/// f(value) at every sample; `F` is any float(float) callable, e.g. a
+/// lambda.
+template <Expression E, class F>
+struct Remap {
+  E input;
+  F f;
+
+  void eval(const Samples& s, float* out) const {
+    input.eval(s, out);
+    for (int i = 0; i < kTileCells; ++i) out[i] = f(out[i]);
+  }
+};
+
+/// op(a, b) at every sample.
+template <Expression A, Expression B, class Op>
+struct Binary {
+  A a;
+  B b;
+
+  void eval(const Samples& s, float* out) const {
+    TileValues rhs;
+    a.eval(s, out);
+    b.eval(s, rhs.v);
+    for (int i = 0; i < kTileCells; ++i) out[i] = Op{}(out[i], rhs.v[i]);
+  }
+};
+
+struct MinOp {
+  float operator()(float a, float b) const { return b < a ? b : a; }
+};
+struct MaxOp {
+  float operator()(float a, float b) const { return a < b ? b : a; }
+};
+
+/// a + (b - a) * t, with t clamped to [0, 1].
+template <Expression A, Expression B, Expression T>
+struct Blend {
+  A a;
+  B b;
+  T t;
+
+  void eval(const Samples& s, float* out) const {
+    TileValues vb;
+    TileValues vt;
+    a.eval(s, out);
+    b.eval(s, vb.v);
+    t.eval(s, vt.v);
+    for (int i = 0; i < kTileCells; ++i) {
+      const float w = vt.v[i] < 0.0f ? 0.0f : (vt.v[i] > 1.0f ? 1.0f : vt.v[i]);
+      out[i] = out[i] + (vb.v[i] - out[i]) * w;
+    }
+  }
+};
+
+inline Constant constant(float value) { return {value}; }
+inline Fbm fbm(FbmParams params) { return {params}; }
+inline Ridged ridged(FbmParams params) { return {params}; }
+inline Billow billow(FbmParams params) { return {params}; }
+
+template <Expression Inner, Expression Offset>
+Warp<Inner, Offset> warp(Inner inner, Offset offset, float strength) {
+  return {std::move(inner), std::move(offset), strength};
+}
+
+template <Expression E, class F>
+Remap<E, F> remap(E input, F f) {
+  return {std::move(input), std::move(f)};
+}
+
+template <Expression E>
+auto clamp(E input, float lo, float hi) {
+  return remap(std::move(input), [lo, hi](float v) { return v < lo ? lo : (v > hi ? hi : v); });
+}
+
+template <Expression A, Expression B>
+Binary<A, B, MinOp> min(A a, B b) {
+  return {std::move(a), std::move(b)};
+}
+
+template <Expression A, Expression B>
+Binary<A, B, MaxOp> max(A a, B b) {
+  return {std::move(a), std::move(b)};
+}
+
+template <Expression A, Expression B, Expression T>
+Blend<A, B, T> blend(A a, B b, T t) {
+  return {std::move(a), std::move(b), std::move(t)};
+}
+
+// Arithmetic between expressions, and with plain floats on either side.
+#define TERRAM_GRAPH_OPERATOR(op, functor)                                          \
+  template <Expression A, Expression B>                                             \
+  Binary<A, B, functor> operator op(A a, B b) {                                     \
+    return {std::move(a), std::move(b)};                                            \
+  }                                                                                 \
+  template <Expression A>                                                           \
+  Binary<A, Constant, functor> operator op(A a, float b) {                          \
+    return {std::move(a), Constant{b}};                                             \
+  }                                                                                 \
+  template <Expression B>                                                           \
+  Binary<Constant, B, functor> operator op(float a, B b) {                          \
+    return {Constant{a}, std::move(b)};                                             \
+  }
+TERRAM_GRAPH_OPERATOR(+, std::plus<float>)
+TERRAM_GRAPH_OPERATOR(-, std::minus<float>)
+TERRAM_GRAPH_OPERATOR(*, std::multiplies<float>)
+#undef TERRAM_GRAPH_OPERATOR
+
+/// Evaluates `expr` over the chunk at `coord` into kChunkCells floats in
+/// the tiled layout, one tile at a time.
+template <Expression E>
+void fill(const E& expr, const SimplexNoise& noise, ChunkCoord coord, float* out) {
+  for (int tz = 0; tz < kTilesPerSide; ++tz) {
+    for (int tx = 0; tx < kTilesPerSide; ++tx) {
+      const Samples s{&noise, chunk_origin(coord.x) + tx * kTileSize,
+                      chunk_origin(coord.z) + tz * kTileSize, kTileGrid.dx, kTileGrid.dz};
+      expr.eval(s, out + (tz * kTilesPerSide + tx) * kTileCells);
+    }
+  }
+}
+
+template <Expression E>
+void fill(const E& expr, const SimplexNoise& noise, ChunkCoord coord, TiledPlane<float>& out) {
+  fill(expr, noise, coord, out.data());
+}
+
+namespace presets {
+
+/// Domain-warped ridged ranges over billowy foothills, flattened into
+/// plains below sea level. Heights roughly in [-10, 130].
+inline auto alpine() {
+  const FbmParams peaks{.frequency = 1.0f / 384.0f, .octaves = 6, .amplitude = 90.0f};
+  const FbmParams wobble{.frequency = 1.0f / 512.0f, .octaves = 3, .amplitude = 1.0f};
+  const FbmParams hills{.frequency = 1.0f / 160.0f, .octaves = 4, .amplitude = 14.0f};
+  auto relief = warp(ridged(peaks), fbm(wobble), 48.0f) * 0.8f + billow(hills) - 20.0f;
+  return remap(std::move(relief), [](float h) { return h < 0.0f ? h * 0.25f : h; });
+}
+
+}  // namespace presets
+
+}  // namespace terram::graph
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "terram/chunk.hpp"
+#include "terram/noise.hpp"
+
+namespace terram {
+
+/// Operations of a noise program. Every register holds one value per sample
+/// of a tile; "a", "b", "c" name source registers.
+enum class Opcode : std::uint8_t {
+  Const,      ///< dst = k0
+  GridX,      ///< dst = sample offset along x from the tile origin, in cells
+  GridZ,      ///< dst = sample offset along z
+  Fbm,        ///< dst = fBm with params[param] at offsets (a, b), origin shifted by (k0, k1)
+  Ridged,     ///< like Fbm with octaves shaped (1 - |n|)^2
+  Billow,     ///< like Fbm with octaves shaped 2|n| - 1
+  Add,        ///< dst = a + b
+  Sub,        ///< dst = a - b
+  Mul,        ///< dst = a * b
+  Min,        ///< dst = min(a, b)
+  Max,        ///< dst = max(a, b)
+  MulAdd,     ///< dst = a * k0 + b
+  ScaleBias,  ///< dst = a * k0 + k1
+  Abs,        ///< dst = |a|
+  Clamp,      ///< dst = clamp(a, k0, k1)
+  Blend,      ///< dst = a + (b - a) * clamp(c, 0, 1)
+};
+
+struct Instruction {
+  Opcode op = Opcode::Const;
+  std::uint8_t dst = 0;
+  std::uint8_t a = 0;
+  std::uint8_t b = 0;
+  std::uint8_t c = 0;
+  std::uint16_t param = 0;
+  float k0 = 0.0f;
+  float k1 = 0.0f;
+};
+
+/// Register-based bytecode for noise graphs only known at run time, e.g.
+/// generators uploaded by users. Each instruction runs over a whole
+/// 16x16 tile before the next, as one vectorized loop, so dispatch costs
+/// one switch per instruction per tile and the noise ops go through the
+/// same SIMD kernels as built-in generators. Ops compute exactly what the
+/// matching graph:: nodes do, so a program transcribing a compiled graph
+/// produces the same values bit for bit.
+///
+/// Programs are validated once, when built or decoded, so evaluation needs
+/// no checks: registers in range and written before they are read, noise
+/// outputs distinct from their offset registers, and the total octave count
+/// bounded so an uploaded program cannot stall a worker.
+class NoiseProgram {
+ public:
+  static constexpr int kMaxRegisters = 16;
+  static constexpr std::size_t kMaxInstructions = 256;
+  static constexpr int kMaxOctaves = 16;
+  /// Octaves summed over all noise ops.
+  static constexpr int kMaxTotalOctaves = 64;
+  /// Offset operand that selects the plain tile grid instead of a register.
+  static constexpr std::uint8_t kGrid = 0xff;
+
+  /// Throws std::invalid_argument if the program breaks a rule above.
+  NoiseProgram(std::vector<FbmParams> params, std::vector<Instruction> code, std::uint8_t output);
+
+  /// Parses bytecode written by encode(). Throws std::runtime_error if it is
+  /// malformed or fails validation.
+  static NoiseProgram decode(std::span<const std::uint8_t> bytes);
+  /// Appends the bytecode to `out`: a 12-byte header, 21 bytes per
+  /// parameter set and 16 per instruction.
+  void encode(std::vector<std::uint8_t>& out) const;
+
+  std::span<const FbmParams> params() const { return params_; }
+  std::span<const Instruction> code() const { return code_; }
+  std::uint8_t output() const { return output_; }
+
+  /// Runs the program over the chunk at `coord`, writing the output
+  /// register into kChunkCells floats in the tiled layout.
+  void fill(const SimplexNoise& noise, ChunkCoord coord, float* out) const;
+  void fill(const SimplexNoise& noise, ChunkCoord coord, TiledPlane<float>& out) const {
+    fill(noise, coord, out.data());
+  }
+
+ private:
+  std::vector<FbmParams> params_;
+  std::vector<Instruction> code_;
+  std::uint8_t output_;
+};
+
+}  // namespace terram
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <span>
+#include <vector>
+
+namespace terram {
+
+/// The CPUs this process may use (its sched_getaffinity() mask), grouped by
+/// the online NUMA nodes read from sysfs. Machines without NUMA information
+/// report one node holding all of them.
+struct NumaTopology {
+  std::vector<std::vector<int>> node_cpus;
+  /// Kernel id of each node; nodes with none of our CPUs are left out, so
+  /// ids can skip numbers.
+  std::vector<int> node_ids;
+
+  int node_count() const { return static_cast<int>(node_cpus.size()); }
+
+  static const NumaTopology& system();
+};
+
+/// Restricts the calling thread to `cpus`. Returns false if the platform
+/// does not support affinity or the call fails.
+bool pin_current_thread(std::span<const int> cpus);
+
+/// Page-aligned `bytes` of memory placed on node `node` (an index into
+/// NumaTopology::system()). Comes from a per-node pool of mappings, each
+/// bound to its node once when mapped, so placing memory never splits a
+/// mapping and no other allocation inherits the policy; freed blocks go
+/// back to their node's pool. Placement is a hint the kernel may not
+/// honour. Throws std::invalid_argument for a node the system does not
+/// have and std::bad_alloc when out of memory.
+void* node_alloc(std::size_t bytes, int node);
+/// Returns a node_alloc() block; `bytes` and `node` as it was allocated.
+void node_free(void* p, std::size_t bytes, int node) noexcept;
+
+/// Frees a node_alloc() block, or, with `node` -1, an aligned_alloc_bytes()
+/// one.
+struct NodeDeleter {
+  int node = -1;
+  std::size_t bytes = 0;
+  void operator()(void* p) const noexcept;
+};
+
+}  // namespace terram
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <stop_token>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "terram/types.hpp"
+
+namespace terram {
+
+class World;
+
+/// Where a viewer is and where it is heading, in world cells and cells per
+/// second.
+struct ViewerMotion {
+  double x = 0.0;
+  double z = 0.0;
+  double vx = 0.0;
+  double vz = 0.0;
+};
+
+struct PrefetchOptions {
+  /// How far ahead, in seconds, the path is extrapolated.
+  double horizon = 2.0;
+  /// Chunks (square radius) made resident around each point of the path.
+  int radius = 3;
+  /// Most chunks planned per viewer update; far points of a fast path are
+  /// dropped beyond it.
+  std::size_t max_planned = 1024;
+  /// Chunks handed to World::prefetch() at a time. Smaller batches let
+  /// on-demand generation in sooner.
+  std::size_t max_batch = 16;
+};
+
+struct PrefetchStats {
+  std::uint64_t updates = 0;
+  /// Plans made, one per burst of updates the worker saw.
+  std::uint64_t plans = 0;
+  std::uint64_t batches = 0;
+  /// Chunks made resident ahead of demand.
+  std::uint64_t prefetched = 0;
+  /// Times the worker held back because on-demand generation was waiting.
+  std::uint64_t yielded = 0;
+};
+
+/// Generates or loads chunks along viewers' predicted paths before they are
+/// asked for, so fast viewers do not outrun on-demand generation. Each
+/// update() replaces the viewer's motion; a worker thread extrapolates
+/// every viewer's straight-line path over the horizon, orders the chunks
+/// within `radius` of it by when the viewer is expected to reach them, and
+/// feeds them to World::prefetch() in small batches.
+///
+/// Prefetching runs at low priority: its batches are Prefetch class, which
+/// Visible batches preempt; the worker waits while chunks() callers are
+/// generating; and when a viewer changes course the batch in flight is
+/// cancelled at its next stage boundary and the worker replans. Prefetched
+/// chunks are not pinned; they compete for the cache budget like any other
+/// chunk. Thread-safe.
+class ViewerPrefetcher {
+ public:
+  explicit ViewerPrefetcher(World& world, PrefetchOptions options = {});
+  /// Cancels the batch in flight and stops the worker.
+  ~ViewerPrefetcher();
+
+  ViewerPrefetcher(const ViewerPrefetcher&) = delete;
+  ViewerPrefetcher& operator=(const ViewerPrefetcher&) = delete;
+
+  void update(std::uint32_t id, const ViewerMotion& motion);
+  void remove(std::uint32_t id);
+
+  /// The chunks a plan for `viewers` covers, soonest first. Exposed for
+  /// tools that visualise the prediction.
+  std::vector<ChunkCoord> plan(const std::vector<ViewerMotion>& viewers) const;
+
+  PrefetchStats stats() const;
+
+ private:
+  void worker_main();
+
+  World& world_;
+  PrefetchOptions options_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable wake_;
+  std::unordered_map<std::uint32_t, ViewerMotion> viewers_;
+  /// Bumped by every update() and remove(); a plan is stale once it moves.
+  std::uint64_t version_ = 0;
+  /// Cancels the batches of the plan being worked on.
+  std::stop_source plan_stop_;
+  bool stop_ = false;
+  PrefetchStats stats_;
+
+  std::thread worker_;
+};
+
+}  // namespace terram
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "terram/chunk.hpp"
+#include "terram/heightfield.hpp"
+
+namespace terram {
+
+/// Results of sample_points(), as structure of arrays: entry i of every
+/// array answers point i. Reusing one across calls keeps its capacity.
+struct PointSamples {
+  /// Bilinearly interpolated height, as Heightfield::sample().
+  std::vector<float> height;
+  /// Unit surface normal, blended from the chunks' normals planes with the
+  /// same weights as the height; straight up where a chunk has none.
+  std::vector<float> normal_x;
+  std::vector<float> normal_y;
+  std::vector<float> normal_z;
+  /// Biome of the cell containing the point, or 0 where its chunk has no
+  /// biomes plane.
+  std::vector<BiomeId> biome;
+  /// 0 where a cell the point reads is not resident, or the position is
+  /// not finite; the entries above are then zero, the normal up.
+  std::vector<std::uint8_t> found;
+
+  std::size_t size() const { return height.size(); }
+  void resize(std::size_t n);
+};
+
+/// Samples `field` at each world position (x[i], z[i]), in cells, into
+/// `out`. Points are taken in blocks of a few thousand and bucketed by
+/// chunk and tile, so each resident chunk is looked up once per call, its
+/// neighbours with it, and a tile's cells are read by every point of the
+/// block that lands in it while they are still in cache; results are
+/// scattered back into input order. Chunks read are marked accessed
+/// for the cache. Chunks that have completed fewer than `min_stage`
+/// stages count as not resident. Returns how many points were not found.
+/// Throws std::invalid_argument if `x` and `z` differ in length.
+std::size_t sample_points(const Heightfield& field, std::span<const double> x,
+                          std::span<const double> z, PointSamples& out, int min_stage = 0);
+
+}  // namespace terram
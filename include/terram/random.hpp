@@ -0,0 +1,65 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include "terram/types.hpp"
+
+namespace terram {
+
+/// Philox4x32-10 (Salmon et al. 2011): a counter-based generator, so the
+/// n-th value of a stream is a pure function of (key, counter) with no
+/// state carried between calls. Anything keyed by chunk coordinates draws
+/// the same numbers whichever thread, order or SIMD path generates it.
+class Philox4x32 {
+ public:
+  using Counter = std::array<std::uint32_t, 4>;
+  using Key = std::array<std::uint32_t, 2>;
+
+  static constexpr Counter generate(Counter c, Key k) {
+    for (int round = 0; round < 10; ++round) {
+      const std::uint64_t p0 = std::uint64_t{kM0} * c[0];
+      const std::uint64_t p1 = std::uint64_t{kM1} * c[2];
+      c = {static_cast<std::uint32_t>(p1 >> 32) ^ c[1] ^ k[0], static_cast<std::uint32_t>(p1),
+           static_cast<std::uint32_t>(p0 >> 32) ^ c[3] ^ k[1], static_cast<std::uint32_t>(p0)};
+      k[0] += kW0;
+      k[1] += kW1;
+    }
+    return c;
+  }
+
+ private:
+  static constexpr std::uint32_t kM0 = 0xD2511F53;
+  static constexpr std::uint32_t kM1 = 0xCD9E8D57;
+  static constexpr std::uint32_t kW0 = 0x9E3779B9;
+  static constexpr std::uint32_t kW1 = 0xBB67AE85;
+};
+
+/// Uniform float in [0, 1) from the top 24 bits of `bits`.
+constexpr float unit_float(std::uint32_t bits) {
+  return static_cast<float>(bits >> 8) * (1.0f / 16777216.0f);
+}
+
+/// Random numbers for the cells of a chunk, keyed by the world seed and a
+/// per-use stream id and counted by (chunk, block of four cells), so a
+/// cell's values do not depend on which chunk's halo computes them.
+class ChunkRandom {
+ public:
+  ChunkRandom(std::uint64_t seed, std::uint32_t stream)
+      : key_{static_cast<std::uint32_t>(seed) ^ stream, static_cast<std::uint32_t>(seed >> 32)},
+        stream_(stream) {}
+
+  /// Four values for cells 4 * block .. 4 * block + 3 of `coord` in the
+  /// tiled layout.
+  Philox4x32::Counter block(ChunkCoord coord, std::uint32_t block) const {
+    return Philox4x32::generate({block, stream_, static_cast<std::uint32_t>(coord.x),
+                                 static_cast<std::uint32_t>(coord.z)},
+                                key_);
+  }
+
+ private:
+  Philox4x32::Key key_;
+  std::uint32_t stream_;
+};
+
+}  // namespace terram
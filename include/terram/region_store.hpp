@@ -0,0 +1,176 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+#include "terram/chunk.hpp"
+#include "terram/io_queue.hpp"
+#include "terram/types.hpp"
+
+namespace terram {
+
+/// Chunks along one side of a region file.
+inline constexpr int kRegionSize = 32;
+inline constexpr int kRegionShift = 5;
+inline constexpr int kRegionSlots = kRegionSize * kRegionSize;
+
+/// Region containing chunk `c`, as a chunk coordinate scaled by kRegionSize.
+constexpr ChunkCoord region_of(ChunkCoord c) {
+  return {c.x >> kRegionShift, c.z >> kRegionShift};
+}
+
+namespace region_format {
+
+// On-disk layout of a region file, native byte order:
+//
+//   [0, 4 KiB)          Header
+//   [4 KiB, 28 KiB)     SlotEntry index[kRegionSlots], slot = z * 32 + x
+//   [32 KiB, ...)       record locations, location i at
+//                       kDataOffset + i * kRecordBytes
+//
+// A record is the chunk's height plane in the in-memory tiled layout, so a
+// mapped record is used directly as a TiledPlane. There are more locations
+// than slots, and a save writes its record to a location nothing references
+// or borrows, then points the slot's index entry at it. Mapped records are
+// therefore never overwritten under a reader. Files are created at full
+// size; unused locations are holes and cost no disk.
+
+inline constexpr char kMagic[8] = {'T', 'E', 'R', 'R', 'A', 'M', 'R', 'G'};
+inline constexpr std::uint32_t kVersion = 2;
+inline constexpr std::uint32_t kByteOrderMark = 0x01020304;
+inline constexpr std::size_t kIndexOffset = 4096;
+inline constexpr std::size_t kRecordBytes = TiledPlane<float>::kBytes;
+inline constexpr std::size_t kDataOffset = 32768;
+inline constexpr int kRecordLocations = 4 * kRegionSlots;
+inline constexpr std::size_t kFileBytes = kDataOffset + kRecordLocations * kRecordBytes;
+
+static_assert(kRecordBytes % 4096 == 0, "records must be page aligned");
+static_assert(kDataOffset % kRecordBytes == 0);
+
+struct Header {
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t byte_order;
+  std::uint32_t chunk_size;
+  std::uint32_t tile_size;
+  std::uint32_t region_size;
+  std::uint32_t record_bytes;
+  std::uint64_t data_offset;
+  std::int32_t region_x;
+  std::int32_t region_z;
+  std::uint32_t record_locations;
+  std::uint32_t reserved;
+};
+
+inline constexpr std::uint32_t kSlotPresent = 1u << 0;
+
+struct SlotEntry {
+  std::uint32_t flags;
+  /// Chunk::stage() when saved.
+  std::uint32_t stage;
+  /// Store-wide save counter; higher is newer.
+  std::uint64_t sequence;
+  /// Location of the record.
+  std::uint32_t record;
+  std::uint32_t reserved;
+};
+
+static_assert(sizeof(SlotEntry) == 24);
+static_assert(kIndexOffset + kRegionSlots * sizeof(SlotEntry) <= kDataOffset);
+
+}  // namespace region_format
+
+/// Read-only view of a stored chunk record, straight out of the mapping.
+struct ChunkRecordView {
+  /// kChunkCells heights in tiled order.
+  const float* height = nullptr;
+  int stage = 0;
+  std::uint64_t sequence = 0;
+  /// Keeps the mapping alive while the view is used.
+  std::shared_ptr<const void> keepalive;
+};
+
+/// Persistent chunk store: a directory of fixed-capacity region files, each
+/// mapped read-only in one piece. Loading a chunk hands out a plane that
+/// borrows the mapped record, so a cold start costs page faults, not
+/// parsing or copying.
+///
+/// Saves are asynchronous. save() snapshots the heights and queues the
+/// record write to a free location through an IoQueue (io_uring where
+/// available), so the caller never waits on the disk. Records that have
+/// landed are made durable by one fdatasync per batch before their index
+/// entries are written, so a crash exposes either the old record or the
+/// complete new one, never a torn one; a replaced location is reused only
+/// after the entry pointing away from it has been synced too, and once no
+/// loaded plane borrows it. Until the index entry is written, loads of
+/// that chunk are served from the snapshot; repeated saves of one chunk
+/// write in order, and saves queued while one is in flight coalesce into
+/// the latest. flush() waits for every save and syncs.
+///
+/// Thread-safe. Throws std::system_error on I/O failure, with errors of
+/// asynchronous writes reported by the next flush(), and
+/// std::runtime_error on a malformed region file.
+class RegionStore {
+ public:
+  explicit RegionStore(std::filesystem::path directory, IoQueueOptions io = {});
+  /// Waits for queued writes; call flush() first to have them synced.
+  ~RegionStore();
+
+  RegionStore(const RegionStore&) = delete;
+  RegionStore& operator=(const RegionStore&) = delete;
+
+  const std::filesystem::path& directory() const { return directory_; }
+
+  bool contains(ChunkCoord c);
+  std::optional<ChunkRecordView> view(ChunkCoord c);
+  /// A chunk whose height plane borrows the mapped record.
+  std::shared_ptr<Chunk> load(ChunkCoord c);
+
+  void save(const Chunk& chunk) { save(chunk, chunk.stage()); }
+  /// Saves `chunk` recording `stage` as its completed stage count, for
+  /// callers that do not persist every stage's output.
+  void save(const Chunk& chunk, int stage) {
+    queue_save(chunk, stage);
+    submit();
+  }
+  /// save() without issuing the writes, so a batch of saves goes to the
+  /// kernel with one submit().
+  void queue_save(const Chunk& chunk, int stage);
+  void submit();
+  bool erase(ChunkCoord c);
+  /// Waits for every queued save, then flushes records and index entries to
+  /// stable storage. Throws the first error of any write since the last
+  /// flush().
+  void flush();
+
+  /// Starts reading the records behind `coords` into the page cache without
+  /// waiting for them, all in flight at once.
+  void prefetch(std::span<const ChunkCoord> coords);
+  void prefetch(ChunkCoord c) { prefetch(std::span<const ChunkCoord>(&c, 1)); }
+
+  IoBackend io_backend() const { return io_->backend(); }
+
+  /// Every stored chunk, scanning the index of each region file.
+  std::vector<ChunkCoord> list();
+
+ private:
+  class Region;
+
+  std::shared_ptr<Region> region(ChunkCoord region, bool create);
+
+  std::filesystem::path directory_;
+  // Declared before regions_ so it outlives the regions that queue on it.
+  std::unique_ptr<IoQueue> io_;
+  std::mutex mutex_;
+  std::unordered_map<ChunkCoord, std::shared_ptr<Region>, ChunkCoordHash> regions_;
+  std::uint64_t sequence_ = 0;
+};
+
+}  // namespace terram
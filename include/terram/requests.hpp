@@ -0,0 +1,157 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <stop_token>
+#include <thread>
+
+#include "terram/chunk.hpp"
+#include "terram/mpmc_queue.hpp"
+#include "terram/scheduler.hpp"
+#include "terram/types.hpp"
+
+namespace terram {
+
+class World;
+
+/// A finished chunk request.
+struct ChunkCompletion {
+  ChunkCoord coord;
+  /// Caller's tag from the request.
+  std::uint64_t tag = 0;
+  /// Null if generation failed or the request was cancelled or refused.
+  std::shared_ptr<Chunk> chunk;
+  bool cancelled = false;
+  /// Never queued: the queue was full. Only ChunkStream answers a coord
+  /// this way; request() reports refusal by returning false.
+  bool refused = false;
+};
+
+/// Invoked on the dispatcher thread of the request's class, or, for
+/// requests still queued when the queue is destroyed, on the destroying
+/// thread. `user` is the pointer passed with the request. Must not block
+/// for long: it delays every later completion of that class.
+using ChunkCallback = void (*)(const ChunkCompletion& completion, void* user);
+
+struct ChunkRequest {
+  ChunkCoord coord;
+  /// Returned in the completion.
+  std::uint64_t tag = 0;
+  Priority priority = Priority::Visible;
+  /// Orders this class's batches; a batch runs by its earliest deadline.
+  Deadline deadline = kNoDeadline;
+  /// Completion goes through `callback`, or to the ring if null.
+  ChunkCallback callback = nullptr;
+  void* user = nullptr;
+};
+
+struct RequestQueueOptions {
+  /// Requests in flight, per priority class, before request() starts
+  /// refusing.
+  std::size_t capacity = 4096;
+  /// Completions waiting for poll(). A full ring holds back the dispatcher
+  /// rather than dropping results.
+  std::size_t completion_capacity = 4096;
+  /// Most requests handed to the generator as one batch.
+  std::size_t max_batch = 256;
+};
+
+struct RequestQueueStats {
+  std::uint64_t accepted = 0;
+  std::uint64_t rejected = 0;
+  /// Includes cancelled requests, which are answered too.
+  std::uint64_t completed = 0;
+  std::uint64_t cancelled = 0;
+  std::uint64_t batches = 0;
+};
+
+/// Non-blocking front end to a World for game and server threads.
+/// request() is a single lock-free push onto a bounded MPMC queue and never
+/// waits on a mutex the generator holds. Each priority class has its own
+/// queue and dispatcher thread, which drains it in batches, resolves them
+/// through World::chunks() at that class, and either invokes the
+/// request's callback or posts to the completion ring that poll() reads.
+/// A class's batches therefore preempt lower classes' in the scheduler
+/// rather than wait behind them in a queue.
+class ChunkRequestQueue {
+ public:
+  explicit ChunkRequestQueue(World& world, RequestQueueOptions options = {});
+  /// Stops the dispatchers, then completes every request still queued as
+  /// cancelled, so no callback (or awaiting coroutine) is left waiting.
+  ~ChunkRequestQueue();
+
+  ChunkRequestQueue(const ChunkRequestQueue&) = delete;
+  ChunkRequestQueue& operator=(const ChunkRequestQueue&) = delete;
+
+  /// Queues a Visible request whose completion goes to the ring. Returns
+  /// false, without blocking, if the queue is full.
+  bool request(ChunkCoord c, std::uint64_t tag = 0) { return request(ChunkRequest{c, tag}); }
+  /// Queues a Visible request completed through `callback` (or the ring if
+  /// null).
+  bool request(ChunkCoord c, std::uint64_t tag, ChunkCallback callback, void* user) {
+    return request(ChunkRequest{.coord = c, .tag = tag, .callback = callback, .user = user});
+  }
+  bool request(const ChunkRequest& r);
+
+  /// Cancels every request of class `priority` made so far: queued ones
+  /// complete without generating, and the batch in flight stops at its next
+  /// stage boundary, its unfinished chunks completing as cancelled. Meant
+  /// for when viewers move away: cancel the stale class, then request what
+  /// is still wanted; chunks finished meanwhile come straight from the
+  /// cache.
+  void cancel(Priority priority);
+
+  /// Pops one completion; false if none is ready.
+  bool poll(ChunkCompletion& out) { return completions_.try_pop(out); }
+  /// Pops up to out.size() completions and returns how many.
+  std::size_t poll(std::span<ChunkCompletion> out);
+
+  RequestQueueStats stats() const;
+
+ private:
+  struct Request {
+    ChunkRequest r;
+    /// Lane::epoch when queued; older than the lane's means cancelled.
+    std::uint64_t epoch = 0;
+    /// now_ns() when queued, for the requests.latency histogram.
+    std::uint64_t queued_ns = 0;
+  };
+
+  /// One priority class: its queue, dispatcher and cancellation state.
+  struct Lane {
+    explicit Lane(std::size_t capacity) : requests(capacity) {}
+
+    MpmcQueue<Request> requests;
+    std::atomic<bool> parked{false};
+    std::atomic<std::uint32_t> wake_seq{0};
+    std::atomic<std::uint64_t> epoch{0};
+    std::mutex stop_mutex;
+    /// Stops the lane's batch in flight.
+    std::stop_source stop;
+    std::thread dispatcher;
+  };
+
+  void dispatch_main(Priority priority);
+  void deliver(ChunkCompletion completion, const Request& q);
+  void wake(Lane& lane);
+
+  World& world_;
+  RequestQueueOptions options_;
+  MpmcQueue<ChunkCompletion> completions_;
+  std::array<std::unique_ptr<Lane>, kPriorityCount> lanes_;
+
+  std::atomic<bool> stop_{false};
+
+  std::atomic<std::uint64_t> accepted_{0};
+  std::atomic<std::uint64_t> rejected_{0};
+  std::atomic<std::uint64_t> completed_{0};
+  std::atomic<std::uint64_t> cancelled_{0};
+  std::atomic<std::uint64_t> batches_{0};
+};
+
+}  // namespace terram
@@ -0,0 +1,202 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <stop_token>
+#include <string>
+#include <vector>
+
+#include "terram/arena.hpp"
+#include "terram/chunk.hpp"
+#include "terram/heightfield.hpp"
+#include "terram/thread_pool.hpp"
+
+namespace terram {
+
+class Histogram;
+
+/// What a stage body sees while it runs for one chunk.
+struct StageContext {
+  Chunk& chunk;
+  /// The chunk and its one-ring. Populated only for stages that read
+  /// neighbours; every neighbour has then completed the previous stage.
+  const ChunkNeighborhood& neighbors;
+  int stage;
+  /// Pool worker running the stage.
+  unsigned worker;
+  /// The worker's scratch arena, reset after every (chunk, stage) task.
+  /// Temporary buffers come from here instead of the heap.
+  Arena& scratch;
+};
+
+/// One step of chunk generation.
+struct Stage {
+  std::string name;
+  /// Stage reads the previous stage's output of the eight neighbours
+  /// (blending, normals, meshing). Such a stage must only write planes its
+  /// neighbours do not read during the same stage; the one-ring dependency
+  /// of the following stage then orders every read before the next write.
+  bool reads_neighbors = false;
+  /// Stage derives its output from the chunk's current heights (normals,
+  /// meshes, masks) and reruns after an edit. Derived stages must follow
+  /// every generation stage, which would otherwise overwrite the edit.
+  bool derived = false;
+  std::function<void(StageContext&)> run;
+  /// Optional per-tile form of `run`: does the stage's work for tile (tx,
+  /// tz) alone. Stages that have one can be fused (see stages::fuse()), so
+  /// a tile passes through all of them while it is in L1. A kernel writes
+  /// only its tile; unless the stage reads neighbours, it also reads only
+  /// its tile of the chunk. Temporaries must not outlive the call.
+  std::function<void(StageContext&, int tx, int tz)> tile = nullptr;
+};
+
+using Pipeline = std::vector<Stage>;
+
+/// Index of the first derived stage, or the stage count if there is none.
+/// This is also the stage a chunk is persisted at: derived output is not
+/// stored and is recomputed after loading.
+int first_derived_stage(const Pipeline& pipeline);
+
+struct ScratchStats {
+  /// Heap blocks taken by all worker arenas so far; constant once warm.
+  std::uint64_t heap_allocations = 0;
+  /// Largest scratch footprint of any single task.
+  std::size_t high_water_bytes = 0;
+  std::size_t capacity_bytes = 0;
+};
+
+/// Scheduling class of a batch; higher classes go first.
+enum class Priority : std::uint8_t {
+  Background,  ///< Pre-generation and baking.
+  Prefetch,    ///< Ahead of a viewer, not yet needed.
+  Visible,     ///< Needed now.
+};
+
+inline constexpr int kPriorityCount = 3;
+
+const char* to_string(Priority priority);
+
+using Deadline = std::chrono::steady_clock::time_point;
+inline constexpr Deadline kNoDeadline = Deadline::max();
+
+struct GenerateOptions {
+  Priority priority = Priority::Visible;
+  /// Orders waiting batches of one class, earliest first. Missing it does
+  /// not cancel the batch.
+  Deadline deadline = kNoDeadline;
+  /// Cancels the batch: tasks not yet started are skipped, so it returns at
+  /// the next stage boundary with its targets partly generated.
+  std::stop_token stop;
+};
+
+struct GenerationStats {
+  /// (chunk, stage) tasks executed.
+  std::size_t tasks = 0;
+  /// Chunks touched, including halo chunks generated only to a lower stage.
+  std::size_t chunks = 0;
+  double seconds = 0.0;
+  /// Times the batch paused for a higher class.
+  std::size_t preemptions = 0;
+  /// Stopped through GenerateOptions::stop before finishing.
+  bool cancelled = false;
+};
+
+/// Generates chunks through a pipeline on a work-stealing pool. Every
+/// (chunk, stage) pair is a task: it waits for the previous stage of the
+/// same chunk, and for neighbour-reading stages also of the one-ring, so
+/// halo chunks are generated just far enough to feed their neighbours.
+/// Work already done (Chunk::stage()) is never repeated.
+///
+/// One batch owns the field at a time. Waiting batches go in priority
+/// order, then earliest deadline, then arrival. A batch running when a
+/// higher class arrives is preempted at stage boundaries: the tasks it
+/// has started finish, the ones that become ready are held back, and it
+/// resumes once the higher batches are done. A preempted batch then
+/// skips tasks the others completed meanwhile.
+class ChunkScheduler {
+ public:
+  /// Supplies a chunk missing from the field (e.g. from a RegionStore), or
+  /// null to have it created empty. Called on the thread planning a batch.
+  using ChunkLoader = std::function<std::shared_ptr<Chunk>(ChunkCoord)>;
+
+  /// Throws std::invalid_argument if a generation stage follows a derived
+  /// one.
+  ChunkScheduler(ThreadPool& pool, Heightfield& field, Pipeline pipeline);
+  ~ChunkScheduler();
+
+  ChunkScheduler(const ChunkScheduler&) = delete;
+  ChunkScheduler& operator=(const ChunkScheduler&) = delete;
+
+  const Pipeline& pipeline() const { return pipeline_; }
+  ThreadPool& pool() { return pool_; }
+  Heightfield& field() { return field_; }
+
+  /// Set before the first batch.
+  void set_loader(ChunkLoader loader) { loader_ = std::move(loader); }
+
+  /// Runs the whole pipeline for `targets` and blocks until it finishes or
+  /// is cancelled. Rethrows the first exception a stage threw.
+  GenerationStats generate(std::span<const ChunkCoord> targets,
+                           const GenerateOptions& options = {});
+
+  ScratchStats scratch_stats();
+
+  /// Ownership of the field, released on destruction.
+  class [[nodiscard]] Exclusive {
+   public:
+    explicit Exclusive(ChunkScheduler& scheduler) : scheduler_(scheduler) {}
+    ~Exclusive() { scheduler_.release(); }
+    Exclusive(const Exclusive&) = delete;
+    Exclusive& operator=(const Exclusive&) = delete;
+
+   private:
+    ChunkScheduler& scheduler_;
+  };
+
+  /// Holds off batches so the caller can mutate chunks the workers would
+  /// otherwise be reading. Waits as a Visible batch would, preempting
+  /// lower classes.
+  Exclusive exclusive();
+
+ private:
+  struct Waiter {
+    Priority priority;
+    Deadline deadline;
+    std::uint64_t ticket;
+  };
+
+  /// Waits until the field is free and no better waiter is queued, asking
+  /// a lower-class owner to yield meanwhile. `yield` is the caller's own
+  /// preemption flag, cleared on entry and raised while it owns the field. A zero ticket is
+  /// assigned; a preempted batch passes its ticket back to keep its place.
+  /// Returns false, without taking ownership, if `stop` is requested.
+  bool acquire(Waiter& waiter, std::atomic<bool>* yield, const std::stop_token& stop = {});
+  void release();
+
+  ThreadPool& pool_;
+  Heightfield& field_;
+  Pipeline pipeline_;
+  ChunkLoader loader_;
+  std::vector<Arena> arenas_;  // one per pool worker
+  /// Per stage: the `stage.<name>` histogram and the interned trace name.
+  std::vector<Histogram*> stage_histograms_;
+  std::vector<const char*> stage_names_;
+
+  std::mutex gate_mutex_;
+  std::condition_variable gate_cv_;
+  std::vector<Waiter> waiters_;
+  std::uint64_t next_ticket_ = 0;
+  bool owned_ = false;
+  Priority owner_priority_ = Priority::Visible;
+  /// The owning batch's preemption flag; null for exclusive().
+  std::atomic<bool>* owner_yield_ = nullptr;
+};
+
+}  // namespace terram
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstdint>
+
+namespace terram {
+
+/// Instruction sets that hot kernels are specialised for.
+enum class SimdIsa : std::uint8_t {
+  Scalar,
+  Avx2,
+  Avx512,
+  Neon,
+};
+
+const char* to_string(SimdIsa isa);
+
+/// Whether the running CPU (and the build) can execute kernels for `isa`.
+bool simd_supported(SimdIsa isa);
+
+/// Widest supported instruction set on this CPU.
+SimdIsa detect_simd();
+
+}  // namespace terram
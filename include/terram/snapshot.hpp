@@ -0,0 +1,141 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <span>
+
+#include "terram/chunk.hpp"
+#include "terram/types.hpp"
+
+namespace terram {
+
+namespace snapshot_format {
+
+// Layout of a snapshot file, native byte order:
+//
+//   [0, 4 KiB)          Header
+//   [4 KiB, ...)        ChunkEntry entries[chunk_count]
+//   page aligned        per chunk: its planes, each starting on a page, then
+//                       its voxels, mesh and surface payloads
+//
+// Planes are stored in the in-memory tiled layout, so a mapped plane is
+// used directly as a TiledPlane. Offsets are from the start of the file;
+// zero means absent.
+
+inline constexpr char kMagic[8] = {'T', 'E', 'R', 'R', 'A', 'M', 'S', 'N'};
+inline constexpr std::uint32_t kVersion = 1;
+inline constexpr std::uint32_t kByteOrderMark = 0x01020304;
+inline constexpr std::size_t kEntryOffset = 4096;
+inline constexpr std::size_t kPlaneAlign = 4096;
+inline constexpr std::size_t kPayloadAlign = 64;
+
+struct Header {
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t byte_order;
+  std::uint32_t chunk_size;
+  std::uint32_t tile_size;
+  std::uint32_t brick_size;
+  std::uint32_t entry_bytes;
+  /// World seed and generator fingerprint; see SnapshotKey.
+  std::uint64_t seed;
+  std::uint64_t fingerprint;
+  std::uint64_t chunk_count;
+  std::uint64_t file_bytes;
+};
+
+inline constexpr std::uint32_t kEdited = 1u << 0;
+
+// Voxels payload: VoxelHeader, then one code per brick in BrickMap slot
+// order (layer, then z, then x): the brick's uniform value in the low
+// byte, or kDenseBrick | n for the n-th of the dense blocks that follow,
+// kBrickCells densities each.
+struct VoxelHeader {
+  std::int32_t base_layer;
+  std::int32_t layers;
+  std::uint32_t dense;
+  std::uint32_t reserved;
+};
+
+inline constexpr std::uint32_t kDenseBrick = 0x80000000u;
+
+struct ChunkEntry {
+  std::int32_t x;
+  std::int32_t z;
+  /// Chunk::stage() when written.
+  std::uint32_t stage;
+  std::uint32_t flags;
+  std::uint64_t height;
+  std::uint64_t normals;
+  std::uint64_t biomes;
+  std::uint64_t voxels;
+  std::uint64_t voxel_bytes;
+  /// MeshVertex array, then uint16 indices.
+  std::uint64_t mesh;
+  std::uint32_t mesh_vertices;
+  std::uint32_t mesh_indices;
+  /// SurfaceVertex array, then uint32 indices.
+  std::uint64_t surface;
+  std::uint32_t surface_vertices;
+  std::uint32_t surface_indices;
+};
+
+static_assert(sizeof(ChunkEntry) == 88);
+static_assert(sizeof(Header) <= kEntryOffset);
+
+}  // namespace snapshot_format
+
+/// Identifies the generator a snapshot was taken from: the world seed and
+/// a hash of what else determines its output (see World::save_snapshot()).
+struct SnapshotKey {
+  std::uint64_t seed = 0;
+  std::uint64_t fingerprint = 0;
+
+  bool operator==(const SnapshotKey&) const = default;
+};
+
+struct SnapshotChunk {
+  std::shared_ptr<const Chunk> chunk;
+  /// Heights differ from what the seed generates; restored chunks keep
+  /// this so their edits still persist and encode as deltas.
+  bool edited = false;
+};
+
+/// Writes `chunks` with every plane, voxel layer and mesh they hold to a
+/// snapshot file, replacing `path` atomically: the file is written beside
+/// it, synced and renamed over it, so a reader never maps a torn snapshot.
+/// Throws std::system_error on I/O failure.
+void write_snapshot(const std::filesystem::path& path, SnapshotKey key,
+                    std::span<const SnapshotChunk> chunks);
+
+/// Read-only mapping of a snapshot file. Chunks loaded from it borrow their
+/// planes from the mapping, like RegionStore::load(), so restoring a warm
+/// cache costs page faults, not regeneration or copies; voxels and meshes
+/// are copied out. The mapping stays alive while any chunk borrows it.
+class Snapshot {
+ public:
+  /// Maps `path` and starts reading it into the page cache. Throws
+  /// std::system_error if it cannot be opened and std::runtime_error if it
+  /// is malformed or laid out for another build.
+  explicit Snapshot(const std::filesystem::path& path);
+
+  SnapshotKey key() const;
+  std::size_t size() const;
+  ChunkCoord coord(std::size_t i) const;
+  bool edited(std::size_t i) const;
+
+  /// Chunk `i` at its recorded stage. Edited chunks own their heights, so
+  /// that a later eviction writes them back; the rest borrow them.
+  std::shared_ptr<Chunk> load(std::size_t i) const;
+
+ private:
+  struct Mapping;
+
+  const snapshot_format::ChunkEntry& entry(std::size_t i) const;
+
+  std::shared_ptr<const Mapping> map_;
+};
+
+}  // namespace terram
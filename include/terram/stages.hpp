@@ -0,0 +1,96 @@
+#pragma once
+
+#include <memory>
+#include <utility>
+
+#include "terram/biome.hpp"
+#include "terram/caves.hpp"
+#include "terram/erosion.hpp"
+#include "terram/mesh.hpp"
+#include "terram/noise.hpp"
+#include "terram/noise_graph.hpp"
+#include "terram/noise_program.hpp"
+#include "terram/scheduler.hpp"
+#include "terram/surface.hpp"
+
+namespace terram::stages {
+
+/// Writes fBm heights into the chunk's height plane.
+Stage heightmap(std::shared_ptr<const SimplexNoise> noise, FbmParams params);
+
+/// Writes a noise graph's values into the chunk's height plane; see
+/// noise_graph.hpp.
+template <graph::Expression E>
+Stage heightmap(std::shared_ptr<const SimplexNoise> noise, E expr) {
+  return Stage{
+      .name = "heightmap",
+      .run = [noise = std::move(noise), expr = std::move(expr)](StageContext& ctx) {
+        graph::fill(expr, *noise, ctx.chunk.coord(), ctx.chunk.height());
+      },
+  };
+}
+
+/// Writes a bytecode program's output into the chunk's height plane.
+Stage heightmap(std::shared_ptr<const SimplexNoise> noise,
+                std::shared_ptr<const NoiseProgram> program);
+
+/// Regenerates the fBm heights heightmap() writes, for erosion's input.
+HeightSource fbm_source(std::shared_ptr<const SimplexNoise> noise, FbmParams params);
+
+/// Regenerates a noise graph's heights, for erosion's input.
+template <graph::Expression E>
+HeightSource graph_source(std::shared_ptr<const SimplexNoise> noise, E expr) {
+  return [noise = std::move(noise), expr = std::move(expr)](ChunkCoord coord, float* out) {
+    graph::fill(expr, *noise, coord, out);
+  };
+}
+
+/// Regenerates a bytecode program's heights, for erosion's input.
+HeightSource program_source(std::shared_ptr<const SimplexNoise> noise,
+                            std::shared_ptr<const NoiseProgram> program);
+
+/// Hydraulic and thermal erosion; see erode(). Overwrites the chunk's
+/// heights with the eroded `source` heights, so it needs no neighbours and
+/// makes a preceding heightmap() stage redundant. `source` is read through
+/// cached_source(), sized by params.source_cache.
+Stage erosion(ErosionParams params, HeightSource source);
+
+/// Derived: classifies every cell into a biome from its height and two
+/// climate fields (see BiomeOptions), a tile at a time through the table.
+/// Temperature falls with height above sea level.
+Stage biomes(std::uint64_t seed, BiomeOptions options);
+
+/// Derived: sparse density volume of caves and overhangs under the
+/// chunk's heights; see carve_caves(). Heights stay as they are, so
+/// consumers that only read the heightfield see no caves.
+Stage caves(std::uint64_t seed, CaveOptions options);
+
+/// Derived: isosurface of the density volume a caves() stage built; see
+/// SurfaceExtractor. Reads the neighbours' volumes, so it must directly
+/// follow caves(). With options.parallel, idle workers share the bricks.
+Stage surface(SurfaceOptions options);
+
+/// Derived: central-difference surface normals from the chunk's heights and
+/// its neighbours' border cells.
+Stage normals();
+
+/// Derived: adaptive RTIN mesh of the chunk, sharing its +x / +z border
+/// with the neighbours; see build_mesh().
+Stage mesh(MeshOptions options);
+
+/// One stage running every member's tile kernel over a tile before moving
+/// to the next, instead of each member passing over the whole chunk in
+/// turn, so the tile's planes stay in L1 from the first member to the
+/// last. Members run in order within each tile. The fused stage is named
+/// "a+b+..." and reads neighbours if its first member does. Throws
+/// std::invalid_argument if a member has no tile kernel, a member other
+/// than the first reads neighbours (it would see tiles the group has not
+/// reached yet), or members mix derived and generation stages. Output is
+/// identical to running the members one after another.
+Stage fuse(std::vector<Stage> members);
+
+/// Replaces every maximal run of consecutive stages that fuse() accepts
+/// with their fused stage; other stages stay as they are.
+Pipeline fuse_tiles(Pipeline pipeline);
+
+}  // namespace terram::stages
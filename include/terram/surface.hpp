@@ -0,0 +1,67 @@
+#pragma once
+
+#include <memory>
+
+#include "terram/heightfield.hpp"
+#include "terram/mesh_buffers.hpp"
+#include "terram/thread_pool.hpp"
+
+namespace terram {
+
+struct SurfaceOptions {
+  /// Let idle workers of the pool running the stage take bricks as well as
+  /// the worker that runs it.
+  bool parallel = true;
+  /// Bricks per helper: a chunk with fewer candidate bricks than twice this
+  /// is extracted by the calling thread alone.
+  int bricks_per_helper = 32;
+};
+
+/// Isosurface extraction over the sparse density layer (see BrickMap) by
+/// surface nets, the dual-contouring variant that places each vertex at
+/// the mean of its cell's edge crossings: one vertex per cell the surface
+/// passes through, and one quad across every edge whose endpoints differ
+/// in sign. Normals come from the density gradient and point out of the
+/// solid.
+///
+/// A chunk owns the edges whose lower endpoint lies in its columns, so
+/// neighbouring chunks' surfaces meet without gaps or overlaps; the cells
+/// on the -x / -z side and the samples past +x / +z come from the
+/// neighbours' volumes. Work is split by brick: a uniform brick whose +x,
+/// +y and +z neighbours are uniform with the same sign cannot own a
+/// crossing and is skipped outright, and the sign tests on the rest run a
+/// whole brick row at a time.
+///
+/// Bricks are claimed from a shared counter by the calling thread and by
+/// helper tasks spawned on `pool`. The caller never waits on a task that
+/// has not started, so extracting from inside a pool task cannot
+/// deadlock. Each participant appends to its own pooled buffers and the
+/// results are concatenated in brick order afterwards without locks, so
+/// the mesh is identical whoever extracted which brick. Vertices along a
+/// brick seam are emitted by both bricks; they coincide exactly.
+class SurfaceExtractor {
+ public:
+  explicit SurfaceExtractor(SurfaceOptions options = {});
+  ~SurfaceExtractor();
+
+  SurfaceExtractor(const SurfaceExtractor&) = delete;
+  SurfaceExtractor& operator=(const SurfaceExtractor&) = delete;
+
+  const SurfaceOptions& options() const { return options_; }
+
+  /// Replaces `out` with the surface of the centre chunk's volume, or
+  /// clears it if the chunk has none. Null `pool` (or options().parallel
+  /// off) extracts on the calling thread only. Thread-safe.
+  void extract(const ChunkNeighborhood& neighbors, SurfaceMesh& out,
+               ThreadPool* pool = nullptr) const;
+
+ private:
+  struct Buffers;
+  struct BufferPool;
+  struct Run;
+
+  SurfaceOptions options_;
+  std::shared_ptr<BufferPool> buffers_;
+};
+
+}  // namespace terram
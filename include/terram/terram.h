@@ -0,0 +1,194 @@
+/* Terram C ABI: a stable interface to the shared library for callers that
+ * are not C++ (or not built with the same compiler and standard library).
+ *
+ * Chunk data is handed out as borrowed, read-only views into the chunk's
+ * own memory, never copied into caller buffers. A view stays valid, and
+ * unchanged, for as long as the terram_chunk handle it came from is held.
+ * Edits (terram_world_apply_deltas(), or any edit on the C++ side) publish
+ * new chunks rather than rebuilding a handed-out one in place; the
+ * world's next terram_world_chunk() returns the new one. Releasing a
+ * handle never invalidates another handle's views.
+ *
+ * Every function returning terram_status catches all errors; on failure
+ * terram_last_error() describes the most recent one on the calling thread.
+ * Structs passed in carry their own size first, so fields can be appended
+ * in later versions without breaking older callers. */
+
+#ifndef TERRAM_TERRAM_H
+#define TERRAM_TERRAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Bumped when an existing declaration changes incompatibly. */
+#define TERRAM_ABI_VERSION 1
+
+typedef enum terram_status {
+  TERRAM_OK = 0,
+  TERRAM_INVALID_ARGUMENT = 1,
+  /* The chunk has no such plane: its stage is not in the pipeline. */
+  TERRAM_NOT_AVAILABLE = 2,
+  TERRAM_OUT_OF_MEMORY = 3,
+  TERRAM_IO_ERROR = 4,
+  TERRAM_INTERNAL_ERROR = 5
+} terram_status;
+
+typedef struct terram_world terram_world;
+/* Shared ownership of one chunk: its memory stays alive, even after the
+ * world's cache evicts it, until terram_chunk_release(). */
+typedef struct terram_chunk terram_chunk;
+
+typedef struct terram_chunk_coord {
+  int32_t x;
+  int32_t z;
+} terram_chunk_coord;
+
+typedef struct terram_fbm {
+  float frequency;
+  int32_t octaves;
+  float lacunarity;
+  float gain;
+  float amplitude;
+  float offset;
+} terram_fbm;
+
+/* Optional stages of the built-in pipeline, with their default options. */
+enum {
+  TERRAM_STAGE_EROSION = 1u << 0,
+  TERRAM_STAGE_BIOMES = 1u << 1,
+  TERRAM_STAGE_CAVES = 1u << 2,
+  /* Isosurface of the caves' volume; needs TERRAM_STAGE_CAVES. */
+  TERRAM_STAGE_SURFACE = 1u << 3,
+  TERRAM_STAGE_MESH = 1u << 4
+};
+
+typedef struct terram_world_options {
+  /* sizeof(terram_world_options) as the caller was compiled. */
+  size_t struct_size;
+  uint64_t seed;
+  terram_fbm terrain;
+  /* TERRAM_STAGE_* bits. */
+  uint32_t stages;
+  /* Worker threads; 0 means one per hardware thread. */
+  uint32_t threads;
+  /* Resident chunk memory budget in bytes. */
+  uint64_t cache_budget_bytes;
+  /* Directory of region files, or NULL to keep the world in memory. */
+  const char* store_directory;
+} terram_world_options;
+
+/* Cells of a chunk plane, in the chunk's tiled layout: square tiles of
+ * tile_size x tile_size cells, each stored row-major, the tiles themselves
+ * row-major. terram_plane_cell() does the addressing. */
+typedef struct terram_plane_view {
+  const void* data;
+  uint32_t cell_bytes;
+  uint32_t chunk_size;
+  uint32_t tile_size;
+  /* Bytes from one row of a tile to the next. */
+  uint32_t row_stride;
+  /* Bytes from one tile to the next along x. */
+  uint32_t tile_stride;
+  /* Bytes from one row of tiles to the next along z. */
+  uint32_t tile_row_stride;
+} terram_plane_view;
+
+static inline const void* terram_plane_cell(const terram_plane_view* view, uint32_t x,
+                                            uint32_t z) {
+  const uint32_t t = view->tile_size;
+  return (const char*)view->data + (z / t) * view->tile_row_stride +
+         (x / t) * view->tile_stride + (z % t) * view->row_stride + (x % t) * view->cell_bytes;
+}
+
+/* A triangle list. Vertices are vertex_floats floats each, vertex_stride
+ * bytes apart: x, y, z in chunk-local cells for the height mesh, followed
+ * by the outward unit normal for the isosurface. Indices are index_bytes
+ * (2 or 4) wide, three per triangle. */
+typedef struct terram_mesh_view {
+  const float* vertices;
+  uint32_t vertex_count;
+  uint32_t vertex_floats;
+  uint32_t vertex_stride;
+  const void* indices;
+  uint32_t index_count;
+  uint32_t index_bytes;
+} terram_mesh_view;
+
+/* The density layer's vertical extent, in bricks of brick_size^3 cells;
+ * see terram_chunk_brick(). */
+typedef struct terram_voxel_info {
+  int32_t base_layer;
+  int32_t layers;
+  int32_t brick_size;
+  int32_t bricks_per_side;
+} terram_voxel_info;
+
+uint32_t terram_abi_version(void);
+/* Message of the last failed call on this thread; empty if none. Valid
+ * until the next failing call on the same thread. */
+const char* terram_last_error(void);
+
+/* Fills `options` with the defaults of the C++ WorldOptions. */
+void terram_world_options_init(terram_world_options* options);
+terram_status terram_world_create(const terram_world_options* options, terram_world** out);
+/* Outstanding chunk handles stay valid after their world is destroyed. */
+void terram_world_destroy(terram_world* world);
+
+/* The fully generated chunk at `coord`; blocks while generating. */
+terram_status terram_world_chunk(terram_world* world, terram_chunk_coord coord,
+                                 terram_chunk** out);
+/* Batched terram_world_chunk(): misses are generated together. out[i] is
+ * the chunk at coords[i]; on failure every entry is NULL. */
+terram_status terram_world_chunks(terram_world* world, const terram_chunk_coord* coords,
+                                  size_t count, terram_chunk** out);
+/* Decodes delta records made by the C++ World::encode_deltas(). */
+terram_status terram_world_apply_deltas(terram_world* world, const uint8_t* data, size_t size,
+                                        size_t* applied);
+
+/* World::save_snapshot() and World::load_snapshot(): a warm cache image.
+ * A snapshot from another seed or pipeline is TERRAM_INVALID_ARGUMENT.
+ * `count`, if not NULL, receives the number of chunks written or loaded. */
+terram_status terram_world_save_snapshot(terram_world* world, const char* path, size_t* count);
+terram_status terram_world_load_snapshot(terram_world* world, const char* path, size_t* count);
+
+/* World::sample_points(): heights, unit normals and biome ids at `count`
+ * world positions (x[i], z[i]) in cells, generating the chunks they read
+ * first. Results are structure of arrays, entry i for point i; any output
+ * may be NULL. found[i] is 0 where a point could not be sampled, its other
+ * entries then zero and its normal straight up. */
+terram_status terram_world_sample_points(terram_world* world, const double* x, const double* z,
+                                         size_t count, float* height, float* normal_x,
+                                         float* normal_y, float* normal_z, uint8_t* biome,
+                                         uint8_t* found);
+
+void terram_chunk_release(terram_chunk* chunk);
+terram_chunk_coord terram_chunk_coord_of(const terram_chunk* chunk);
+
+/* float heights. */
+terram_status terram_chunk_heights(const terram_chunk* chunk, terram_plane_view* out);
+/* Normals as two int16 snorm components (x, z); y is positive and
+ * implied. */
+terram_status terram_chunk_normals(const terram_chunk* chunk, terram_plane_view* out);
+/* uint8 biome ids. */
+terram_status terram_chunk_biomes(const terram_chunk* chunk, terram_plane_view* out);
+/* Height mesh: 3 floats per vertex, 16-bit indices. */
+terram_status terram_chunk_mesh(const terram_chunk* chunk, terram_mesh_view* out);
+/* Isosurface: 6 floats per vertex, 32-bit indices. */
+terram_status terram_chunk_surface(const terram_chunk* chunk, terram_mesh_view* out);
+
+terram_status terram_chunk_voxels(const terram_chunk* chunk, terram_voxel_info* out);
+/* Brick (bx, layer, bz): *cells points at its brick_size^3 int8 densities,
+ * indexed [(y * brick_size + z) * brick_size + x], or is NULL when every
+ * cell holds *uniform. Positive is solid. */
+terram_status terram_chunk_brick(const terram_chunk* chunk, int32_t bx, int32_t layer,
+                                 int32_t bz, const int8_t** cells, int8_t* uniform);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TERRAM_TERRAM_H */
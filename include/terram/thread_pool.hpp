@@ -0,0 +1,124 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace terram {
+
+/// Unit of work for the thread pool. Tasks are not owned by the pool; the
+/// submitter keeps them alive until run() returns.
+class Task {
+ public:
+  virtual ~Task() = default;
+  virtual void run() = 0;
+};
+
+/// How workers are bound to CPUs.
+enum class WorkerAffinity {
+  None,      ///< Let the OS place workers.
+  NumaNode,  ///< Pin each worker to every CPU of its assigned NUMA node.
+  Core,      ///< Pin each worker to a single CPU of its assigned node.
+};
+
+struct ThreadPoolOptions {
+  /// Worker count; 0 means one per hardware thread.
+  unsigned threads = 0;
+  WorkerAffinity affinity = WorkerAffinity::None;
+  /// NUMA nodes to spread workers over, in blocks of consecutive worker
+  /// indices. Empty means every node.
+  std::vector<int> numa_nodes;
+};
+
+/// Work-stealing thread pool. Each worker owns a Chase-Lev deque: tasks
+/// submitted from a worker go to its own deque and run LIFO, so dependent
+/// work stays on the core whose cache holds its inputs; idle workers steal
+/// FIFO from the other end. Tasks submitted from outside the pool go
+/// through a shared injection queue.
+///
+/// On a pool spanning several NUMA nodes, submit(task, node) queues a task
+/// for the workers of one node, and thieves try workers on their own node
+/// before crossing to another, so work stays next to the memory it was
+/// placed on whenever a local worker is free to run it.
+class ThreadPool {
+ public:
+  explicit ThreadPool(ThreadPoolOptions options = {});
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  void submit(Task* task);
+  /// submit() preferring the workers of NUMA node `node`: the calling
+  /// worker's own deque if it is on that node, else the node's queue,
+  /// which any idle worker still drains once its own node has nothing
+  /// left. A node the pool does not span, or -1, is plain submit().
+  void submit(Task* task, int node);
+
+  /// Runs `fn` on the pool; the wrapper frees itself after running.
+  template <typename F>
+  void spawn(F&& fn) {
+    submit(new FunctionTask<std::decay_t<F>>(std::forward<F>(fn)));
+  }
+
+  unsigned size() const { return static_cast<unsigned>(workers_.size()); }
+
+  /// NUMA node the worker at `index` was assigned to.
+  int worker_node(unsigned index) const;
+  /// Distinct NUMA nodes the workers were spread over.
+  unsigned node_count() const { return node_count_; }
+
+  /// Index of the calling worker in its pool, or -1 off-pool.
+  static int current_worker();
+  /// Pool the calling thread is a worker of, or null.
+  static ThreadPool* current_pool();
+  /// NUMA node of the calling worker, or -1 off-pool.
+  static int current_node();
+
+ private:
+  template <typename F>
+  class FunctionTask final : public Task {
+   public:
+    explicit FunctionTask(F fn) : fn_(std::move(fn)) {}
+    void run() override {
+      fn_();
+      delete this;
+    }
+
+   private:
+    F fn_;
+  };
+
+  struct Worker;
+  struct NodeQueue;
+
+  void worker_main(unsigned index);
+  Task* find_work(unsigned self, std::uint64_t& rng);
+  Task* steal_from(unsigned self, std::uint64_t& rng, bool remote);
+  void notify();
+
+  std::vector<std::unique_ptr<Worker>> workers_;
+  /// Indexed by node; empty unless the workers span several nodes.
+  std::vector<std::unique_ptr<NodeQueue>> node_queues_;
+  unsigned node_count_ = 1;
+  std::vector<std::thread> threads_;
+
+  std::mutex inject_mutex_;
+  std::deque<Task*> inject_;
+  std::atomic<std::size_t> inject_size_{0};
+
+  std::mutex sleep_mutex_;
+  std::condition_variable sleep_cv_;
+  std::atomic<std::uint64_t> epoch_{0};
+  std::atomic<unsigned> sleepers_{0};
+  std::atomic<bool> stop_{false};
+};
+
+}  // namespace terram
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace terram {
+
+/// Cells along one side of a chunk.
+inline constexpr int kChunkSize = 64;
+/// Cells along one side of a tile. A chunk is stored as kTilesPerSide^2
+/// contiguous tiles rather than as one row-major array.
+inline constexpr int kTileSize = 16;
+inline constexpr int kTilesPerSide = kChunkSize / kTileSize;
+inline constexpr int kTileCells = kTileSize * kTileSize;
+inline constexpr int kChunkCells = kChunkSize * kChunkSize;
+
+inline constexpr int kChunkShift = 6;
+inline constexpr int kTileShift = 4;
+
+/// Alignment of every plane allocation.
+inline constexpr std::size_t kCacheLine = 64;
+
+static_assert((1 << kChunkShift) == kChunkSize);
+static_assert((1 << kTileShift) == kTileSize);
+static_assert(kTileSize * sizeof(float) == kCacheLine,
+              "one tile row of floats must be exactly one cache line");
+
+/// Integer chunk coordinate on the horizontal plane.
+struct ChunkCoord {
+  std::int32_t x = 0;
+  std::int32_t z = 0;
+
+  friend constexpr bool operator==(ChunkCoord, ChunkCoord) = default;
+};
+
+struct ChunkCoordHash {
+  std::size_t operator()(ChunkCoord c) const noexcept {
+    std::uint64_t k = (static_cast<std::uint64_t>(static_cast<std::uint32_t>(c.x)) << 32) |
+                      static_cast<std::uint32_t>(c.z);
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    return static_cast<std::size_t>(k);
+  }
+};
+
+/// Chunk containing world cell (wx, wz). Uses floor division so negative
+/// cells map to negative chunks.
+constexpr ChunkCoord chunk_of(std::int64_t wx, std::int64_t wz) {
+  return {static_cast<std::int32_t>(wx >> kChunkShift),
+          static_cast<std::int32_t>(wz >> kChunkShift)};
+}
+
+/// Cell offset of world coordinate w inside its chunk, in [0, kChunkSize).
+constexpr int local_of(std::int64_t w) {
+  return static_cast<int>(w & (kChunkSize - 1));
+}
+
+/// World coordinate of the chunk's first cell along one axis.
+constexpr std::int64_t chunk_origin(std::int32_t c) {
+  return static_cast<std::int64_t>(c) * kChunkSize;
+}
+
+/// Position of local cell (x, z) in the tiled layout: tiles are stored in
+/// row-major tile order and cells are row-major inside a tile.
+constexpr int tiled_index(int x, int z) {
+  const int tile = (z >> kTileShift) * kTilesPerSide + (x >> kTileShift);
+  const int cell = (z & (kTileSize - 1)) * kTileSize + (x & (kTileSize - 1));
+  return tile * kTileCells + cell;
+}
+
+}  // namespace terram
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "terram/types.hpp"
+
+namespace terram {
+
+/// Cells along each side of a brick.
+inline constexpr int kBrickSize = 8;
+inline constexpr int kBrickShift = 3;
+inline constexpr int kBrickCells = kBrickSize * kBrickSize * kBrickSize;
+/// Bricks along each horizontal side of a chunk.
+inline constexpr int kBricksPerSide = kChunkSize / kBrickSize;
+/// Cells in one layer of bricks: a kChunkSize x kBrickSize x kChunkSize slab.
+inline constexpr int kBrickLayerCells = kChunkCells * kBrickSize;
+
+static_assert((1 << kBrickShift) == kBrickSize);
+
+/// Density in [-1, 1] stored as a signed byte: positive is solid, negative
+/// empty, and the surface lies where it crosses zero.
+using Density = std::int8_t;
+
+inline constexpr Density kSolid = 127;
+inline constexpr Density kEmpty = -127;
+
+inline Density quantize_density(float d) {
+  const float c = d < -1.0f ? -1.0f : (d > 1.0f ? 1.0f : d);
+  // NaN fails both compares above and is stored as empty.
+  if (!(c == c)) return kEmpty;
+  return static_cast<Density>(c * 127.0f + (c < 0.0f ? -0.5f : 0.5f));
+}
+
+inline float density_value(Density d) { return static_cast<float>(d) * (1.0f / 127.0f); }
+
+/// Sparse 3D density of one chunk, for what a heightfield cannot express
+/// (caves, overhangs, arches). The chunk's column is split into 8^3 bricks
+/// over layers [base_layer, base_layer + layers()) of kBrickSize cells of
+/// height. A brick whose cells all hold one value is stored as that value;
+/// only bricks with differing cells, in practice those the surface passes
+/// through, keep a dense 512-byte block. Storing densities truncated to a
+/// narrow band around the surface (as stages::caves() does) makes
+/// everything away from the surface uniform, so memory follows the
+/// surface's area, not the volume.
+///
+/// Cells below the covered layers read as solid and above as empty.
+class BrickMap {
+ public:
+  BrickMap() = default;
+  BrickMap(int base_layer, int layers) { reset(base_layer, layers); }
+
+  /// Covers layers [base_layer, base_layer + layers), every brick empty.
+  /// Dense storage keeps its capacity for reuse.
+  void reset(int base_layer, int layers);
+
+  int base_layer() const { return base_layer_; }
+  int layers() const { return layers_; }
+  /// Lowest covered cell height, and one past the highest.
+  int min_y() const { return base_layer_ * kBrickSize; }
+  int max_y() const { return (base_layer_ + layers_) * kBrickSize; }
+
+  /// Density of local cell (x, z) in [0, kChunkSize) at height y.
+  Density at(int x, int y, int z) const;
+  float density(int x, int y, int z) const { return density_value(at(x, y, z)); }
+
+  /// Sets one covered cell, making its brick dense if the value differs.
+  /// Call compact() after a batch of edits to collapse bricks again.
+  void set(int x, int y, int z, Density value);
+
+  /// Replaces layer `layer` (absolute, like base_layer) with `cells`:
+  /// kBrickLayerCells densities indexed [(y * kChunkSize + z) * kChunkSize
+  /// + x] for y in [0, kBrickSize). Uniform bricks are collapsed as they
+  /// are stored.
+  void store_layer(int layer, const Density* cells);
+
+  /// Replaces brick (bx, bz) of absolute layer `layer` with `cells`, in
+  /// brick() order, or with `value` throughout if `cells` is null. Layers
+  /// outside the covered range are ignored.
+  void store_brick(int bx, int layer, int bz, const Density* cells, Density value = 0);
+
+  /// Collapses every dense brick whose cells are all equal; returns how
+  /// many were collapsed.
+  std::size_t compact();
+
+  /// Brick at brick coordinates (bx, bz) in [0, kBricksPerSide) and
+  /// absolute layer `layer`: null if uniform, with its value in `uniform`;
+  /// else its cells, indexed [(y * kBrickSize + z) * kBrickSize + x].
+  const Density* brick(int bx, int layer, int bz, Density* uniform) const;
+
+  std::size_t brick_count() const { return slots_.size(); }
+  std::size_t dense_bricks() const { return dense_ - free_.size(); }
+  /// Heap bytes held, including dense blocks free for reuse.
+  std::size_t memory_bytes() const;
+
+ private:
+  /// A slot holds a uniform value in its low byte, or a dense block's index
+  /// with kDenseBit set.
+  static constexpr std::uint32_t kDenseBit = 0x80000000u;
+
+  std::size_t slot_index(int bx, int layer, int bz) const {
+    return static_cast<std::size_t>(((layer - base_layer_) * kBricksPerSide + bz) *
+                                        kBricksPerSide +
+                                    bx);
+  }
+  static std::uint32_t uniform_slot(Density value) {
+    return static_cast<std::uint8_t>(value);
+  }
+  Density* block(std::uint32_t slot) {
+    return bricks_.data() + static_cast<std::size_t>(slot & ~kDenseBit) * kBrickCells;
+  }
+  const Density* block(std::uint32_t slot) const {
+    return bricks_.data() + static_cast<std::size_t>(slot & ~kDenseBit) * kBrickCells;
+  }
+  std::uint32_t allocate_block();
+  void release_block(std::uint32_t slot);
+
+  int base_layer_ = 0;
+  int layers_ = 0;
+  std::vector<std::uint32_t> slots_;
+  std::vector<Density> bricks_;
+  /// Dense blocks in use or free.
+  std::size_t dense_ = 0;
+  std::vector<std::uint32_t> free_;
+};
+
+}  // namespace terram
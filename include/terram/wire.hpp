@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "terram/chunk.hpp"
+#include "terram/types.hpp"
+
+namespace terram {
+
+/// Header of one chunk delta record.
+struct DeltaRecord {
+  ChunkCoord coord;
+  /// Pipeline stage the baseline was generated to.
+  int stage = 0;
+  float quantum = 0.0f;
+  /// Every cell matched the baseline to within the quantum; no payload.
+  bool identical = false;
+  /// Bytes of the whole record, header included.
+  std::size_t size = 0;
+};
+
+/// Heights differ from what a client regenerates from the seed only where
+/// they were edited, so a chunk travels as its difference from that
+/// baseline. The encoder:
+///   1. quantizes height - baseline to multiples of `quantum`, so decoded
+///      heights are within quantum / 2 of the originals;
+///   2. replaces each value with its Lorenzo residual, value minus the
+///      prediction left + above - above-left, which is zero wherever the
+///      delta is constant or planar;
+///   3. zigzags residuals to bytes, escaping large ones to a varint side
+///      stream;
+///   4. codes the byte stream with a static rANS coder. A chunk has
+///      exactly 2^12 cells, so the symbol counts are the normalized
+///      frequencies as they stand.
+/// An untouched chunk costs a 24-byte header, and a few edited cells add
+/// a few dozen bytes. Appends the record to `out`.
+void encode_delta(ChunkCoord coord, int stage, const TiledPlane<float>& heights,
+                  const TiledPlane<float>& baseline, float quantum,
+                  std::vector<std::uint8_t>& out);
+
+/// Reads the header of the record at the front of `in`. Throws
+/// std::runtime_error if it is truncated or not a delta record.
+DeltaRecord peek_delta(std::span<const std::uint8_t> in);
+
+/// Decodes the record at the front of `in` against `baseline` into `out`
+/// and returns its header. Throws std::runtime_error on malformed input.
+DeltaRecord decode_delta(std::span<const std::uint8_t> in, const TiledPlane<float>& baseline,
+                         TiledPlane<float>& out);
+
+}  // namespace terram
@@ -0,0 +1,199 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <stop_token>
+#include <unordered_set>
+#include <vector>
+
+#include "terram/biome.hpp"
+#include "terram/caves.hpp"
+#include "terram/chunk_cache.hpp"
+#include "terram/edit.hpp"
+#include "terram/erosion.hpp"
+#include "terram/heightfield.hpp"
+#include "terram/mesh.hpp"
+#include "terram/noise.hpp"
+#include "terram/query.hpp"
+#include "terram/region_store.hpp"
+#include "terram/scheduler.hpp"
+#include "terram/snapshot.hpp"
+#include "terram/surface.hpp"
+#include "terram/thread_pool.hpp"
+
+namespace terram {
+
+struct WorldOptions {
+  std::uint64_t seed = 0;
+  FbmParams terrain;
+  /// Generation stages; empty means the built-in pipeline for `terrain`
+  /// (erosion if set, else heightmap, then derived normals, and biomes,
+  /// caves, surface and mesh where set; see stages::fuse_tiles()). Every
+  /// built-in stage is a pure function of the seed and the chunk
+  /// coordinate, so output is bit-identical whatever the thread count,
+  /// scheduling order, cache size or SIMD path; see hash_chunks().
+  Pipeline pipeline;
+  /// Erosion for the built-in pipeline; unset skips it.
+  std::optional<ErosionParams> erosion;
+  /// Biome classification for the built-in pipeline; unset skips it.
+  std::optional<BiomeOptions> biomes;
+  /// Caves and overhangs for the built-in pipeline; unset skips them.
+  std::optional<CaveOptions> caves;
+  /// Isosurface of the caves' volume for the built-in pipeline; unset, or
+  /// without caves, skips it.
+  std::optional<SurfaceOptions> surface;
+  /// Meshing for the built-in pipeline; unset skips it.
+  std::optional<MeshOptions> mesh;
+  /// Hard budget for resident chunk memory.
+  std::size_t cache_budget_bytes = std::size_t{1} << 30;
+  /// Directory of region files; unset keeps the world in memory only, with
+  /// edited chunks pinned in the cache so their edits are never evicted.
+  std::optional<std::filesystem::path> store_directory;
+  /// Write generated chunks to the store when they are evicted, so the
+  /// next start maps them instead of regenerating them. Edited chunks are
+  /// written back either way.
+  bool persist_generated = true;
+  /// Backend and queue depth of the store's asynchronous I/O.
+  IoQueueOptions io;
+  ThreadPoolOptions threads;
+  /// Height resolution of encode_deltas(); decoded heights are within half
+  /// of it.
+  float delta_quantum = 1.0f / 64.0f;
+};
+
+/// A generated world: resident chunks in a budgeted cache, backed by the
+/// region store and, behind that, the generator. Thread-safe.
+class World {
+ public:
+  explicit World(WorldOptions options);
+  ~World();
+
+  World(const World&) = delete;
+  World& operator=(const World&) = delete;
+
+  /// The fully generated chunk at `c`: from the cache, else the store,
+  /// else the generator. Blocks while generating.
+  std::shared_ptr<Chunk> chunk(ChunkCoord c);
+  /// Batched chunk(): misses are generated together in one scheduler
+  /// batch, scheduled as `options` says. Results are in the order of
+  /// `coords`; if the batch is cancelled, chunks it did not finish are null.
+  std::vector<std::shared_ptr<Chunk>> chunks(std::span<const ChunkCoord> coords,
+                                             const GenerateOptions& options = {});
+
+  /// sample_points() over the world, for physics and AI queries in bulk.
+  /// Chunks the points read that are not fully generated are loaded or
+  /// generated first, in one chunks() batch scheduled as `options` says,
+  /// and stay pinned while their points are sampled; resident chunks cost
+  /// no cache lookups. Returns how many points were still not found:
+  /// non-finite positions, or chunks a cancelled batch did not finish.
+  std::size_t sample_points(std::span<const double> x, std::span<const double> z,
+                            PointSamples& out, const GenerateOptions& options = {});
+
+  /// Low-priority chunks() for work ahead of demand: makes `coords`
+  /// resident without returning them. Stored chunks are mapped, with all of
+  /// their records read ahead at once; the rest are generated in one
+  /// Prefetch-class batch, cancelled through `stop`, unless a Visible
+  /// chunks() caller is waiting on the generator, in which case they are
+  /// left for a later call. Returns how many chunks this call made resident.
+  std::size_t prefetch(std::span<const ChunkCoord> coords, std::stop_token stop = {});
+  /// Visible-class chunks() callers waiting on the generator right now.
+  int demand_waiting() const { return demand_waiting_.load(std::memory_order_relaxed); }
+
+  /// Applies `edit` to every cell in its bounds, generating those chunks
+  /// first. Derived stages of the touched chunks, and of neighbours whose
+  /// derived output reads them, are invalidated and rerun on the next
+  /// access or by regenerate_dirty(). Each affected chunk is replaced by an
+  /// edited copy; chunks callers already hold are left as they were.
+  void apply(const Edit& edit);
+  /// Reruns the stale derived stages of every chunk edits invalidated, in
+  /// one batch.
+  GenerationStats regenerate_dirty();
+  std::size_t dirty_count() const { return dirty_->size(); }
+
+  /// Chunks apply() or apply_deltas() changed since this world started.
+  std::vector<ChunkCoord> edited_chunks() const;
+  /// Appends a delta record (see encode_delta()) per chunk of `coords`
+  /// against its baseline, the generation stages rerun from the seed.
+  /// Untouched chunks cost a header each. Records are in `coords` order.
+  void encode_deltas(std::span<const ChunkCoord> coords, std::vector<std::uint8_t>& out);
+  /// Decodes consecutive delta records from `in`, regenerating each
+  /// baseline, and takes the results in as edited chunks; derived stages
+  /// rerun on access. Throws std::runtime_error on malformed input, or if
+  /// a record's baseline stage does not match this world's pipeline.
+  /// Returns the number of chunks applied.
+  std::size_t apply_deltas(std::span<const std::uint8_t> in);
+
+  /// Writes every resident, generated chunk to the store and flushes.
+  /// Derived stages are not persisted. No-op without a store.
+  void save();
+
+  /// Writes every resident, fully generated chunk with its derived output
+  /// to a snapshot file at `path` (see write_snapshot()), so that a
+  /// restarted world can load_snapshot() it and serve from a warm cache at
+  /// once. Returns the number of chunks written.
+  std::size_t save_snapshot(const std::filesystem::path& path);
+  /// Makes the chunks of the snapshot at `path` resident, skipping those
+  /// already resident and stopping at the cache budget. Their planes borrow
+  /// the mapping. Throws std::runtime_error if the snapshot is malformed or
+  /// its key is not snapshot_key(), std::system_error if it cannot be read.
+  /// Returns the number of chunks loaded.
+  std::size_t load_snapshot(const std::filesystem::path& path);
+  /// The seed, plus a hash of the terrain parameters, the pipeline's stage
+  /// names and the chunk layout. Noise permutations, biome tables and
+  /// compiled programs are rebuilt from these when a world starts, in well
+  /// under a millisecond, so a snapshot records only the key they come
+  /// from. Options inside a stage are not covered: discard snapshots when
+  /// changing them.
+  SnapshotKey snapshot_key() const;
+
+  const WorldOptions& options() const { return options_; }
+  int stage_count() const { return static_cast<int>(scheduler_->pipeline().size()); }
+  const SimplexNoise& noise() const { return *noise_; }
+  ThreadPool& pool() { return *pool_; }
+  Heightfield& field() { return field_; }
+  ChunkCache& cache() { return *cache_; }
+  /// Null without a store directory.
+  RegionStore* store() { return store_.get(); }
+  ChunkScheduler& scheduler() { return *scheduler_; }
+
+ private:
+  std::shared_ptr<Chunk> load_stored(ChunkCoord c);
+  void write_back(const std::shared_ptr<Chunk>& chunk);
+  bool edited(ChunkCoord c) const;
+  /// Adds `coords` to edited_, pinning them when there is no store.
+  void record_edited(std::span<const ChunkCoord> coords);
+  /// Runs the scheduler for `coords` with them pinned in the cache, then
+  /// `collect`, before they become evictable again.
+  void generate_pinned(std::span<const ChunkCoord> coords, const GenerateOptions& options,
+                       const std::function<void()>& collect = {});
+  void persist(const Chunk& chunk);
+  /// Heights of `coords` regenerated from the seed through the generation
+  /// stages, in `coords` order, on a private field.
+  std::vector<std::shared_ptr<Chunk>> baselines(std::span<const ChunkCoord> coords);
+
+  WorldOptions options_;
+  std::shared_ptr<const SimplexNoise> noise_;
+  std::unique_ptr<ThreadPool> pool_;
+  Heightfield field_;
+  std::unique_ptr<RegionStore> store_;
+  std::unique_ptr<ChunkCache> cache_;
+  std::unique_ptr<ChunkScheduler> scheduler_;
+  std::unique_ptr<DirtyTracker> dirty_;
+  int persisted_stage_ = 0;
+  /// Held by baselines() over the private field's generate, find and clear.
+  std::mutex baseline_mutex_;
+  std::unique_ptr<Heightfield> baseline_field_;
+  std::unique_ptr<ChunkScheduler> baseline_scheduler_;
+  std::atomic<int> demand_waiting_{0};
+  mutable std::mutex edited_mutex_;
+  std::unordered_set<ChunkCoord, ChunkCoordHash> edited_;
+};
+
+}  // namespace terram
@@ -0,0 +1,135 @@
+#include "terram/arena.hpp"
+
+#include <algorithm>
+#include <utility>
+
+#include "terram/memory.hpp"
+#include "terram/numa.hpp"
+
+namespace terram {
+
+Arena::Arena(std::size_t initial_bytes) { next_block(std::max<std::size_t>(initial_bytes, 4096)); }
+
+Arena::~Arena() { release(); }
+
+Arena::Arena(Arena&& other) noexcept
+    : blocks_(std::move(other.blocks_)),
+      current_(std::exchange(other.current_, 0)),
+      offset_(std::exchange(other.offset_, 0)),
+      used_(std::exchange(other.used_, 0)),
+      high_water_(std::exchange(other.high_water_, 0)),
+      heap_allocations_(std::exchange(other.heap_allocations_, 0)),
+      node_(std::exchange(other.node_, -1)) {
+  other.blocks_.clear();
+}
+
+Arena& Arena::operator=(Arena&& other) noexcept {
+  if (this != &other) {
+    release();
+    blocks_ = std::move(other.blocks_);
+    other.blocks_.clear();
+    current_ = std::exchange(other.current_, 0);
+    offset_ = std::exchange(other.offset_, 0);
+    used_ = std::exchange(other.used_, 0);
+    high_water_ = std::exchange(other.high_water_, 0);
+    heap_allocations_ = std::exchange(other.heap_allocations_, 0);
+    node_ = std::exchange(other.node_, -1);
+  }
+  return *this;
+}
+
+void Arena::release() {
+  for (Block& b : blocks_) {
+    if (b.node < 0) {
+      aligned_free(b.data);
+    } else {
+      node_free(b.data, b.size, b.node);
+    }
+  }
+  blocks_.clear();
+}
+
+std::size_t Arena::capacity() const {
+  std::size_t total = 0;
+  for (const Block& b : blocks_) total += b.size;
+  return total;
+}
+
+void Arena::set_numa_node(int node) {
+  node_ = node;
+  // Swapped for one block of the same capacity from the node's pool.
+  const std::size_t total = capacity();
+  release();
+  blocks_.push_back(new_block(total));
+  current_ = 0;
+  offset_ = 0;
+  used_ = 0;
+}
+
+Arena::Block Arena::new_block(std::size_t bytes) {
+  ++heap_allocations_;
+  if (node_ >= 0) return {static_cast<char*>(node_alloc(bytes, node_)), bytes, node_};
+  return {static_cast<char*>(aligned_alloc_bytes(bytes, kCacheLine)), bytes, -1};
+}
+
+void Arena::next_block(std::size_t min_bytes) {
+  // Reuse a block chained on during an earlier run if it is big enough.
+  if (!blocks_.empty() && current_ + 1 < blocks_.size() &&
+      blocks_[current_ + 1].size >= min_bytes) {
+    ++current_;
+    offset_ = 0;
+    return;
+  }
+  std::size_t size = blocks_.empty() ? min_bytes : blocks_.back().size * 2;
+  size = std::max(size, min_bytes);
+  const Block b = new_block(size);
+  if (blocks_.empty() || current_ + 1 >= blocks_.size()) {
+    blocks_.push_back(b);
+    current_ = blocks_.size() - 1;
+  } else {
+    // A chained block too small for this request: put the new one next.
+    blocks_.insert(blocks_.begin() + static_cast<std::ptrdiff_t>(current_ + 1), b);
+    ++current_;
+  }
+  offset_ = 0;
+}
+
+void* Arena::allocate(std::size_t bytes, std::size_t align) {
+  if (bytes == 0) bytes = 1;
+  auto aligned_offset = [&] {
+    const auto base = reinterpret_cast<std::uintptr_t>(blocks_[current_].data);
+    return ((base + offset_ + align - 1) & ~(align - 1)) - base;
+  };
+  std::size_t start = aligned_offset();
+  if (start + bytes > blocks_[current_].size) {
+    next_block(bytes + align);
+    start = aligned_offset();
+  }
+  offset_ = start + bytes;
+  used_ += bytes;
+  high_water_ = std::max(high_water_, used_);
+  return blocks_[current_].data + start;
+}
+
+void Arena::reset() {
+  if (blocks_.size() > 1) {
+    // Fold the chain into one block big enough for the whole run.
+    const std::size_t total = capacity();
+    release();
+    blocks_.push_back(new_block(total));
+  }
+  current_ = 0;
+  offset_ = 0;
+  used_ = 0;
+}
+
+ArenaScope::ArenaScope(Arena& arena)
+    : arena_(arena), current_(arena.current_), offset_(arena.offset_), used_(arena.used_) {}
+
+ArenaScope::~ArenaScope() {
+  arena_.current_ = current_;
+  arena_.offset_ = offset_;
+  arena_.used_ = used_;
+}
+
+}  // namespace terram
@@ -0,0 +1,164 @@
+#include "terram/async.hpp"
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+namespace terram {
+
+bool ChunkAwaitable::await_suspend(std::coroutine_handle<> handle) {
+  handle_ = handle;
+  request_.callback = &ChunkAwaitable::complete;
+  request_.user = this;
+  // Once queued, the completion may resume the coroutine, and end this
+  // awaitable's life, before request() returns: nothing here touches
+  // `this` after it.
+  if (queue_.request(request_)) return true;
+  rejected_ = true;
+  return false;
+}
+
+ChunkCompletion ChunkAwaitable::await_resume() {
+  if (rejected_) throw std::runtime_error("ChunkAwaitable: request queue is full");
+  return std::move(completion_);
+}
+
+void ChunkAwaitable::complete(const ChunkCompletion& completion, void* user) {
+  auto* self = static_cast<ChunkAwaitable*>(user);
+  self->completion_ = completion;
+  self->handle_.resume();
+}
+
+// Shared by the stream and its requests in flight, which reference it
+// through their callbacks' user pointer; the last of them frees it, so a
+// stream may be destroyed, even from its own completion, with requests
+// still queued.
+struct ChunkStream::State {
+  State(ChunkRequestQueue& queue, std::span<const ChunkCoord> coords, ChunkStreamOptions options)
+      : queue(queue), options(options), coords(coords.begin(), coords.end()) {
+    if (this->options.window == 0) this->options.window = 1;
+  }
+
+  // Tops the window up from the coords not yet requested. `mutex` held.
+  // request() is one lock-free push, so holding it here only holds off
+  // this stream's own completions.
+  void fill() {
+    while (!closed && in_flight < options.window && sent < coords.size()) {
+      const ChunkRequest r{.coord = coords[sent],
+                           .tag = sent,
+                           .priority = options.priority,
+                           .deadline = options.deadline,
+                           .callback = &State::complete,
+                           .user = this};
+      refs.fetch_add(1, std::memory_order_relaxed);
+      if (!queue.request(r)) {
+        refs.fetch_sub(1, std::memory_order_relaxed);
+        return;
+      }
+      ++sent;
+      ++in_flight;
+    }
+  }
+
+  static void complete(const ChunkCompletion& completion, void* user) {
+    auto* state = static_cast<State*>(user);
+    Next* waiter = nullptr;
+    {
+      std::lock_guard lock(state->mutex);
+      --state->in_flight;
+      if (!state->closed) {
+        waiter = std::exchange(state->waiter, nullptr);
+        if (waiter) {
+          waiter->result_ = completion;
+        } else {
+          state->ready.push_back(completion);
+        }
+        state->fill();
+      }
+    }
+    // Still holding this request's reference: the resumed coroutine may
+    // destroy the stream.
+    if (waiter) waiter->handle_.resume();
+    state->release();
+  }
+
+  void release() {
+    if (refs.fetch_sub(1, std::memory_order_acq_rel) == 1) delete this;
+  }
+
+  ChunkRequestQueue& queue;
+  ChunkStreamOptions options;
+  const std::vector<ChunkCoord> coords;
+
+  std::mutex mutex;
+  /// Coords requested, or answered as refused, so far.
+  std::size_t sent = 0;
+  std::size_t in_flight = 0;
+  /// Completions not yet taken by next().
+  std::deque<ChunkCompletion> ready;
+  Next* waiter = nullptr;
+  /// The stream is gone; completions are dropped.
+  bool closed = false;
+  /// The stream's reference plus one per request in flight.
+  std::atomic<std::size_t> refs{1};
+};
+
+bool ChunkStream::Next::await_suspend(std::coroutine_handle<> handle) {
+  std::lock_guard lock(state_->mutex);
+  state_->fill();
+  if (!state_->ready.empty()) {
+    result_ = std::move(state_->ready.front());
+    state_->ready.pop_front();
+    return false;
+  }
+  if (state_->in_flight > 0) {
+    handle_ = handle;
+    // A completion may resume the coroutine as soon as the mutex is
+    // released, so nothing touches `this` after this point.
+    state_->waiter = this;
+    return true;
+  }
+  if (state_->sent < state_->coords.size()) {
+    // Refused with nothing of ours in flight to retry after.
+    const std::size_t i = state_->sent++;
+    result_ = ChunkCompletion{.coord = state_->coords[i], .tag = i, .chunk = nullptr,
+                              .refused = true};
+  }
+  return false;
+}
+
+ChunkStream::ChunkStream(ChunkRequestQueue& queue, std::span<const ChunkCoord> coords,
+                         ChunkStreamOptions options)
+    : state_(new State(queue, coords, options)) {
+  std::lock_guard lock(state_->mutex);
+  state_->fill();
+}
+
+ChunkStream::~ChunkStream() { release(); }
+
+ChunkStream::ChunkStream(ChunkStream&& other) noexcept
+    : state_(std::exchange(other.state_, nullptr)) {}
+
+ChunkStream& ChunkStream::operator=(ChunkStream&& other) noexcept {
+  if (this != &other) {
+    release();
+    state_ = std::exchange(other.state_, nullptr);
+  }
+  return *this;
+}
+
+std::size_t ChunkStream::size() const { return state_ ? state_->coords.size() : 0; }
+
+void ChunkStream::release() {
+  if (!state_) return;
+  {
+    std::lock_guard lock(state_->mutex);
+    state_->closed = true;
+    state_->ready.clear();
+  }
+  std::exchange(state_, nullptr)->release();
+}
+
+}  // namespace terram
@@ -0,0 +1,128 @@
+#include "terram/biome.hpp"
+
+#include <stdexcept>
+#include <string>
+
+#include "biome/lut_kernels.hpp"
+
+namespace terram {
+
+namespace detail {
+
+void biome_lookup_scalar(const BiomeLut& lut, const float* temperature, const float* moisture,
+                         const float* height, int count, std::uint8_t* out) {
+  lut::tail(lut, temperature, moisture, height, 0, count, out);
+}
+
+}  // namespace detail
+
+namespace {
+
+detail::BiomeLookupFn kernel_for(SimdIsa isa) {
+  switch (isa) {
+#if defined(TERRAM_HAVE_AVX2)
+    case SimdIsa::Avx2: return detail::biome_lookup_avx2;
+#endif
+#if defined(TERRAM_HAVE_AVX512)
+    case SimdIsa::Avx512: return detail::biome_lookup_avx512;
+#endif
+    default: return detail::biome_lookup_scalar;
+  }
+}
+
+void check_axis(const char* name, const BiomeAxis& axis) {
+  if (axis.bins < 1 || axis.bins > 256 || !(axis.min < axis.max)) {
+    throw std::invalid_argument(std::string("BiomeTable: bad ") + name + " axis");
+  }
+}
+
+}  // namespace
+
+const char* to_string(Biome biome) {
+  switch (biome) {
+    case Biome::Ocean: return "ocean";
+    case Biome::Beach: return "beach";
+    case Biome::Desert: return "desert";
+    case Biome::Savanna: return "savanna";
+    case Biome::Rainforest: return "rainforest";
+    case Biome::Shrubland: return "shrubland";
+    case Biome::Grassland: return "grassland";
+    case Biome::Forest: return "forest";
+    case Biome::Taiga: return "taiga";
+    case Biome::Tundra: return "tundra";
+    case Biome::Snow: return "snow";
+    case Biome::Rock: return "rock";
+  }
+  return "unknown";
+}
+
+BiomeTable::BiomeTable(BiomeAxis temperature, BiomeAxis moisture, BiomeAxis height,
+                       const Classifier& classify)
+    : axes_{temperature, moisture, height} {
+  check_axis("temperature", temperature);
+  check_axis("moisture", moisture);
+  check_axis("height", height);
+  const long long cells = static_cast<long long>(temperature.bins) * moisture.bins * height.bins;
+  if (cells > kMaxCells) throw std::invalid_argument("BiomeTable: too many cells");
+
+  float step[3];
+  for (int a = 0; a < 3; ++a) {
+    step[a] = (axes_[a].max - axes_[a].min) / static_cast<float>(axes_[a].bins);
+    scale_[a] = static_cast<float>(axes_[a].bins) / (axes_[a].max - axes_[a].min);
+  }
+  cells_.assign(static_cast<std::size_t>(cells) + kPadding, 0);
+  std::size_t i = 0;
+  for (int h = 0; h < height.bins; ++h) {
+    for (int m = 0; m < moisture.bins; ++m) {
+      for (int t = 0; t < temperature.bins; ++t) {
+        cells_[i++] = classify(temperature.min + (static_cast<float>(t) + 0.5f) * step[0],
+                               moisture.min + (static_cast<float>(m) + 0.5f) * step[1],
+                               height.min + (static_cast<float>(h) + 0.5f) * step[2]);
+      }
+    }
+  }
+}
+
+BiomeId BiomeTable::lookup(float temperature, float moisture, float height) const {
+  BiomeId out;
+  classify(&temperature, &moisture, &height, 1, &out);
+  return out;
+}
+
+void BiomeTable::classify(const float* temperature, const float* moisture,
+                          const float* height, int count, BiomeId* out) const {
+  detail::BiomeLut lut;
+  lut.table = cells_.data();
+  for (int a = 0; a < 3; ++a) {
+    lut.min[a] = axes_[a].min;
+    lut.scale[a] = scale_[a];
+    lut.top[a] = static_cast<float>(axes_[a].bins - 1);
+  }
+  lut.stride_moisture = axes_[0].bins;
+  lut.stride_height = axes_[0].bins * axes_[1].bins;
+  kernel_for(noise_isa())(lut, temperature, moisture, height, count, out);
+}
+
+BiomeId standard_biome(float temperature, float moisture, float height) {
+  auto id = [](Biome b) { return static_cast<BiomeId>(b); };
+  if (height < -4.0f) return id(Biome::Ocean);
+  if (height < 2.0f) return id(Biome::Beach);
+  if (height > 96.0f) return id(temperature < 0.0f ? Biome::Snow : Biome::Rock);
+  if (temperature < -0.6f) return id(Biome::Snow);
+  if (temperature < -0.25f) return id(moisture < -0.2f ? Biome::Tundra : Biome::Taiga);
+  if (temperature < 0.3f) {
+    if (moisture < -0.4f) return id(Biome::Shrubland);
+    return id(moisture < 0.1f ? Biome::Grassland : Biome::Forest);
+  }
+  if (moisture < -0.3f) return id(Biome::Desert);
+  return id(moisture < 0.2f ? Biome::Savanna : Biome::Rainforest);
+}
+
+std::shared_ptr<const BiomeTable> standard_biome_table() {
+  static const auto table = std::make_shared<const BiomeTable>(
+      BiomeAxis{-1.0f, 1.0f, 16}, BiomeAxis{-1.0f, 1.0f, 16}, BiomeAxis{-8.0f, 120.0f, 32},
+      standard_biome);
+  return table;
+}
+
+}  // namespace terram
@@ -0,0 +1,43 @@
+#include <immintrin.h>
+
+#include "biome/lut_kernels.hpp"
+
+namespace terram::detail {
+namespace {
+
+__m256i bin(__m256 v, __m256 min, __m256 scale, __m256 top) {
+  const __m256 f = _mm256_mul_ps(_mm256_sub_ps(v, min), scale);
+  return _mm256_cvttps_epi32(_mm256_min_ps(_mm256_max_ps(f, _mm256_setzero_ps()), top));
+}
+
+}  // namespace
+
+void biome_lookup_avx2(const BiomeLut& lut, const float* temperature, const float* moisture,
+                       const float* height, int count, std::uint8_t* out) {
+  __m256 min[3], scale[3], top[3];
+  for (int a = 0; a < 3; ++a) {
+    min[a] = _mm256_set1_ps(lut.min[a]);
+    scale[a] = _mm256_set1_ps(lut.scale[a]);
+    top[a] = _mm256_set1_ps(lut.top[a]);
+  }
+  const __m256i stride_m = _mm256_set1_epi32(lut.stride_moisture);
+  const __m256i stride_h = _mm256_set1_epi32(lut.stride_height);
+  const __m256i low_byte = _mm256_set1_epi32(0xff);
+  const auto* table = reinterpret_cast<const int*>(lut.table);
+  const int vec_end = count & ~7;
+  for (int i = 0; i < vec_end; i += 8) {
+    const __m256i t = bin(_mm256_loadu_ps(temperature + i), min[0], scale[0], top[0]);
+    const __m256i m = bin(_mm256_loadu_ps(moisture + i), min[1], scale[1], top[1]);
+    const __m256i h = bin(_mm256_loadu_ps(height + i), min[2], scale[2], top[2]);
+    const __m256i index = _mm256_add_epi32(
+        t, _mm256_add_epi32(_mm256_mullo_epi32(m, stride_m), _mm256_mullo_epi32(h, stride_h)));
+    // Byte-granular gather: four bytes from each cell, keep the first.
+    const __m256i ids = _mm256_and_si256(_mm256_i32gather_epi32(table, index, 1), low_byte);
+    const __m128i words = _mm_packus_epi32(_mm256_castsi256_si128(ids),
+                                           _mm256_extracti128_si256(ids, 1));
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(out + i), _mm_packus_epi16(words, words));
+  }
+  lut::tail(lut, temperature, moisture, height, vec_end, count, out);
+}
+
+}  // namespace terram::detail
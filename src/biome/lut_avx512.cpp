@@ -0,0 +1,39 @@
+#include <immintrin.h>
+
+#include "biome/lut_kernels.hpp"
+
+namespace terram::detail {
+namespace {
+
+__m512i bin(__m512 v, __m512 min, __m512 scale, __m512 top) {
+  const __m512 f = _mm512_mul_ps(_mm512_sub_ps(v, min), scale);
+  return _mm512_cvttps_epi32(_mm512_min_ps(_mm512_max_ps(f, _mm512_setzero_ps()), top));
+}
+
+}  // namespace
+
+void biome_lookup_avx512(const BiomeLut& lut, const float* temperature, const float* moisture,
+                         const float* height, int count, std::uint8_t* out) {
+  __m512 min[3], scale[3], top[3];
+  for (int a = 0; a < 3; ++a) {
+    min[a] = _mm512_set1_ps(lut.min[a]);
+    scale[a] = _mm512_set1_ps(lut.scale[a]);
+    top[a] = _mm512_set1_ps(lut.top[a]);
+  }
+  const __m512i stride_m = _mm512_set1_epi32(lut.stride_moisture);
+  const __m512i stride_h = _mm512_set1_epi32(lut.stride_height);
+  const int vec_end = count & ~15;
+  for (int i = 0; i < vec_end; i += 16) {
+    const __m512i t = bin(_mm512_loadu_ps(temperature + i), min[0], scale[0], top[0]);
+    const __m512i m = bin(_mm512_loadu_ps(moisture + i), min[1], scale[1], top[1]);
+    const __m512i h = bin(_mm512_loadu_ps(height + i), min[2], scale[2], top[2]);
+    const __m512i index = _mm512_add_epi32(
+        t, _mm512_add_epi32(_mm512_mullo_epi32(m, stride_m), _mm512_mullo_epi32(h, stride_h)));
+    // Byte-granular gather; the narrowing store keeps each cell's first byte.
+    const __m512i ids = _mm512_i32gather_epi32(index, lut.table, 1);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm512_cvtepi32_epi8(ids));
+  }
+  lut::tail(lut, temperature, moisture, height, vec_end, count, out);
+}
+
+}  // namespace terram::detail
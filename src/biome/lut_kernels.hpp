@@ -0,0 +1,61 @@
+#pragma once
+
+// Internal: biome table lookup kernels, one per instruction set. Every
+// kernel quantises exactly as lut::index() does, so all of them agree.
+
+#include <cstdint>
+
+namespace terram::detail {
+
+/// A BiomeTable as the kernels see it. `table` has three readable bytes
+/// past its last cell.
+struct BiomeLut {
+  const std::uint8_t* table;
+  float min[3];
+  float scale[3];
+  /// bins - 1, as the clamp bound of each axis.
+  float top[3];
+  int stride_moisture;
+  int stride_height;
+};
+
+using BiomeLookupFn = void (*)(const BiomeLut& lut, const float* temperature,
+                               const float* moisture, const float* height, int count,
+                               std::uint8_t* out);
+
+void biome_lookup_scalar(const BiomeLut& lut, const float* temperature, const float* moisture,
+                         const float* height, int count, std::uint8_t* out);
+#if defined(TERRAM_HAVE_AVX2)
+void biome_lookup_avx2(const BiomeLut& lut, const float* temperature, const float* moisture,
+                       const float* height, int count, std::uint8_t* out);
+#endif
+#if defined(TERRAM_HAVE_AVX512)
+void biome_lookup_avx512(const BiomeLut& lut, const float* temperature, const float* moisture,
+                         const float* height, int count, std::uint8_t* out);
+#endif
+
+namespace lut {
+
+// Static for the same reason as the simplex helpers: each ISA file keeps
+// its own copy. The compares are written as maxps / minps evaluate them,
+// so NaN lands in bin 0 on every path.
+static inline int bin(float v, float min, float scale, float top) {
+  float f = (v - min) * scale;
+  f = f > 0.0f ? f : 0.0f;
+  f = f < top ? f : top;
+  return static_cast<int>(f);
+}
+
+static inline int index(const BiomeLut& lut, float t, float m, float h) {
+  return bin(t, lut.min[0], lut.scale[0], lut.top[0]) +
+         bin(m, lut.min[1], lut.scale[1], lut.top[1]) * lut.stride_moisture +
+         bin(h, lut.min[2], lut.scale[2], lut.top[2]) * lut.stride_height;
+}
+
+static inline void tail(const BiomeLut& lut, const float* t, const float* m, const float* h,
+                        int begin, int count, std::uint8_t* out) {
+  for (int i = begin; i < count; ++i) out[i] = lut.table[index(lut, t[i], m[i], h[i])];
+}
+
+}  // namespace lut
+}  // namespace terram::detail
@@ -0,0 +1,310 @@
+#include "terram/terram.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "terram/world.hpp"
+
+struct terram_world {
+  std::unique_ptr<terram::World> world;
+};
+
+struct terram_chunk {
+  std::shared_ptr<terram::Chunk> chunk;
+};
+
+namespace {
+
+using namespace terram;
+
+thread_local std::string t_last_error;
+
+terram_status fail(terram_status status, const char* what) {
+  t_last_error = what;
+  return status;
+}
+
+// Runs `fn`, turning whatever it throws into a status: nothing may unwind
+// through a C frame.
+template <typename F>
+terram_status guarded(F&& fn) {
+  try {
+    return fn();
+  } catch (const std::invalid_argument& e) {
+    return fail(TERRAM_INVALID_ARGUMENT, e.what());
+  } catch (const std::bad_alloc&) {
+    return fail(TERRAM_OUT_OF_MEMORY, "out of memory");
+  } catch (const std::system_error& e) {
+    return fail(TERRAM_IO_ERROR, e.what());
+  } catch (const std::exception& e) {
+    return fail(TERRAM_INTERNAL_ERROR, e.what());
+  } catch (...) {
+    return fail(TERRAM_INTERNAL_ERROR, "unknown exception");
+  }
+}
+
+template <typename T>
+terram_status plane_view(const TiledPlane<T>* plane, terram_plane_view* out) {
+  if (!out) return fail(TERRAM_INVALID_ARGUMENT, "null view");
+  if (!plane) return fail(TERRAM_NOT_AVAILABLE, "plane not generated by this pipeline");
+  out->data = plane->data();
+  out->cell_bytes = sizeof(T);
+  out->chunk_size = kChunkSize;
+  out->tile_size = kTileSize;
+  out->row_stride = sizeof(T) * kTileSize;
+  out->tile_stride = sizeof(T) * kTileCells;
+  out->tile_row_stride = sizeof(T) * kTileCells * kTilesPerSide;
+  return TERRAM_OK;
+}
+
+template <typename Vertex, typename Index>
+terram_status mesh_view(std::span<const Vertex> vertices, std::span<const Index> indices,
+                        terram_mesh_view* out) {
+  static_assert(sizeof(Vertex) % sizeof(float) == 0);
+  out->vertices = reinterpret_cast<const float*>(vertices.data());
+  out->vertex_count = static_cast<std::uint32_t>(vertices.size());
+  out->vertex_floats = sizeof(Vertex) / sizeof(float);
+  out->vertex_stride = sizeof(Vertex);
+  out->indices = indices.data();
+  out->index_count = static_cast<std::uint32_t>(indices.size());
+  out->index_bytes = sizeof(Index);
+  return TERRAM_OK;
+}
+
+FbmParams to_fbm(const terram_fbm& f) {
+  FbmParams p;
+  p.frequency = f.frequency;
+  p.octaves = f.octaves;
+  p.lacunarity = f.lacunarity;
+  p.gain = f.gain;
+  p.amplitude = f.amplitude;
+  p.offset = f.offset;
+  return p;
+}
+
+}  // namespace
+
+extern "C" {
+
+uint32_t terram_abi_version(void) { return TERRAM_ABI_VERSION; }
+
+const char* terram_last_error(void) { return t_last_error.c_str(); }
+
+void terram_world_options_init(terram_world_options* options) {
+  if (!options) return;
+  const WorldOptions defaults;
+  std::memset(options, 0, sizeof *options);
+  options->struct_size = sizeof *options;
+  options->seed = defaults.seed;
+  options->terrain.frequency = defaults.terrain.frequency;
+  options->terrain.octaves = defaults.terrain.octaves;
+  options->terrain.lacunarity = defaults.terrain.lacunarity;
+  options->terrain.gain = defaults.terrain.gain;
+  options->terrain.amplitude = defaults.terrain.amplitude;
+  options->terrain.offset = defaults.terrain.offset;
+  options->stages = 0;
+  options->threads = defaults.threads.threads;
+  options->cache_budget_bytes = defaults.cache_budget_bytes;
+  options->store_directory = nullptr;
+}
+
+terram_status terram_world_create(const terram_world_options* options, terram_world** out) {
+  if (!out) return fail(TERRAM_INVALID_ARGUMENT, "null output");
+  *out = nullptr;
+  if (!options || options->struct_size < sizeof options->struct_size) {
+    return fail(TERRAM_INVALID_ARGUMENT, "bad terram_world_options");
+  }
+  // Fields a caller built against an older header does not know keep
+  // their defaults.
+  terram_world_options o;
+  terram_world_options_init(&o);
+  std::memcpy(&o, options, std::min(options->struct_size, sizeof o));
+  return guarded([&] {
+    WorldOptions w;
+    w.seed = o.seed;
+    w.terrain = to_fbm(o.terrain);
+    w.threads.threads = o.threads;
+    w.cache_budget_bytes = static_cast<std::size_t>(o.cache_budget_bytes);
+    if (o.store_directory) w.store_directory = o.store_directory;
+    if (o.stages & TERRAM_STAGE_EROSION) w.erosion = ErosionParams{};
+    if (o.stages & TERRAM_STAGE_BIOMES) w.biomes = BiomeOptions{};
+    if (o.stages & TERRAM_STAGE_CAVES) w.caves = CaveOptions{};
+    if (o.stages & TERRAM_STAGE_SURFACE) w.surface = SurfaceOptions{};
+    if (o.stages & TERRAM_STAGE_MESH) w.mesh = MeshOptions{};
+    auto world = std::make_unique<terram_world>();
+    world->world = std::make_unique<World>(std::move(w));
+    *out = world.release();
+    return TERRAM_OK;
+  });
+}
+
+void terram_world_destroy(terram_world* world) { delete world; }
+
+terram_status terram_world_chunk(terram_world* world, terram_chunk_coord coord,
+                                 terram_chunk** out) {
+  if (!world || !out) return fail(TERRAM_INVALID_ARGUMENT, "null argument");
+  *out = nullptr;
+  return guarded([&] {
+    auto handle = std::make_unique<terram_chunk>();
+    handle->chunk = world->world->chunk(ChunkCoord{coord.x, coord.z});
+    *out = handle.release();
+    return TERRAM_OK;
+  });
+}
+
+terram_status terram_world_chunks(terram_world* world, const terram_chunk_coord* coords,
+                                  size_t count, terram_chunk** out) {
+  if (!world || (count > 0 && (!coords || !out))) {
+    return fail(TERRAM_INVALID_ARGUMENT, "null argument");
+  }
+  std::fill(out, out + count, nullptr);
+  return guarded([&] {
+    std::vector<ChunkCoord> cs(count);
+    for (std::size_t i = 0; i < count; ++i) cs[i] = ChunkCoord{coords[i].x, coords[i].z};
+    std::vector<std::shared_ptr<Chunk>> chunks = world->world->chunks(cs);
+    std::vector<std::unique_ptr<terram_chunk>> handles(count);
+    for (std::size_t i = 0; i < count; ++i) {
+      handles[i] = std::make_unique<terram_chunk>();
+      handles[i]->chunk = std::move(chunks[i]);
+    }
+    for (std::size_t i = 0; i < count; ++i) out[i] = handles[i].release();
+    return TERRAM_OK;
+  });
+}
+
+terram_status terram_world_apply_deltas(terram_world* world, const uint8_t* data, size_t size,
+                                        size_t* applied) {
+  if (!world || (size > 0 && !data)) return fail(TERRAM_INVALID_ARGUMENT, "null argument");
+  return guarded([&] {
+    try {
+      const std::size_t n = world->world->apply_deltas({data, size});
+      if (applied) *applied = n;
+      return TERRAM_OK;
+    } catch (const std::system_error&) {
+      throw;
+    } catch (const std::runtime_error& e) {
+      // Malformed or mismatched records.
+      return fail(TERRAM_INVALID_ARGUMENT, e.what());
+    }
+  });
+}
+
+terram_status terram_world_save_snapshot(terram_world* world, const char* path, size_t* count) {
+  if (!world || !path) return fail(TERRAM_INVALID_ARGUMENT, "null argument");
+  return guarded([&] {
+    const std::size_t n = world->world->save_snapshot(path);
+    if (count) *count = n;
+    return TERRAM_OK;
+  });
+}
+
+terram_status terram_world_load_snapshot(terram_world* world, const char* path, size_t* count) {
+  if (!world || !path) return fail(TERRAM_INVALID_ARGUMENT, "null argument");
+  return guarded([&] {
+    try {
+      const std::size_t n = world->world->load_snapshot(path);
+      if (count) *count = n;
+      return TERRAM_OK;
+    } catch (const std::system_error&) {
+      throw;
+    } catch (const std::runtime_error& e) {
+      // Malformed, or taken from another world.
+      return fail(TERRAM_INVALID_ARGUMENT, e.what());
+    }
+  });
+}
+
+terram_status terram_world_sample_points(terram_world* world, const double* x, const double* z,
+                                         size_t count, float* height, float* normal_x,
+                                         float* normal_y, float* normal_z, uint8_t* biome,
+                                         uint8_t* found) {
+  if (!world || (count > 0 && (!x || !z))) return fail(TERRAM_INVALID_ARGUMENT, "null argument");
+  return guarded([&] {
+    thread_local PointSamples samples;
+    world->world->sample_points({x, count}, {z, count}, samples);
+    auto copy = [count](const auto& from, auto* to) {
+      if (to) std::copy(from.begin(), from.begin() + static_cast<std::ptrdiff_t>(count), to);
+    };
+    copy(samples.height, height);
+    copy(samples.normal_x, normal_x);
+    copy(samples.normal_y, normal_y);
+    copy(samples.normal_z, normal_z);
+    copy(samples.biome, biome);
+    copy(samples.found, found);
+    return TERRAM_OK;
+  });
+}
+
+void terram_chunk_release(terram_chunk* chunk) { delete chunk; }
+
+terram_chunk_coord terram_chunk_coord_of(const terram_chunk* chunk) {
+  if (!chunk || !chunk->chunk) return terram_chunk_coord{0, 0};
+  const ChunkCoord c = chunk->chunk->coord();
+  return terram_chunk_coord{c.x, c.z};
+}
+
+terram_status terram_chunk_heights(const terram_chunk* chunk, terram_plane_view* out) {
+  if (!chunk || !chunk->chunk) return fail(TERRAM_INVALID_ARGUMENT, "null chunk");
+  return plane_view(&std::as_const(*chunk->chunk).height(), out);
+}
+
+terram_status terram_chunk_normals(const terram_chunk* chunk, terram_plane_view* out) {
+  if (!chunk || !chunk->chunk) return fail(TERRAM_INVALID_ARGUMENT, "null chunk");
+  return plane_view(std::as_const(*chunk->chunk).normals(), out);
+}
+
+terram_status terram_chunk_biomes(const terram_chunk* chunk, terram_plane_view* out) {
+  if (!chunk || !chunk->chunk) return fail(TERRAM_INVALID_ARGUMENT, "null chunk");
+  return plane_view(std::as_const(*chunk->chunk).biomes(), out);
+}
+
+terram_status terram_chunk_mesh(const terram_chunk* chunk, terram_mesh_view* out) {
+  if (!chunk || !chunk->chunk || !out) return fail(TERRAM_INVALID_ARGUMENT, "null argument");
+  const MeshBuffers* mesh = std::as_const(*chunk->chunk).mesh();
+  if (!mesh) return fail(TERRAM_NOT_AVAILABLE, "chunk has no mesh");
+  return mesh_view(mesh->vertices(), mesh->indices(), out);
+}
+
+terram_status terram_chunk_surface(const terram_chunk* chunk, terram_mesh_view* out) {
+  if (!chunk || !chunk->chunk || !out) return fail(TERRAM_INVALID_ARGUMENT, "null argument");
+  const SurfaceMesh* surface = std::as_const(*chunk->chunk).surface();
+  if (!surface) return fail(TERRAM_NOT_AVAILABLE, "chunk has no surface");
+  return mesh_view(std::span<const SurfaceVertex>(surface->vertices),
+                   std::span<const std::uint32_t>(surface->indices), out);
+}
+
+terram_status terram_chunk_voxels(const terram_chunk* chunk, terram_voxel_info* out) {
+  if (!chunk || !chunk->chunk || !out) return fail(TERRAM_INVALID_ARGUMENT, "null argument");
+  const BrickMap* voxels = std::as_const(*chunk->chunk).voxels();
+  if (!voxels) return fail(TERRAM_NOT_AVAILABLE, "chunk has no density layer");
+  out->base_layer = voxels->base_layer();
+  out->layers = voxels->layers();
+  out->brick_size = kBrickSize;
+  out->bricks_per_side = kBricksPerSide;
+  return TERRAM_OK;
+}
+
+terram_status terram_chunk_brick(const terram_chunk* chunk, int32_t bx, int32_t layer,
+                                 int32_t bz, const int8_t** cells, int8_t* uniform) {
+  if (!chunk || !chunk->chunk || !cells || !uniform) {
+    return fail(TERRAM_INVALID_ARGUMENT, "null argument");
+  }
+  if (bx < 0 || bx >= kBricksPerSide || bz < 0 || bz >= kBricksPerSide) {
+    return fail(TERRAM_INVALID_ARGUMENT, "brick coordinate out of range");
+  }
+  const BrickMap* voxels = std::as_const(*chunk->chunk).voxels();
+  if (!voxels) return fail(TERRAM_NOT_AVAILABLE, "chunk has no density layer");
+  // Layers outside the covered range read as one value, like the map.
+  *cells = voxels->brick(bx, layer, bz, uniform);
+  return TERRAM_OK;
+}
+
+}  // extern "C"
@@ -0,0 +1,66 @@
+#include "terram/caves.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace terram {
+namespace {
+
+// One horizontal slice of a tunnel field at height y: fBm whose domain is
+// offset by shear * y along (dx, dz).
+void field_slice(const SimplexNoise& noise, const FbmParams& p, ChunkCoord coord, float y,
+                 float shear, float dx, float dz, float* out) {
+  std::memset(out, 0, sizeof(float) * kChunkCells);
+  const double ox = static_cast<double>(chunk_origin(coord.x)) + shear * y * dx;
+  const double oz = static_cast<double>(chunk_origin(coord.z)) + shear * y * dz;
+  float frequency = p.frequency;
+  float amplitude = p.amplitude;
+  for (int o = 0; o < p.octaves; ++o) {
+    const double shift = o * SimplexNoise::kOctaveShift;
+    noise.accumulate_block(static_cast<float>(ox * frequency + shift),
+                           static_cast<float>(oz * frequency + shift), frequency, kChunkSize,
+                           kChunkSize, amplitude, out);
+    frequency *= p.lacunarity;
+    amplitude *= p.gain;
+  }
+}
+
+}  // namespace
+
+void carve_caves(const SimplexNoise& first, const SimplexNoise& second, ChunkCoord coord,
+                 const TiledPlane<float>& height, const CaveOptions& options, Arena& scratch,
+                 BrickMap& out) {
+  ArenaScope scope(scratch);
+  float* h = scratch.allocate_array<float>(kChunkCells);
+  height.copy_to_row_major(h);
+  const auto [lo, hi] = std::minmax_element(h, h + kChunkCells);
+  const float band = std::max(options.band, 1e-3f);
+  const int base = static_cast<int>(std::floor((*lo - options.depth) / kBrickSize));
+  const int top = static_cast<int>(std::floor((*hi + band) / kBrickSize)) + 1;
+  out.reset(base, top - base);
+
+  // Field units to cells: simplex noise changes by about two per unit of
+  // its input.
+  const float to_cells =
+      1.0f / (2.0f * std::max(options.tunnels.amplitude * options.tunnels.frequency, 1e-6f));
+  float* a = scratch.allocate_array<float>(kChunkCells);
+  float* b = scratch.allocate_array<float>(kChunkCells);
+  Density* slab = scratch.allocate_array<Density>(kBrickLayerCells);
+  for (int layer = base; layer < top; ++layer) {
+    for (int ly = 0; ly < kBrickSize; ++ly) {
+      const auto y = static_cast<float>(layer * kBrickSize + ly);
+      field_slice(first, options.tunnels, coord, y, options.shear, 1.0f, 0.0f, a);
+      field_slice(second, options.tunnels, coord, y, options.shear, 0.0f, 1.0f, b);
+      Density* row = slab + ly * kChunkCells;
+      for (int i = 0; i < kChunkCells; ++i) {
+        const float solid = h[i] - y;
+        const float tunnel = (std::sqrt(a[i] * a[i] + b[i] * b[i]) - options.radius) * to_cells;
+        row[i] = quantize_density(std::min(solid, tunnel) / band);
+      }
+    }
+    out.store_layer(layer, slab);
+  }
+}
+
+}  // namespace terram
@@ -0,0 +1,72 @@
+#include "terram/chunk.hpp"
+
+#include <utility>
+
+namespace terram {
+
+std::size_t Chunk::memory_bytes() const {
+  std::size_t bytes = height_.size_bytes();
+  if (normals_) bytes += normals_->size_bytes();
+  if (biomes_) bytes += biomes_->size_bytes();
+  if (voxels_) bytes += voxels_->memory_bytes();
+  if (mesh_) bytes += mesh_->capacity_bytes();
+  if (surface_) bytes += surface_->capacity_bytes();
+  return bytes;
+}
+
+std::shared_ptr<Chunk> Chunk::copy(int stage) const {
+  auto out = std::make_shared<Chunk>(coord_, height_, stage);
+  auto clone = [](const auto& p) {
+    using T = typename std::decay_t<decltype(p)>::element_type;
+    return p ? std::make_unique<T>(*p) : nullptr;
+  };
+  out->normals_ = clone(normals_);
+  out->biomes_ = clone(biomes_);
+  out->voxels_ = clone(voxels_);
+  out->mesh_ = mesh_;
+  out->surface_ = clone(surface_);
+  return out;
+}
+
+void Chunk::place_on_node(int node) {
+  home_node_.store(node, std::memory_order_relaxed);
+  if (stage() > 0) return;
+  height_.move_to_node(node);
+  if (normals_) normals_->move_to_node(node);
+  if (biomes_) biomes_->move_to_node(node);
+}
+
+TiledPlane<PackedNormal>& Chunk::ensure_normals() {
+  if (!normals_) normals_ = std::make_unique<TiledPlane<PackedNormal>>(home_node());
+  return *normals_;
+}
+
+void Chunk::set_normals(TiledPlane<PackedNormal> normals) {
+  normals_ = std::make_unique<TiledPlane<PackedNormal>>(std::move(normals));
+}
+
+TiledPlane<BiomeId>& Chunk::ensure_biomes() {
+  if (!biomes_) biomes_ = std::make_unique<TiledPlane<BiomeId>>(home_node());
+  return *biomes_;
+}
+
+void Chunk::set_biomes(TiledPlane<BiomeId> biomes) {
+  biomes_ = std::make_unique<TiledPlane<BiomeId>>(std::move(biomes));
+}
+
+BrickMap& Chunk::ensure_voxels() {
+  if (!voxels_) voxels_ = std::make_unique<BrickMap>();
+  return *voxels_;
+}
+
+MeshBuffers& Chunk::ensure_mesh() {
+  if (!mesh_) mesh_.emplace();
+  return *mesh_;
+}
+
+SurfaceMesh& Chunk::ensure_surface() {
+  if (!surface_) surface_ = std::make_unique<SurfaceMesh>();
+  return *surface_;
+}
+
+}  // namespace terram
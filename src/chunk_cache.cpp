@@ -0,0 +1,244 @@
+#include "terram/chunk_cache.hpp"
+
+#include <utility>
+
+#include "terram/metrics.hpp"
+
+namespace terram {
+namespace {
+
+struct CacheMetrics {
+  Counter& hits;
+  Counter& misses;
+  Counter& evictions;
+};
+
+CacheMetrics& cache_metrics() {
+  Metrics& m = Metrics::global();
+  static CacheMetrics metrics{m.counter("cache.hits"), m.counter("cache.misses"),
+                              m.counter("cache.evictions")};
+  return metrics;
+}
+
+}  // namespace
+
+ChunkCache::ChunkCache(Heightfield& field, std::size_t budget_bytes)
+    : field_(field), budget_(budget_bytes) {
+  field_.set_listener(this);
+  for (ChunkCoord c : field_.coords()) {
+    if (auto chunk = field_.find(c)) on_insert(chunk);
+  }
+}
+
+ChunkCache::~ChunkCache() { field_.set_listener(nullptr); }
+
+std::size_t ChunkCache::charge(const Chunk& chunk) {
+  return chunk.memory_bytes() + sizeof(Chunk);
+}
+
+std::shared_ptr<Chunk> ChunkCache::lookup(ChunkCoord c) {
+  auto chunk = field_.find(c);
+  if (chunk) {
+    chunk->mark_accessed();
+    hits_.fetch_add(1, std::memory_order_relaxed);
+    cache_metrics().hits.add();
+  } else {
+    misses_.fetch_add(1, std::memory_order_relaxed);
+    cache_metrics().misses.add();
+  }
+  return chunk;
+}
+
+void ChunkCache::set_budget(std::size_t bytes) {
+  budget_.store(bytes, std::memory_order_relaxed);
+  trim();
+}
+
+void ChunkCache::set_evict_callback(EvictFn fn) {
+  std::lock_guard lock(mutex_);
+  on_evict_ = std::move(fn);
+}
+
+void ChunkCache::pin_locked(ChunkCoord c, int delta) {
+  auto it = pins_.find(c);
+  if (it == pins_.end()) {
+    if (delta > 0) pins_.emplace(c, delta);
+    return;
+  }
+  it->second += delta;
+  if (it->second <= 0) pins_.erase(it);
+}
+
+void ChunkCache::pin(ChunkCoord c) {
+  std::lock_guard lock(mutex_);
+  pin_locked(c, 1);
+}
+
+void ChunkCache::unpin(ChunkCoord c) {
+  {
+    std::lock_guard lock(mutex_);
+    pin_locked(c, -1);
+  }
+  trim();
+}
+
+bool ChunkCache::pinned(ChunkCoord c) const {
+  std::lock_guard lock(mutex_);
+  return pins_.count(c) != 0;
+}
+
+void ChunkCache::pin_square_locked(const Viewer& v, int delta) {
+  for (int dz = -v.radius; dz <= v.radius; ++dz) {
+    for (int dx = -v.radius; dx <= v.radius; ++dx) {
+      pin_locked({v.center.x + dx, v.center.z + dz}, delta);
+    }
+  }
+}
+
+void ChunkCache::set_viewer(std::uint32_t id, ChunkCoord center, int radius) {
+  {
+    std::lock_guard lock(mutex_);
+    const Viewer next{center, radius < 0 ? 0 : radius};
+    auto it = viewers_.find(id);
+    if (it != viewers_.end()) {
+      if (it->second.center == next.center && it->second.radius == next.radius) return;
+      // Pin the new square before releasing the old one so the overlap
+      // never becomes evictable.
+      pin_square_locked(next, 1);
+      pin_square_locked(it->second, -1);
+      it->second = next;
+    } else {
+      pin_square_locked(next, 1);
+      viewers_.emplace(id, next);
+    }
+  }
+  trim();
+}
+
+void ChunkCache::remove_viewer(std::uint32_t id) {
+  {
+    std::lock_guard lock(mutex_);
+    auto it = viewers_.find(id);
+    if (it == viewers_.end()) return;
+    pin_square_locked(it->second, -1);
+    viewers_.erase(it);
+  }
+  trim();
+}
+
+void ChunkCache::on_insert(const std::shared_ptr<Chunk>& chunk) {
+  std::vector<Entry> victims;
+  {
+    std::lock_guard lock(mutex_);
+    const ChunkCoord c = chunk->coord();
+    auto it = slots_.find(c);
+    if (it != slots_.end()) {
+      // Replaced in place: recharge the slot for the new chunk.
+      Entry& e = ring_[it->second];
+      resident_bytes_ -= e.charged;
+      e.chunk = chunk;
+      e.charged = charge(*chunk);
+      resident_bytes_ += e.charged;
+    } else {
+      Entry e{chunk, charge(*chunk)};
+      resident_bytes_ += e.charged;
+      slots_.emplace(c, ring_.size());
+      ring_.push_back(std::move(e));
+    }
+    victims = select_victims_locked();
+  }
+  evict(std::move(victims));
+}
+
+void ChunkCache::on_erase(ChunkCoord coord) {
+  std::lock_guard lock(mutex_);
+  auto it = slots_.find(coord);
+  if (it != slots_.end()) remove_slot_locked(it->second);
+}
+
+void ChunkCache::on_resize(const std::shared_ptr<Chunk>& chunk) {
+  std::lock_guard lock(mutex_);
+  auto it = slots_.find(chunk->coord());
+  if (it == slots_.end()) return;
+  Entry& e = ring_[it->second];
+  if (e.chunk != chunk) return;
+  resident_bytes_ -= e.charged;
+  e.charged = charge(*chunk);
+  resident_bytes_ += e.charged;
+}
+
+void ChunkCache::remove_slot_locked(std::size_t slot) {
+  resident_bytes_ -= ring_[slot].charged;
+  slots_.erase(ring_[slot].chunk->coord());
+  if (slot != ring_.size() - 1) {
+    ring_[slot] = std::move(ring_.back());
+    slots_[ring_[slot].chunk->coord()] = slot;
+  }
+  ring_.pop_back();
+  if (hand_ >= ring_.size()) hand_ = 0;
+}
+
+std::vector<ChunkCache::Entry> ChunkCache::select_victims_locked() {
+  std::vector<Entry> victims;
+  const std::size_t budget = budget_.load(std::memory_order_relaxed);
+  // Two full turns: the first clears access bits, the second must then
+  // find every unpinned chunk evictable.
+  std::size_t steps = 2 * ring_.size();
+  while (resident_bytes_ > budget && !ring_.empty() && steps-- > 0) {
+    if (hand_ >= ring_.size()) hand_ = 0;
+    Entry& e = ring_[hand_];
+    if (pins_.count(e.chunk->coord()) != 0 || e.chunk->clear_accessed()) {
+      ++hand_;
+      continue;
+    }
+    victims.push_back(e);
+    remove_slot_locked(hand_);  // the slot now holds the former last entry
+  }
+  return victims;
+}
+
+std::size_t ChunkCache::evict(std::vector<Entry> victims) {
+  EvictFn on_evict;
+  if (!victims.empty()) {
+    std::lock_guard lock(mutex_);
+    on_evict = on_evict_;
+  }
+  std::size_t evicted = 0;
+  for (const auto& [chunk, bytes] : victims) {
+    if (on_evict) on_evict(chunk);
+    // Lost the race against a replacement: the new chunk stays resident.
+    if (!field_.erase_if_same(chunk->coord(), chunk.get())) continue;
+    ++evicted;
+    evictions_.fetch_add(1, std::memory_order_relaxed);
+    cache_metrics().evictions.add();
+    evicted_bytes_.fetch_add(bytes, std::memory_order_relaxed);
+  }
+  return evicted;
+}
+
+std::size_t ChunkCache::trim() {
+  std::vector<Entry> victims;
+  {
+    std::lock_guard lock(mutex_);
+    victims = select_victims_locked();
+  }
+  return evict(std::move(victims));
+}
+
+CacheStats ChunkCache::stats() const {
+  CacheStats s;
+  s.hits = hits_.load(std::memory_order_relaxed);
+  s.misses = misses_.load(std::memory_order_relaxed);
+  s.evictions = evictions_.load(std::memory_order_relaxed);
+  s.evicted_bytes = evicted_bytes_.load(std::memory_order_relaxed);
+  s.budget_bytes = budget_.load(std::memory_order_relaxed);
+  std::lock_guard lock(mutex_);
+  s.resident_chunks = ring_.size();
+  s.resident_bytes = resident_bytes_;
+  for (const Entry& e : ring_) {
+    if (pins_.count(e.chunk->coord()) != 0) ++s.pinned_chunks;
+  }
+  return s;
+}
+
+}  // namespace terram
@@ -0,0 +1,125 @@
+#include "terram/edit.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+
+namespace terram {
+
+std::vector<ChunkCoord> CellRect::chunks() const {
+  std::vector<ChunkCoord> out;
+  if (empty()) return out;
+  const ChunkCoord lo = chunk_of(x0, z0);
+  const ChunkCoord hi = chunk_of(x1 - 1, z1 - 1);
+  for (std::int32_t z = lo.z; z <= hi.z; ++z) {
+    for (std::int32_t x = lo.x; x <= hi.x; ++x) out.push_back({x, z});
+  }
+  return out;
+}
+
+namespace brushes {
+namespace {
+
+CellRect around(double x, double z, double radius) {
+  return {static_cast<std::int64_t>(std::floor(x - radius)),
+          static_cast<std::int64_t>(std::floor(z - radius)),
+          static_cast<std::int64_t>(std::floor(x + radius)) + 1,
+          static_cast<std::int64_t>(std::floor(z + radius)) + 1};
+}
+
+// Squared distance from the brush centre in units of the radius.
+double falloff_d2(double x, double z, double radius, std::int64_t wx, std::int64_t wz) {
+  const double dx = (static_cast<double>(wx) - x) / radius;
+  const double dz = (static_cast<double>(wz) - z) / radius;
+  return dx * dx + dz * dz;
+}
+
+}  // namespace
+
+Edit raise(double x, double z, double radius, float amount) {
+  return {around(x, z, radius), [=](std::int64_t wx, std::int64_t wz, float& h) {
+            const double d2 = falloff_d2(x, z, radius, wx, wz);
+            if (d2 >= 1.0) return;
+            const double w = 1.0 - d2;
+            h += static_cast<float>(amount * w * w);
+          }};
+}
+
+Edit flatten(double x, double z, double radius, float level, float strength) {
+  return {around(x, z, radius), [=](std::int64_t wx, std::int64_t wz, float& h) {
+            const double d2 = falloff_d2(x, z, radius, wx, wz);
+            if (d2 >= 1.0) return;
+            const auto t = static_cast<float>(strength * (1.0 - d2));
+            h += (level - h) * t;
+          }};
+}
+
+Edit crater(double x, double z, double radius, float depth) {
+  // The rim extends to 1.5 radii; inside one radius the floor is a
+  // parabolic bowl.
+  return {around(x, z, radius * 1.5), [=](std::int64_t wx, std::int64_t wz, float& h) {
+            const double d2 = falloff_d2(x, z, radius, wx, wz);
+            const double d = std::sqrt(d2);
+            if (d >= 1.5) return;
+            if (d < 1.0) {
+              h -= static_cast<float>(depth * (1.0 - d2));
+            }
+            const double rim = 1.0 - std::abs(d - 1.0) * 2.0;
+            if (rim > 0.0) h += static_cast<float>(depth * 0.25 * rim * rim);
+          }};
+}
+
+}  // namespace brushes
+
+DirtyTracker::DirtyTracker(const Pipeline& pipeline)
+    : first_derived_(first_derived_stage(pipeline)) {
+  for (const Stage& s : pipeline) reads_neighbors_.push_back(s.reads_neighbors);
+}
+
+void DirtyTracker::mark_edited(Heightfield& field, std::span<const ChunkCoord> edited) {
+  const int stages = static_cast<int>(reads_neighbors_.size());
+  // Lowest stage each affected chunk must rerun from. Propagate forwards:
+  // a neighbour-reading stage spreads the invalidation by one ring.
+  std::unordered_map<ChunkCoord, int, ChunkCoordHash> rerun;
+  std::vector<ChunkCoord> frontier(edited.begin(), edited.end());
+  for (ChunkCoord c : frontier) rerun.emplace(c, first_derived_);
+  for (int s = first_derived_; s < stages; ++s) {
+    if (!reads_neighbors_[static_cast<std::size_t>(s)]) continue;
+    std::vector<ChunkCoord> grown;
+    for (ChunkCoord c : frontier) {
+      for (int dz = -1; dz <= 1; ++dz) {
+        for (int dx = -1; dx <= 1; ++dx) {
+          const ChunkCoord n{c.x + dx, c.z + dz};
+          if (rerun.emplace(n, s).second) grown.push_back(n);
+        }
+      }
+    }
+    frontier.insert(frontier.end(), grown.begin(), grown.end());
+  }
+
+  std::vector<ChunkCoord> marked;
+  for (const auto& [c, from] : rerun) {
+    auto chunk = field.find(c);
+    // Chunks that are not resident have no derived output to go stale.
+    if (!chunk) continue;
+    // Reruns rebuild a copy: readers holding the chunk keep its old output.
+    if (chunk->stage() > from) field.insert(chunk->copy(from));
+    marked.push_back(c);
+  }
+  std::lock_guard lock(mutex_);
+  pending_.insert(marked.begin(), marked.end());
+}
+
+std::size_t DirtyTracker::size() const {
+  std::lock_guard lock(mutex_);
+  return pending_.size();
+}
+
+std::vector<ChunkCoord> DirtyTracker::take() {
+  std::lock_guard lock(mutex_);
+  std::vector<ChunkCoord> out(pending_.begin(), pending_.end());
+  pending_.clear();
+  return out;
+}
+
+}  // namespace terram
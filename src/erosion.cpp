@@ -0,0 +1,309 @@
+#include "terram/erosion.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "terram/random.hpp"
+
+namespace terram {
+namespace {
+
+constexpr std::uint32_t kRainStream = 0x7261696e;  // "rain"
+
+// SoA fields over the padded domain. The outermost ring of cells is held
+// fixed, so every update loop runs over interior cells only and reads its
+// four neighbours without bounds checks. Passes that read neighbours of the
+// field they rewrite go through a back buffer and swap; the boundary ring is
+// the same in both, so swapping never disturbs it.
+struct Fields {
+  int w = 0;
+  float* b = nullptr;   // terrain height
+  float* d = nullptr;   // water depth
+  float* s = nullptr;   // suspended sediment
+  float* fl = nullptr;  // outflow flux towards -x, +x, -z, +z
+  float* fr = nullptr;
+  float* ft = nullptr;
+  float* fb = nullptr;
+  float* u = nullptr;   // water velocity
+  float* v = nullptr;
+  float* rain = nullptr;  // water added per step
+  float* back_b = nullptr;
+  float* back_s = nullptr;
+
+  Fields(Arena& arena, int width) : w(width) {
+    const auto n = static_cast<std::size_t>(w) * static_cast<std::size_t>(w);
+    for (float** f : {&b, &d, &s, &fl, &fr, &ft, &fb, &u, &v, &rain, &back_b, &back_s}) {
+      *f = arena.allocate_array<float>(n);
+      std::fill(*f, *f + n, 0.0f);
+    }
+  }
+};
+
+// Each pass runs a row kernel over columns [x0, x1) of the rows it updates,
+// never the boundary ring. Kernels take
+// restrict-qualified row pointers, which GCC only honours on parameters, so
+// their loops vectorize; only transport_row() gathers. Neighbours above and
+// below are at -w and +w. std::min/max return references, which GCC will
+// not if-convert, hence max_of/min_of.
+inline float max_of(float a, float b) { return a > b ? a : b; }
+inline float min_of(float a, float b) { return a < b ? a : b; }
+inline float clamp_of(float v, float lo, float hi) { return min_of(max_of(v, lo), hi); }
+
+void flux_row(const float* __restrict b, const float* __restrict d, float* __restrict fl,
+              float* __restrict fr, float* __restrict ft, float* __restrict fb, int w, int x0,
+              int x1, float k, float inv_dt) {
+  for (int x = x0; x < x1; ++x) {
+    const float h = b[x] + d[x];
+    const float l = max_of(0.0f, fl[x] + k * (h - b[x - 1] - d[x - 1]));
+    const float r = max_of(0.0f, fr[x] + k * (h - b[x + 1] - d[x + 1]));
+    const float t = max_of(0.0f, ft[x] + k * (h - b[x - w] - d[x - w]));
+    const float bo = max_of(0.0f, fb[x] + k * (h - b[x + w] - d[x + w]));
+    // Never drain more water than the cell holds in one step. With no
+    // outflow the zero fluxes stay zero whatever the scale.
+    const float sum = (l + r) + (t + bo);
+    const float scale = min_of(1.0f, d[x] * inv_dt / max_of(sum, 1e-20f));
+    fl[x] = l * scale;
+    fr[x] = r * scale;
+    ft[x] = t * scale;
+    fb[x] = bo * scale;
+  }
+}
+
+// Depth only needs the cell's own depth and its neighbours' flux, so it is
+// updated in place.
+void water_row(const float* __restrict fl, const float* __restrict fr,
+               const float* __restrict ft, const float* __restrict fb, float* __restrict d,
+               float* __restrict u, float* __restrict v, int w, int x0, int x1, float dt) {
+  const float max_speed = 1.0f / dt;  // at most one cell per step
+  for (int x = x0; x < x1; ++x) {
+    const float in = (fr[x - 1] + fl[x + 1]) + (fb[x - w] + ft[x + w]);
+    const float out = (fl[x] + fr[x]) + (ft[x] + fb[x]);
+    const float d2 = max_of(0.0f, d[x] + dt * (in - out));
+    const float wx = ((fr[x - 1] - fl[x]) + (fr[x] - fl[x + 1])) * 0.5f;
+    const float wz = ((fb[x - w] - ft[x]) + (fb[x] - ft[x + w])) * 0.5f;
+    const float mean = (d[x] + d2) * 0.5f;
+    const float rcp = 1.0f / max_of(mean, 1e-4f);
+    const float inv = mean > 1e-4f ? rcp : 0.0f;
+    u[x] = clamp_of(wx * inv, -max_speed, max_speed);
+    v[x] = clamp_of(wz * inv, -max_speed, max_speed);
+    d[x] = d2;
+  }
+}
+
+void erosion_row(const float* __restrict b, const float* __restrict d,
+                 const float* __restrict u, const float* __restrict v, float* __restrict s,
+                 float* __restrict out, int w, int x0, int x1, const ErosionParams& p) {
+  const float min_slope = p.min_slope;
+  const float capacity = p.capacity;
+  const float dissolving = p.dissolving;
+  const float deposition = p.deposition;
+  for (int x = x0; x < x1; ++x) {
+    const float gx = (b[x + 1] - b[x - 1]) * 0.5f;
+    const float gz = (b[x + w] - b[x - w]) * 0.5f;
+    const float g2 = gx * gx + gz * gz;
+    const float slope = max_of(min_slope, std::sqrt(g2 / (1.0f + g2)));
+    const float speed = std::sqrt(u[x] * u[x] + v[x] * v[x]);
+    const float cap = capacity * slope * speed * d[x];
+    const float diff = cap - s[x];
+    const float amount = diff > 0.0f ? dissolving * diff : deposition * diff;
+    out[x] = b[x] - amount;
+    s[x] += amount;
+  }
+}
+
+// Semi-Lagrangian advection: each cell pulls sediment from where its water
+// came from. Offsets stay relative to the cell so the result does not
+// depend on where in the padded domain the cell sits; speeds are clamped to
+// one cell per step, so the source lies in the 2x2 cells around it.
+void transport_row(const float* __restrict s, const float* __restrict u,
+                   const float* __restrict v, float* __restrict out, int w, int x0, int x1,
+                   float dt) {
+  for (int x = x0; x < x1; ++x) {
+    const float ox = -u[x] * dt;
+    const float oz = -v[x] * dt;
+    const int ix = ox < 0.0f ? -1 : 0;
+    const int iz = oz < 0.0f ? -1 : 0;
+    const float tx = ox - static_cast<float>(ix);
+    const float tz = oz - static_cast<float>(iz);
+    const float* src = s + iz * w + x + ix;
+    const float top = src[0] + (src[1] - src[0]) * tx;
+    const float bottom = src[w] + (src[w + 1] - src[w]) * tx;
+    out[x] = top + (bottom - top) * tz;
+  }
+}
+
+// Gather form of talus slippage: every cell computes what it gives to and
+// receives from each neighbour from the same pair of heights, so the pass
+// is data-parallel and conserves material.
+void thermal_row(const float* __restrict b, float* __restrict out, int w, int x0, int x1,
+                 float k, float t) {
+  auto slip = [t](float diff) { return max_of(0.0f, diff - t) - max_of(0.0f, -diff - t); };
+  for (int x = x0; x < x1; ++x) {
+    const float h = b[x];
+    const float delta = (slip(b[x - 1] - h) + slip(b[x + 1] - h)) +
+                        (slip(b[x - w] - h) + slip(b[x + w] - h));
+    out[x] = h + k * delta;
+  }
+}
+
+// One iteration over the window of cells at least `lo` from the domain
+// edge. Cells outside it keep stale values; see erode().
+void iterate(Fields& f, const ErosionParams& p, int lo) {
+  const int w = f.w;
+  const int hi = w - lo;
+  const float keep = 1.0f - p.evaporation * p.dt;
+  for (int z = lo; z < hi; ++z) {
+    float* d = f.d + z * w;
+    const float* rain = f.rain + z * w;
+    for (int x = lo; x < hi; ++x) d[x] += rain[x];
+  }
+  for (int z = lo; z < hi; ++z) {
+    const int r = z * w;
+    flux_row(f.b + r, f.d + r, f.fl + r, f.fr + r, f.ft + r, f.fb + r, w, lo, hi, p.dt * p.pipe,
+             1.0f / p.dt);
+  }
+  for (int z = lo; z < hi; ++z) {
+    const int r = z * w;
+    water_row(f.fl + r, f.fr + r, f.ft + r, f.fb + r, f.d + r, f.u + r, f.v + r, w, lo, hi, p.dt);
+  }
+  for (int z = lo; z < hi; ++z) {
+    const int r = z * w;
+    erosion_row(f.b + r, f.d + r, f.u + r, f.v + r, f.s + r, f.back_b + r, w, lo, hi, p);
+  }
+  std::swap(f.b, f.back_b);
+  for (int z = lo; z < hi; ++z) {
+    const int r = z * w;
+    transport_row(f.s + r, f.u + r, f.v + r, f.back_s + r, w, lo, hi, p.dt);
+  }
+  std::swap(f.s, f.back_s);
+  for (int z = lo; z < hi; ++z) {
+    float* d = f.d + z * w;
+    for (int x = lo; x < hi; ++x) d[x] *= keep;
+  }
+  for (int z = lo; z < hi; ++z) {
+    const int r = z * w;
+    thermal_row(f.b + r, f.back_b + r, w, lo, hi, p.thermal_rate * 0.25f, p.talus);
+  }
+  std::swap(f.b, f.back_b);
+}
+
+// Recently read source chunks, for the neighbours that read them next, in
+// a ring of slots overwritten oldest first. The slots are allocated on the
+// first read and looked up by a scan, so a warm cache allocates nothing.
+class SourceCache {
+ public:
+  SourceCache(HeightSource source, std::size_t chunks)
+      : source_(std::move(source)), capacity_(chunks) {}
+
+  void read(ChunkCoord c, float* out) {
+    {
+      std::lock_guard lock(mutex_);
+      if (const float* cells = find_locked(c)) {
+        std::copy(cells, cells + kChunkCells, out);
+        return;
+      }
+    }
+    source_(c, out);
+    std::lock_guard lock(mutex_);
+    // Another reader may have filled it meanwhile: the source is pure, so
+    // either copy will do.
+    if (find_locked(c)) return;
+    if (cells_.empty()) {
+      coords_.resize(capacity_);
+      cells_.resize(capacity_ * kChunkCells);
+    }
+    coords_[next_] = c;
+    std::copy(out, out + kChunkCells, cells_.data() + next_ * kChunkCells);
+    next_ = (next_ + 1) % capacity_;
+    used_ = std::min(used_ + 1, capacity_);
+  }
+
+ private:
+  const float* find_locked(ChunkCoord c) const {
+    for (std::size_t i = 0; i < used_; ++i) {
+      if (coords_[i] == c) return cells_.data() + i * kChunkCells;
+    }
+    return nullptr;
+  }
+
+  HeightSource source_;
+  std::size_t capacity_;
+  std::mutex mutex_;
+  std::vector<ChunkCoord> coords_;
+  std::vector<float> cells_;
+  std::size_t next_ = 0;
+  std::size_t used_ = 0;
+};
+
+}  // namespace
+
+int erosion_halo(const ErosionParams& params) {
+  // Three cells per iteration, +1 for the fixed boundary ring.
+  const int exact = 3 * std::max(params.iterations, 0) + 1;
+  return params.halo > 0 ? std::min(params.halo, exact) : exact;
+}
+
+HeightSource cached_source(HeightSource source, std::size_t chunks) {
+  if (chunks == 0) return source;
+  auto cache = std::make_shared<SourceCache>(std::move(source), chunks);
+  return [cache = std::move(cache)](ChunkCoord c, float* out) { cache->read(c, out); };
+}
+
+void erode(ChunkCoord center, const HeightSource& source, const ErosionParams& params,
+           Arena& scratch, TiledPlane<float>& out) {
+  const int halo = erosion_halo(params);
+  const int w = kChunkSize + 2 * halo;
+  ArenaScope scope(scratch);
+  Fields f(scratch, w);
+
+  // The domain lies within the chunks up to `reach` away from the centre;
+  // each is loaded and its overlap copied in.
+  float* heights = scratch.allocate_array<float>(kChunkCells);
+  float* rain = scratch.allocate_array<float>(kChunkCells);
+  const ChunkRandom random(params.seed, kRainStream);
+  const float base = params.rain * params.dt;
+  const int reach = (halo + kChunkSize - 1) / kChunkSize;
+  for (int cz = -reach; cz <= reach; ++cz) {
+    for (int cx = -reach; cx <= reach; ++cx) {
+      const ChunkCoord coord{center.x + cx, center.z + cz};
+      source(coord, heights);
+      for (std::uint32_t i = 0; i < kChunkCells / 4; ++i) {
+        const auto bits = random.block(coord, i);
+        for (int lane = 0; lane < 4; ++lane) {
+          const float r = unit_float(bits[lane]) * 2.0f - 1.0f;
+          rain[i * 4 + lane] = base * (1.0f + params.rain_variation * r);
+        }
+      }
+      // Domain cell (x, z) is local cell (x - ox, z - oz) of this chunk.
+      const int ox = halo + cx * kChunkSize;
+      const int oz = halo + cz * kChunkSize;
+      for (int z = std::max(oz, 0); z < std::min(oz + kChunkSize, w); ++z) {
+        for (int x = std::max(ox, 0); x < std::min(ox + kChunkSize, w); ++x) {
+          const int i = tiled_index(x - ox, z - oz);
+          f.b[z * w + x] = heights[i];
+          f.rain[z * w + x] = rain[i];
+        }
+      }
+    }
+  }
+  std::copy(f.b, f.b + w * w, f.back_b);
+  // An iteration carries values at most three cells, so with k iterations
+  // left, this one included, the centre depends only on cells within 3k of
+  // it. Each iteration updates just those; the stale values left outside
+  // reach only cells the centre no longer depends on. Over the exact halo
+  // this halves the work, and the centre comes out bit for bit the same.
+  const int n = params.iterations;
+  for (int it = 0; it < n; ++it) iterate(f, params, std::max(1, halo - 3 * (n - it)));
+
+  // Sediment still suspended settles where it is.
+  for (int z = 0; z < kChunkSize; ++z) {
+    const int row = (z + halo) * w + halo;
+    for (int x = 0; x < kChunkSize; ++x) out.at(x, z) = f.b[row + x] + f.s[row + x];
+  }
+}
+
+}  // namespace terram
@@ -0,0 +1,106 @@
+#include "terram/hash.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+namespace terram {
+namespace {
+
+constexpr std::uint64_t kMul0 = 0x9e3779b97f4a7c15ULL;
+constexpr std::uint64_t kMul1 = 0xc2b2ae3d27d4eb4fULL;
+
+constexpr std::uint64_t rotl(std::uint64_t v, int r) { return (v << r) | (v >> (64 - r)); }
+
+// murmur3's 64-bit finalizer.
+constexpr std::uint64_t mix(std::uint64_t k) {
+  k ^= k >> 33;
+  k *= 0xff51afd7ed558ccdULL;
+  k ^= k >> 33;
+  k *= 0xc4ceb9fe1a85ec53ULL;
+  k ^= k >> 33;
+  return k;
+}
+
+std::uint64_t load_le(const unsigned char* p, std::size_t n) {
+  std::uint64_t v = 0;
+  for (std::size_t i = 0; i < n; ++i) v |= std::uint64_t{p[i]} << (8 * i);
+  return v;
+}
+
+}  // namespace
+
+std::uint64_t hash_bytes(const void* data, std::size_t size, std::uint64_t seed) {
+  const auto* p = static_cast<const unsigned char*>(data);
+  // Four independent lanes keep the multiplies off one dependency chain;
+  // they are folded in a fixed order at the end.
+  std::uint64_t lanes[4] = {seed ^ kMul0, seed ^ kMul1, seed + kMul0, seed - kMul1};
+  std::size_t i = 0;
+  for (; i + 32 <= size; i += 32) {
+    for (int l = 0; l < 4; ++l) {
+      lanes[l] = rotl(lanes[l] ^ (load_le(p + i + 8 * l, 8) * kMul1), 31) * kMul0;
+    }
+  }
+  std::uint64_t h = rotl(lanes[0], 1) + rotl(lanes[1], 7) + rotl(lanes[2], 12) +
+                    rotl(lanes[3], 18);
+  for (; i < size; i += 8) {
+    const std::size_t n = std::min<std::size_t>(8, size - i);
+    h = rotl(h ^ (load_le(p + i, n) * kMul1), 27) * kMul0;
+  }
+  return mix(h ^ size);
+}
+
+std::uint64_t hash_chunk(const Chunk& chunk) {
+  const std::uint64_t header[2] = {
+      (std::uint64_t{static_cast<std::uint32_t>(chunk.coord().x)} << 32) |
+          static_cast<std::uint32_t>(chunk.coord().z),
+      static_cast<std::uint64_t>(chunk.stage())};
+  std::uint64_t h = hash_bytes(header, sizeof header);
+  h = hash_bytes(chunk.height().data(), chunk.height().size_bytes(), h);
+  if (const auto* normals = chunk.normals()) {
+    h = hash_bytes(normals->data(), normals->size_bytes(), h);
+  }
+  if (const auto* biomes = chunk.biomes()) {
+    h = hash_bytes(biomes->data(), biomes->size_bytes(), h);
+  }
+  if (const BrickMap* voxels = chunk.voxels()) {
+    const std::int32_t range[2] = {voxels->base_layer(), voxels->layers()};
+    h = hash_bytes(range, sizeof range, h);
+    for (int layer = voxels->base_layer(); layer < voxels->base_layer() + voxels->layers();
+         ++layer) {
+      for (int bz = 0; bz < kBricksPerSide; ++bz) {
+        for (int bx = 0; bx < kBricksPerSide; ++bx) {
+          Density uniform = 0;
+          const Density* cells = voxels->brick(bx, layer, bz, &uniform);
+          h = cells ? hash_bytes(cells, kBrickCells, h) : hash_bytes(&uniform, 1, h);
+        }
+      }
+    }
+  }
+  if (const MeshBuffers* mesh = chunk.mesh()) {
+    h = hash_bytes(mesh->vertices().data(), mesh->vertices().size_bytes(), h);
+    h = hash_bytes(mesh->indices().data(), mesh->indices().size_bytes(), h);
+  }
+  if (const SurfaceMesh* surface = chunk.surface()) {
+    h = hash_bytes(surface->vertices.data(),
+                   surface->vertices.size() * sizeof(SurfaceVertex), h);
+    h = hash_bytes(surface->indices.data(),
+                   surface->indices.size() * sizeof(std::uint32_t), h);
+  }
+  return h;
+}
+
+std::uint64_t hash_chunks(std::span<const std::shared_ptr<Chunk>> chunks) {
+  std::vector<std::pair<ChunkCoord, std::uint64_t>> hashes;
+  hashes.reserve(chunks.size());
+  for (const auto& chunk : chunks) hashes.emplace_back(chunk->coord(), hash_chunk(*chunk));
+  std::sort(hashes.begin(), hashes.end(), [](const auto& a, const auto& b) {
+    return a.first.z != b.first.z ? a.first.z < b.first.z : a.first.x < b.first.x;
+  });
+  std::uint64_t h = mix(hashes.size());
+  for (const auto& [coord, value] : hashes) h = mix(h ^ value) + kMul0;
+  return h;
+}
+
+}  // namespace terram
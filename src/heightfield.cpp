@@ -0,0 +1,166 @@
+#include "terram/heightfield.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+#include <utility>
+
+namespace terram {
+
+bool ChunkNeighborhood::complete() const {
+  return std::all_of(chunks_.begin(), chunks_.end(), [](Chunk* c) { return c != nullptr; });
+}
+
+float ChunkNeighborhood::height(int x, int z) const {
+  const int dx = (x < 0) ? -1 : (x >= kChunkSize ? 1 : 0);
+  const int dz = (z < 0) ? -1 : (z >= kChunkSize ? 1 : 0);
+  if (const Chunk* c = at(dx, dz)) {
+    return c->height().at(x - dx * kChunkSize, z - dz * kChunkSize);
+  }
+  return center()->height().at(std::clamp(x, 0, kChunkSize - 1),
+                               std::clamp(z, 0, kChunkSize - 1));
+}
+
+std::shared_ptr<Chunk> Heightfield::find(ChunkCoord c) const {
+  std::shared_lock lock(mutex_);
+  auto it = chunks_.find(c);
+  return it == chunks_.end() ? nullptr : it->second;
+}
+
+std::shared_ptr<Chunk> Heightfield::get_or_create(ChunkCoord c) {
+  if (auto existing = find(c)) return existing;
+  std::shared_ptr<Chunk> created;
+  {
+    std::unique_lock lock(mutex_);
+    auto& slot = chunks_[c];
+    if (slot) return slot;
+    slot = created = std::make_shared<Chunk>(c);
+  }
+  if (listener_) listener_->on_insert(created);
+  return created;
+}
+
+void Heightfield::insert(std::shared_ptr<Chunk> chunk) {
+  const ChunkCoord c = chunk->coord();
+  {
+    std::unique_lock lock(mutex_);
+    chunks_[c] = chunk;
+  }
+  if (listener_) listener_->on_insert(chunk);
+}
+
+bool Heightfield::erase(ChunkCoord c) {
+  {
+    std::unique_lock lock(mutex_);
+    if (chunks_.erase(c) == 0) return false;
+  }
+  if (listener_) listener_->on_erase(c);
+  return true;
+}
+
+bool Heightfield::erase_if_same(ChunkCoord c, const Chunk* expected) {
+  {
+    std::unique_lock lock(mutex_);
+    auto it = chunks_.find(c);
+    if (it == chunks_.end() || it->second.get() != expected) return false;
+    chunks_.erase(it);
+  }
+  if (listener_) listener_->on_erase(c);
+  return true;
+}
+
+void Heightfield::clear() {
+  std::vector<ChunkCoord> removed;
+  {
+    std::unique_lock lock(mutex_);
+    if (listener_) {
+      for (const auto& [coord, chunk] : chunks_) removed.push_back(coord);
+    }
+    chunks_.clear();
+  }
+  for (ChunkCoord c : removed) listener_->on_erase(c);
+}
+
+void Heightfield::resized(const std::shared_ptr<Chunk>& chunk) {
+  if (listener_) listener_->on_resize(chunk);
+}
+
+std::size_t Heightfield::size() const {
+  std::shared_lock lock(mutex_);
+  return chunks_.size();
+}
+
+std::size_t Heightfield::memory_bytes() const {
+  std::shared_lock lock(mutex_);
+  std::size_t total = 0;
+  for (const auto& [coord, chunk] : chunks_) total += chunk->memory_bytes();
+  return total;
+}
+
+std::vector<ChunkCoord> Heightfield::coords() const {
+  std::shared_lock lock(mutex_);
+  std::vector<ChunkCoord> out;
+  out.reserve(chunks_.size());
+  for (const auto& [coord, chunk] : chunks_) out.push_back(coord);
+  return out;
+}
+
+std::optional<float> Heightfield::height_at(std::int64_t wx, std::int64_t wz) const {
+  auto chunk = find(chunk_of(wx, wz));
+  if (!chunk) return std::nullopt;
+  return std::as_const(*chunk).height().at(local_of(wx), local_of(wz));
+}
+
+std::optional<float> Heightfield::sample(double x, double z) const {
+  const double fx = std::floor(x);
+  const double fz = std::floor(z);
+  const auto x0 = static_cast<std::int64_t>(fx);
+  const auto z0 = static_cast<std::int64_t>(fz);
+  const float tx = static_cast<float>(x - fx);
+  const float tz = static_cast<float>(z - fz);
+
+  // All four corners usually share a chunk; fetch it once.
+  const ChunkCoord c = chunk_of(x0, z0);
+  const int lx = local_of(x0);
+  const int lz = local_of(z0);
+  float h00, h10, h01, h11;
+  if (lx < kChunkSize - 1 && lz < kChunkSize - 1) {
+    auto chunk = find(c);
+    if (!chunk) return std::nullopt;
+    const auto& h = std::as_const(*chunk).height();
+    h00 = h.at(lx, lz);
+    h10 = h.at(lx + 1, lz);
+    h01 = h.at(lx, lz + 1);
+    h11 = h.at(lx + 1, lz + 1);
+  } else {
+    auto a = height_at(x0, z0);
+    auto b = height_at(x0 + 1, z0);
+    auto d = height_at(x0, z0 + 1);
+    auto e = height_at(x0 + 1, z0 + 1);
+    if (!a || !b || !d || !e) return std::nullopt;
+    h00 = *a;
+    h10 = *b;
+    h01 = *d;
+    h11 = *e;
+  }
+  const float top = h00 + (h10 - h00) * tx;
+  const float bottom = h01 + (h11 - h01) * tx;
+  return top + (bottom - top) * tz;
+}
+
+ChunkNeighborhood Heightfield::neighborhood(
+    ChunkCoord c, std::array<std::shared_ptr<Chunk>, 9>* owners) const {
+  ChunkNeighborhood n;
+  std::shared_lock lock(mutex_);
+  for (int dz = -1; dz <= 1; ++dz) {
+    for (int dx = -1; dx <= 1; ++dx) {
+      auto it = chunks_.find({c.x + dx, c.z + dz});
+      if (it == chunks_.end()) continue;
+      n.set(dx, dz, it->second.get());
+      if (owners) (*owners)[(dz + 1) * 3 + (dx + 1)] = it->second;
+    }
+  }
+  return n;
+}
+
+}  // namespace terram
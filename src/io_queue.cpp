@@ -0,0 +1,546 @@
+#include "terram/io_queue.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "terram/metrics.hpp"
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#define TERRAM_HAVE_IO_URING 1
+#endif
+
+namespace terram {
+
+enum class OpKind : std::uint8_t { Read, Write, Sync, Advise };
+
+struct IoQueue::Op {
+  OpKind kind;
+  int fd;
+  char* data;
+  std::size_t bytes;
+  std::uint64_t offset;
+  /// Bytes already transferred by earlier short reads or writes.
+  std::size_t done = 0;
+  IoCompletion callback;
+  std::uint64_t queued_ns = 0;
+};
+
+class IoQueue::Backend {
+ public:
+  explicit Backend(IoQueue& queue) : queue_(queue) {}
+  virtual ~Backend() = default;
+
+  virtual IoBackend kind() const = 0;
+  /// Takes ownership of `op`; it is not issued before the next submit().
+  virtual void enqueue(Op* op) = 0;
+  virtual void submit() = 0;
+
+ protected:
+  void complete(Op* op, std::int64_t result) { queue_.finish(op, result); }
+
+ private:
+  IoQueue& queue_;
+};
+
+namespace {
+
+using Op = IoQueue::Op;
+
+// Runs one operation to completion with plain syscalls.
+std::int64_t perform(const Op& op) {
+  switch (op.kind) {
+    case OpKind::Read:
+    case OpKind::Write: {
+      std::size_t done = op.done;
+      while (done < op.bytes) {
+        const auto offset = static_cast<off_t>(op.offset + done);
+        const ssize_t n = op.kind == OpKind::Read
+                              ? ::pread(op.fd, op.data + done, op.bytes - done, offset)
+                              : ::pwrite(op.fd, op.data + done, op.bytes - done, offset);
+        if (n < 0) {
+          if (errno == EINTR) continue;
+          return -errno;
+        }
+        if (n == 0) {
+          if (op.kind == OpKind::Write) return -EIO;
+          break;  // end of file
+        }
+        done += static_cast<std::size_t>(n);
+      }
+      return static_cast<std::int64_t>(done);
+    }
+    case OpKind::Sync:
+#if defined(__APPLE__)
+      return ::fsync(op.fd) == 0 ? 0 : -errno;
+#else
+      return ::fdatasync(op.fd) == 0 ? 0 : -errno;
+#endif
+    case OpKind::Advise:
+#if defined(POSIX_FADV_WILLNEED)
+      return -::posix_fadvise(op.fd, static_cast<off_t>(op.offset),
+                              static_cast<off_t>(op.bytes), POSIX_FADV_WILLNEED);
+#else
+      return 0;
+#endif
+  }
+  return -EINVAL;
+}
+
+class ThreadBackend final : public IoQueue::Backend {
+ public:
+  ThreadBackend(IoQueue& queue, unsigned threads) : Backend(queue) {
+    for (unsigned i = 0; i < std::max(threads, 1u); ++i) workers_.emplace_back([this] { run(); });
+  }
+
+  ~ThreadBackend() override {
+    {
+      std::lock_guard lock(mutex_);
+      stop_ = true;
+    }
+    ready_cv_.notify_all();
+    for (auto& t : workers_) t.join();
+  }
+
+  IoBackend kind() const override { return IoBackend::Threads; }
+
+  void enqueue(Op* op) override {
+    std::lock_guard lock(mutex_);
+    staged_.push_back(op);
+  }
+
+  void submit() override {
+    {
+      std::lock_guard lock(mutex_);
+      if (staged_.empty()) return;
+      ready_.insert(ready_.end(), staged_.begin(), staged_.end());
+      staged_.clear();
+    }
+    ready_cv_.notify_all();
+  }
+
+ private:
+  void run() {
+    for (;;) {
+      Op* op = nullptr;
+      {
+        std::unique_lock lock(mutex_);
+        ready_cv_.wait(lock, [&] { return stop_ || !ready_.empty(); });
+        if (ready_.empty()) return;
+        op = ready_.front();
+        ready_.pop_front();
+      }
+      complete(op, perform(*op));
+    }
+  }
+
+  std::mutex mutex_;
+  std::condition_variable ready_cv_;
+  std::vector<Op*> staged_;
+  std::deque<Op*> ready_;
+  bool stop_ = false;
+  std::vector<std::thread> workers_;
+};
+
+#if defined(TERRAM_HAVE_IO_URING)
+
+int uring_setup(unsigned entries, io_uring_params* p) {
+  return static_cast<int>(::syscall(__NR_io_uring_setup, entries, p));
+}
+
+int uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+  return static_cast<int>(
+      ::syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0));
+}
+
+int uring_register(int fd, unsigned opcode, void* arg, unsigned count) {
+  return static_cast<int>(::syscall(__NR_io_uring_register, fd, opcode, arg, count));
+}
+
+// The rings are shared with the kernel: the indices it writes are read with
+// acquire and the ones we write are published with release.
+std::uint32_t load_acquire(std::uint32_t* p) {
+  return std::atomic_ref<std::uint32_t>(*p).load(std::memory_order_acquire);
+}
+
+void store_release(std::uint32_t* p, std::uint32_t v) {
+  std::atomic_ref<std::uint32_t>(*p).store(v, std::memory_order_release);
+}
+
+bool supports(int fd, std::initializer_list<int> opcodes) {
+  constexpr unsigned kOps = 64;
+  std::vector<unsigned char> buffer(sizeof(io_uring_probe) + kOps * sizeof(io_uring_probe_op));
+  auto* probe = reinterpret_cast<io_uring_probe*>(buffer.data());
+  if (uring_register(fd, IORING_REGISTER_PROBE, probe, kOps) != 0) return false;
+  for (int op : opcodes) {
+    if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED)) return false;
+  }
+  return true;
+}
+
+class UringBackend final : public IoQueue::Backend {
+ public:
+  /// Null if io_uring is unavailable or lacks an operation we need.
+  static std::unique_ptr<UringBackend> create(IoQueue& queue, unsigned entries) {
+    io_uring_params params{};
+    const int fd = uring_setup(std::clamp(entries, 8u, 4096u), &params);
+    if (fd < 0) return nullptr;
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP) ||
+        !supports(fd, {IORING_OP_NOP, IORING_OP_READ, IORING_OP_WRITE, IORING_OP_FSYNC,
+                       IORING_OP_FADVISE})) {
+      ::close(fd);
+      return nullptr;
+    }
+    auto backend = std::unique_ptr<UringBackend>(new UringBackend(queue, fd, params));
+    if (!backend->ring_) return nullptr;
+    backend->reaper_ = std::thread([b = backend.get()] { b->reap(); });
+    return backend;
+  }
+
+  ~UringBackend() override {
+    if (reaper_.joinable()) {
+      Finished finished;
+      {
+        std::lock_guard lock(mutex_);
+        stop_ = true;
+        // A no-op with null user data wakes the reaper to see stop_.
+        backlog_.push_back(nullptr);
+        pump_locked(finished);
+      }
+      complete_all(finished);
+      reaper_.join();
+    }
+    if (sqes_) ::munmap(sqes_, sqes_bytes_);
+    if (ring_) ::munmap(ring_, ring_bytes_);
+    ::close(fd_);
+  }
+
+  IoBackend kind() const override { return IoBackend::IoUring; }
+
+  void enqueue(Op* op) override {
+    std::lock_guard lock(mutex_);
+    staged_.push_back(op);
+  }
+
+  void submit() override {
+    Finished finished;
+    {
+      std::lock_guard lock(mutex_);
+      backlog_.insert(backlog_.end(), staged_.begin(), staged_.end());
+      staged_.clear();
+      pump_locked(finished);
+    }
+    complete_all(finished);
+  }
+
+ private:
+  /// Ops reaped under the lock, with their results, to complete after it.
+  using Finished = std::vector<std::pair<Op*, std::int64_t>>;
+
+  UringBackend(IoQueue& queue, int fd, const io_uring_params& p) : Backend(queue), fd_(fd) {
+    sq_entries_ = p.sq_entries;
+    cq_entries_ = p.cq_entries;
+    ring_bytes_ = std::max(p.sq_off.array + p.sq_entries * sizeof(std::uint32_t),
+                           p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe));
+    void* ring = ::mmap(nullptr, ring_bytes_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        fd, IORING_OFF_SQ_RING);
+    if (ring == MAP_FAILED) return;
+    sqes_bytes_ = p.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = ::mmap(nullptr, sqes_bytes_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+      ::munmap(ring, ring_bytes_);
+      return;
+    }
+    ring_ = ring;
+    sqes_ = static_cast<io_uring_sqe*>(sqes);
+    auto* base = static_cast<char*>(ring);
+    sq_head_ = reinterpret_cast<std::uint32_t*>(base + p.sq_off.head);
+    sq_tail_ = reinterpret_cast<std::uint32_t*>(base + p.sq_off.tail);
+    sq_mask_ = *reinterpret_cast<std::uint32_t*>(base + p.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<std::uint32_t*>(base + p.sq_off.array);
+    cq_head_ = reinterpret_cast<std::uint32_t*>(base + p.cq_off.head);
+    cq_tail_ = reinterpret_cast<std::uint32_t*>(base + p.cq_off.tail);
+    cq_mask_ = *reinterpret_cast<std::uint32_t*>(base + p.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe*>(base + p.cq_off.cqes);
+  }
+
+  // Moves backlog entries into the submission ring while it and the
+  // completion ring have room, then enters the kernel once for all of them.
+  // Completions reaped on the way are added to `finished`.
+  void pump_locked(Finished& finished) {
+    std::uint32_t tail = *sq_tail_;
+    while (!backlog_.empty() && in_flight_ < cq_entries_ &&
+           tail - load_acquire(sq_head_) < sq_entries_) {
+      Op* op = backlog_.front();
+      backlog_.pop_front();
+      const std::uint32_t index = tail & sq_mask_;
+      prepare(sqes_[index], op);
+      sq_array_[index] = index;
+      ++tail;
+      ++in_flight_;
+      ++unsubmitted_;
+    }
+    store_release(sq_tail_, tail);
+    unsigned flags = 0;
+    while (unsubmitted_ > 0) {
+      const int n = uring_enter(fd_, unsubmitted_, 0, flags);
+      if (n > 0) {
+        unsubmitted_ -= static_cast<unsigned>(n);
+      } else if (n < 0 && errno == EINTR) {
+        continue;
+      } else if (n < 0 && (errno == EBUSY || errno == EAGAIN)) {
+        // The completion ring is full (or has overflowed) or the kernel is
+        // out of resources. The reaper may be asleep waiting for a
+        // completion that only these entries would produce, so make room
+        // here: reap what is there, and have the retry flush the overflow.
+        // Once that frees nothing, leave the entries to the reaper's next
+        // completion, or, with none of ours in the kernel, try again.
+        if (reap_locked(finished) == 0 && flags != 0) {
+          if (in_flight_ > unsubmitted_) break;
+          std::this_thread::yield();
+        }
+        flags = IORING_ENTER_GETEVENTS;
+      } else {
+        break;
+      }
+    }
+  }
+
+  static void prepare(io_uring_sqe& sqe, Op* op) {
+    std::memset(&sqe, 0, sizeof sqe);
+    sqe.user_data = reinterpret_cast<std::uint64_t>(op);
+    if (!op) {
+      sqe.opcode = IORING_OP_NOP;
+      return;
+    }
+    sqe.fd = op->fd;
+    switch (op->kind) {
+      case OpKind::Read:
+      case OpKind::Write:
+        sqe.opcode = op->kind == OpKind::Read ? IORING_OP_READ : IORING_OP_WRITE;
+        sqe.addr = reinterpret_cast<std::uint64_t>(op->data + op->done);
+        sqe.len = static_cast<std::uint32_t>(std::min<std::size_t>(op->bytes - op->done, 1u << 30));
+        sqe.off = op->offset + op->done;
+        break;
+      case OpKind::Sync:
+        sqe.opcode = IORING_OP_FSYNC;
+        sqe.fsync_flags = IORING_FSYNC_DATASYNC;
+        break;
+      case OpKind::Advise:
+        sqe.opcode = IORING_OP_FADVISE;
+        sqe.off = op->offset;
+        sqe.len = static_cast<std::uint32_t>(op->bytes);
+        sqe.fadvise_advice = POSIX_FADV_WILLNEED;
+        break;
+    }
+  }
+
+  // Consumes the completion ring: finished ops go to `finished`, retried
+  // ones back to the backlog. Returns the number of entries consumed.
+  std::uint32_t reap_locked(Finished& finished) {
+    const std::uint32_t first = *cq_head_;
+    std::uint32_t head = first;
+    const std::uint32_t tail = load_acquire(cq_tail_);
+    for (; head != tail; ++head) {
+      const io_uring_cqe& cqe = cqes_[head & cq_mask_];
+      Op* op = reinterpret_cast<Op*>(cqe.user_data);
+      const std::int64_t res = cqe.res;
+      --in_flight_;
+      if (!op) continue;
+      if (res == -EINTR || res == -EAGAIN) {
+        backlog_.push_front(op);
+        continue;
+      }
+      const bool transfer = op->kind == OpKind::Read || op->kind == OpKind::Write;
+      if (transfer && res > 0) {
+        op->done += static_cast<std::size_t>(res);
+        if (op->done < op->bytes) {
+          backlog_.push_front(op);  // short transfer: issue the rest
+          continue;
+        }
+        finished.emplace_back(op, static_cast<std::int64_t>(op->done));
+      } else if (transfer && res == 0) {
+        finished.emplace_back(op, op->kind == OpKind::Read ? static_cast<std::int64_t>(op->done)
+                                                           : -EIO);
+      } else {
+        finished.emplace_back(op, res);
+      }
+    }
+    store_release(cq_head_, head);
+    return head - first;
+  }
+
+  void complete_all(Finished& finished) {
+    for (auto [op, res] : finished) complete(op, res);
+    finished.clear();
+  }
+
+  void reap() {
+    Finished finished;
+    for (;;) {
+      const int r = uring_enter(fd_, 0, 1, IORING_ENTER_GETEVENTS);
+      if (r < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) break;
+
+      bool stopping = false;
+      {
+        std::lock_guard lock(mutex_);
+        reap_locked(finished);
+        pump_locked(finished);
+        stopping = stop_ && in_flight_ == 0 && backlog_.empty();
+      }
+      complete_all(finished);
+      if (stopping) return;
+    }
+  }
+
+  int fd_;
+  void* ring_ = nullptr;
+  std::size_t ring_bytes_ = 0;
+  io_uring_sqe* sqes_ = nullptr;
+  std::size_t sqes_bytes_ = 0;
+  std::uint32_t sq_entries_ = 0;
+  std::uint32_t cq_entries_ = 0;
+  std::uint32_t* sq_head_ = nullptr;
+  std::uint32_t* sq_tail_ = nullptr;
+  std::uint32_t sq_mask_ = 0;
+  std::uint32_t* sq_array_ = nullptr;
+  std::uint32_t* cq_head_ = nullptr;
+  std::uint32_t* cq_tail_ = nullptr;
+  std::uint32_t cq_mask_ = 0;
+  io_uring_cqe* cqes_ = nullptr;
+
+  std::mutex mutex_;
+  std::vector<Op*> staged_;
+  std::deque<Op*> backlog_;
+  std::uint32_t in_flight_ = 0;
+  std::uint32_t unsubmitted_ = 0;
+  bool stop_ = false;
+  std::thread reaper_;
+};
+
+#endif  // TERRAM_HAVE_IO_URING
+
+// Latency histograms, indexed by OpKind.
+struct IoMetrics {
+  Histogram* latency[4];
+  Counter& read_bytes;
+  Counter& write_bytes;
+  Counter& errors;
+};
+
+IoMetrics& io_metrics() {
+  Metrics& m = Metrics::global();
+  static IoMetrics metrics{{&m.histogram("io.read"), &m.histogram("io.write"),
+                            &m.histogram("io.sync"), &m.histogram("io.advise")},
+                           m.counter("io.read_bytes"),
+                           m.counter("io.write_bytes"),
+                           m.counter("io.errors")};
+  return metrics;
+}
+
+bool threads_forced() {
+  const char* env = std::getenv("TERRAM_IO");
+  return env && std::strcmp(env, to_string(IoBackend::Threads)) == 0;
+}
+
+}  // namespace
+
+const char* to_string(IoBackend backend) {
+  switch (backend) {
+    case IoBackend::Threads: return "threads";
+    case IoBackend::IoUring: return "io_uring";
+  }
+  return "unknown";
+}
+
+IoQueue::IoQueue(IoQueueOptions options) {
+#if defined(TERRAM_HAVE_IO_URING)
+  if (!options.force_threads && !threads_forced()) {
+    backend_ = UringBackend::create(*this, options.entries);
+  }
+#endif
+  if (!backend_) backend_ = std::make_unique<ThreadBackend>(*this, options.threads);
+}
+
+IoQueue::~IoQueue() {
+  drain();
+  backend_.reset();
+}
+
+IoBackend IoQueue::backend() const { return backend_->kind(); }
+
+void IoQueue::queue(std::unique_ptr<Op> op) {
+  {
+    std::lock_guard lock(mutex_);
+    ++pending_;
+  }
+  op->queued_ns = now_ns();
+  backend_->enqueue(op.release());
+}
+
+void IoQueue::finish(Op* op, std::int64_t result) {
+  std::unique_ptr<Op> owned(op);
+  IoMetrics& metrics = io_metrics();
+  metrics.latency[static_cast<int>(owned->kind)]->record(now_ns() - owned->queued_ns);
+  if (result < 0) {
+    metrics.errors.add();
+  } else if (owned->kind == OpKind::Read) {
+    metrics.read_bytes.add(static_cast<std::uint64_t>(result));
+  } else if (owned->kind == OpKind::Write) {
+    metrics.write_bytes.add(static_cast<std::uint64_t>(result));
+  }
+  if (owned->callback) owned->callback(result);
+  owned.reset();
+  std::lock_guard lock(mutex_);
+  if (--pending_ == 0) idle_.notify_all();
+}
+
+void IoQueue::read(int fd, void* data, std::size_t bytes, std::uint64_t offset,
+                   IoCompletion done) {
+  queue(std::make_unique<Op>(
+      Op{OpKind::Read, fd, static_cast<char*>(data), bytes, offset, 0, std::move(done)}));
+}
+
+void IoQueue::write(int fd, const void* data, std::size_t bytes, std::uint64_t offset,
+                    IoCompletion done) {
+  // The kernel only reads the buffer; Op keeps one pointer type for both.
+  queue(std::make_unique<Op>(Op{OpKind::Write, fd,
+                                const_cast<char*>(static_cast<const char*>(data)), bytes,
+                                offset, 0, std::move(done)}));
+}
+
+void IoQueue::sync(int fd, IoCompletion done) {
+  queue(std::make_unique<Op>(Op{OpKind::Sync, fd, nullptr, 0, 0, 0, std::move(done)}));
+}
+
+void IoQueue::advise(int fd, std::uint64_t offset, std::size_t bytes, IoCompletion done) {
+  queue(std::make_unique<Op>(Op{OpKind::Advise, fd, nullptr, bytes, offset, 0, std::move(done)}));
+}
+
+void IoQueue::submit() { backend_->submit(); }
+
+void IoQueue::drain() {
+  submit();
+  std::unique_lock lock(mutex_);
+  idle_.wait(lock, [&] { return pending_ == 0; });
+}
+
+std::size_t IoQueue::pending() const {
+  std::lock_guard lock(mutex_);
+  return pending_;
+}
+
+}  // namespace terram
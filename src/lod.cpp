@@ -0,0 +1,188 @@
+#include "terram/lod.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <utility>
+
+#include "terram/noise.hpp"
+#include "terram/world.hpp"
+
+namespace terram {
+namespace {
+
+void update_range(LodTile& tile) {
+  const float* h = std::as_const(tile.height).data();
+  const auto [lo, hi] = std::minmax_element(h, h + kChunkCells);
+  tile.min_height = *lo;
+  tile.max_height = *hi;
+}
+
+// 2x2 box filter: child (qx, qz) fills that quadrant of the parent.
+void downsample(const LodTile* const children[4], TiledPlane<float>& out) {
+  constexpr int kHalf = kChunkSize / 2;
+  for (int qz = 0; qz < 2; ++qz) {
+    for (int qx = 0; qx < 2; ++qx) {
+      const TiledPlane<float>& in = children[qz * 2 + qx]->height;
+      for (int z = 0; z < kHalf; ++z) {
+        for (int x = 0; x < kHalf; ++x) {
+          const float sum = (in.at(2 * x, 2 * z) + in.at(2 * x + 1, 2 * z)) +
+                            (in.at(2 * x, 2 * z + 1) + in.at(2 * x + 1, 2 * z + 1));
+          out.at(qx * kHalf + x, qz * kHalf + z) = sum * 0.25f;
+        }
+      }
+    }
+  }
+}
+
+double distance_to(const LodKey& key, double x, double z) {
+  const double x0 = static_cast<double>(key.origin_x());
+  const double z0 = static_cast<double>(key.origin_z());
+  const double size = static_cast<double>(key.size_cells());
+  const double dx = std::max({x0 - x, 0.0, x - (x0 + size)});
+  const double dz = std::max({z0 - z, 0.0, z - (z0 + size)});
+  return std::sqrt(dx * dx + dz * dz);
+}
+
+}  // namespace
+
+LodPyramid::LodPyramid(World& world, LodOptions options)
+    : world_(world), options_(options) {
+  if (options_.levels < 1 || options_.levels > kMaxLodLevels) {
+    throw std::invalid_argument("LodPyramid: levels out of range");
+  }
+}
+
+std::shared_ptr<const LodTile> LodPyramid::find(LodKey key) const {
+  std::lock_guard lock(mutex_);
+  auto it = tiles_.find(key);
+  return it == tiles_.end() ? nullptr : it->second.tile;
+}
+
+std::shared_ptr<const LodTile> LodPyramid::tile(LodKey key) {
+  if (key.level < 0 || key.level >= options_.levels) {
+    throw std::out_of_range("LodPyramid: level out of range");
+  }
+  {
+    std::lock_guard lock(mutex_);
+    auto it = tiles_.find(key);
+    if (it != tiles_.end()) {
+      it->second.last_used = ++clock_;
+      return it->second.tile;
+    }
+  }
+  // Built unlocked; a racing build of the same key loses in insert().
+  return build(key);
+}
+
+std::shared_ptr<const LodTile> LodPyramid::build(LodKey key) {
+  auto tile = std::make_shared<LodTile>();
+  tile->key = key;
+  if (key.level == 0) {
+    std::shared_ptr<Chunk> chunk = world_.chunk(key.coord);
+    tile->height.copy_from(std::as_const(*chunk).height());
+    tile->exact = true;
+  } else {
+    std::shared_ptr<const LodTile> children[4];
+    bool exact = true;
+    {
+      std::lock_guard lock(mutex_);
+      for (int q = 0; q < 4 && exact; ++q) {
+        auto it = tiles_.find(key.child(q & 1, q >> 1));
+        exact = it != tiles_.end() && it->second.tile->exact;
+        if (exact) children[q] = it->second.tile;
+      }
+    }
+    if (exact) {
+      const LodTile* raw[4] = {children[0].get(), children[1].get(), children[2].get(),
+                               children[3].get()};
+      downsample(raw, tile->height);
+      tile->exact = true;
+    } else {
+      world_.noise().fill_level(key.coord, key.level, world_.options().terrain, tile->height);
+    }
+  }
+  update_range(*tile);
+  return insert(std::move(tile));
+}
+
+std::shared_ptr<const LodTile> LodPyramid::insert(std::shared_ptr<LodTile> tile) {
+  std::lock_guard lock(mutex_);
+  const LodKey key = tile->key;
+  auto [it, inserted] = tiles_.try_emplace(key, Entry{std::move(tile), 0});
+  it->second.last_used = ++clock_;
+  std::shared_ptr<const LodTile> result = it->second.tile;
+  if (!inserted) return result;
+
+  // Refinement: once all four children are exact, a synthesized parent is
+  // dropped so its next request filters the real data instead.
+  if (result->exact && key.level + 1 < options_.levels) {
+    const LodKey parent = key.parent();
+    auto p = tiles_.find(parent);
+    if (p != tiles_.end() && !p->second.tile->exact) {
+      bool complete = true;
+      for (int q = 0; q < 4 && complete; ++q) {
+        auto c = tiles_.find(parent.child(q & 1, q >> 1));
+        complete = c != tiles_.end() && c->second.tile->exact;
+      }
+      if (complete) tiles_.erase(p);
+    }
+  }
+  if (tiles_.size() > options_.max_tiles) evict_locked();
+  return result;
+}
+
+void LodPyramid::evict_locked() {
+  // Drop the oldest eighth in one pass rather than one tile per insert.
+  std::vector<std::pair<std::uint64_t, LodKey>> ages;
+  ages.reserve(tiles_.size());
+  for (const auto& [key, entry] : tiles_) ages.emplace_back(entry.last_used, key);
+  const std::size_t drop = std::max<std::size_t>(tiles_.size() - options_.max_tiles,
+                                                 options_.max_tiles / 8);
+  std::nth_element(ages.begin(), ages.begin() + static_cast<std::ptrdiff_t>(drop) - 1,
+                   ages.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+  for (std::size_t i = 0; i < drop; ++i) tiles_.erase(ages[i].second);
+}
+
+std::vector<LodKey> LodPyramid::select(double x, double z, double radius) const {
+  const int top = options_.levels - 1;
+  const double root = static_cast<double>(std::int64_t{kChunkSize} << top);
+  const auto lo_x = static_cast<std::int32_t>(std::floor((x - radius) / root));
+  const auto hi_x = static_cast<std::int32_t>(std::floor((x + radius) / root));
+  const auto lo_z = static_cast<std::int32_t>(std::floor((z - radius) / root));
+  const auto hi_z = static_cast<std::int32_t>(std::floor((z + radius) / root));
+
+  std::vector<LodKey> leaves;
+  std::vector<LodKey> stack;
+  for (std::int32_t rz = lo_z; rz <= hi_z; ++rz) {
+    for (std::int32_t rx = lo_x; rx <= hi_x; ++rx) stack.push_back({top, {rx, rz}});
+  }
+  while (!stack.empty()) {
+    const LodKey key = stack.back();
+    stack.pop_back();
+    const double size = static_cast<double>(key.size_cells());
+    if (key.level > 0 && distance_to(key, x, z) < options_.split_distance * size) {
+      for (int q = 0; q < 4; ++q) stack.push_back(key.child(q & 1, q >> 1));
+    } else {
+      leaves.push_back(key);
+    }
+  }
+  return leaves;
+}
+
+void LodPyramid::invalidate(std::span<const ChunkCoord> chunks) {
+  std::lock_guard lock(mutex_);
+  for (ChunkCoord c : chunks) {
+    LodKey key{0, c};
+    for (int level = 0; level < options_.levels; ++level, key = key.parent()) {
+      tiles_.erase(key);
+    }
+  }
+}
+
+std::size_t LodPyramid::size() const {
+  std::lock_guard lock(mutex_);
+  return tiles_.size();
+}
+
+}  // namespace terram
@@ -0,0 +1,16 @@
+#include "terram/memory.hpp"
+
+#include <cstdlib>
+
+namespace terram {
+
+void* aligned_alloc_bytes(std::size_t bytes, std::size_t align) {
+  const std::size_t rounded = (bytes + align - 1) / align * align;
+  void* p = std::aligned_alloc(align, rounded == 0 ? align : rounded);
+  if (p == nullptr) throw std::bad_alloc();
+  return p;
+}
+
+void aligned_free(void* p) noexcept { std::free(p); }
+
+}  // namespace terram
@@ -0,0 +1,235 @@
+#include "terram/mesh.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdlib>
+#include <initializer_list>
+#include <vector>
+
+namespace terram {
+namespace {
+
+constexpr int kMax = kMeshGrid - 1;
+// Every triangle of the full RTIN hierarchy except the two roots' parent.
+constexpr int kTriangles = kMax * kMax * 2 - 2;
+constexpr int kParentTriangles = kTriangles - kMax * kMax;
+// Most a mesh can hold: every grid vertex plus a skirt vertex per border
+// vertex, and every full-resolution triangle plus two skirt triangles per
+// border edge.
+constexpr int kMaxVertices = kMeshGrid * kMeshGrid + 4 * kMax;
+constexpr int kMaxIndices = 3 * (2 * kMax * kMax + 2 * 4 * kMax);
+static_assert(kMaxVertices <= 0xffff, "mesh indices are 16-bit");
+
+// Corner a and b (the hypotenuse) of every hierarchy triangle; c follows
+// from them. Triangle i has id i + 2: the low bit picks the root, each
+// further bit the left or right half of the parent.
+struct Hierarchy {
+  std::vector<std::array<std::uint8_t, 4>> coords;
+
+  Hierarchy() : coords(kTriangles) {
+    for (int i = 0; i < kTriangles; ++i) {
+      int id = i + 2;
+      int ax = 0, ay = 0, bx = 0, by = 0, cx = 0, cy = 0;
+      if (id & 1) {
+        bx = by = cx = kMax;
+      } else {
+        ax = ay = cy = kMax;
+      }
+      while ((id >>= 1) > 1) {
+        const int mx = (ax + bx) >> 1;
+        const int my = (ay + by) >> 1;
+        if (id & 1) {
+          bx = ax;
+          by = ay;
+          ax = cx;
+          ay = cy;
+        } else {
+          ax = bx;
+          ay = by;
+          bx = cx;
+          by = cy;
+        }
+        cx = mx;
+        cy = my;
+      }
+      coords[i] = {static_cast<std::uint8_t>(ax), static_cast<std::uint8_t>(ay),
+                   static_cast<std::uint8_t>(bx), static_cast<std::uint8_t>(by)};
+    }
+  }
+};
+
+const Hierarchy& hierarchy() {
+  static const Hierarchy h;
+  return h;
+}
+
+class Builder {
+ public:
+  Builder(const float* grid, float cell_size, float max_error, float skirt_depth,
+          Arena& scratch, MeshBuffers& out)
+      : grid_(grid), cell_(cell_size), max_error_(max_error), skirt_(skirt_depth), out_(out) {
+    errors_ = scratch.allocate_array<float>(kMeshGrid * kMeshGrid);
+    vertex_ = scratch.allocate_array<std::uint16_t>(kMeshGrid * kMeshGrid);
+    skirt_vertex_ = scratch.allocate_array<std::uint16_t>(kMeshGrid * kMeshGrid);
+    vertices_ = scratch.allocate_array<MeshVertex>(kMaxVertices);
+    indices_ = scratch.allocate_array<std::uint16_t>(kMaxIndices);
+    std::fill(errors_, errors_ + kMeshGrid * kMeshGrid, 0.0f);
+    std::fill(vertex_, vertex_ + kMeshGrid * kMeshGrid, kNone);
+    std::fill(skirt_vertex_, skirt_vertex_ + kMeshGrid * kMeshGrid, kNone);
+  }
+
+  // Bottom-up: a midpoint's error is its own interpolation error and the
+  // largest of its descendants', so a split decision accounts for all the
+  // detail below it.
+  void compute_errors() {
+    const auto& coords = hierarchy().coords;
+    for (int i = kTriangles - 1; i >= 0; --i) {
+      const auto [ax, ay, bx, by] = coords[i];
+      const int mx = (ax + bx) >> 1;
+      const int my = (ay + by) >> 1;
+      const int cx = mx + my - ay;
+      const int cy = my + ax - mx;
+      const float interpolated = (height(ax, ay) + height(bx, by)) * 0.5f;
+      const int m = my * kMeshGrid + mx;
+      float error = std::max(errors_[m], std::fabs(interpolated - grid_[m]));
+      if (i < kParentTriangles) {
+        const int left = ((ay + cy) >> 1) * kMeshGrid + ((ax + cx) >> 1);
+        const int right = ((by + cy) >> 1) * kMeshGrid + ((bx + cx) >> 1);
+        error = std::max({error, errors_[left], errors_[right]});
+      }
+      errors_[m] = error;
+    }
+  }
+
+  // Built in scratch, then copied out at its final size: the output grows
+  // its one allocation at most once per build.
+  void extract() {
+    split(0, 0, kMax, kMax, kMax, 0);
+    split(kMax, kMax, 0, 0, 0, kMax);
+    out_.assign({vertices_, vertex_count_}, {indices_, index_count_});
+  }
+
+ private:
+  static constexpr std::uint16_t kNone = 0xffff;
+
+  float height(int x, int z) const { return grid_[z * kMeshGrid + x]; }
+
+  void split(int ax, int ay, int bx, int by, int cx, int cy) {
+    const int mx = (ax + bx) >> 1;
+    const int my = (ay + by) >> 1;
+    if (std::abs(ax - cx) + std::abs(ay - cy) > 1 && errors_[my * kMeshGrid + mx] > max_error_) {
+      split(cx, cy, ax, ay, mx, my);
+      split(bx, by, cx, cy, mx, my);
+      return;
+    }
+    const std::uint16_t a = vertex(ax, ay);
+    const std::uint16_t b = vertex(bx, by);
+    const std::uint16_t c = vertex(cx, cy);
+    emit({a, b, c});
+    skirt(ax, ay, bx, by);
+    skirt(bx, by, cx, cy);
+    skirt(cx, cy, ax, ay);
+  }
+
+  std::uint16_t vertex(int x, int z) {
+    std::uint16_t& slot = vertex_[z * kMeshGrid + x];
+    if (slot == kNone) {
+      slot = static_cast<std::uint16_t>(vertex_count_);
+      vertices_[vertex_count_++] = {x * cell_, height(x, z), z * cell_};
+    }
+    return slot;
+  }
+
+  std::uint16_t skirt_vertex(int x, int z) {
+    std::uint16_t& slot = skirt_vertex_[z * kMeshGrid + x];
+    if (slot == kNone) {
+      slot = static_cast<std::uint16_t>(vertex_count_);
+      vertices_[vertex_count_++] = {x * cell_, height(x, z) - skirt_, z * cell_};
+    }
+    return slot;
+  }
+
+  // Edge p -> q of a counter-clockwise triangle: if it lies on the grid
+  // border, hang a wall below it facing outwards.
+  void skirt(int px, int pz, int qx, int qz) {
+    if (skirt_ <= 0.0f) return;
+    const bool border = (px == qx && (px == 0 || px == kMax)) ||
+                        (pz == qz && (pz == 0 || pz == kMax));
+    if (!border) return;
+    const std::uint16_t p = vertex_[pz * kMeshGrid + px];
+    const std::uint16_t q = vertex_[qz * kMeshGrid + qx];
+    const std::uint16_t pl = skirt_vertex(px, pz);
+    const std::uint16_t ql = skirt_vertex(qx, qz);
+    emit({p, pl, q, q, pl, ql});
+  }
+
+  void emit(std::initializer_list<std::uint16_t> indices) {
+    std::copy(indices.begin(), indices.end(), indices_ + index_count_);
+    index_count_ += indices.size();
+  }
+
+  const float* grid_;
+  float cell_;
+  float max_error_;
+  float skirt_;
+  MeshBuffers& out_;
+  float* errors_;
+  std::uint16_t* vertex_;
+  std::uint16_t* skirt_vertex_;
+  MeshVertex* vertices_;
+  std::size_t vertex_count_ = 0;
+  std::uint16_t* indices_;
+  std::size_t index_count_ = 0;
+};
+
+float skirt_for(const MeshOptions& options, float scale) {
+  return options.skirt_depth > 0.0f ? options.skirt_depth : options.max_error * scale * 4.0f;
+}
+
+}  // namespace
+
+void build_mesh(const float* grid, float cell_size, float max_error, float skirt_depth,
+                Arena& scratch, MeshBuffers& out) {
+  ArenaScope scope(scratch);
+  Builder builder(grid, cell_size, max_error, skirt_depth, scratch, out);
+  builder.compute_errors();
+  builder.extract();
+}
+
+void mesh_chunk(const ChunkNeighborhood& neighbors, const MeshOptions& options, Arena& scratch,
+                MeshBuffers& out) {
+  ArenaScope scope(scratch);
+  float* grid = scratch.allocate_array<float>(kMeshGrid * kMeshGrid);
+  std::as_const(*neighbors.center()).height().copy_to_row_major(grid, kMeshGrid);
+  for (int i = 0; i < kMeshGrid; ++i) {
+    grid[i * kMeshGrid + kChunkSize] = neighbors.height(kChunkSize, i);
+    grid[kChunkSize * kMeshGrid + i] = neighbors.height(i, kChunkSize);
+  }
+  build_mesh(grid, 1.0f, options.max_error, skirt_for(options, 1.0f), scratch, out);
+}
+
+void mesh_lod_tile(const LodPyramid& pyramid, const LodTile& tile, const MeshOptions& options,
+                   Arena& scratch, MeshBuffers& out) {
+  ArenaScope scope(scratch);
+  float* grid = scratch.allocate_array<float>(kMeshGrid * kMeshGrid);
+  tile.height.copy_to_row_major(grid, kMeshGrid);
+
+  const LodKey key = tile.key;
+  const auto east = pyramid.find({key.level, {key.coord.x + 1, key.coord.z}});
+  const auto south = pyramid.find({key.level, {key.coord.x, key.coord.z + 1}});
+  const auto corner = pyramid.find({key.level, {key.coord.x + 1, key.coord.z + 1}});
+  for (int i = 0; i < kChunkSize; ++i) {
+    grid[i * kMeshGrid + kChunkSize] =
+        east ? east->height.at(0, i) : grid[i * kMeshGrid + kChunkSize - 1];
+    grid[kChunkSize * kMeshGrid + i] =
+        south ? south->height.at(i, 0) : grid[(kChunkSize - 1) * kMeshGrid + i];
+  }
+  grid[kChunkSize * kMeshGrid + kChunkSize] =
+      corner ? corner->height.at(0, 0) : grid[(kChunkSize - 1) * kMeshGrid + kChunkSize - 1];
+
+  const auto scale = static_cast<float>(std::int64_t{1} << key.level);
+  build_mesh(grid, scale, options.max_error * scale, skirt_for(options, scale), scratch, out);
+}
+
+}  // namespace terram
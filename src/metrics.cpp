@@ -0,0 +1,293 @@
+#include "terram/metrics.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <set>
+
+namespace terram {
+
+namespace detail {
+
+unsigned metric_shard() {
+  static std::atomic<unsigned> next{0};
+  thread_local const unsigned shard =
+      next.fetch_add(1, std::memory_order_relaxed) % kMetricShards;
+  return shard;
+}
+
+}  // namespace detail
+
+std::uint64_t now_ns() {
+  return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                        std::chrono::steady_clock::now().time_since_epoch())
+                                        .count());
+}
+
+std::uint64_t Counter::value() const {
+  std::uint64_t total = 0;
+  for (const Shard& s : shards_) total += s.value.load(std::memory_order_relaxed);
+  return total;
+}
+
+std::uint64_t HistogramSnapshot::quantile(double q) const {
+  if (count == 0) return 0;
+  const double position = std::clamp(q, 0.0, 1.0) * static_cast<double>(count - 1);
+  const auto rank = static_cast<std::uint64_t>(position);
+  std::uint64_t seen = 0;
+  for (int b = 0; b < kHistogramBuckets; ++b) {
+    seen += buckets[b];
+    if (seen > rank) {
+      const std::uint64_t upper = b == 0 ? 0 : (std::uint64_t{1} << b) - 1;
+      return std::min(upper, max);
+    }
+  }
+  return max;
+}
+
+void Histogram::record(std::uint64_t value) {
+  Shard& s = shards_[detail::metric_shard()];
+  const int bucket = std::min(static_cast<int>(std::bit_width(value)), kHistogramBuckets - 1);
+  s.buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+  s.count.fetch_add(1, std::memory_order_relaxed);
+  s.sum.fetch_add(value, std::memory_order_relaxed);
+  std::uint64_t seen = s.max.load(std::memory_order_relaxed);
+  while (seen < value && !s.max.compare_exchange_weak(seen, value, std::memory_order_relaxed)) {
+  }
+}
+
+HistogramSnapshot Histogram::snapshot() const {
+  HistogramSnapshot out;
+  for (const Shard& s : shards_) {
+    out.count += s.count.load(std::memory_order_relaxed);
+    out.sum += s.sum.load(std::memory_order_relaxed);
+    out.max = std::max(out.max, s.max.load(std::memory_order_relaxed));
+    for (int b = 0; b < kHistogramBuckets; ++b) {
+      out.buckets[b] += s.buckets[b].load(std::memory_order_relaxed);
+    }
+  }
+  return out;
+}
+
+void MetricsSnapshot::write(std::ostream& out) const {
+  char line[160];
+  for (const auto& [name, value] : counters) {
+    std::snprintf(line, sizeof(line), "%-28s %14llu\n", name.c_str(),
+                  static_cast<unsigned long long>(value));
+    out << line;
+  }
+  for (const auto& [name, h] : histograms) {
+    std::snprintf(line, sizeof(line),
+                  "%-28s n=%-10llu mean=%-12.0f p50=%-12llu p99=%-12llu max=%llu\n", name.c_str(),
+                  static_cast<unsigned long long>(h.count), h.mean(),
+                  static_cast<unsigned long long>(h.quantile(0.5)),
+                  static_cast<unsigned long long>(h.quantile(0.99)),
+                  static_cast<unsigned long long>(h.max));
+    out << line;
+  }
+}
+
+Metrics& Metrics::global() {
+  // Never destroyed, so instrumented code may update metrics during exit.
+  static Metrics* metrics = new Metrics;
+  return *metrics;
+}
+
+Counter& Metrics::counter(std::string_view name) {
+  std::lock_guard lock(mutex_);
+  auto it = counters_.find(name);
+  if (it == counters_.end()) {
+    it = counters_.emplace(std::string(name), std::make_unique<Counter>()).first;
+  }
+  return *it->second;
+}
+
+Histogram& Metrics::histogram(std::string_view name) {
+  std::lock_guard lock(mutex_);
+  auto it = histograms_.find(name);
+  if (it == histograms_.end()) {
+    it = histograms_.emplace(std::string(name), std::make_unique<Histogram>()).first;
+  }
+  return *it->second;
+}
+
+MetricsSnapshot Metrics::snapshot() const {
+  std::lock_guard lock(mutex_);
+  MetricsSnapshot out;
+  for (const auto& [name, c] : counters_) out.counters.emplace_back(name, c->value());
+  for (const auto& [name, h] : histograms_) out.histograms.emplace_back(name, h->snapshot());
+  return out;
+}
+
+namespace trace {
+namespace detail {
+std::atomic<bool> g_enabled{false};
+}  // namespace detail
+
+namespace {
+
+struct Event {
+  const char* name;
+  const char* category;
+  std::uint64_t start_ns;
+  std::uint64_t duration_ns;
+  ChunkCoord chunk;
+  bool has_chunk;
+};
+
+// One thread's events. Only the owner appends; `size` publishes them to
+// the writer.
+struct Buffer {
+  std::vector<Event> events;
+  std::atomic<std::size_t> size{0};
+  /// Recording the events belong to; set once they are reset for it.
+  std::atomic<std::uint64_t> generation{0};
+  unsigned tid = 0;
+};
+
+struct Recorder {
+  std::mutex mutex;
+  std::vector<std::shared_ptr<Buffer>> buffers;  // outlive their threads
+  std::set<std::string, std::less<>> names;
+  std::atomic<std::uint64_t> generation{0};
+  std::size_t capacity = 0;
+  std::uint64_t origin_ns = 0;
+  std::atomic<std::uint64_t> dropped{0};
+};
+
+Recorder& recorder() {
+  static Recorder* r = new Recorder;
+  return *r;
+}
+
+Buffer& local_buffer() {
+  thread_local std::shared_ptr<Buffer> buffer;
+  if (!buffer) {
+    buffer = std::make_shared<Buffer>();
+    Recorder& r = recorder();
+    std::lock_guard lock(r.mutex);
+    buffer->tid = static_cast<unsigned>(r.buffers.size()) + 1;
+    r.buffers.push_back(buffer);
+  }
+  return *buffer;
+}
+
+void write_string(std::ostream& out, const char* s) {
+  out << '"';
+  for (; *s; ++s) {
+    const auto c = static_cast<unsigned char>(*s);
+    if (c == '"' || c == '\\') {
+      out << '\\' << *s;
+    } else if (c < 0x20) {
+      char esc[8];
+      std::snprintf(esc, sizeof(esc), "\\u%04x", c);
+      out << esc;
+    } else {
+      out << *s;
+    }
+  }
+  out << '"';
+}
+
+}  // namespace
+
+void start(std::size_t events_per_thread) {
+  Recorder& r = recorder();
+  {
+    std::lock_guard lock(r.mutex);
+    r.capacity = events_per_thread;
+    r.origin_ns = now_ns();
+    r.dropped.store(0, std::memory_order_relaxed);
+    // Buffers notice the new generation on their next event and start
+    // over.
+    r.generation.fetch_add(1, std::memory_order_release);
+  }
+  detail::g_enabled.store(true, std::memory_order_release);
+}
+
+void stop() { detail::g_enabled.store(false, std::memory_order_release); }
+
+const char* intern(std::string_view name) {
+  Recorder& r = recorder();
+  std::lock_guard lock(r.mutex);
+  return r.names.emplace(name).first->c_str();
+}
+
+void complete(const char* name, const char* category, std::uint64_t start_ns,
+              std::uint64_t duration_ns, const ChunkCoord* chunk) {
+  Recorder& r = recorder();
+  Buffer& b = local_buffer();
+  const std::uint64_t generation = r.generation.load(std::memory_order_acquire);
+  if (b.generation.load(std::memory_order_relaxed) != generation) {
+    std::size_t capacity;
+    {
+      std::lock_guard lock(r.mutex);
+      capacity = r.capacity;
+    }
+    b.size.store(0, std::memory_order_release);
+    b.events.clear();
+    b.events.reserve(capacity);
+    b.generation.store(generation, std::memory_order_release);
+  }
+  const std::size_t n = b.size.load(std::memory_order_relaxed);
+  if (n == b.events.capacity()) {
+    r.dropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  // Within capacity, so the vector never reallocates under the writer.
+  b.events.push_back(Event{name, category, start_ns, duration_ns,
+                           chunk ? *chunk : ChunkCoord{}, chunk != nullptr});
+  b.size.store(n + 1, std::memory_order_release);
+}
+
+void write_json(std::ostream& out) {
+  Recorder& r = recorder();
+  std::lock_guard lock(r.mutex);
+  const std::uint64_t generation = r.generation.load(std::memory_order_acquire);
+  char num[96];
+  bool first = true;
+  out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+  for (const auto& b : r.buffers) {
+    if (b->generation.load(std::memory_order_acquire) != generation) continue;
+    const std::size_t n = b->size.load(std::memory_order_acquire);
+    if (n == 0) continue;
+    out << (first ? "\n" : ",\n");
+    first = false;
+    std::snprintf(num, sizeof(num), "{\"ph\":\"M\",\"pid\":1,\"tid\":%u,", b->tid);
+    out << num << "\"name\":\"thread_name\",\"args\":{\"name\":\"thread " << b->tid << "\"}}";
+    for (std::size_t i = 0; i < n; ++i) {
+      const Event& e = b->events[i];
+      out << ",\n{\"ph\":\"X\",\"name\":";
+      write_string(out, e.name);
+      out << ",\"cat\":";
+      write_string(out, e.category);
+      // Microseconds since start(), with nanosecond precision.
+      const std::uint64_t ts = e.start_ns > r.origin_ns ? e.start_ns - r.origin_ns : 0;
+      std::snprintf(num, sizeof(num), ",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%u",
+                    static_cast<double>(ts) * 1e-3, static_cast<double>(e.duration_ns) * 1e-3,
+                    b->tid);
+      out << num;
+      if (e.has_chunk) {
+        std::snprintf(num, sizeof(num), ",\"args\":{\"x\":%d,\"z\":%d}", e.chunk.x, e.chunk.z);
+        out << num;
+      }
+      out << '}';
+    }
+  }
+  out << "\n]}\n";
+}
+
+bool write_json(const std::filesystem::path& path) {
+  std::ofstream out(path);
+  if (!out) return false;
+  write_json(out);
+  return static_cast<bool>(out.flush());
+}
+
+std::uint64_t dropped() { return recorder().dropped.load(std::memory_order_relaxed); }
+
+}  // namespace trace
+
+}  // namespace terram
@@ -0,0 +1,195 @@
+#include "terram/noise.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <initializer_list>
+#include <numeric>
+
+#include "noise/simplex_kernels.hpp"
+
+namespace terram {
+namespace {
+
+detail::SimplexBlockFn kernel_for(SimdIsa isa) {
+  switch (isa) {
+#if defined(TERRAM_HAVE_AVX2)
+    case SimdIsa::Avx2: return detail::simplex_block_avx2;
+#endif
+#if defined(TERRAM_HAVE_AVX512)
+    case SimdIsa::Avx512: return detail::simplex_block_avx512;
+#endif
+#if defined(TERRAM_HAVE_NEON)
+    case SimdIsa::Neon: return detail::simplex_block_neon;
+#endif
+    default: return detail::simplex_block_scalar;
+  }
+}
+
+detail::SimplexPointsFn points_kernel_for(SimdIsa isa) {
+  switch (isa) {
+#if defined(TERRAM_HAVE_AVX2)
+    case SimdIsa::Avx2: return detail::simplex_points_avx2;
+#endif
+#if defined(TERRAM_HAVE_AVX512)
+    case SimdIsa::Avx512: return detail::simplex_points_avx512;
+#endif
+#if defined(TERRAM_HAVE_NEON)
+    case SimdIsa::Neon: return detail::simplex_points_neon;
+#endif
+    default: return detail::simplex_points_scalar;
+  }
+}
+
+SimdIsa initial_isa() {
+  if (const char* env = std::getenv("TERRAM_SIMD")) {
+    for (SimdIsa isa : {SimdIsa::Scalar, SimdIsa::Avx2, SimdIsa::Avx512, SimdIsa::Neon}) {
+      if (std::strcmp(env, to_string(isa)) == 0 && simd_supported(isa)) return isa;
+    }
+  }
+  return detect_simd();
+}
+
+struct Dispatch {
+  std::atomic<SimdIsa> isa;
+  std::atomic<detail::SimplexBlockFn> block;
+  std::atomic<detail::SimplexPointsFn> points;
+
+  Dispatch()
+      : isa(initial_isa()), block(kernel_for(isa.load())), points(points_kernel_for(isa.load())) {}
+};
+
+// Resolved during static initialisation, i.e. when the shared object loads.
+Dispatch g_dispatch;
+
+std::uint64_t splitmix64(std::uint64_t& state) {
+  std::uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+// One tile of fBm whose first cell is world cell (wx, wz), sampling every
+// `spacing`-th cell.
+void fbm_tile(detail::SimplexBlockFn block, const std::int32_t* perm, std::int64_t wx,
+              std::int64_t wz, std::int64_t spacing, int octaves, const FbmParams& params,
+              float* tile) {
+  std::fill(tile, tile + kTileCells, params.offset);
+  double freq = params.frequency;
+  float amp = params.amplitude;
+  for (int o = 0; o < octaves; ++o) {
+    const double shift = o * SimplexNoise::kOctaveShift;
+    const auto x0 = static_cast<float>(static_cast<double>(wx) * freq + shift);
+    const auto z0 = static_cast<float>(static_cast<double>(wz) * freq + shift);
+    const auto step = static_cast<float>(freq * static_cast<double>(spacing));
+    block(perm, x0, z0, step, kTileSize, kTileSize, amp, tile);
+    freq *= params.lacunarity;
+    amp *= params.gain;
+  }
+}
+
+}  // namespace
+
+SimdIsa noise_isa() { return g_dispatch.isa.load(std::memory_order_relaxed); }
+
+bool set_noise_isa(SimdIsa isa) {
+  if (!simd_supported(isa)) return false;
+  g_dispatch.block.store(kernel_for(isa), std::memory_order_relaxed);
+  g_dispatch.points.store(points_kernel_for(isa), std::memory_order_relaxed);
+  g_dispatch.isa.store(isa, std::memory_order_relaxed);
+  return true;
+}
+
+SimplexNoise::SimplexNoise(std::uint64_t seed) : seed_(seed) {
+  std::array<std::int32_t, 256> p;
+  std::iota(p.begin(), p.end(), 0);
+  std::uint64_t state = seed;
+  for (int i = 255; i > 0; --i) {
+    const auto j = static_cast<int>(splitmix64(state) % static_cast<std::uint64_t>(i + 1));
+    std::swap(p[i], p[j]);
+  }
+  for (int i = 0; i < 512; ++i) perm_[i] = p[i & 255];
+}
+
+float SimplexNoise::sample(float x, float z) const {
+  return detail::simplex::point(perm_.data(), x, z);
+}
+
+void SimplexNoise::accumulate_block(float x0, float z0, float step, int width, int rows,
+                                    float amplitude, float* out) const {
+  g_dispatch.block.load(std::memory_order_relaxed)(perm_.data(), x0, z0, step, width, rows,
+                                                   amplitude, out);
+}
+
+void SimplexNoise::accumulate_points(float x0, float z0, float step, const float* dx,
+                                     const float* dz, int count, float amplitude,
+                                     float* out) const {
+  g_dispatch.points.load(std::memory_order_relaxed)(perm_.data(), x0, z0, step, dx, dz, count,
+                                                    amplitude, out);
+}
+
+float SimplexNoise::fbm(std::int64_t wx, std::int64_t wz, const FbmParams& params) const {
+  // Reproduce fill(): each tile starts its own lattice walk at the tile
+  // origin, so offset from there.
+  const std::int64_t tx = wx & ~static_cast<std::int64_t>(kTileSize - 1);
+  const std::int64_t tz = wz & ~static_cast<std::int64_t>(kTileSize - 1);
+  const auto i = static_cast<float>(wx - tx);
+  const auto r = static_cast<float>(wz - tz);
+  float value = params.offset;
+  double freq = params.frequency;
+  float amp = params.amplitude;
+  for (int o = 0; o < params.octaves; ++o) {
+    const auto step = static_cast<float>(freq);
+    const auto x0 = static_cast<float>(static_cast<double>(tx) * freq + o * kOctaveShift);
+    const auto z0 = static_cast<float>(static_cast<double>(tz) * freq + o * kOctaveShift);
+    value += amp * detail::simplex::point(perm_.data(), x0 + i * step, z0 + r * step);
+    freq *= params.lacunarity;
+    amp *= params.gain;
+  }
+  return value;
+}
+
+void SimplexNoise::fill(ChunkCoord coord, const FbmParams& params, TiledPlane<float>& out) const {
+  fill_level(coord, 0, params, out);
+}
+
+void SimplexNoise::fill_level(ChunkCoord coord, int level, const FbmParams& params,
+                              TiledPlane<float>& out) const {
+  fill_tiles(coord, level, params, out.data());
+}
+
+void SimplexNoise::fill_tiles(ChunkCoord coord, int level, const FbmParams& params,
+                              float* out) const {
+  const auto block = g_dispatch.block.load(std::memory_order_relaxed);
+  const std::int64_t spacing = std::int64_t{1} << level;
+  const std::int64_t ox = chunk_origin(coord.x) * spacing;
+  const std::int64_t oz = chunk_origin(coord.z) * spacing;
+  // Octaves finer than two samples per cycle would only alias.
+  int octaves = params.octaves;
+  if (level > 0) {
+    double freq = params.frequency * static_cast<double>(spacing);
+    for (int o = 0; o < params.octaves; ++o, freq *= params.lacunarity) {
+      if (freq > 0.5 && o > 0) {
+        octaves = o;
+        break;
+      }
+    }
+  }
+  for (int tz = 0; tz < kTilesPerSide; ++tz) {
+    for (int tx = 0; tx < kTilesPerSide; ++tx) {
+      fbm_tile(block, perm_.data(), ox + tx * kTileSize * spacing,
+               oz + tz * kTileSize * spacing, spacing, octaves, params,
+               out + (tz * kTilesPerSide + tx) * kTileCells);
+    }
+  }
+}
+
+void SimplexNoise::fill_tile(ChunkCoord coord, int tx, int tz, const FbmParams& params,
+                             float* out) const {
+  fbm_tile(g_dispatch.block.load(std::memory_order_relaxed), perm_.data(),
+           chunk_origin(coord.x) + tx * kTileSize, chunk_origin(coord.z) + tz * kTileSize, 1,
+           params.octaves, params, out);
+}
+
+}  // namespace terram
@@ -0,0 +1,268 @@
+#include "terram/noise_program.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include "terram/noise_graph.hpp"
+
+namespace terram {
+namespace {
+
+constexpr std::uint32_t kMagic = 0x504e5254;  // "TRNP" little-endian
+constexpr std::uint8_t kVersion = 1;
+constexpr std::size_t kHeaderBytes = 12;
+constexpr std::size_t kParamBytes = 21;
+constexpr std::size_t kInstructionBytes = 16;
+constexpr int kOpcodeCount = static_cast<int>(Opcode::Blend) + 1;
+// Origin shifts are whole cells a float holds exactly.
+constexpr float kMaxShift = 16777216.0f;
+
+[[noreturn]] void invalid(const char* what) {
+  throw std::invalid_argument(std::string("noise program: ") + what);
+}
+
+[[noreturn]] void malformed(const char* what) {
+  throw std::runtime_error(std::string("noise program: ") + what);
+}
+
+bool is_noise(Opcode op) {
+  return op == Opcode::Fbm || op == Opcode::Ridged || op == Opcode::Billow;
+}
+
+// Source registers each op reads.
+int operand_count(Opcode op) {
+  switch (op) {
+    case Opcode::Const:
+    case Opcode::GridX:
+    case Opcode::GridZ: return 0;
+    case Opcode::Abs:
+    case Opcode::ScaleBias:
+    case Opcode::Clamp: return 1;
+    case Opcode::Blend: return 3;
+    default: return 2;
+  }
+}
+
+void put_u16(std::vector<std::uint8_t>& out, std::uint16_t v) {
+  out.push_back(static_cast<std::uint8_t>(v));
+  out.push_back(static_cast<std::uint8_t>(v >> 8));
+}
+
+void put_f32(std::vector<std::uint8_t>& out, float f) {
+  std::uint32_t v;
+  std::memcpy(&v, &f, sizeof v);
+  for (int i = 0; i < 4; ++i) out.push_back(static_cast<std::uint8_t>(v >> (8 * i)));
+}
+
+std::uint32_t get_u32(const std::uint8_t* p) {
+  return std::uint32_t{p[0]} | (std::uint32_t{p[1]} << 8) | (std::uint32_t{p[2]} << 16) |
+         (std::uint32_t{p[3]} << 24);
+}
+
+std::uint16_t get_u16(const std::uint8_t* p) {
+  return static_cast<std::uint16_t>(p[0] | (p[1] << 8));
+}
+
+float get_f32(const std::uint8_t* p) {
+  const std::uint32_t v = get_u32(p);
+  float f;
+  std::memcpy(&f, &v, sizeof f);
+  return f;
+}
+
+template <class Op>
+void binary(const float* a, const float* b, float* out, Op op) {
+  for (int i = 0; i < kTileCells; ++i) out[i] = op(a[i], b[i]);
+}
+
+template <class Op>
+void unary(const float* a, float* out, Op op) {
+  for (int i = 0; i < kTileCells; ++i) out[i] = op(a[i]);
+}
+
+}  // namespace
+
+NoiseProgram::NoiseProgram(std::vector<FbmParams> params, std::vector<Instruction> code,
+                           std::uint8_t output)
+    : params_(std::move(params)), code_(std::move(code)), output_(output) {
+  if (code_.empty()) invalid("empty program");
+  if (code_.size() > kMaxInstructions) invalid("too many instructions");
+  for (const FbmParams& p : params_) {
+    if (p.octaves < 0 || p.octaves > kMaxOctaves) invalid("octaves out of range");
+    for (float f : {p.frequency, p.lacunarity, p.gain, p.amplitude, p.offset}) {
+      if (!std::isfinite(f)) invalid("non-finite parameter");
+    }
+  }
+  std::uint32_t written = 0;
+  int octaves = 0;
+  auto readable = [&](std::uint8_t r) { return r < kMaxRegisters && (written >> r & 1u); };
+  for (const Instruction& in : code_) {
+    if (static_cast<int>(in.op) >= kOpcodeCount) invalid("unknown opcode");
+    if (in.dst >= kMaxRegisters) invalid("register out of range");
+    if (!std::isfinite(in.k0) || !std::isfinite(in.k1)) invalid("non-finite immediate");
+    if (is_noise(in.op)) {
+      if (in.param >= params_.size()) invalid("parameter index out of range");
+      for (std::uint8_t r : {in.a, in.b}) {
+        if (r == kGrid) continue;
+        if (!readable(r)) invalid("offset register read before written");
+        if (r == in.dst) invalid("noise output overwrites its offsets");
+      }
+      for (float k : {in.k0, in.k1}) {
+        if (std::trunc(k) != k || std::fabs(k) > kMaxShift) invalid("bad origin shift");
+      }
+      octaves += params_[in.param].octaves;
+      if (octaves > kMaxTotalOctaves) invalid("too many octaves");
+    } else {
+      const std::uint8_t sources[3] = {in.a, in.b, in.c};
+      for (int i = 0; i < operand_count(in.op); ++i) {
+        if (!readable(sources[i])) invalid("register read before written");
+      }
+    }
+    written |= 1u << in.dst;
+  }
+  if (!readable(output_)) invalid("output register never written");
+}
+
+NoiseProgram NoiseProgram::decode(std::span<const std::uint8_t> bytes) {
+  if (bytes.size() < kHeaderBytes) malformed("truncated");
+  const std::uint8_t* p = bytes.data();
+  if (get_u32(p) != kMagic) malformed("bad magic");
+  if (p[4] != kVersion) malformed("unsupported version");
+  const std::uint8_t output = p[5];
+  const std::size_t param_count = get_u16(p + 6);
+  const std::size_t code_count = get_u16(p + 8);
+  if (bytes.size() != kHeaderBytes + param_count * kParamBytes + code_count * kInstructionBytes) {
+    malformed("size mismatch");
+  }
+  p += kHeaderBytes;
+
+  std::vector<FbmParams> params(param_count);
+  for (FbmParams& fp : params) {
+    fp.frequency = get_f32(p);
+    fp.octaves = p[4];
+    fp.lacunarity = get_f32(p + 5);
+    fp.gain = get_f32(p + 9);
+    fp.amplitude = get_f32(p + 13);
+    fp.offset = get_f32(p + 17);
+    p += kParamBytes;
+  }
+  std::vector<Instruction> code(code_count);
+  for (Instruction& in : code) {
+    if (p[0] >= kOpcodeCount) malformed("unknown opcode");
+    in.op = static_cast<Opcode>(p[0]);
+    in.dst = p[1];
+    in.a = p[2];
+    in.b = p[3];
+    in.c = p[4];
+    in.param = get_u16(p + 6);
+    in.k0 = get_f32(p + 8);
+    in.k1 = get_f32(p + 12);
+    p += kInstructionBytes;
+  }
+  try {
+    return NoiseProgram(std::move(params), std::move(code), output);
+  } catch (const std::invalid_argument& e) {
+    throw std::runtime_error(e.what());
+  }
+}
+
+void NoiseProgram::encode(std::vector<std::uint8_t>& out) const {
+  for (int i = 0; i < 4; ++i) out.push_back(static_cast<std::uint8_t>(kMagic >> (8 * i)));
+  out.push_back(kVersion);
+  out.push_back(output_);
+  put_u16(out, static_cast<std::uint16_t>(params_.size()));
+  put_u16(out, static_cast<std::uint16_t>(code_.size()));
+  put_u16(out, 0);
+  for (const FbmParams& fp : params_) {
+    put_f32(out, fp.frequency);
+    out.push_back(static_cast<std::uint8_t>(fp.octaves));
+    put_f32(out, fp.lacunarity);
+    put_f32(out, fp.gain);
+    put_f32(out, fp.amplitude);
+    put_f32(out, fp.offset);
+  }
+  for (const Instruction& in : code_) {
+    out.push_back(static_cast<std::uint8_t>(in.op));
+    out.push_back(in.dst);
+    out.push_back(in.a);
+    out.push_back(in.b);
+    out.push_back(in.c);
+    out.push_back(0);
+    put_u16(out, in.param);
+    put_f32(out, in.k0);
+    put_f32(out, in.k1);
+  }
+}
+
+void NoiseProgram::fill(const SimplexNoise& noise, ChunkCoord coord, float* out) const {
+  graph::TileValues regs[kMaxRegisters];
+  const graph::TileGrid& grid = graph::kTileGrid;
+  for (int tz = 0; tz < kTilesPerSide; ++tz) {
+    for (int tx = 0; tx < kTilesPerSide; ++tx) {
+      const std::int64_t x0 = chunk_origin(coord.x) + tx * kTileSize;
+      const std::int64_t z0 = chunk_origin(coord.z) + tz * kTileSize;
+      for (const Instruction& in : code_) {
+        float* d = regs[in.dst].v;
+        // Unused operands may name any register; only read them per op.
+        auto reg = [&](std::uint8_t r) { return regs[r % kMaxRegisters].v; };
+        const float* a = reg(in.a);
+        const float* b = reg(in.b);
+        const float k0 = in.k0;
+        const float k1 = in.k1;
+        switch (in.op) {
+          case Opcode::Const: std::fill(d, d + kTileCells, k0); break;
+          case Opcode::GridX: std::copy(grid.dx, grid.dx + kTileCells, d); break;
+          case Opcode::GridZ: std::copy(grid.dz, grid.dz + kTileCells, d); break;
+          case Opcode::Fbm:
+          case Opcode::Ridged:
+          case Opcode::Billow: {
+            const graph::Samples s{&noise, x0 + static_cast<std::int64_t>(k0),
+                                   z0 + static_cast<std::int64_t>(k1),
+                                   in.a == kGrid ? grid.dx : a, in.b == kGrid ? grid.dz : b};
+            const FbmParams& p = params_[in.param];
+            if (in.op == Opcode::Fbm) {
+              graph::Fbm{p}.eval(s, d);
+            } else if (in.op == Opcode::Ridged) {
+              graph::Ridged{p}.eval(s, d);
+            } else {
+              graph::Billow{p}.eval(s, d);
+            }
+            break;
+          }
+          case Opcode::Add: binary(a, b, d, std::plus<float>{}); break;
+          case Opcode::Sub: binary(a, b, d, std::minus<float>{}); break;
+          case Opcode::Mul: binary(a, b, d, std::multiplies<float>{}); break;
+          case Opcode::Min: binary(a, b, d, graph::MinOp{}); break;
+          case Opcode::Max: binary(a, b, d, graph::MaxOp{}); break;
+          case Opcode::MulAdd:
+            binary(a, b, d, [k0](float x, float y) { return x * k0 + y; });
+            break;
+          case Opcode::ScaleBias:
+            unary(a, d, [k0, k1](float x) { return x * k0 + k1; });
+            break;
+          case Opcode::Abs: unary(a, d, [](float x) { return std::fabs(x); }); break;
+          case Opcode::Clamp:
+            unary(a, d, [k0, k1](float x) { return x < k0 ? k0 : (x > k1 ? k1 : x); });
+            break;
+          case Opcode::Blend: {
+            const float* t = reg(in.c);
+            for (int i = 0; i < kTileCells; ++i) {
+              const float w = t[i] < 0.0f ? 0.0f : (t[i] > 1.0f ? 1.0f : t[i]);
+              d[i] = a[i] + (b[i] - a[i]) * w;
+            }
+            break;
+          }
+        }
+      }
+      const float* result = regs[output_].v;
+      std::copy(result, result + kTileCells, out + (tz * kTilesPerSide + tx) * kTileCells);
+    }
+  }
+}
+
+}  // namespace terram
@@ -0,0 +1,110 @@
+#include <immintrin.h>
+
+#include "noise/simplex_kernels.hpp"
+
+namespace terram::detail {
+namespace {
+
+struct Avx2 {
+  static __m256 corner(__m256 t, __m256i g, __m256 x, __m256 y, __m256 gx_table,
+                       __m256 gy_table) {
+    const __m256 gx = _mm256_permutevar8x32_ps(gx_table, g);
+    const __m256 gy = _mm256_permutevar8x32_ps(gy_table, g);
+    const __m256 t2 = _mm256_mul_ps(t, t);
+    const __m256 dot = _mm256_add_ps(_mm256_mul_ps(gx, x), _mm256_mul_ps(gy, y));
+    const __m256 n = _mm256_mul_ps(_mm256_mul_ps(t2, t2), dot);
+    const __m256 negative = _mm256_cmp_ps(t, _mm256_setzero_ps(), _CMP_LT_OQ);
+    return _mm256_andnot_ps(negative, n);
+  }
+
+  static __m256 falloff(__m256 x, __m256 y) {
+    return _mm256_sub_ps(_mm256_sub_ps(_mm256_set1_ps(0.5f), _mm256_mul_ps(x, x)),
+                         _mm256_mul_ps(y, y));
+  }
+
+  static __m256 point(const std::int32_t* perm, __m256 x, __m256 y) {
+    using namespace simplex;
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 g2 = _mm256_set1_ps(kG2);
+    const __m256i mask255 = _mm256_set1_epi32(255);
+    const __m256i mask7 = _mm256_set1_epi32(7);
+    const __m256i ione = _mm256_set1_epi32(1);
+
+    const __m256 s = _mm256_mul_ps(_mm256_add_ps(x, y), _mm256_set1_ps(kF2));
+    const __m256 fi = _mm256_floor_ps(_mm256_add_ps(x, s));
+    const __m256 fj = _mm256_floor_ps(_mm256_add_ps(y, s));
+    const __m256 t = _mm256_mul_ps(_mm256_add_ps(fi, fj), g2);
+    const __m256 x0 = _mm256_sub_ps(x, _mm256_sub_ps(fi, t));
+    const __m256 y0 = _mm256_sub_ps(y, _mm256_sub_ps(fj, t));
+    const __m256 upper = _mm256_cmp_ps(x0, y0, _CMP_GT_OQ);
+    const __m256 i1 = _mm256_and_ps(upper, one);
+    const __m256 j1 = _mm256_andnot_ps(upper, one);
+    const __m256 x1 = _mm256_add_ps(_mm256_sub_ps(x0, i1), g2);
+    const __m256 y1 = _mm256_add_ps(_mm256_sub_ps(y0, j1), g2);
+    const __m256 x2 = _mm256_add_ps(x0, _mm256_set1_ps(kG2x2m1));
+    const __m256 y2 = _mm256_add_ps(y0, _mm256_set1_ps(kG2x2m1));
+
+    const __m256i ii = _mm256_and_si256(_mm256_cvttps_epi32(fi), mask255);
+    const __m256i jj = _mm256_and_si256(_mm256_cvttps_epi32(fj), mask255);
+    const __m256i ii1 = _mm256_and_si256(_mm256_castps_si256(upper), ione);
+    const __m256i jj1 = _mm256_sub_epi32(ione, ii1);
+
+    const __m256i p0 = _mm256_i32gather_epi32(perm, jj, 4);
+    const __m256i p1 = _mm256_i32gather_epi32(perm, _mm256_add_epi32(jj, jj1), 4);
+    const __m256i p2 = _mm256_i32gather_epi32(perm, _mm256_add_epi32(jj, ione), 4);
+    const __m256i h0 = _mm256_i32gather_epi32(perm, _mm256_add_epi32(ii, p0), 4);
+    const __m256i h1 =
+        _mm256_i32gather_epi32(perm, _mm256_add_epi32(_mm256_add_epi32(ii, ii1), p1), 4);
+    const __m256i h2 =
+        _mm256_i32gather_epi32(perm, _mm256_add_epi32(_mm256_add_epi32(ii, ione), p2), 4);
+
+    const __m256 gx = _mm256_load_ps(kGradX);
+    const __m256 gy = _mm256_load_ps(kGradY);
+    const __m256 n0 = corner(falloff(x0, y0), _mm256_and_si256(h0, mask7), x0, y0, gx, gy);
+    const __m256 n1 = corner(falloff(x1, y1), _mm256_and_si256(h1, mask7), x1, y1, gx, gy);
+    const __m256 n2 = corner(falloff(x2, y2), _mm256_and_si256(h2, mask7), x2, y2, gx, gy);
+    return _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(n0, n1), n2), _mm256_set1_ps(kScale));
+  }
+};
+
+}  // namespace
+
+void simplex_block_avx2(const std::int32_t* perm, float x0, float z0, float step, int width,
+                        int rows, float amplitude, float* out) {
+  const __m256 lane = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+  const __m256 vstep = _mm256_set1_ps(step);
+  const __m256 vx0 = _mm256_set1_ps(x0);
+  const __m256 vamp = _mm256_set1_ps(amplitude);
+  const int vec_end = width & ~7;
+  for (int r = 0; r < rows; ++r) {
+    const float z = z0 + static_cast<float>(r) * step;
+    const __m256 vz = _mm256_set1_ps(z);
+    float* row = out + r * width;
+    for (int i = 0; i < vec_end; i += 8) {
+      const __m256 idx = _mm256_add_ps(_mm256_set1_ps(static_cast<float>(i)), lane);
+      const __m256 x = _mm256_add_ps(vx0, _mm256_mul_ps(idx, vstep));
+      const __m256 n = Avx2::point(perm, x, vz);
+      _mm256_storeu_ps(row + i, _mm256_add_ps(_mm256_loadu_ps(row + i), _mm256_mul_ps(vamp, n)));
+    }
+    simplex::row_tail(perm, x0, z, step, vec_end, width, amplitude, row);
+  }
+}
+
+void simplex_points_avx2(const std::int32_t* perm, float x0, float z0, float step,
+                         const float* dx, const float* dz, int count, float amplitude,
+                         float* out) {
+  const __m256 vstep = _mm256_set1_ps(step);
+  const __m256 vx0 = _mm256_set1_ps(x0);
+  const __m256 vz0 = _mm256_set1_ps(z0);
+  const __m256 vamp = _mm256_set1_ps(amplitude);
+  const int vec_end = count & ~7;
+  for (int i = 0; i < vec_end; i += 8) {
+    const __m256 x = _mm256_add_ps(vx0, _mm256_mul_ps(_mm256_loadu_ps(dx + i), vstep));
+    const __m256 z = _mm256_add_ps(vz0, _mm256_mul_ps(_mm256_loadu_ps(dz + i), vstep));
+    const __m256 n = Avx2::point(perm, x, z);
+    _mm256_storeu_ps(out + i, _mm256_add_ps(_mm256_loadu_ps(out + i), _mm256_mul_ps(vamp, n)));
+  }
+  simplex::points_tail(perm, x0, z0, step, dx, dz, vec_end, count, amplitude, out);
+}
+
+}  // namespace terram::detail
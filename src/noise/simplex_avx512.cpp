@@ -0,0 +1,114 @@
+#include <immintrin.h>
+
+#include "noise/simplex_kernels.hpp"
+
+namespace terram::detail {
+namespace {
+
+struct Avx512 {
+  static __m512 corner(__m512 t, __m512i g, __m512 x, __m512 y, __m512 gx_table,
+                       __m512 gy_table) {
+    const __m512 gx = _mm512_permutexvar_ps(g, gx_table);
+    const __m512 gy = _mm512_permutexvar_ps(g, gy_table);
+    const __m512 t2 = _mm512_mul_ps(t, t);
+    const __m512 dot = _mm512_add_ps(_mm512_mul_ps(gx, x), _mm512_mul_ps(gy, y));
+    const __m512 n = _mm512_mul_ps(_mm512_mul_ps(t2, t2), dot);
+    const __mmask16 negative = _mm512_cmp_ps_mask(t, _mm512_setzero_ps(), _CMP_LT_OQ);
+    return _mm512_maskz_mov_ps(static_cast<__mmask16>(~negative), n);
+  }
+
+  static __m512 falloff(__m512 x, __m512 y) {
+    return _mm512_sub_ps(_mm512_sub_ps(_mm512_set1_ps(0.5f), _mm512_mul_ps(x, x)),
+                         _mm512_mul_ps(y, y));
+  }
+
+  static __m512 point(const std::int32_t* perm, __m512 x, __m512 y) {
+    using namespace simplex;
+    constexpr int kFloor = _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC;
+    const __m512 one = _mm512_set1_ps(1.0f);
+    const __m512 g2 = _mm512_set1_ps(kG2);
+    const __m512i mask255 = _mm512_set1_epi32(255);
+    const __m512i mask7 = _mm512_set1_epi32(7);
+    const __m512i ione = _mm512_set1_epi32(1);
+
+    const __m512 s = _mm512_mul_ps(_mm512_add_ps(x, y), _mm512_set1_ps(kF2));
+    const __m512 fi = _mm512_roundscale_ps(_mm512_add_ps(x, s), kFloor);
+    const __m512 fj = _mm512_roundscale_ps(_mm512_add_ps(y, s), kFloor);
+    const __m512 t = _mm512_mul_ps(_mm512_add_ps(fi, fj), g2);
+    const __m512 x0 = _mm512_sub_ps(x, _mm512_sub_ps(fi, t));
+    const __m512 y0 = _mm512_sub_ps(y, _mm512_sub_ps(fj, t));
+    const __mmask16 upper = _mm512_cmp_ps_mask(x0, y0, _CMP_GT_OQ);
+    const __m512 i1 = _mm512_maskz_mov_ps(upper, one);
+    const __m512 j1 = _mm512_maskz_mov_ps(static_cast<__mmask16>(~upper), one);
+    const __m512 x1 = _mm512_add_ps(_mm512_sub_ps(x0, i1), g2);
+    const __m512 y1 = _mm512_add_ps(_mm512_sub_ps(y0, j1), g2);
+    const __m512 x2 = _mm512_add_ps(x0, _mm512_set1_ps(kG2x2m1));
+    const __m512 y2 = _mm512_add_ps(y0, _mm512_set1_ps(kG2x2m1));
+
+    const __m512i ii = _mm512_and_si512(_mm512_cvttps_epi32(fi), mask255);
+    const __m512i jj = _mm512_and_si512(_mm512_cvttps_epi32(fj), mask255);
+    const __m512i ii1 = _mm512_maskz_mov_epi32(upper, ione);
+    const __m512i jj1 = _mm512_sub_epi32(ione, ii1);
+
+    const __m512i p0 = _mm512_i32gather_epi32(jj, perm, 4);
+    const __m512i p1 = _mm512_i32gather_epi32(_mm512_add_epi32(jj, jj1), perm, 4);
+    const __m512i p2 = _mm512_i32gather_epi32(_mm512_add_epi32(jj, ione), perm, 4);
+    const __m512i h0 = _mm512_i32gather_epi32(_mm512_add_epi32(ii, p0), perm, 4);
+    const __m512i h1 =
+        _mm512_i32gather_epi32(_mm512_add_epi32(_mm512_add_epi32(ii, ii1), p1), perm, 4);
+    const __m512i h2 =
+        _mm512_i32gather_epi32(_mm512_add_epi32(_mm512_add_epi32(ii, ione), p2), perm, 4);
+
+    // permutexvar indexes 16 lanes; the 8-entry tables are repeated.
+    const __m512 gx = _mm512_castsi512_ps(_mm512_broadcast_i64x4(
+        _mm256_castps_si256(_mm256_load_ps(kGradX))));
+    const __m512 gy = _mm512_castsi512_ps(_mm512_broadcast_i64x4(
+        _mm256_castps_si256(_mm256_load_ps(kGradY))));
+    const __m512 n0 = corner(falloff(x0, y0), _mm512_and_si512(h0, mask7), x0, y0, gx, gy);
+    const __m512 n1 = corner(falloff(x1, y1), _mm512_and_si512(h1, mask7), x1, y1, gx, gy);
+    const __m512 n2 = corner(falloff(x2, y2), _mm512_and_si512(h2, mask7), x2, y2, gx, gy);
+    return _mm512_mul_ps(_mm512_add_ps(_mm512_add_ps(n0, n1), n2), _mm512_set1_ps(kScale));
+  }
+};
+
+}  // namespace
+
+void simplex_block_avx512(const std::int32_t* perm, float x0, float z0, float step, int width,
+                          int rows, float amplitude, float* out) {
+  const __m512 lane = _mm512_setr_ps(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+  const __m512 vstep = _mm512_set1_ps(step);
+  const __m512 vx0 = _mm512_set1_ps(x0);
+  const __m512 vamp = _mm512_set1_ps(amplitude);
+  const int vec_end = width & ~15;
+  for (int r = 0; r < rows; ++r) {
+    const float z = z0 + static_cast<float>(r) * step;
+    const __m512 vz = _mm512_set1_ps(z);
+    float* row = out + r * width;
+    for (int i = 0; i < vec_end; i += 16) {
+      const __m512 idx = _mm512_add_ps(_mm512_set1_ps(static_cast<float>(i)), lane);
+      const __m512 x = _mm512_add_ps(vx0, _mm512_mul_ps(idx, vstep));
+      const __m512 n = Avx512::point(perm, x, vz);
+      _mm512_storeu_ps(row + i, _mm512_add_ps(_mm512_loadu_ps(row + i), _mm512_mul_ps(vamp, n)));
+    }
+    simplex::row_tail(perm, x0, z, step, vec_end, width, amplitude, row);
+  }
+}
+
+void simplex_points_avx512(const std::int32_t* perm, float x0, float z0, float step,
+                           const float* dx, const float* dz, int count, float amplitude,
+                           float* out) {
+  const __m512 vstep = _mm512_set1_ps(step);
+  const __m512 vx0 = _mm512_set1_ps(x0);
+  const __m512 vz0 = _mm512_set1_ps(z0);
+  const __m512 vamp = _mm512_set1_ps(amplitude);
+  const int vec_end = count & ~15;
+  for (int i = 0; i < vec_end; i += 16) {
+    const __m512 x = _mm512_add_ps(vx0, _mm512_mul_ps(_mm512_loadu_ps(dx + i), vstep));
+    const __m512 z = _mm512_add_ps(vz0, _mm512_mul_ps(_mm512_loadu_ps(dz + i), vstep));
+    const __m512 n = Avx512::point(perm, x, z);
+    _mm512_storeu_ps(out + i, _mm512_add_ps(_mm512_loadu_ps(out + i), _mm512_mul_ps(vamp, n)));
+  }
+  simplex::points_tail(perm, x0, z0, step, dx, dz, vec_end, count, amplitude, out);
+}
+
+}  // namespace terram::detail
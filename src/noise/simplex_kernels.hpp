@@ -0,0 +1,116 @@
+#pragma once
+
+// Internal: simplex noise block kernels, one per instruction set. Every
+// kernel evaluates exactly the operation sequence of simplex_point(), lane
+// by lane and without FMA contraction, so all of them agree bit for bit.
+
+#include <cmath>
+#include <cstdint>
+
+namespace terram::detail {
+
+/// out[r * width + i] += amplitude * noise(x0 + i * step, z0 + r * step)
+using SimplexBlockFn = void (*)(const std::int32_t* perm, float x0, float z0, float step,
+                                int width, int rows, float amplitude, float* out);
+
+/// out[i] += amplitude * noise(x0 + dx[i] * step, z0 + dz[i] * step) for
+/// `count` samples at arbitrary offsets. With dx, dz the offsets of a grid
+/// this matches the block kernel exactly.
+using SimplexPointsFn = void (*)(const std::int32_t* perm, float x0, float z0, float step,
+                                 const float* dx, const float* dz, int count, float amplitude,
+                                 float* out);
+
+void simplex_block_scalar(const std::int32_t* perm, float x0, float z0, float step, int width,
+                          int rows, float amplitude, float* out);
+void simplex_points_scalar(const std::int32_t* perm, float x0, float z0, float step,
+                           const float* dx, const float* dz, int count, float amplitude,
+                           float* out);
+#if defined(TERRAM_HAVE_AVX2)
+void simplex_block_avx2(const std::int32_t* perm, float x0, float z0, float step, int width,
+                        int rows, float amplitude, float* out);
+void simplex_points_avx2(const std::int32_t* perm, float x0, float z0, float step,
+                         const float* dx, const float* dz, int count, float amplitude, float* out);
+#endif
+#if defined(TERRAM_HAVE_AVX512)
+void simplex_block_avx512(const std::int32_t* perm, float x0, float z0, float step, int width,
+                          int rows, float amplitude, float* out);
+void simplex_points_avx512(const std::int32_t* perm, float x0, float z0, float step,
+                           const float* dx, const float* dz, int count, float amplitude,
+                           float* out);
+#endif
+#if defined(TERRAM_HAVE_NEON)
+void simplex_block_neon(const std::int32_t* perm, float x0, float z0, float step, int width,
+                        int rows, float amplitude, float* out);
+void simplex_points_neon(const std::int32_t* perm, float x0, float z0, float step,
+                         const float* dx, const float* dz, int count, float amplitude, float* out);
+#endif
+
+namespace simplex {
+
+inline constexpr float kF2 = 0.366025403784f;  // (sqrt(3) - 1) / 2
+inline constexpr float kG2 = 0.211324865405f;  // (3 - sqrt(3)) / 6
+inline constexpr float kG2x2m1 = 2.0f * kG2 - 1.0f;
+inline constexpr float kScale = 70.0f;
+
+// Eight gradient directions, indexed by hash & 7.
+alignas(32) inline constexpr float kGradX[8] = {1, -1, 1, -1, 1, -1, 0, 0};
+alignas(32) inline constexpr float kGradY[8] = {1, 1, -1, -1, 0, 0, 1, -1};
+
+// Static so each translation unit keeps its own copy compiled with its own
+// target flags; an inline function would be merged across the ISA files.
+[[gnu::always_inline]] static inline float corner(float t, int g, float x, float y) {
+  if (t < 0.0f) return 0.0f;
+  const float t2 = t * t;
+  return (t2 * t2) * (kGradX[g] * x + kGradY[g] * y);
+}
+
+[[gnu::always_inline]] static inline float point(const std::int32_t* perm, float x, float y) {
+  const float s = (x + y) * kF2;
+  const float fi = std::floor(x + s);
+  const float fj = std::floor(y + s);
+  const float t = (fi + fj) * kG2;
+  const float x0 = x - (fi - t);
+  const float y0 = y - (fj - t);
+  const bool upper = x0 > y0;
+  const float i1 = upper ? 1.0f : 0.0f;
+  const float j1 = upper ? 0.0f : 1.0f;
+  const float x1 = (x0 - i1) + kG2;
+  const float y1 = (y0 - j1) + kG2;
+  const float x2 = x0 + kG2x2m1;
+  const float y2 = y0 + kG2x2m1;
+
+  const int ii = static_cast<int>(fi) & 255;
+  const int jj = static_cast<int>(fj) & 255;
+  const int ii1 = upper ? 1 : 0;
+  const int jj1 = upper ? 0 : 1;
+  const int g0 = perm[ii + perm[jj]] & 7;
+  const int g1 = perm[ii + ii1 + perm[jj + jj1]] & 7;
+  const int g2 = perm[ii + 1 + perm[jj + 1]] & 7;
+
+  const float n0 = corner((0.5f - x0 * x0) - y0 * y0, g0, x0, y0);
+  const float n1 = corner((0.5f - x1 * x1) - y1 * y1, g1, x1, y1);
+  const float n2 = corner((0.5f - x2 * x2) - y2 * y2, g2, x2, y2);
+  return ((n0 + n1) + n2) * kScale;
+}
+
+/// Scalar tail shared by the vector kernels: columns [begin, width) of one row.
+[[gnu::always_inline]] static inline void row_tail(const std::int32_t* perm, float x0, float z,
+                                                   float step, int begin, int width,
+                                                   float amplitude, float* out) {
+  for (int i = begin; i < width; ++i) {
+    out[i] += amplitude * point(perm, x0 + static_cast<float>(i) * step, z);
+  }
+}
+
+/// Scalar tail of the points kernels: samples [begin, count).
+[[gnu::always_inline]] static inline void points_tail(const std::int32_t* perm, float x0,
+                                                      float z0, float step, const float* dx,
+                                                      const float* dz, int begin, int count,
+                                                      float amplitude, float* out) {
+  for (int i = begin; i < count; ++i) {
+    out[i] += amplitude * point(perm, x0 + dx[i] * step, z0 + dz[i] * step);
+  }
+}
+
+}  // namespace simplex
+}  // namespace terram::detail
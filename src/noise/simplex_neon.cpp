@@ -0,0 +1,125 @@
+#include <arm_neon.h>
+
+#include "noise/simplex_kernels.hpp"
+
+namespace terram::detail {
+namespace {
+
+// NEON has no gather; four scalar loads into one register.
+inline int32x4_t gather(const std::int32_t* table, int32x4_t idx) {
+  int32x4_t r = vdupq_n_s32(0);
+  r = vsetq_lane_s32(table[vgetq_lane_s32(idx, 0)], r, 0);
+  r = vsetq_lane_s32(table[vgetq_lane_s32(idx, 1)], r, 1);
+  r = vsetq_lane_s32(table[vgetq_lane_s32(idx, 2)], r, 2);
+  r = vsetq_lane_s32(table[vgetq_lane_s32(idx, 3)], r, 3);
+  return r;
+}
+
+inline float32x4_t gather(const float* table, int32x4_t idx) {
+  float32x4_t r = vdupq_n_f32(0.0f);
+  r = vsetq_lane_f32(table[vgetq_lane_s32(idx, 0)], r, 0);
+  r = vsetq_lane_f32(table[vgetq_lane_s32(idx, 1)], r, 1);
+  r = vsetq_lane_f32(table[vgetq_lane_s32(idx, 2)], r, 2);
+  r = vsetq_lane_f32(table[vgetq_lane_s32(idx, 3)], r, 3);
+  return r;
+}
+
+// Separate multiply and add: vmlaq/vfmaq would fuse and break bit-identity.
+inline float32x4_t corner(float32x4_t t, int32x4_t g, float32x4_t x, float32x4_t y) {
+  using namespace simplex;
+  const float32x4_t gx = gather(kGradX, g);
+  const float32x4_t gy = gather(kGradY, g);
+  const float32x4_t t2 = vmulq_f32(t, t);
+  const float32x4_t dot = vaddq_f32(vmulq_f32(gx, x), vmulq_f32(gy, y));
+  const float32x4_t n = vmulq_f32(vmulq_f32(t2, t2), dot);
+  const uint32x4_t negative = vcltq_f32(t, vdupq_n_f32(0.0f));
+  return vreinterpretq_f32_u32(vbicq_u32(vreinterpretq_u32_f32(n), negative));
+}
+
+inline float32x4_t falloff(float32x4_t x, float32x4_t y) {
+  return vsubq_f32(vsubq_f32(vdupq_n_f32(0.5f), vmulq_f32(x, x)), vmulq_f32(y, y));
+}
+
+inline float32x4_t point(const std::int32_t* perm, float32x4_t x, float32x4_t y) {
+  using namespace simplex;
+  const float32x4_t one = vdupq_n_f32(1.0f);
+  const float32x4_t g2 = vdupq_n_f32(kG2);
+  const int32x4_t mask255 = vdupq_n_s32(255);
+  const int32x4_t mask7 = vdupq_n_s32(7);
+  const int32x4_t ione = vdupq_n_s32(1);
+
+  const float32x4_t s = vmulq_f32(vaddq_f32(x, y), vdupq_n_f32(kF2));
+  const float32x4_t fi = vrndmq_f32(vaddq_f32(x, s));
+  const float32x4_t fj = vrndmq_f32(vaddq_f32(y, s));
+  const float32x4_t t = vmulq_f32(vaddq_f32(fi, fj), g2);
+  const float32x4_t x0 = vsubq_f32(x, vsubq_f32(fi, t));
+  const float32x4_t y0 = vsubq_f32(y, vsubq_f32(fj, t));
+  const uint32x4_t upper = vcgtq_f32(x0, y0);
+  const float32x4_t i1 =
+      vreinterpretq_f32_u32(vandq_u32(upper, vreinterpretq_u32_f32(one)));
+  const float32x4_t j1 =
+      vreinterpretq_f32_u32(vbicq_u32(vreinterpretq_u32_f32(one), upper));
+  const float32x4_t x1 = vaddq_f32(vsubq_f32(x0, i1), g2);
+  const float32x4_t y1 = vaddq_f32(vsubq_f32(y0, j1), g2);
+  const float32x4_t x2 = vaddq_f32(x0, vdupq_n_f32(kG2x2m1));
+  const float32x4_t y2 = vaddq_f32(y0, vdupq_n_f32(kG2x2m1));
+
+  const int32x4_t ii = vandq_s32(vcvtq_s32_f32(fi), mask255);
+  const int32x4_t jj = vandq_s32(vcvtq_s32_f32(fj), mask255);
+  const int32x4_t ii1 = vandq_s32(vreinterpretq_s32_u32(upper), ione);
+  const int32x4_t jj1 = vsubq_s32(ione, ii1);
+
+  const int32x4_t h0 = gather(perm, vaddq_s32(ii, gather(perm, jj)));
+  const int32x4_t h1 =
+      gather(perm, vaddq_s32(vaddq_s32(ii, ii1), gather(perm, vaddq_s32(jj, jj1))));
+  const int32x4_t h2 =
+      gather(perm, vaddq_s32(vaddq_s32(ii, ione), gather(perm, vaddq_s32(jj, ione))));
+
+  const float32x4_t n0 = corner(falloff(x0, y0), vandq_s32(h0, mask7), x0, y0);
+  const float32x4_t n1 = corner(falloff(x1, y1), vandq_s32(h1, mask7), x1, y1);
+  const float32x4_t n2 = corner(falloff(x2, y2), vandq_s32(h2, mask7), x2, y2);
+  return vmulq_f32(vaddq_f32(vaddq_f32(n0, n1), n2), vdupq_n_f32(kScale));
+}
+
+}  // namespace
+
+void simplex_block_neon(const std::int32_t* perm, float x0, float z0, float step, int width,
+                        int rows, float amplitude, float* out) {
+  static const float kLane[4] = {0, 1, 2, 3};
+  const float32x4_t lane = vld1q_f32(kLane);
+  const float32x4_t vstep = vdupq_n_f32(step);
+  const float32x4_t vx0 = vdupq_n_f32(x0);
+  const float32x4_t vamp = vdupq_n_f32(amplitude);
+  const int vec_end = width & ~3;
+  for (int r = 0; r < rows; ++r) {
+    const float z = z0 + static_cast<float>(r) * step;
+    const float32x4_t vz = vdupq_n_f32(z);
+    float* row = out + r * width;
+    for (int i = 0; i < vec_end; i += 4) {
+      const float32x4_t idx = vaddq_f32(vdupq_n_f32(static_cast<float>(i)), lane);
+      const float32x4_t x = vaddq_f32(vx0, vmulq_f32(idx, vstep));
+      const float32x4_t n = point(perm, x, vz);
+      vst1q_f32(row + i, vaddq_f32(vld1q_f32(row + i), vmulq_f32(vamp, n)));
+    }
+    simplex::row_tail(perm, x0, z, step, vec_end, width, amplitude, row);
+  }
+}
+
+void simplex_points_neon(const std::int32_t* perm, float x0, float z0, float step,
+                         const float* dx, const float* dz, int count, float amplitude,
+                         float* out) {
+  const float32x4_t vstep = vdupq_n_f32(step);
+  const float32x4_t vx0 = vdupq_n_f32(x0);
+  const float32x4_t vz0 = vdupq_n_f32(z0);
+  const float32x4_t vamp = vdupq_n_f32(amplitude);
+  const int vec_end = count & ~3;
+  for (int i = 0; i < vec_end; i += 4) {
+    const float32x4_t x = vaddq_f32(vx0, vmulq_f32(vld1q_f32(dx + i), vstep));
+    const float32x4_t z = vaddq_f32(vz0, vmulq_f32(vld1q_f32(dz + i), vstep));
+    const float32x4_t n = point(perm, x, z);
+    vst1q_f32(out + i, vaddq_f32(vld1q_f32(out + i), vmulq_f32(vamp, n)));
+  }
+  simplex::points_tail(perm, x0, z0, step, dx, dz, vec_end, count, amplitude, out);
+}
+
+}  // namespace terram::detail
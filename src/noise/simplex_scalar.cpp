@@ -0,0 +1,19 @@
+#include "noise/simplex_kernels.hpp"
+
+namespace terram::detail {
+
+void simplex_block_scalar(const std::int32_t* perm, float x0, float z0, float step, int width,
+                          int rows, float amplitude, float* out) {
+  for (int r = 0; r < rows; ++r) {
+    const float z = z0 + static_cast<float>(r) * step;
+    simplex::row_tail(perm, x0, z, step, 0, width, amplitude, out + r * width);
+  }
+}
+
+void simplex_points_scalar(const std::int32_t* perm, float x0, float z0, float step,
+                           const float* dx, const float* dz, int count, float amplitude,
+                           float* out) {
+  simplex::points_tail(perm, x0, z0, step, dx, dz, 0, count, amplitude, out);
+}
+
+}  // namespace terram::detail
@@ -0,0 +1,249 @@
+#include "terram/numa.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <new>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "terram/memory.hpp"
+
+namespace terram {
+namespace {
+
+// Parses a sysfs cpulist such as "0-3,8,10-11".
+std::vector<int> parse_cpulist(const std::string& text) {
+  std::vector<int> cpus;
+  std::stringstream ss(text);
+  std::string range;
+  while (std::getline(ss, range, ',')) {
+    if (range.empty() || range == "\n") continue;
+    const auto dash = range.find('-');
+    const int lo = std::stoi(range.substr(0, dash));
+    const int hi = dash == std::string::npos ? lo : std::stoi(range.substr(dash + 1));
+    for (int c = lo; c <= hi; ++c) cpus.push_back(c);
+  }
+  return cpus;
+}
+
+// Ascending.
+std::vector<int> allowed_cpus() {
+  std::vector<int> cpus;
+#if defined(__linux__)
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+    for (int c = 0; c < CPU_SETSIZE; ++c) {
+      if (CPU_ISSET(c, &set)) cpus.push_back(c);
+    }
+  }
+#endif
+  if (cpus.empty()) cpus.push_back(0);
+  return cpus;
+}
+
+std::string read_line(const std::string& path) {
+  std::ifstream in(path);
+  std::string line;
+  if (in) std::getline(in, line);
+  return line;
+}
+
+NumaTopology detect() {
+  NumaTopology topo;
+  const std::vector<int> allowed = allowed_cpus();
+#if defined(__linux__)
+  // Node ids can skip numbers, e.g. with memory-only or offlined nodes, so
+  // walk the online list rather than count up to the first gap.
+  for (int node : parse_cpulist(read_line("/sys/devices/system/node/online"))) {
+    const std::string path = "/sys/devices/system/node/node" + std::to_string(node) + "/cpulist";
+    // Only the CPUs this process may run on: pinning a worker to a node's
+    // others would fail, or move it outside a cgroup's or taskset's grant.
+    std::vector<int> cpus;
+    for (int c : parse_cpulist(read_line(path))) {
+      if (std::binary_search(allowed.begin(), allowed.end(), c)) cpus.push_back(c);
+    }
+    if (!cpus.empty()) {
+      topo.node_cpus.push_back(std::move(cpus));
+      topo.node_ids.push_back(node);
+    }
+  }
+#endif
+  if (topo.node_cpus.empty()) {
+    topo.node_cpus.push_back(allowed);
+    topo.node_ids.push_back(0);
+  }
+  return topo;
+}
+
+std::size_t page_size() {
+#if defined(__linux__)
+  static const auto page = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+  return page;
+#else
+  return 4096;
+#endif
+}
+
+// Maps `bytes` (a multiple of the page size) placed on `node`. The pages
+// are untouched, so the policy places each of them as it is first written.
+void* map_on_node(std::size_t bytes, int node) {
+#if defined(__linux__)
+  void* p = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (p == MAP_FAILED) throw std::bad_alloc();
+#if defined(SYS_mbind)
+  const NumaTopology& topo = NumaTopology::system();
+  if (topo.node_count() > 1) {
+    // The syscall's node mask, one bit per kernel node id.
+    constexpr int kBits = 8 * sizeof(unsigned long);
+    const int id = topo.node_ids[static_cast<std::size_t>(node)];
+    std::vector<unsigned long> mask(static_cast<std::size_t>(id / kBits + 1), 0);
+    mask[static_cast<std::size_t>(id / kBits)] |= 1ul << (id % kBits);
+    constexpr long kMpolPreferred = 1;
+    // A hint: unplaced pages still work, wherever they land.
+    (void)syscall(SYS_mbind, p, bytes, kMpolPreferred, mask.data(), mask.size() * kBits + 1, 0);
+  }
+#endif
+  return p;
+#else
+  (void)node;
+  return aligned_alloc_bytes(bytes, page_size());
+#endif
+}
+
+void unmap(void* p, std::size_t bytes) noexcept {
+#if defined(__linux__)
+  ::munmap(p, bytes);
+#else
+  (void)bytes;
+  aligned_free(p);
+#endif
+}
+
+// One node's memory. Blocks are whole pages, in power-of-two size classes
+// carved from slabs of their own class; freed blocks are kept for their
+// class. Blocks larger than a slab get a mapping each, unmapped on free.
+class NodePool {
+ public:
+  static constexpr std::size_t kSlabBytes = std::size_t{2} << 20;
+
+  void* allocate(std::size_t bytes, int node) {
+    const std::size_t rounded = round_up(bytes);
+    if (rounded > kSlabBytes) return map_on_node(rounded, node);
+    Class& c = classes_[class_of(rounded)];
+    std::lock_guard lock(mutex_);
+    if (!c.free.empty()) {
+      void* p = c.free.back();
+      c.free.pop_back();
+      return p;
+    }
+    if (c.next == c.end) {
+      c.next = static_cast<char*>(map_on_node(kSlabBytes, node));
+      c.end = c.next + kSlabBytes;
+    }
+    void* p = c.next;
+    c.next += rounded;
+    return p;
+  }
+
+  void free(void* p, std::size_t bytes) noexcept {
+    const std::size_t rounded = round_up(bytes);
+    if (rounded > kSlabBytes) {
+      unmap(p, rounded);
+      return;
+    }
+    Class& c = classes_[class_of(rounded)];
+    std::lock_guard lock(mutex_);
+    try {
+      c.free.push_back(p);
+    } catch (...) {
+      // Out of memory for the list: the block is lost, not misused.
+    }
+  }
+
+ private:
+  struct Class {
+    std::vector<void*> free;
+    char* next = nullptr;
+    char* end = nullptr;
+  };
+
+  // Whole pages, in a power of two of them up to a slab.
+  static std::size_t round_up(std::size_t bytes) {
+    const std::size_t page = page_size();
+    const std::size_t pages = std::max<std::size_t>(1, (bytes + page - 1) / page);
+    if (pages * page > kSlabBytes) return pages * page;
+    return std::bit_ceil(pages) * page;
+  }
+
+  static std::size_t class_of(std::size_t rounded) {
+    return static_cast<std::size_t>(std::countr_zero(rounded / page_size()));
+  }
+
+  std::mutex mutex_;
+  // 1, 2, 4, ... 512 pages: a slab of the smallest pages there are, 4 KiB.
+  std::array<Class, 10> classes_;
+};
+
+// Never destroyed: planes may still be freed during static destruction.
+std::vector<NodePool>& pools() {
+  static auto* pools = new std::vector<NodePool>(
+      static_cast<std::size_t>(NumaTopology::system().node_count()));
+  return *pools;
+}
+
+}  // namespace
+
+const NumaTopology& NumaTopology::system() {
+  static const NumaTopology topo = detect();
+  return topo;
+}
+
+bool pin_current_thread(std::span<const int> cpus) {
+#if defined(__linux__)
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (int c : cpus) {
+    if (c >= 0 && c < CPU_SETSIZE) CPU_SET(c, &set);
+  }
+  return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+  (void)cpus;
+  return false;
+#endif
+}
+
+void* node_alloc(std::size_t bytes, int node) {
+  const NumaTopology& topo = NumaTopology::system();
+  if (node < 0 || node >= topo.node_count()) {
+    throw std::invalid_argument("node_alloc: no NUMA node " + std::to_string(node));
+  }
+  return pools()[static_cast<std::size_t>(node)].allocate(bytes, node);
+}
+
+void node_free(void* p, std::size_t bytes, int node) noexcept {
+  if (p) pools()[static_cast<std::size_t>(node)].free(p, bytes);
+}
+
+void NodeDeleter::operator()(void* p) const noexcept {
+  if (node < 0) {
+    aligned_free(p);
+  } else {
+    node_free(p, bytes, node);
+  }
+}
+
+}  // namespace terram
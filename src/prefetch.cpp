@@ -0,0 +1,149 @@
+#include "terram/prefetch.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <span>
+#include <utility>
+
+#include "terram/world.hpp"
+
+namespace terram {
+
+ViewerPrefetcher::ViewerPrefetcher(World& world, PrefetchOptions options)
+    : world_(world), options_(options), worker_([this] { worker_main(); }) {}
+
+ViewerPrefetcher::~ViewerPrefetcher() {
+  {
+    std::lock_guard lock(mutex_);
+    stop_ = true;
+    plan_stop_.request_stop();
+  }
+  wake_.notify_one();
+  worker_.join();
+}
+
+void ViewerPrefetcher::update(std::uint32_t id, const ViewerMotion& motion) {
+  {
+    std::lock_guard lock(mutex_);
+    viewers_[id] = motion;
+    ++version_;
+    plan_stop_.request_stop();
+    ++stats_.updates;
+  }
+  wake_.notify_one();
+}
+
+void ViewerPrefetcher::remove(std::uint32_t id) {
+  {
+    std::lock_guard lock(mutex_);
+    if (viewers_.erase(id) == 0) return;
+    ++version_;
+    plan_stop_.request_stop();
+  }
+  wake_.notify_one();
+}
+
+PrefetchStats ViewerPrefetcher::stats() const {
+  std::lock_guard lock(mutex_);
+  return stats_;
+}
+
+std::vector<ChunkCoord> ViewerPrefetcher::plan(const std::vector<ViewerMotion>& viewers) const {
+  // Each chunk keeps the earliest (time, ring) at which any viewer's path
+  // comes within the radius of it.
+  struct Eta {
+    double t;
+    int ring;
+  };
+  std::unordered_map<ChunkCoord, Eta, ChunkCoordHash> eta;
+  const int r = std::max(options_.radius, 0);
+  for (const ViewerMotion& v : viewers) {
+    // One path point per chunk travelled, so consecutive squares overlap.
+    const double distance = std::hypot(v.vx, v.vz) * std::max(options_.horizon, 0.0);
+    const auto steps = static_cast<int>(std::min(std::ceil(distance / kChunkSize), 1e6));
+    for (int i = 0; i <= steps && eta.size() < options_.max_planned; ++i) {
+      const double t = steps == 0 ? 0.0 : options_.horizon * i / steps;
+      const ChunkCoord c = chunk_of(static_cast<std::int64_t>(std::floor(v.x + v.vx * t)),
+                                    static_cast<std::int64_t>(std::floor(v.z + v.vz * t)));
+      for (int dz = -r; dz <= r; ++dz) {
+        for (int dx = -r; dx <= r; ++dx) {
+          const Eta e{t, std::max(std::abs(dx), std::abs(dz))};
+          auto [it, added] = eta.try_emplace({c.x + dx, c.z + dz}, e);
+          const Eta& old = it->second;
+          if (!added && (e.t < old.t || (e.t == old.t && e.ring < old.ring))) it->second = e;
+        }
+      }
+    }
+  }
+
+  std::vector<std::pair<ChunkCoord, Eta>> order(eta.begin(), eta.end());
+  std::sort(order.begin(), order.end(), [](const auto& a, const auto& b) {
+    if (a.second.t != b.second.t) return a.second.t < b.second.t;
+    if (a.second.ring != b.second.ring) return a.second.ring < b.second.ring;
+    return a.first.z != b.first.z ? a.first.z < b.first.z : a.first.x < b.first.x;
+  });
+  std::vector<ChunkCoord> out;
+  out.reserve(std::min(order.size(), options_.max_planned));
+  for (const auto& [c, e] : order) {
+    if (out.size() == options_.max_planned) break;
+    out.push_back(c);
+  }
+  return out;
+}
+
+void ViewerPrefetcher::worker_main() {
+  const std::size_t batch = std::max<std::size_t>(options_.max_batch, 1);
+  std::uint64_t planned = 0;
+  std::unique_lock lock(mutex_);
+  while (true) {
+    wake_.wait(lock, [&] { return stop_ || version_ != planned; });
+    if (stop_) return;
+    planned = version_;
+    plan_stop_ = std::stop_source();
+    const std::stop_token stop = plan_stop_.get_token();
+    std::vector<ViewerMotion> viewers;
+    viewers.reserve(viewers_.size());
+    for (const auto& [id, v] : viewers_) viewers.push_back(v);
+    ++stats_.plans;
+    lock.unlock();
+
+    const std::vector<ChunkCoord> coords = plan(viewers);
+    for (std::size_t i = 0; i < coords.size();) {
+      lock.lock();
+      if (world_.demand_waiting() > 0) {
+        // Poll rather than be signalled: chunks() knows nothing of us.
+        ++stats_.yielded;
+        wake_.wait_for(lock, std::chrono::milliseconds(1),
+                       [&] { return stop_ || version_ != planned; });
+      }
+      const bool stale = stop_ || version_ != planned;
+      lock.unlock();
+      if (stale) break;
+      if (world_.demand_waiting() > 0) continue;
+
+      const std::size_t n = std::min(batch, coords.size() - i);
+      std::size_t made = 0;
+      try {
+        made = world_.prefetch(std::span<const ChunkCoord>(coords).subspan(i, n), stop);
+      } catch (...) {
+        // A failing stage fails the same way when the chunk is demanded,
+        // where the caller can see it.
+      }
+      {
+        std::lock_guard stats(mutex_);
+        ++stats_.batches;
+        stats_.prefetched += made;
+      }
+      // A batch deferred for demand is retried once demand has passed; a
+      // cancelled one is replanned.
+      if (stop.stop_requested()) break;
+      if (made < n && world_.demand_waiting() > 0) continue;
+      i += n;
+    }
+    lock.lock();
+  }
+}
+
+}  // namespace terram
@@ -0,0 +1,270 @@
+#include "terram/query.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace terram {
+namespace {
+
+// Positions this far from the origin or further have no chunk coordinate
+// (and doubles no longer resolve cells).
+constexpr double kMaxCoord = static_cast<double>(std::int64_t{1} << 36);
+
+void not_found(PointSamples& out, std::size_t i) {
+  out.height[i] = 0.0f;
+  out.normal_x[i] = 0.0f;
+  out.normal_y[i] = 1.0f;
+  out.normal_z[i] = 0.0f;
+  out.biome[i] = 0;
+  out.found[i] = 0;
+}
+
+// Points gathered from the chunks and not yet interpolated. Interpolation
+// runs over whole arrays of lanes with no loads from the chunks left in
+// it, so the compiler vectorizes it, square roots included. Value
+// initialised, so lanes never written hold zeros.
+struct Staging {
+  static constexpr int kLanes = 256;
+
+  int size = 0;
+  std::uint32_t index[kLanes];
+  float tx[kLanes];
+  float tz[kLanes];
+  // Corner q: (lx + (q & 1), lz + (q >> 1)).
+  float h[4][kLanes];
+  // Normal x and z of each corner; zero, i.e. straight up, without normals.
+  float nx[4][kLanes];
+  float nz[4][kLanes];
+
+  void add(const Chunk* const (&corner)[4], const int (&cell)[4], float fx, float fz,
+           std::uint32_t i) {
+    const int l = size++;
+    index[l] = i;
+    tx[l] = fx;
+    tz[l] = fz;
+    const bool normals = corner[0]->normals() && corner[1]->normals() &&
+                         corner[2]->normals() && corner[3]->normals();
+    for (int q = 0; q < 4; ++q) {
+      h[q][l] = corner[q]->height().data()[cell[q]];
+      const PackedNormal p = normals ? corner[q]->normals()->data()[cell[q]] : PackedNormal{};
+      nx[q][l] = static_cast<float>(p.x) * (1.0f / 32767.0f);
+      nz[q][l] = static_cast<float>(p.z) * (1.0f / 32767.0f);
+    }
+  }
+
+  // The implied y of a unit normal with these x and z.
+  static float up(float x, float z) { return std::sqrt(std::max(1.0f - x * x - z * z, 0.0f)); }
+
+  void flush(PointSamples& out) {
+    // Every lane, stale ones included: a fixed trip count is what lets
+    // GCC vectorize at -O2.
+    float height[kLanes], rx[kLanes], ry[kLanes], rz[kLanes];
+    for (int l = 0; l < kLanes; ++l) {
+      // The same arithmetic as Heightfield::sample(), so both agree exactly.
+      const float top = h[0][l] + (h[1][l] - h[0][l]) * tx[l];
+      const float bottom = h[2][l] + (h[3][l] - h[2][l]) * tx[l];
+      height[l] = top + (bottom - top) * tz[l];
+
+      // Spelled out per corner: an inner loop over them keeps the outer
+      // one from vectorizing.
+      const float w0 = (1.0f - tx[l]) * (1.0f - tz[l]);
+      const float w1 = tx[l] * (1.0f - tz[l]);
+      const float w2 = (1.0f - tx[l]) * tz[l];
+      const float w3 = tx[l] * tz[l];
+      const float x = w0 * nx[0][l] + w1 * nx[1][l] + w2 * nx[2][l] + w3 * nx[3][l];
+      const float z = w0 * nz[0][l] + w1 * nz[1][l] + w2 * nz[2][l] + w3 * nz[3][l];
+      const float y = w0 * up(nx[0][l], nz[0][l]) + w1 * up(nx[1][l], nz[1][l]) +
+                      w2 * up(nx[2][l], nz[2][l]) + w3 * up(nx[3][l], nz[3][l]);
+      const float inv = 1.0f / std::sqrt(x * x + y * y + z * z);
+      rx[l] = x * inv;
+      ry[l] = y * inv;
+      rz[l] = z * inv;
+    }
+    for (int l = 0; l < size; ++l) {
+      const std::uint32_t i = index[l];
+      out.height[i] = height[l];
+      out.normal_x[i] = rx[l];
+      out.normal_y[i] = ry[l];
+      out.normal_z[i] = rz[l];
+      out.found[i] = 1;
+    }
+    size = 0;
+  }
+};
+
+// Points per block. A block's positions and results stay in L1/L2 while
+// its points are grouped by chunk and sampled.
+constexpr std::size_t kBlock = 4096;
+
+// A chunk of the batch with the neighbours its +x / +z edge reads, kept
+// alive for the rest of the call.
+struct Resolved {
+  std::array<std::shared_ptr<Chunk>, 9> owners;
+  ChunkNeighborhood hood;
+};
+
+// Sorts `order` by chunk, z then x, then by tile within the chunk: a
+// counting sort when the block spans a compact area, as a tick's queries
+// around the players do.
+void sort_by_chunk(std::vector<std::uint32_t>& order, const std::int32_t* cx,
+                   const std::int32_t* cz, const std::uint8_t* tile,
+                   std::vector<std::uint32_t>& start, std::vector<std::uint32_t>& sorted) {
+  if (order.size() < 2) return;
+  std::int32_t x0 = cx[order[0]], x1 = x0, z0 = cz[order[0]], z1 = z0;
+  for (std::uint32_t i : order) {
+    x0 = std::min(x0, cx[i]);
+    x1 = std::max(x1, cx[i]);
+    z0 = std::min(z0, cz[i]);
+    z1 = std::max(z1, cz[i]);
+  }
+  const auto width = static_cast<std::uint64_t>(std::int64_t{x1} - x0 + 1);
+  const auto buckets = width * static_cast<std::uint64_t>(std::int64_t{z1} - z0 + 1) *
+                       kTilesPerSide * kTilesPerSide;
+  if (buckets > 4 * kBlock) {
+    std::sort(order.begin(), order.end(), [&](std::uint32_t a, std::uint32_t b) {
+      if (cz[a] != cz[b]) return cz[a] < cz[b];
+      return cx[a] != cx[b] ? cx[a] < cx[b] : tile[a] < tile[b];
+    });
+    return;
+  }
+  auto bucket = [&](std::uint32_t i) {
+    const std::uint64_t chunk = static_cast<std::uint64_t>(cz[i] - z0) * width +
+                                static_cast<std::uint64_t>(cx[i] - x0);
+    return static_cast<std::size_t>(chunk * kTilesPerSide * kTilesPerSide + tile[i]);
+  };
+  start.assign(buckets + 1, 0);
+  for (std::uint32_t i : order) ++start[bucket(i) + 1];
+  for (std::size_t b = 1; b <= buckets; ++b) start[b] += start[b - 1];
+  sorted.resize(order.size());
+  for (std::uint32_t i : order) sorted[start[bucket(i)]++] = i;
+  order.swap(sorted);
+}
+
+}  // namespace
+
+void PointSamples::resize(std::size_t n) {
+  height.resize(n);
+  normal_x.resize(n);
+  normal_y.resize(n);
+  normal_z.resize(n);
+  biome.resize(n);
+  found.resize(n);
+}
+
+std::size_t sample_points(const Heightfield& field, std::span<const double> x,
+                          std::span<const double> z, PointSamples& out, int min_stage) {
+  if (x.size() != z.size()) {
+    throw std::invalid_argument("sample_points: x and z differ in length");
+  }
+  if (x.size() > std::numeric_limits<std::uint32_t>::max()) {
+    throw std::invalid_argument("sample_points: too many points");
+  }
+  const std::size_t n = x.size();
+  out.resize(n);
+
+  std::size_t missing = 0;
+  std::unordered_map<ChunkCoord, Resolved, ChunkCoordHash> resolved;
+  std::int32_t cx[kBlock], cz[kBlock];
+  std::uint8_t tile[kBlock];
+  std::vector<std::uint32_t> order, start, sorted;
+  order.reserve(kBlock);
+  auto staging = std::make_unique<Staging>();
+  for (std::size_t base = 0; base < n; base += kBlock) {
+    const std::size_t count = std::min(kBlock, n - base);
+    // Chunk of the cell each point lies in; points without one are answered
+    // here and left out of the sort.
+    order.clear();
+    for (std::size_t j = 0; j < count; ++j) {
+      const std::size_t i = base + j;
+      if (!(std::abs(x[i]) < kMaxCoord && std::abs(z[i]) < kMaxCoord)) {
+        not_found(out, i);
+        ++missing;
+        continue;
+      }
+      const auto wx = static_cast<std::int64_t>(std::floor(x[i]));
+      const auto wz = static_cast<std::int64_t>(std::floor(z[i]));
+      const ChunkCoord c = chunk_of(wx, wz);
+      cx[j] = c.x;
+      cz[j] = c.z;
+      tile[j] = static_cast<std::uint8_t>((local_of(wz) >> kTileShift) * kTilesPerSide +
+                                          (local_of(wx) >> kTileShift));
+      order.push_back(static_cast<std::uint32_t>(j));
+    }
+    sort_by_chunk(order, cx, cz, tile, start, sorted);
+
+    for (std::size_t run = 0; run < order.size();) {
+      const ChunkCoord c{cx[order[run]], cz[order[run]]};
+      std::size_t end = run + 1;
+      while (end < order.size() && cx[order[end]] == c.x && cz[order[end]] == c.z) ++end;
+
+      auto [it, inserted] = resolved.try_emplace(c);
+      ChunkNeighborhood& hood = it->second.hood;
+      if (inserted) {
+        hood = field.neighborhood(c, &it->second.owners);
+        for (int dz = -1; dz <= 1; ++dz) {
+          for (int dx = -1; dx <= 1; ++dx) {
+            const Chunk* k = hood.at(dx, dz);
+            if (k && k->stage() < min_stage) hood.set(dx, dz, nullptr);
+          }
+        }
+        if (hood.center()) hood.center()->mark_accessed();
+      }
+      const Chunk* centre = hood.center();
+      if (!centre) {
+        for (std::size_t k = run; k < end; ++k) not_found(out, base + order[k]);
+        missing += end - run;
+        run = end;
+        continue;
+      }
+      const TiledPlane<BiomeId>* biomes = centre->biomes();
+
+      for (std::size_t k = run; k < end; ++k) {
+        const std::size_t i = base + order[k];
+        const double fx = std::floor(x[i]);
+        const double fz = std::floor(z[i]);
+        const int lx = local_of(static_cast<std::int64_t>(fx));
+        const int lz = local_of(static_cast<std::int64_t>(fz));
+        const float tx = static_cast<float>(x[i] - fx);
+        const float tz = static_cast<float>(z[i] - fz);
+
+        // Corners (lx, lz), (lx + 1, lz), (lx, lz + 1), (lx + 1, lz + 1);
+        // only points on the +x / +z edge reach into a neighbour.
+        const Chunk* corner[4] = {centre, centre, centre, centre};
+        int cell[4];
+        if (lx < kChunkSize - 1 && lz < kChunkSize - 1) {
+          cell[0] = tiled_index(lx, lz);
+          cell[1] = tiled_index(lx + 1, lz);
+          cell[2] = tiled_index(lx, lz + 1);
+          cell[3] = tiled_index(lx + 1, lz + 1);
+        } else {
+          bool resident = true;
+          for (int q = 0; q < 4; ++q) {
+            const int ax = lx + (q & 1);
+            const int az = lz + (q >> 1);
+            corner[q] = hood.at(ax >> kChunkShift, az >> kChunkShift);
+            resident = resident && corner[q];
+            cell[q] = tiled_index(ax & (kChunkSize - 1), az & (kChunkSize - 1));
+          }
+          if (!resident) {
+            not_found(out, i);
+            ++missing;
+            continue;
+          }
+        }
+        out.biome[i] = biomes ? biomes->data()[tiled_index(lx, lz)] : BiomeId{0};
+        staging->add(corner, cell, tx, tz, static_cast<std::uint32_t>(i));
+        if (staging->size == Staging::kLanes) staging->flush(out);
+      }
+      run = end;
+    }
+  }
+  staging->flush(out);
+  return missing;
+}
+
+}  // namespace terram
@@ -0,0 +1,586 @@
+#include "terram/region_store.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "terram/memory.hpp"
+
+namespace terram {
+namespace {
+
+namespace fmt = region_format;
+
+[[noreturn]] void throw_errno(const std::string& what) {
+  throw std::system_error(errno, std::generic_category(), what);
+}
+
+void write_all(int fd, const void* data, std::size_t bytes, std::size_t offset,
+               const std::string& path) {
+  const auto* p = static_cast<const char*>(data);
+  while (bytes > 0) {
+    const ssize_t n = ::pwrite(fd, p, bytes, static_cast<off_t>(offset));
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      throw_errno("pwrite " + path);
+    }
+    p += n;
+    bytes -= static_cast<std::size_t>(n);
+    offset += static_cast<std::size_t>(n);
+  }
+}
+
+std::string region_name(ChunkCoord r) {
+  return "r." + std::to_string(r.x) + "." + std::to_string(r.z) + ".trr";
+}
+
+int slot_of(ChunkCoord c) {
+  return (c.z & (kRegionSize - 1)) * kRegionSize + (c.x & (kRegionSize - 1));
+}
+
+}  // namespace
+
+class RegionStore::Region : public std::enable_shared_from_this<Region> {
+ public:
+  /// What readers of a slot see: a queued save's snapshot until its index
+  /// entry is on disk, else the mapping.
+  struct Lookup {
+    const float* height;
+    fmt::SlotEntry entry;
+    std::shared_ptr<const void> keepalive;
+  };
+
+  Region(std::filesystem::path path, ChunkCoord coord, bool create, IoQueue& io)
+      : path_(std::move(path)),
+        coord_(coord),
+        io_(io),
+        busy_(fmt::kRecordLocations, 0),
+        borrows_(fmt::kRecordLocations, 0) {
+    fd_ = ::open(path_.c_str(), O_RDWR | O_CLOEXEC | (create ? O_CREAT : 0), 0644);
+    if (fd_ < 0) throw_errno("open " + path_.string());
+    try {
+      struct stat st {};
+      if (::fstat(fd_, &st) != 0) throw_errno("fstat " + path_.string());
+      if (st.st_size == 0 && create) {
+        initialise();
+      } else if (static_cast<std::size_t>(st.st_size) < fmt::kFileBytes) {
+        throw std::runtime_error("region file truncated: " + path_.string());
+      }
+      void* base = ::mmap(nullptr, fmt::kFileBytes, PROT_READ, MAP_SHARED, fd_, 0);
+      if (base == MAP_FAILED) throw_errno("mmap " + path_.string());
+      base_ = static_cast<const char*>(base);
+      validate();
+      index();
+    } catch (...) {
+      if (base_) ::munmap(const_cast<char*>(base_), fmt::kFileBytes);
+      ::close(fd_);
+      throw;
+    }
+  }
+
+  ~Region() {
+    ::munmap(const_cast<char*>(base_), fmt::kFileBytes);
+    ::close(fd_);
+  }
+
+  Region(const Region&) = delete;
+  Region& operator=(const Region&) = delete;
+
+  ChunkCoord coord() const { return coord_; }
+
+  fmt::SlotEntry entry(int slot) {
+    std::lock_guard lock(mutex_);
+    auto it = pending_.find(slot);
+    return it != pending_.end() ? it->second.entry : mapped_entry(slot);
+  }
+
+  Lookup lookup(int slot) {
+    std::lock_guard lock(mutex_);
+    auto it = pending_.find(slot);
+    if (it != pending_.end() && it->second.record) {
+      const Pending& p = it->second;
+      return {p.record.get(), p.entry, p.record};
+    }
+    const fmt::SlotEntry e = it != pending_.end() ? it->second.entry : mapped_entry(slot);
+    if (!(e.flags & fmt::kSlotPresent)) return {nullptr, e, nullptr};
+    auto borrow = std::make_shared<Borrow>(shared_from_this(), e.record);
+    ++borrows_[e.record];
+    return {record(e.record), e, std::move(borrow)};
+  }
+
+  /// Queues a save of `height` with index entry `e`. Snapshots the heights
+  /// unless they already are the slot's current record.
+  void queue_write(int slot, const float* height, fmt::SlotEntry e) {
+    std::lock_guard lock(mutex_);
+    Pending& p = pending_[slot];
+    const fmt::SlotEntry mapped = mapped_entry(slot);
+    if (height == nullptr) {
+      p.record = nullptr;
+    } else if (!p.record && (mapped.flags & fmt::kSlotPresent) &&
+               height == record(mapped.record)) {
+      // A plane still borrowing its own, already written record.
+      p.record = nullptr;
+      e.record = mapped.record;
+    } else if (height != p.record.get()) {
+      // Snapshots are never written once queued, so a plane borrowing the
+      // previous save's snapshot can share it.
+      std::shared_ptr<float[]> copy = make_aligned_array<float>(kChunkCells);
+      std::memcpy(copy.get(), height, fmt::kRecordBytes);
+      p.record = std::move(copy);
+    }
+    p.entry = e;
+    p.version = ++version_;
+    dirty_ = true;
+    if (!p.writing) start_locked(slot, p);
+  }
+
+  /// Queues an fdatasync if anything was written or replaced since the
+  /// last one.
+  void sync() {
+    std::lock_guard lock(mutex_);
+    if (barrier_ || (!dirty_ && retired_.empty())) return;
+    start_barrier_locked();
+  }
+
+  /// Throws, and clears, the first error since the last call.
+  void rethrow() {
+    std::lock_guard lock(error_mutex_);
+    if (error_ == 0) return;
+    const int err = error_;
+    error_ = 0;
+    throw std::system_error(err, std::generic_category(), error_what_);
+  }
+
+  /// The store is going away: no I/O is issued from here on.
+  void close() {
+    std::unique_lock lock(mutex_);
+    closed_ = true;
+    submitted_.wait(lock, [&] { return submitting_ == 0; });
+  }
+
+  void advise(int slot) {
+    std::lock_guard lock(mutex_);
+    if (pending_.contains(slot)) return;
+    const fmt::SlotEntry e = mapped_entry(slot);
+    if (!(e.flags & fmt::kSlotPresent)) return;
+    io_.advise(fd_, offset(e.record), fmt::kRecordBytes);
+  }
+
+ private:
+  struct Pending {
+    /// Snapshot to write; null if the mapped record is already current.
+    std::shared_ptr<float[]> record;
+    fmt::SlotEntry entry;
+    std::uint64_t version = 0;
+    bool writing = false;
+  };
+
+  // One save of a slot in flight: its buffers live here until its index
+  // entry is written.
+  struct Flight {
+    std::shared_ptr<float[]> record;
+    fmt::SlotEntry entry;
+    std::uint64_t version;
+    /// The slot's index entry when the save started.
+    fmt::SlotEntry previous;
+  };
+
+  using Landed = std::vector<std::pair<int, std::shared_ptr<Flight>>>;
+  /// Locations replaced by an index write, with the slot that replaced them.
+  using Retired = std::vector<std::pair<int, std::uint32_t>>;
+
+  // Held by every plane borrowing a mapped record: keeps the mapping alive,
+  // and the location from being reused, for as long as the plane reads it.
+  struct Borrow {
+    Borrow(std::shared_ptr<Region> region, std::uint32_t location)
+        : region(std::move(region)), location(location) {}
+    ~Borrow() { region->unborrow(location); }
+
+    std::shared_ptr<Region> region;
+    std::uint32_t location;
+  };
+
+  fmt::SlotEntry mapped_entry(int slot) const {
+    fmt::SlotEntry e;
+    std::memcpy(&e, base_ + fmt::kIndexOffset + slot * sizeof(fmt::SlotEntry), sizeof(e));
+    return e;
+  }
+
+  static std::size_t offset(std::uint32_t location) {
+    return fmt::kDataOffset + location * fmt::kRecordBytes;
+  }
+
+  const float* record(std::uint32_t location) const {
+    return reinterpret_cast<const float*>(base_ + offset(location));
+  }
+
+  // Marks the locations the index references as taken.
+  void index() {
+    for (int slot = 0; slot < kRegionSlots; ++slot) {
+      const fmt::SlotEntry e = mapped_entry(slot);
+      if (!(e.flags & fmt::kSlotPresent)) continue;
+      if (e.record >= fmt::kRecordLocations || busy_[e.record]) {
+        throw std::runtime_error("bad region index: " + path_.string());
+      }
+      busy_[e.record] = 1;
+    }
+  }
+
+  // A location no index entry, save in flight or loaded plane uses, or -1.
+  std::int64_t allocate_locked() {
+    for (int i = 0; i < fmt::kRecordLocations; ++i) {
+      const int location = (cursor_ + i) % fmt::kRecordLocations;
+      if (!busy_[location] && borrows_[location] == 0) {
+        cursor_ = location + 1;
+        busy_[location] = 1;
+        return location;
+      }
+    }
+    return -1;
+  }
+
+  void release_locked(std::uint32_t location) {
+    busy_[location] = 0;
+    if (borrows_[location] == 0) restart_stalled_locked();
+  }
+
+  // A save that found every location taken waits here for one to free up.
+  void restart_stalled_locked() {
+    if (stalled_.empty()) return;
+    const int slot = stalled_.front();
+    stalled_.pop_front();
+    start_locked(slot, pending_[slot]);
+  }
+
+  // Borrows can outlive the store, and with it io_: once closed, only the
+  // count changes. The restarted save is submitted unlocked, as submit()
+  // may run completions, which lock mutex_, on this thread; close() waits
+  // for the submit so io_ outlives it.
+  void unborrow(std::uint32_t location) {
+    {
+      std::lock_guard lock(mutex_);
+      if (--borrows_[location] != 0 || busy_[location] || closed_ || stalled_.empty()) return;
+      restart_stalled_locked();
+      ++submitting_;
+    }
+    io_.submit();
+    std::lock_guard lock(mutex_);
+    if (--submitting_ == 0) submitted_.notify_all();
+  }
+
+  bool referenced_locked(int slot, std::uint32_t location) const {
+    auto at = [&](const fmt::SlotEntry& e) {
+      return (e.flags & fmt::kSlotPresent) && e.record == location;
+    };
+    if (at(mapped_entry(slot))) return true;
+    auto it = pending_.find(slot);
+    return it != pending_.end() && !it->second.record && at(it->second.entry);
+  }
+
+  // Record to a free location, then, once a barrier has synced it, the
+  // index entry; the record it replaces stays intact until that entry is
+  // synced as well. A crash therefore never exposes a torn record.
+  void start_locked(int slot, Pending& p) {
+    p.writing = true;
+    auto flight =
+        std::make_shared<Flight>(Flight{p.record, p.entry, p.version, mapped_entry(slot)});
+    if (!flight->record) {
+      write_index(slot, std::move(flight));
+      return;
+    }
+    const std::int64_t location = allocate_locked();
+    if (location < 0) {
+      stalled_.push_back(slot);
+      return;
+    }
+    flight->entry.record = static_cast<std::uint32_t>(location);
+    const float* data = flight->record.get();
+    io_.write(fd_, data, fmt::kRecordBytes, offset(flight->entry.record),
+              [self = shared_from_this(), slot, flight](std::int64_t res) {
+                if (res < 0) {
+                  self->written(slot, *flight, res, "pwrite ", false);
+                } else {
+                  self->landed(slot, flight);
+                }
+              });
+  }
+
+  // A record is in the page cache; its index entry waits for a barrier.
+  void landed(int slot, std::shared_ptr<Flight> flight) {
+    {
+      std::lock_guard lock(mutex_);
+      landed_.emplace_back(slot, std::move(flight));
+      if (!barrier_) start_barrier_locked();
+    }
+    io_.submit();
+  }
+
+  // One fdatasync for every record landed and every location retired so
+  // far; what lands meanwhile waits for the next.
+  void start_barrier_locked() {
+    barrier_ = true;
+    dirty_ = false;
+    auto landed = std::make_shared<Landed>(std::move(landed_));
+    auto retired = std::make_shared<Retired>(std::move(retired_));
+    landed_.clear();
+    retired_.clear();
+    io_.sync(fd_, [self = shared_from_this(), landed, retired](std::int64_t res) {
+      self->synced(*landed, *retired, res);
+    });
+  }
+
+  void synced(const Landed& landed, const Retired& retired, std::int64_t res) {
+    if (res < 0) fail(res, "fdatasync ");
+    {
+      std::lock_guard lock(mutex_);
+      barrier_ = false;
+      for (const auto& [slot, location] : retired) {
+        if (res < 0) {
+          retired_.emplace_back(slot, location);
+        } else if (!referenced_locked(slot, location)) {
+          release_locked(location);
+        }
+      }
+      if (res >= 0) {
+        for (const auto& [slot, flight] : landed) write_index(slot, flight);
+      }
+      if (!landed_.empty()) start_barrier_locked();
+    }
+    if (res < 0) {
+      for (const auto& [slot, flight] : landed) written(slot, *flight, res, "fdatasync ", false);
+    }
+    io_.submit();
+  }
+
+  void write_index(int slot, std::shared_ptr<Flight> flight) {
+    const fmt::SlotEntry* entry = &flight->entry;
+    io_.write(fd_, entry, sizeof(*entry), fmt::kIndexOffset + slot * sizeof(*entry),
+              [self = shared_from_this(), slot, flight](std::int64_t res) {
+                self->written(slot, *flight, res, "pwrite ", true);
+              });
+  }
+
+  // The save in flight for `slot` finished, `indexed` if it got as far as
+  // writing its index entry. A newer save queued meanwhile starts now;
+  // otherwise readers go back to the mapping. After a failure the snapshot
+  // stays pending, so reads stay correct until a later save.
+  void written(int slot, const Flight& flight, std::int64_t res, const char* op, bool indexed) {
+    if (res < 0) fail(res, op);
+    {
+      std::lock_guard lock(mutex_);
+      const fmt::SlotEntry& old = flight.previous;
+      if (res >= 0) {
+        dirty_ = true;
+        const bool kept = (flight.entry.flags & fmt::kSlotPresent) &&
+                          flight.entry.record == old.record;
+        if ((old.flags & fmt::kSlotPresent) && !kept) retired_.emplace_back(slot, old.record);
+      } else if (!indexed && flight.record) {
+        release_locked(flight.entry.record);
+      }
+      auto it = pending_.find(slot);
+      Pending& p = it->second;
+      p.writing = false;
+      if (p.version != flight.version) {
+        start_locked(slot, p);
+      } else if (res >= 0) {
+        pending_.erase(it);
+      }
+    }
+    io_.submit();
+  }
+
+  void fail(std::int64_t res, const char* op) {
+    std::lock_guard lock(error_mutex_);
+    if (error_ != 0) return;
+    error_ = static_cast<int>(-res);
+    error_what_ = op + path_.string();
+  }
+
+  void initialise() {
+    if (::ftruncate(fd_, static_cast<off_t>(fmt::kFileBytes)) != 0) {
+      throw_errno("ftruncate " + path_.string());
+    }
+    fmt::Header h{};
+    std::memcpy(h.magic, fmt::kMagic, sizeof(h.magic));
+    h.version = fmt::kVersion;
+    h.byte_order = fmt::kByteOrderMark;
+    h.chunk_size = kChunkSize;
+    h.tile_size = kTileSize;
+    h.region_size = kRegionSize;
+    h.record_bytes = static_cast<std::uint32_t>(fmt::kRecordBytes);
+    h.data_offset = fmt::kDataOffset;
+    h.region_x = coord_.x;
+    h.region_z = coord_.z;
+    h.record_locations = fmt::kRecordLocations;
+    write_all(fd_, &h, sizeof(h), 0, path_.string());
+  }
+
+  void validate() const {
+    fmt::Header h;
+    std::memcpy(&h, base_, sizeof(h));
+    const bool ok = std::memcmp(h.magic, fmt::kMagic, sizeof(h.magic)) == 0 &&
+                    h.version == fmt::kVersion && h.byte_order == fmt::kByteOrderMark &&
+                    h.chunk_size == kChunkSize && h.tile_size == kTileSize &&
+                    h.region_size == kRegionSize && h.record_bytes == fmt::kRecordBytes &&
+                    h.data_offset == fmt::kDataOffset && h.region_x == coord_.x &&
+                    h.region_z == coord_.z && h.record_locations == fmt::kRecordLocations;
+    if (!ok) throw std::runtime_error("bad region header: " + path_.string());
+  }
+
+  std::filesystem::path path_;
+  ChunkCoord coord_;
+  int fd_ = -1;
+  const char* base_ = nullptr;
+  IoQueue& io_;
+  /// Per record location: referenced by the index or by a save in flight.
+  std::vector<std::uint8_t> busy_;
+  /// Per record location: live Borrows of it.
+  std::vector<std::uint32_t> borrows_;
+  int cursor_ = 0;
+  std::mutex mutex_;
+  std::unordered_map<int, Pending> pending_;
+  std::uint64_t version_ = 0;
+  /// Index entries written since the last barrier.
+  bool dirty_ = false;
+  bool barrier_ = false;
+  Landed landed_;
+  Retired retired_;
+  std::deque<int> stalled_;
+  bool closed_ = false;
+  /// unborrow() calls submitting outside mutex_, which close() waits out.
+  int submitting_ = 0;
+  std::condition_variable submitted_;
+  /// Guards error_ and error_what_, which I/O completions set.
+  std::mutex error_mutex_;
+  int error_ = 0;
+  std::string error_what_;
+};
+
+RegionStore::RegionStore(std::filesystem::path directory, IoQueueOptions io)
+    : directory_(std::move(directory)), io_(std::make_unique<IoQueue>(io)) {
+  std::filesystem::create_directories(directory_);
+}
+
+RegionStore::~RegionStore() {
+  io_->drain();
+  std::lock_guard lock(mutex_);
+  for (auto& [coord, r] : regions_) r->close();
+}
+
+std::shared_ptr<RegionStore::Region> RegionStore::region(ChunkCoord r, bool create) {
+  std::lock_guard lock(mutex_);
+  auto it = regions_.find(r);
+  if (it != regions_.end()) return it->second;
+  const auto path = directory_ / region_name(r);
+  if (!create && !std::filesystem::exists(path)) return nullptr;
+  auto region = std::make_shared<Region>(path, r, create, *io_);
+  // Resume the save counter past anything already on disk.
+  for (int slot = 0; slot < kRegionSlots; ++slot) {
+    const auto e = region->entry(slot);
+    if (e.flags & fmt::kSlotPresent) sequence_ = std::max(sequence_, e.sequence);
+  }
+  regions_.emplace(r, region);
+  return region;
+}
+
+bool RegionStore::contains(ChunkCoord c) {
+  auto r = region(region_of(c), false);
+  return r && (r->entry(slot_of(c)).flags & fmt::kSlotPresent);
+}
+
+std::optional<ChunkRecordView> RegionStore::view(ChunkCoord c) {
+  auto r = region(region_of(c), false);
+  if (!r) return std::nullopt;
+  auto found = r->lookup(slot_of(c));
+  if (!(found.entry.flags & fmt::kSlotPresent)) return std::nullopt;
+  return ChunkRecordView{found.height, static_cast<int>(found.entry.stage), found.entry.sequence,
+                         std::move(found.keepalive)};
+}
+
+std::shared_ptr<Chunk> RegionStore::load(ChunkCoord c) {
+  auto v = view(c);
+  if (!v) return nullptr;
+  return std::make_shared<Chunk>(c, TiledPlane<float>(v->height, std::move(v->keepalive)),
+                                 v->stage);
+}
+
+void RegionStore::queue_save(const Chunk& chunk, int stage) {
+  const ChunkCoord c = chunk.coord();
+  auto r = region(region_of(c), true);
+  fmt::SlotEntry e{};
+  e.flags = fmt::kSlotPresent;
+  e.stage = static_cast<std::uint32_t>(stage);
+  {
+    std::lock_guard lock(mutex_);
+    e.sequence = ++sequence_;
+  }
+  r->queue_write(slot_of(c), chunk.height().data(), e);
+}
+
+void RegionStore::submit() { io_->submit(); }
+
+bool RegionStore::erase(ChunkCoord c) {
+  auto r = region(region_of(c), false);
+  if (!r) return false;
+  const int slot = slot_of(c);
+  if (!(r->entry(slot).flags & fmt::kSlotPresent)) return false;
+  r->queue_write(slot, nullptr, fmt::SlotEntry{});
+  io_->submit();
+  return true;
+}
+
+void RegionStore::flush() {
+  io_->drain();
+  std::vector<std::shared_ptr<Region>> open;
+  {
+    std::lock_guard lock(mutex_);
+    for (auto& [coord, r] : regions_) open.push_back(r);
+  }
+  // Every region syncs in parallel.
+  for (auto& r : open) r->sync();
+  io_->drain();
+  for (auto& r : open) r->rethrow();
+}
+
+void RegionStore::prefetch(std::span<const ChunkCoord> coords) {
+  for (ChunkCoord c : coords) {
+    if (auto r = region(region_of(c), false)) r->advise(slot_of(c));
+  }
+  io_->submit();
+}
+
+std::vector<ChunkCoord> RegionStore::list() {
+  std::vector<ChunkCoord> out;
+  for (const auto& file : std::filesystem::directory_iterator(directory_)) {
+    int rx = 0;
+    int rz = 0;
+    char tail = 0;
+    const std::string name = file.path().filename().string();
+    if (std::sscanf(name.c_str(), "r.%d.%d.tr%c", &rx, &rz, &tail) != 3 || tail != 'r') continue;
+    auto r = region({rx, rz}, false);
+    if (!r) continue;
+    for (int slot = 0; slot < kRegionSlots; ++slot) {
+      if (r->entry(slot).flags & fmt::kSlotPresent) {
+        out.push_back({rx * kRegionSize + (slot & (kRegionSize - 1)),
+                       rz * kRegionSize + (slot >> kRegionShift)});
+      }
+    }
+  }
+  return out;
+}
+
+}  // namespace terram
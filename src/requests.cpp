@@ -0,0 +1,187 @@
+#include "terram/requests.hpp"
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "terram/metrics.hpp"
+#include "terram/world.hpp"
+
+namespace terram {
+namespace {
+
+struct RequestMetrics {
+  Histogram& latency;
+  Counter& accepted;
+  Counter& rejected;
+  Counter& cancelled;
+};
+
+RequestMetrics& request_metrics() {
+  Metrics& m = Metrics::global();
+  static RequestMetrics metrics{m.histogram("requests.latency"), m.counter("requests.accepted"),
+                                m.counter("requests.rejected"), m.counter("requests.cancelled")};
+  return metrics;
+}
+
+}  // namespace
+
+ChunkRequestQueue::ChunkRequestQueue(World& world, RequestQueueOptions options)
+    : world_(world), options_(options), completions_(options.completion_capacity) {
+  for (auto& lane : lanes_) lane = std::make_unique<Lane>(options.capacity);
+  for (int p = 0; p < kPriorityCount; ++p) {
+    lanes_[p]->dispatcher = std::thread([this, p] { dispatch_main(static_cast<Priority>(p)); });
+  }
+}
+
+ChunkRequestQueue::~ChunkRequestQueue() {
+  stop_.store(true, std::memory_order_seq_cst);
+  for (auto& lane : lanes_) {
+    {
+      std::lock_guard lock(lane->stop_mutex);
+      lane->stop.request_stop();
+    }
+    lane->wake_seq.fetch_add(1, std::memory_order_seq_cst);
+    lane->wake_seq.notify_one();
+  }
+  for (auto& lane : lanes_) lane->dispatcher.join();
+  // Callbacks may hand a coroutine or stream its last completion: answer
+  // what the dispatchers left behind rather than drop it.
+  for (auto& lane : lanes_) {
+    Request q;
+    while (lane->requests.try_pop(q)) {
+      deliver(ChunkCompletion{q.r.coord, q.r.tag, nullptr, true}, q);
+    }
+  }
+}
+
+bool ChunkRequestQueue::request(const ChunkRequest& r) {
+  Lane& lane = *lanes_[static_cast<std::size_t>(r.priority)];
+  RequestMetrics& metrics = request_metrics();
+  if (!lane.requests.try_push(Request{r, lane.epoch.load(std::memory_order_acquire), now_ns()})) {
+    rejected_.fetch_add(1, std::memory_order_relaxed);
+    metrics.rejected.add();
+    return false;
+  }
+  accepted_.fetch_add(1, std::memory_order_relaxed);
+  metrics.accepted.add();
+  wake(lane);
+  return true;
+}
+
+void ChunkRequestQueue::cancel(Priority priority) {
+  Lane& lane = *lanes_[static_cast<std::size_t>(priority)];
+  lane.epoch.fetch_add(1, std::memory_order_acq_rel);
+  std::lock_guard lock(lane.stop_mutex);
+  lane.stop.request_stop();
+}
+
+void ChunkRequestQueue::wake(Lane& lane) {
+  // Pairs with the fence in dispatch_main(): either the dispatcher sees the
+  // pushed request before parking, or we see it parked and wake it.
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (lane.parked.load(std::memory_order_relaxed)) {
+    lane.wake_seq.fetch_add(1, std::memory_order_release);
+    lane.wake_seq.notify_one();
+  }
+}
+
+std::size_t ChunkRequestQueue::poll(std::span<ChunkCompletion> out) {
+  std::size_t n = 0;
+  while (n < out.size() && completions_.try_pop(out[n])) ++n;
+  return n;
+}
+
+RequestQueueStats ChunkRequestQueue::stats() const {
+  return {accepted_.load(std::memory_order_relaxed), rejected_.load(std::memory_order_relaxed),
+          completed_.load(std::memory_order_relaxed), cancelled_.load(std::memory_order_relaxed),
+          batches_.load(std::memory_order_relaxed)};
+}
+
+void ChunkRequestQueue::deliver(ChunkCompletion completion, const Request& q) {
+  RequestMetrics& metrics = request_metrics();
+  completed_.fetch_add(1, std::memory_order_relaxed);
+  metrics.latency.record(now_ns() - q.queued_ns);
+  if (completion.cancelled) {
+    cancelled_.fetch_add(1, std::memory_order_relaxed);
+    metrics.cancelled.add();
+  }
+  const ChunkRequest& r = q.r;
+  if (r.callback) {
+    r.callback(completion, r.user);
+    return;
+  }
+  while (!completions_.try_push(completion)) {
+    if (stop_.load(std::memory_order_relaxed)) return;
+    std::this_thread::yield();
+  }
+}
+
+void ChunkRequestQueue::dispatch_main(Priority priority) {
+  Lane& lane = *lanes_[static_cast<std::size_t>(priority)];
+  std::vector<Request> batch;
+  std::vector<ChunkCoord> coords;
+  batch.reserve(options_.max_batch);
+  coords.reserve(options_.max_batch);
+
+  while (!stop_.load(std::memory_order_relaxed)) {
+    batch.clear();
+    Request q;
+    while (batch.size() < options_.max_batch && lane.requests.try_pop(q)) batch.push_back(q);
+
+    if (batch.empty()) {
+      const std::uint32_t seq = lane.wake_seq.load(std::memory_order_acquire);
+      lane.parked.store(true, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (lane.requests.empty_approx() && !stop_.load(std::memory_order_relaxed)) {
+        lane.wake_seq.wait(seq, std::memory_order_acquire);
+      }
+      lane.parked.store(false, std::memory_order_relaxed);
+      continue;
+    }
+
+    GenerateOptions generate;
+    generate.priority = priority;
+    std::uint64_t epoch = 0;
+    {
+      // cancel() bumps the epoch before stopping the source, so a stop
+      // replaced here has its requests dropped by the epoch check below,
+      // and a cancel() from here on stops this batch.
+      std::lock_guard lock(lane.stop_mutex);
+      epoch = lane.epoch.load(std::memory_order_acquire);
+      if (lane.stop.stop_requested() && !stop_.load(std::memory_order_relaxed)) {
+        lane.stop = std::stop_source();
+      }
+      generate.stop = lane.stop.get_token();
+    }
+    // Cancelled while queued: answer without generating.
+    std::erase_if(batch, [&](const Request& q) {
+      if (q.epoch == epoch) return false;
+      deliver(ChunkCompletion{q.r.coord, q.r.tag, nullptr, true}, q);
+      return true;
+    });
+    if (batch.empty()) continue;
+
+    // The batch runs by its most urgent request.
+    coords.clear();
+    for (const Request& q : batch) {
+      coords.push_back(q.r.coord);
+      generate.deadline = std::min(generate.deadline, q.r.deadline);
+    }
+    std::vector<std::shared_ptr<Chunk>> chunks;
+    try {
+      chunks = world_.chunks(coords, generate);
+    } catch (...) {
+      chunks.assign(batch.size(), nullptr);
+    }
+    const bool stopped = generate.stop.stop_requested();
+    batches_.fetch_add(1, std::memory_order_relaxed);
+    for (std::size_t i = 0; i < batch.size(); ++i) {
+      const ChunkRequest& r = batch[i].r;
+      const bool cancelled = stopped && !chunks[i];
+      deliver(ChunkCompletion{r.coord, r.tag, std::move(chunks[i]), cancelled}, batch[i]);
+    }
+  }
+}
+
+}  // namespace terram
@@ -0,0 +1,440 @@
+#include "terram/scheduler.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <stdexcept>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "terram/metrics.hpp"
+
+namespace terram {
+namespace {
+
+struct SchedulerMetrics {
+  Histogram& batch;
+  Counter& tasks;
+  Counter& preemptions;
+  Counter& cancelled;
+};
+
+SchedulerMetrics& scheduler_metrics() {
+  Metrics& m = Metrics::global();
+  static SchedulerMetrics metrics{m.histogram("scheduler.batch"), m.counter("scheduler.tasks"),
+                                  m.counter("scheduler.preemptions"),
+                                  m.counter("scheduler.cancelled")};
+  return metrics;
+}
+
+class Batch;
+
+class Node final : public Task {
+ public:
+  void run() override;
+
+  Batch* batch = nullptr;
+  std::shared_ptr<Chunk> chunk;
+  ChunkNeighborhood neighbors;
+  int stage = 0;
+  std::atomic<int> pending{0};
+  std::vector<Node*> successors;
+};
+
+class Batch {
+ public:
+  Batch(ThreadPool& pool, Heightfield& field, const Pipeline& pipeline,
+        std::vector<Arena>& arenas, const std::vector<Histogram*>& histograms,
+        const std::vector<const char*>& names, std::atomic<bool>& yield, std::stop_token stop)
+      : pool(pool), field(field), pipeline(pipeline), arenas(arenas), histograms(histograms),
+        names(names), yield(yield), stop(std::move(stop)) {}
+
+  // A chunk's later stages go to its home node's workers, where its planes
+  // and its neighbours' (placed by the same workers) already are.
+  void submit(Node* node) {
+    in_flight.fetch_add(1, std::memory_order_relaxed);
+    pool.submit(node, node->chunk->home_node());
+  }
+
+  // Tasks becoming ready while a higher class waits are held back, so the
+  // batch drains to a stage boundary.
+  void ready(Node* node) {
+    if (yield.load(std::memory_order_acquire)) {
+      std::lock_guard lock(mutex);
+      parked.push_back(node);
+    } else {
+      submit(node);
+    }
+  }
+
+  /// Takes a queued task that has not started back out of flight. Returns
+  /// false if the batch is not yielding.
+  bool park(Node* node) {
+    if (!yield.load(std::memory_order_acquire)) return false;
+    std::lock_guard lock(mutex);
+    parked.push_back(node);
+    if (in_flight.fetch_sub(1, std::memory_order_acq_rel) == 1) cv.notify_all();
+    return true;
+  }
+
+  void finish(Node& node) {
+    for (Node* s : node.successors) {
+      if (s->pending.fetch_sub(1, std::memory_order_acq_rel) == 1) ready(s);
+    }
+    const bool last = remaining.fetch_sub(1, std::memory_order_acq_rel) == 1;
+    // Successors were counted in before this task is counted out, so zero
+    // in flight means everything left is parked.
+    const bool drained = in_flight.fetch_sub(1, std::memory_order_acq_rel) == 1;
+    if (last || drained) {
+      std::lock_guard lock(mutex);
+      done = done || last;
+      cv.notify_all();
+    }
+  }
+
+  void fail(std::exception_ptr e) {
+    std::lock_guard lock(mutex);
+    if (!error) error = e;
+    failed.store(true, std::memory_order_relaxed);
+  }
+
+  /// After a failure or cancellation the rest of the graph drains without
+  /// running stages.
+  bool halted() const { return failed.load(std::memory_order_relaxed) || stop.stop_requested(); }
+
+  /// Waits until the batch is done, or paused with every remaining ready
+  /// task parked. Returns true when done.
+  bool wait() {
+    std::unique_lock lock(mutex);
+    cv.wait(lock, [&] {
+      return done || (!parked.empty() && in_flight.load(std::memory_order_acquire) == 0);
+    });
+    return done;
+  }
+
+  void resume() {
+    std::vector<Node*> held;
+    {
+      std::lock_guard lock(mutex);
+      held.swap(parked);
+    }
+    for (Node* node : held) submit(node);
+  }
+
+  ThreadPool& pool;
+  Heightfield& field;
+  const Pipeline& pipeline;
+  std::vector<Arena>& arenas;
+  const std::vector<Histogram*>& histograms;
+  const std::vector<const char*>& names;
+  /// Raised by the scheduler while a higher class waits.
+  std::atomic<bool>& yield;
+  std::stop_token stop;
+  std::atomic<std::size_t> remaining{0};
+  std::atomic<std::size_t> in_flight{0};
+  std::atomic<bool> failed{false};
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::vector<Node*> parked;
+  bool done = false;
+  std::exception_ptr error;
+};
+
+void Node::run() {
+  // Tasks still queued when a higher class arrives go back too, so the
+  // batch stops within one task per worker.
+  if (batch->park(this)) return;
+  // A batch that ran while this one was preempted may have done this task
+  // already; an edit meanwhile may have reset the chunk below it, in which
+  // case the next batch for it picks the stage up again.
+  if (!batch->halted() && chunk->stage() == stage) {
+    const int w = ThreadPool::current_worker();
+    const auto worker = static_cast<unsigned>(w < 0 ? 0 : w);
+    Arena& scratch = batch->arenas[worker];
+    const auto s = static_cast<std::size_t>(stage);
+    try {
+      // The first stage to run on a chunk settles where its memory lives,
+      // before it writes the planes.
+      if (batch->pool.node_count() > 1 && chunk->home_node() < 0) {
+        chunk->place_on_node(ThreadPool::current_node());
+      }
+      const ChunkCoord coord = chunk->coord();
+      ScopedTimer timer(batch->histograms[s], batch->names[s], "stage", &coord);
+      StageContext ctx{*chunk, neighbors, stage, worker, scratch};
+      batch->pipeline[s].run(ctx);
+      chunk->set_stage(stage + 1);
+      // The stage may have added planes or a mesh; this worker is the only
+      // one that can measure the chunk safely now.
+      batch->field.resized(chunk);
+    } catch (...) {
+      batch->fail(std::current_exception());
+    }
+    scratch.reset();
+  }
+  batch->finish(*this);
+}
+
+struct NodeKey {
+  ChunkCoord coord;
+  int stage;
+  friend bool operator==(const NodeKey&, const NodeKey&) = default;
+};
+
+struct NodeKeyHash {
+  std::size_t operator()(const NodeKey& k) const noexcept {
+    return ChunkCoordHash{}(k.coord) * 31u + static_cast<std::size_t>(k.stage);
+  }
+};
+
+}  // namespace
+
+const char* to_string(Priority priority) {
+  switch (priority) {
+    case Priority::Background: return "background";
+    case Priority::Prefetch: return "prefetch";
+    case Priority::Visible: return "visible";
+  }
+  return "unknown";
+}
+
+int first_derived_stage(const Pipeline& pipeline) {
+  for (std::size_t s = 0; s < pipeline.size(); ++s) {
+    if (pipeline[s].derived) return static_cast<int>(s);
+  }
+  return static_cast<int>(pipeline.size());
+}
+
+ChunkScheduler::ChunkScheduler(ThreadPool& pool, Heightfield& field, Pipeline pipeline)
+    : pool_(pool), field_(field), pipeline_(std::move(pipeline)) {
+  arenas_.reserve(pool_.size());
+  for (unsigned i = 0; i < pool_.size(); ++i) {
+    arenas_.emplace_back();
+    if (pool_.node_count() > 1) arenas_.back().set_numa_node(pool_.worker_node(i));
+  }
+  for (const Stage& s : pipeline_) {
+    stage_histograms_.push_back(&Metrics::global().histogram("stage." + s.name));
+    stage_names_.push_back(trace::intern(s.name));
+  }
+  const auto first = static_cast<std::size_t>(first_derived_stage(pipeline_));
+  for (std::size_t s = first; s < pipeline_.size(); ++s) {
+    if (!pipeline_[s].derived) {
+      throw std::invalid_argument("generation stage '" + pipeline_[s].name +
+                                  "' follows a derived stage");
+    }
+  }
+}
+
+ChunkScheduler::~ChunkScheduler() = default;
+
+ScratchStats ChunkScheduler::scratch_stats() {
+  auto lock = exclusive();
+  ScratchStats s;
+  for (const Arena& a : arenas_) {
+    s.heap_allocations += a.heap_allocations();
+    s.high_water_bytes = std::max(s.high_water_bytes, a.high_water());
+    s.capacity_bytes += a.capacity();
+  }
+  return s;
+}
+
+ChunkScheduler::Exclusive ChunkScheduler::exclusive() {
+  Waiter w{Priority::Visible, kNoDeadline, 0};
+  acquire(w, nullptr);
+  return Exclusive(*this);
+}
+
+bool ChunkScheduler::acquire(Waiter& w, std::atomic<bool>* yield, const std::stop_token& stop) {
+  // Higher class, then earlier deadline, then earlier arrival.
+  auto before = [](const Waiter& a, const Waiter& b) {
+    if (a.priority != b.priority) return a.priority > b.priority;
+    if (a.deadline != b.deadline) return a.deadline < b.deadline;
+    return a.ticket < b.ticket;
+  };
+  // Notifies under the lock so the wakeup cannot fall between the
+  // predicate check and the wait; registered before locking, as it runs
+  // at once if stop is already requested.
+  std::stop_callback wake(stop, [&] {
+    std::lock_guard g(gate_mutex_);
+    gate_cv_.notify_all();
+  });
+  std::unique_lock lock(gate_mutex_);
+  // Cleared under the lock, before it is published as the owner's: a
+  // waiter that asks us to yield from then on is never lost.
+  if (yield) yield->store(false, std::memory_order_release);
+  if (w.ticket == 0) w.ticket = ++next_ticket_;
+  waiters_.push_back(w);
+  if (owned_ && owner_yield_ && owner_priority_ < w.priority) {
+    owner_yield_->store(true, std::memory_order_release);
+  }
+  auto mine = [&](const Waiter& x) { return x.ticket == w.ticket; };
+  gate_cv_.wait(lock, [&] {
+    if (stop.stop_requested()) return true;
+    if (owned_) return false;
+    return std::none_of(waiters_.begin(), waiters_.end(),
+                        [&](const Waiter& x) { return !mine(x) && before(x, w); });
+  });
+  waiters_.erase(std::find_if(waiters_.begin(), waiters_.end(), mine));
+  if (stop.stop_requested()) {
+    // Our leaving may make another waiter the best.
+    gate_cv_.notify_all();
+    return false;
+  }
+  owned_ = true;
+  owner_priority_ = w.priority;
+  owner_yield_ = yield;
+  // Every waiter left ranks below us, so none needs us to yield yet.
+  return true;
+}
+
+void ChunkScheduler::release() {
+  std::lock_guard lock(gate_mutex_);
+  owned_ = false;
+  owner_yield_ = nullptr;
+  gate_cv_.notify_all();
+}
+
+GenerationStats ChunkScheduler::generate(std::span<const ChunkCoord> targets,
+                                         const GenerateOptions& options) {
+  const auto start = std::chrono::steady_clock::now();
+  GenerationStats stats;
+  const int stage_count = static_cast<int>(pipeline_.size());
+  if (stage_count == 0 || targets.empty()) return stats;
+  SchedulerMetrics& metrics = scheduler_metrics();
+  ScopedTimer timer(&metrics.batch, to_string(options.priority), "batch");
+
+  std::atomic<bool> yield{false};
+  Waiter waiter{options.priority, options.deadline, 0};
+  if (!acquire(waiter, &yield, options.stop)) {
+    metrics.cancelled.add();
+    stats.cancelled = true;
+    return stats;
+  }
+  struct Release {
+    ChunkScheduler* self;
+    ~Release() {
+      if (self) self->release();
+    }
+  } owner{this};
+
+  std::vector<ChunkCoord> todo(targets.begin(), targets.end());
+  for (;;) {
+    // Chunks that need each stage, from the last stage down: a neighbour
+    // stage widens what the previous stage must cover by one ring.
+    using CoordSet = std::unordered_set<ChunkCoord, ChunkCoordHash>;
+    std::vector<CoordSet> needed(static_cast<std::size_t>(stage_count));
+    needed.back().insert(todo.begin(), todo.end());
+    for (int s = stage_count - 1; s > 0; --s) {
+      const int r = pipeline_[static_cast<std::size_t>(s)].reads_neighbors ? 1 : 0;
+      auto& prev = needed[static_cast<std::size_t>(s - 1)];
+      for (ChunkCoord c : needed[static_cast<std::size_t>(s)]) {
+        for (int dz = -r; dz <= r; ++dz) {
+          for (int dx = -r; dx <= r; ++dx) prev.insert({c.x + dx, c.z + dz});
+        }
+      }
+    }
+
+    Batch batch(pool_, field_, pipeline_, arenas_, stage_histograms_, stage_names_, yield,
+                options.stop);
+    std::unordered_map<ChunkCoord, std::shared_ptr<Chunk>, ChunkCoordHash> chunks;
+    std::unordered_map<NodeKey, Node*, NodeKeyHash> index;
+    std::vector<std::unique_ptr<Node>> nodes;
+    auto chunk_at = [&](ChunkCoord c) -> std::shared_ptr<Chunk>& {
+      auto& chunk = chunks[c];
+      if (chunk) return chunk;
+      chunk = field_.find(c);
+      if (!chunk && loader_) {
+        if ((chunk = loader_(c))) field_.insert(chunk);
+      }
+      if (!chunk) chunk = field_.get_or_create(c);
+      return chunk;
+    };
+    for (int s = 0; s < stage_count; ++s) {
+      // Row-major order keeps neighbouring chunks adjacent in the root list.
+      std::vector<ChunkCoord> order(needed[static_cast<std::size_t>(s)].begin(),
+                                    needed[static_cast<std::size_t>(s)].end());
+      std::sort(order.begin(), order.end(), [](ChunkCoord a, ChunkCoord b) {
+        return a.z != b.z ? a.z < b.z : a.x < b.x;
+      });
+      for (ChunkCoord c : order) {
+        auto& chunk = chunk_at(c);
+        if (chunk->stage() > s) continue;
+        auto node = std::make_unique<Node>();
+        node->batch = &batch;
+        node->chunk = chunk;
+        node->stage = s;
+        index.emplace(NodeKey{c, s}, node.get());
+        nodes.push_back(std::move(node));
+      }
+    }
+
+    for (auto& node : nodes) {
+      const ChunkCoord c = node->chunk->coord();
+      const bool ring = pipeline_[static_cast<std::size_t>(node->stage)].reads_neighbors;
+      if (ring) {
+        for (int dz = -1; dz <= 1; ++dz) {
+          for (int dx = -1; dx <= 1; ++dx) {
+            node->neighbors.set(dx, dz, chunk_at({c.x + dx, c.z + dz}).get());
+          }
+        }
+      }
+      if (node->stage == 0) continue;
+      const int r = ring ? 1 : 0;
+      for (int dz = -r; dz <= r; ++dz) {
+        for (int dx = -r; dx <= r; ++dx) {
+          auto it = index.find(NodeKey{{c.x + dx, c.z + dz}, node->stage - 1});
+          if (it == index.end()) continue;  // finished in an earlier batch
+          it->second->successors.push_back(node.get());
+          node->pending.fetch_add(1, std::memory_order_relaxed);
+        }
+      }
+    }
+
+    stats.tasks += nodes.size();
+    metrics.tasks.add(nodes.size());
+    stats.chunks += chunks.size();
+    if (nodes.empty()) break;
+
+    batch.remaining.store(nodes.size(), std::memory_order_relaxed);
+    std::vector<Node*> roots;
+    for (auto& node : nodes) {
+      if (node->pending.load(std::memory_order_relaxed) == 0) roots.push_back(node.get());
+    }
+    for (Node* root : roots) batch.submit(root);
+    while (!batch.wait()) {
+      // Parked at a stage boundary: let the higher classes run, then carry
+      // on. Cancelled meanwhile, the parked tasks drain without ownership;
+      // halted tasks touch no chunk.
+      ++stats.preemptions;
+      metrics.preemptions.add();
+      release();
+      owner.self = nullptr;
+      if (acquire(waiter, &yield, options.stop)) owner.self = this;
+      batch.resume();
+    }
+    if (batch.error) std::rethrow_exception(batch.error);
+    if (batch.halted() || !owner.self) break;
+
+    // An edit during a preemption replaces chunks in the field, leaving
+    // this batch's copies orphaned or its tasks skipped, so targets are
+    // checked as the field now has them; go round again for those short.
+    // One evicted meanwhile was not pinned, and is left to its next access.
+    std::vector<ChunkCoord> short_of;
+    for (ChunkCoord c : todo) {
+      const auto chunk = stats.preemptions > 0 ? field_.find(c) : chunks[c];
+      if (chunk && chunk->stage() < stage_count) short_of.push_back(c);
+    }
+    if (short_of.empty()) break;
+    todo = std::move(short_of);
+  }
+
+  stats.cancelled = options.stop.stop_requested();
+  if (stats.cancelled) metrics.cancelled.add();
+  stats.seconds =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  return stats;
+}
+
+}  // namespace terram
@@ -0,0 +1,50 @@
+#include "terram/simd.hpp"
+
+#include <initializer_list>
+
+namespace terram {
+
+const char* to_string(SimdIsa isa) {
+  switch (isa) {
+    case SimdIsa::Scalar: return "scalar";
+    case SimdIsa::Avx2: return "avx2";
+    case SimdIsa::Avx512: return "avx512";
+    case SimdIsa::Neon: return "neon";
+  }
+  return "unknown";
+}
+
+bool simd_supported(SimdIsa isa) {
+  switch (isa) {
+    case SimdIsa::Scalar:
+      return true;
+    case SimdIsa::Avx2:
+#if defined(TERRAM_HAVE_AVX2)
+      return __builtin_cpu_supports("avx2");
+#else
+      return false;
+#endif
+    case SimdIsa::Avx512:
+#if defined(TERRAM_HAVE_AVX512)
+      return __builtin_cpu_supports("avx512f");
+#else
+      return false;
+#endif
+    case SimdIsa::Neon:
+#if defined(TERRAM_HAVE_NEON)
+      return true;
+#else
+      return false;
+#endif
+  }
+  return false;
+}
+
+SimdIsa detect_simd() {
+  for (SimdIsa isa : {SimdIsa::Avx512, SimdIsa::Avx2, SimdIsa::Neon}) {
+    if (simd_supported(isa)) return isa;
+  }
+  return SimdIsa::Scalar;
+}
+
+}  // namespace terram
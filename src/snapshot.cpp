@@ -0,0 +1,328 @@
+#include "terram/snapshot.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include "terram/voxels.hpp"
+
+namespace terram {
+namespace {
+
+namespace fmt = snapshot_format;
+
+[[noreturn]] void throw_errno(const std::string& what) {
+  throw std::system_error(errno, std::generic_category(), what);
+}
+
+void write_all(int fd, const void* data, std::size_t bytes, std::size_t offset,
+               const std::string& path) {
+  const auto* p = static_cast<const char*>(data);
+  while (bytes > 0) {
+    const ssize_t n = ::pwrite(fd, p, bytes, static_cast<off_t>(offset));
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      throw_errno("pwrite " + path);
+    }
+    p += n;
+    bytes -= static_cast<std::size_t>(n);
+    offset += static_cast<std::size_t>(n);
+  }
+}
+
+constexpr std::size_t align_up(std::size_t v, std::size_t a) { return (v + a - 1) / a * a; }
+
+std::size_t brick_slots(int layers) {
+  return static_cast<std::size_t>(layers) * kBricksPerSide * kBricksPerSide;
+}
+
+// Voxels payload of `voxels`; see VoxelHeader.
+std::vector<std::uint8_t> encode_voxels(const BrickMap& voxels) {
+  std::vector<std::uint32_t> codes;
+  std::vector<const Density*> dense;
+  codes.reserve(brick_slots(voxels.layers()));
+  for (int layer = voxels.base_layer(); layer < voxels.base_layer() + voxels.layers(); ++layer) {
+    for (int bz = 0; bz < kBricksPerSide; ++bz) {
+      for (int bx = 0; bx < kBricksPerSide; ++bx) {
+        Density uniform = 0;
+        const Density* cells = voxels.brick(bx, layer, bz, &uniform);
+        if (cells) {
+          codes.push_back(fmt::kDenseBrick | static_cast<std::uint32_t>(dense.size()));
+          dense.push_back(cells);
+        } else {
+          codes.push_back(static_cast<std::uint8_t>(uniform));
+        }
+      }
+    }
+  }
+  fmt::VoxelHeader h{};
+  h.base_layer = voxels.base_layer();
+  h.layers = voxels.layers();
+  h.dense = static_cast<std::uint32_t>(dense.size());
+  std::vector<std::uint8_t> out(sizeof h + codes.size() * sizeof(std::uint32_t) +
+                                dense.size() * kBrickCells);
+  std::uint8_t* p = out.data();
+  std::memcpy(p, &h, sizeof h);
+  p += sizeof h;
+  std::memcpy(p, codes.data(), codes.size() * sizeof(std::uint32_t));
+  p += codes.size() * sizeof(std::uint32_t);
+  for (const Density* cells : dense) {
+    std::memcpy(p, cells, kBrickCells);
+    p += kBrickCells;
+  }
+  return out;
+}
+
+}  // namespace
+
+void write_snapshot(const std::filesystem::path& path, SnapshotKey key,
+                    std::span<const SnapshotChunk> chunks) {
+  std::filesystem::path tmp = path;
+  tmp += ".tmp";
+  const std::string name = tmp.string();
+  const int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0) throw_errno("open " + name);
+  try {
+    std::vector<fmt::ChunkEntry> entries(chunks.size());
+    std::size_t at = fmt::kEntryOffset + entries.size() * sizeof(fmt::ChunkEntry);
+    auto put = [&](const void* data, std::size_t bytes, std::size_t align) {
+      at = align_up(at, align);
+      const std::size_t offset = at;
+      write_all(fd, data, bytes, offset, name);
+      at += bytes;
+      return static_cast<std::uint64_t>(offset);
+    };
+
+    for (std::size_t i = 0; i < chunks.size(); ++i) {
+      const Chunk& c = *chunks[i].chunk;
+      fmt::ChunkEntry& e = entries[i];
+      e.x = c.coord().x;
+      e.z = c.coord().z;
+      e.stage = static_cast<std::uint32_t>(c.stage());
+      e.flags = chunks[i].edited ? fmt::kEdited : 0;
+      e.height = put(c.height().data(), c.height().size_bytes(), fmt::kPlaneAlign);
+      if (const auto* normals = c.normals()) {
+        e.normals = put(normals->data(), normals->size_bytes(), fmt::kPlaneAlign);
+      }
+      if (const auto* biomes = c.biomes()) {
+        e.biomes = put(biomes->data(), biomes->size_bytes(), fmt::kPlaneAlign);
+      }
+      if (const BrickMap* voxels = c.voxels()) {
+        const std::vector<std::uint8_t> payload = encode_voxels(*voxels);
+        e.voxels = put(payload.data(), payload.size(), fmt::kPayloadAlign);
+        e.voxel_bytes = payload.size();
+      }
+      // Indices follow the vertices directly; both vertex sizes keep them
+      // aligned.
+      if (const MeshBuffers* mesh = c.mesh()) {
+        e.mesh = put(mesh->vertices().data(), mesh->vertices().size_bytes(),
+                     fmt::kPayloadAlign);
+        put(mesh->indices().data(), mesh->indices().size_bytes(), 1);
+        e.mesh_vertices = static_cast<std::uint32_t>(mesh->vertices().size());
+        e.mesh_indices = static_cast<std::uint32_t>(mesh->indices().size());
+      }
+      if (const SurfaceMesh* surface = c.surface()) {
+        e.surface = put(surface->vertices.data(),
+                        surface->vertices.size() * sizeof(SurfaceVertex), fmt::kPayloadAlign);
+        put(surface->indices.data(), surface->indices.size() * sizeof(std::uint32_t), 1);
+        e.surface_vertices = static_cast<std::uint32_t>(surface->vertices.size());
+        e.surface_indices = static_cast<std::uint32_t>(surface->indices.size());
+      }
+    }
+    const std::size_t file_bytes = align_up(at, fmt::kPlaneAlign);
+    if (::ftruncate(fd, static_cast<off_t>(file_bytes)) != 0) throw_errno("ftruncate " + name);
+    write_all(fd, entries.data(), entries.size() * sizeof(fmt::ChunkEntry), fmt::kEntryOffset,
+              name);
+
+    fmt::Header h{};
+    std::memcpy(h.magic, fmt::kMagic, sizeof(h.magic));
+    h.version = fmt::kVersion;
+    h.byte_order = fmt::kByteOrderMark;
+    h.chunk_size = kChunkSize;
+    h.tile_size = kTileSize;
+    h.brick_size = kBrickSize;
+    h.entry_bytes = sizeof(fmt::ChunkEntry);
+    h.seed = key.seed;
+    h.fingerprint = key.fingerprint;
+    h.chunk_count = entries.size();
+    h.file_bytes = file_bytes;
+    write_all(fd, &h, sizeof h, 0, name);
+    if (::fdatasync(fd) != 0) throw_errno("fdatasync " + name);
+  } catch (...) {
+    ::close(fd);
+    ::unlink(tmp.c_str());
+    throw;
+  }
+  if (::close(fd) != 0) {
+    ::unlink(tmp.c_str());
+    throw_errno("close " + name);
+  }
+  std::filesystem::rename(tmp, path);
+}
+
+struct Snapshot::Mapping {
+  std::string path;
+  const char* base = nullptr;
+  std::size_t bytes = 0;
+
+  ~Mapping() {
+    if (base) ::munmap(const_cast<char*>(base), bytes);
+  }
+};
+
+Snapshot::Snapshot(const std::filesystem::path& path) {
+  auto map = std::make_shared<Mapping>();
+  map->path = path.string();
+  const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) throw_errno("open " + map->path);
+  struct stat st {};
+  if (::fstat(fd, &st) != 0) {
+    ::close(fd);
+    throw_errno("fstat " + map->path);
+  }
+  map->bytes = static_cast<std::size_t>(st.st_size);
+  if (map->bytes < fmt::kEntryOffset) {
+    ::close(fd);
+    throw std::runtime_error("snapshot truncated: " + map->path);
+  }
+  void* base = ::mmap(nullptr, map->bytes, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (base == MAP_FAILED) throw_errno("mmap " + map->path);
+  map->base = static_cast<const char*>(base);
+  // Read ahead of the first loads; restoring touches most of the file.
+  ::madvise(base, map->bytes, MADV_WILLNEED);
+  map_ = std::move(map);
+
+  fmt::Header h;
+  std::memcpy(&h, map_->base, sizeof h);
+  const bool ok = std::memcmp(h.magic, fmt::kMagic, sizeof(h.magic)) == 0 &&
+                  h.version == fmt::kVersion && h.byte_order == fmt::kByteOrderMark &&
+                  h.chunk_size == kChunkSize && h.tile_size == kTileSize &&
+                  h.brick_size == kBrickSize && h.entry_bytes == sizeof(fmt::ChunkEntry) &&
+                  h.file_bytes == map_->bytes &&
+                  h.chunk_count <= (map_->bytes - fmt::kEntryOffset) / sizeof(fmt::ChunkEntry);
+  if (!ok) throw std::runtime_error("bad snapshot header: " + map_->path);
+
+  auto within = [&](std::uint64_t offset, std::uint64_t bytes, std::size_t align) {
+    return offset % align == 0 && offset <= map_->bytes && bytes <= map_->bytes - offset;
+  };
+  for (std::size_t i = 0; i < size(); ++i) {
+    const fmt::ChunkEntry& e = entry(i);
+    const bool planes = e.height != 0 && within(e.height, TiledPlane<float>::kBytes,
+                                                fmt::kPlaneAlign) &&
+                        (!e.normals ||
+                         within(e.normals, TiledPlane<PackedNormal>::kBytes, fmt::kPlaneAlign)) &&
+                        (!e.biomes ||
+                         within(e.biomes, TiledPlane<BiomeId>::kBytes, fmt::kPlaneAlign));
+    const bool payloads =
+        (!e.voxels || within(e.voxels, e.voxel_bytes, fmt::kPayloadAlign)) &&
+        (!e.mesh || within(e.mesh,
+                           std::uint64_t{e.mesh_vertices} * sizeof(MeshVertex) +
+                               std::uint64_t{e.mesh_indices} * sizeof(std::uint16_t),
+                           fmt::kPayloadAlign)) &&
+        (!e.surface || within(e.surface,
+                              std::uint64_t{e.surface_vertices} * sizeof(SurfaceVertex) +
+                                  std::uint64_t{e.surface_indices} * sizeof(std::uint32_t),
+                              fmt::kPayloadAlign));
+    if (!planes || !payloads) {
+      throw std::runtime_error("bad snapshot entry " + std::to_string(i) + ": " + map_->path);
+    }
+  }
+}
+
+const snapshot_format::ChunkEntry& Snapshot::entry(std::size_t i) const {
+  return reinterpret_cast<const fmt::ChunkEntry*>(map_->base + fmt::kEntryOffset)[i];
+}
+
+SnapshotKey Snapshot::key() const {
+  fmt::Header h;
+  std::memcpy(&h, map_->base, sizeof h);
+  return {h.seed, h.fingerprint};
+}
+
+std::size_t Snapshot::size() const {
+  fmt::Header h;
+  std::memcpy(&h, map_->base, sizeof h);
+  return static_cast<std::size_t>(h.chunk_count);
+}
+
+ChunkCoord Snapshot::coord(std::size_t i) const { return {entry(i).x, entry(i).z}; }
+
+bool Snapshot::edited(std::size_t i) const { return entry(i).flags & fmt::kEdited; }
+
+std::shared_ptr<Chunk> Snapshot::load(std::size_t i) const {
+  const fmt::ChunkEntry& e = entry(i);
+  const char* base = map_->base;
+  TiledPlane<float> height(reinterpret_cast<const float*>(base + e.height), map_);
+  if (e.flags & fmt::kEdited) {
+    TiledPlane<float> owned;
+    owned.copy_from(height);
+    height = std::move(owned);
+  }
+  auto chunk = std::make_shared<Chunk>(ChunkCoord{e.x, e.z}, std::move(height),
+                                       static_cast<int>(e.stage));
+  if (e.normals) {
+    chunk->set_normals(
+        TiledPlane<PackedNormal>(reinterpret_cast<const PackedNormal*>(base + e.normals), map_));
+  }
+  if (e.biomes) {
+    chunk->set_biomes(
+        TiledPlane<BiomeId>(reinterpret_cast<const BiomeId*>(base + e.biomes), map_));
+  }
+
+  if (e.voxels) {
+    const char* p = base + e.voxels;
+    fmt::VoxelHeader h;
+    if (e.voxel_bytes < sizeof h) throw std::runtime_error("bad snapshot voxels: " + map_->path);
+    std::memcpy(&h, p, sizeof h);
+    const std::size_t slots = h.layers >= 0 ? brick_slots(h.layers) : 0;
+    if (h.layers < 0 || e.voxel_bytes != sizeof h + slots * sizeof(std::uint32_t) +
+                                             std::size_t{h.dense} * kBrickCells) {
+      throw std::runtime_error("bad snapshot voxels: " + map_->path);
+    }
+    const auto* codes = reinterpret_cast<const std::uint32_t*>(p + sizeof h);
+    const auto* dense = reinterpret_cast<const Density*>(codes + slots);
+    BrickMap& voxels = chunk->ensure_voxels();
+    voxels.reset(h.base_layer, h.layers);
+    std::size_t slot = 0;
+    for (int layer = h.base_layer; layer < h.base_layer + h.layers; ++layer) {
+      for (int bz = 0; bz < kBricksPerSide; ++bz) {
+        for (int bx = 0; bx < kBricksPerSide; ++bx) {
+          const std::uint32_t code = codes[slot++];
+          if (!(code & fmt::kDenseBrick)) {
+            voxels.store_brick(bx, layer, bz, nullptr, static_cast<Density>(code & 0xff));
+            continue;
+          }
+          const std::uint32_t n = code & ~fmt::kDenseBrick;
+          if (n >= h.dense) throw std::runtime_error("bad snapshot voxels: " + map_->path);
+          voxels.store_brick(bx, layer, bz, dense + std::size_t{n} * kBrickCells);
+        }
+      }
+    }
+  }
+  if (e.mesh) {
+    const auto* vertices = reinterpret_cast<const MeshVertex*>(base + e.mesh);
+    const auto* indices = reinterpret_cast<const std::uint16_t*>(vertices + e.mesh_vertices);
+    chunk->ensure_mesh().assign({vertices, e.mesh_vertices}, {indices, e.mesh_indices});
+  }
+  if (e.surface) {
+    const auto* vertices = reinterpret_cast<const SurfaceVertex*>(base + e.surface);
+    const auto* indices =
+        reinterpret_cast<const std::uint32_t*>(vertices + e.surface_vertices);
+    SurfaceMesh& surface = chunk->ensure_surface();
+    surface.vertices.assign(vertices, vertices + e.surface_vertices);
+    surface.indices.assign(indices, indices + e.surface_indices);
+  }
+  return chunk;
+}
+
+}  // namespace terram
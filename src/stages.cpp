@@ -0,0 +1,249 @@
+#include "terram/stages.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+#include <stdexcept>
+#include <utility>
+
+namespace terram::stages {
+namespace {
+
+using TileKernel = std::function<void(StageContext&, int, int)>;
+
+// A stage's whole-chunk body built from its tile kernel.
+std::function<void(StageContext&)> each_tile(TileKernel kernel) {
+  return [kernel = std::move(kernel)](StageContext& ctx) {
+    for (int tz = 0; tz < kTilesPerSide; ++tz) {
+      for (int tx = 0; tx < kTilesPerSide; ++tx) kernel(ctx, tx, tz);
+    }
+  };
+}
+
+}  // namespace
+
+Stage heightmap(std::shared_ptr<const SimplexNoise> noise, FbmParams params) {
+  return Stage{
+      .name = "heightmap",
+      .run = [noise, params](StageContext& ctx) {
+        noise->fill(ctx.chunk.coord(), params, ctx.chunk.height());
+      },
+      .tile = [noise, params](StageContext& ctx, int tx, int tz) {
+        noise->fill_tile(ctx.chunk.coord(), tx, tz, params, ctx.chunk.height().tile(tx, tz));
+      },
+  };
+}
+
+Stage heightmap(std::shared_ptr<const SimplexNoise> noise,
+                std::shared_ptr<const NoiseProgram> program) {
+  return Stage{
+      .name = "heightmap",
+      .run = [noise = std::move(noise), program = std::move(program)](StageContext& ctx) {
+        program->fill(*noise, ctx.chunk.coord(), ctx.chunk.height());
+      },
+  };
+}
+
+HeightSource fbm_source(std::shared_ptr<const SimplexNoise> noise, FbmParams params) {
+  return [noise = std::move(noise), params](ChunkCoord coord, float* out) {
+    noise->fill_tiles(coord, 0, params, out);
+  };
+}
+
+HeightSource program_source(std::shared_ptr<const SimplexNoise> noise,
+                            std::shared_ptr<const NoiseProgram> program) {
+  return [noise = std::move(noise), program = std::move(program)](ChunkCoord coord, float* out) {
+    program->fill(*noise, coord, out);
+  };
+}
+
+Stage erosion(ErosionParams params, HeightSource source) {
+  source = cached_source(std::move(source), params.source_cache);
+  return Stage{
+      .name = "erosion",
+      .run = [params, source = std::move(source)](StageContext& ctx) {
+        erode(ctx.chunk.coord(), source, params, ctx.scratch, ctx.chunk.height());
+      },
+  };
+}
+
+Stage biomes(std::uint64_t seed, BiomeOptions options) {
+  // Climate seeds apart from the terrain's, so the fields do not follow
+  // the heights.
+  auto temperature = std::make_shared<const SimplexNoise>(seed ^ 0x7e3a9c1d5b2f4e68ULL);
+  auto moisture = std::make_shared<const SimplexNoise>(seed ^ 0x3c6ef372fe94f82bULL);
+  if (!options.table) options.table = standard_biome_table();
+  TileKernel kernel = [temperature = std::move(temperature), moisture = std::move(moisture),
+                       options = std::move(options)](StageContext& ctx, int tx, int tz) {
+    ArenaScope scope(ctx.scratch);
+    float* t = ctx.scratch.allocate_array<float>(kTileCells);
+    float* m = ctx.scratch.allocate_array<float>(kTileCells);
+    float* h = ctx.scratch.allocate_array<float>(kTileCells);
+    const ChunkCoord c = ctx.chunk.coord();
+    temperature->fill_tile(c, tx, tz, options.temperature, t);
+    moisture->fill_tile(c, tx, tz, options.moisture, m);
+    const float* cells = std::as_const(ctx.chunk).height().tile(tx, tz);
+    for (int i = 0; i < kTileCells; ++i) {
+      h[i] = cells[i] - options.sea_level;
+      t[i] -= options.lapse_rate * std::max(h[i], 0.0f);
+    }
+    options.table->classify(t, m, h, kTileCells, ctx.chunk.ensure_biomes().tile(tx, tz));
+  };
+  return Stage{
+      .name = "biomes",
+      .derived = true,
+      .run = each_tile(kernel),
+      .tile = kernel,
+  };
+}
+
+Stage caves(std::uint64_t seed, CaveOptions options) {
+  auto first = std::make_shared<const SimplexNoise>(seed ^ 0x510e527fade682d1ULL);
+  auto second = std::make_shared<const SimplexNoise>(seed ^ 0x9b05688c2b3e6c1fULL);
+  return Stage{
+      .name = "caves",
+      .derived = true,
+      .run = [first = std::move(first), second = std::move(second), options](StageContext& ctx) {
+        carve_caves(*first, *second, ctx.chunk.coord(), std::as_const(ctx.chunk).height(),
+                    options, ctx.scratch, ctx.chunk.ensure_voxels());
+      },
+  };
+}
+
+Stage surface(SurfaceOptions options) {
+  auto extractor = std::make_shared<const SurfaceExtractor>(options);
+  return Stage{
+      .name = "surface",
+      .reads_neighbors = true,
+      .derived = true,
+      .run = [extractor = std::move(extractor)](StageContext& ctx) {
+        extractor->extract(ctx.neighbors, ctx.chunk.ensure_surface(),
+                           ThreadPool::current_pool());
+      },
+  };
+}
+
+Stage normals() {
+  TileKernel kernel = [](StageContext& ctx, int tx, int tz) {
+    // Heights of the tile with a one-cell halo, row-major, so the stencil
+    // below needs no border cases.
+    constexpr int kPad = kTileSize + 2;
+    float h[kPad * kPad];
+    const TiledPlane<float>& height = std::as_const(ctx.chunk).height();
+    for (int r = 0; r < kTileSize; ++r) {
+      const float* src = height.tile_row(tx, tz, r);
+      std::copy(src, src + kTileSize, h + (r + 1) * kPad + 1);
+    }
+    // The halo comes from the adjacent tiles where they are in this chunk,
+    // else from the neighbours.
+    const int x0 = tx * kTileSize;
+    const int z0 = tz * kTileSize;
+    constexpr int kLast = kTileSize - 1;
+    const ChunkNeighborhood& n = ctx.neighbors;
+    if (tz > 0) {
+      const float* src = height.tile_row(tx, tz - 1, kLast);
+      std::copy(src, src + kTileSize, h + 1);
+    } else {
+      for (int i = 0; i < kTileSize; ++i) h[i + 1] = n.height(x0 + i, z0 - 1);
+    }
+    if (tz < kTilesPerSide - 1) {
+      const float* src = height.tile_row(tx, tz + 1, 0);
+      std::copy(src, src + kTileSize, h + (kPad - 1) * kPad + 1);
+    } else {
+      for (int i = 0; i < kTileSize; ++i) {
+        h[(kPad - 1) * kPad + i + 1] = n.height(x0 + i, z0 + kTileSize);
+      }
+    }
+    const float* left = tx > 0 ? height.tile(tx - 1, tz) + kLast : nullptr;
+    const float* right = tx < kTilesPerSide - 1 ? height.tile(tx + 1, tz) : nullptr;
+    for (int i = 0; i < kTileSize; ++i) {
+      h[(i + 1) * kPad] = left ? left[i * kTileSize] : n.height(x0 - 1, z0 + i);
+      h[(i + 1) * kPad + kPad - 1] =
+          right ? right[i * kTileSize] : n.height(x0 + kTileSize, z0 + i);
+    }
+    h[0] = n.height(x0 - 1, z0 - 1);
+    h[kPad - 1] = n.height(x0 + kTileSize, z0 - 1);
+    h[(kPad - 1) * kPad] = n.height(x0 - 1, z0 + kTileSize);
+    h[kPad * kPad - 1] = n.height(x0 + kTileSize, z0 + kTileSize);
+
+    PackedNormal* out = ctx.chunk.ensure_normals().tile(tx, tz);
+    for (int z = 0; z < kTileSize; ++z) {
+      const float* row = h + (z + 1) * kPad + 1;
+      for (int x = 0; x < kTileSize; ++x) {
+        const float dx = (row[x + 1] - row[x - 1]) * 0.5f;
+        const float dz = (row[x + kPad] - row[x - kPad]) * 0.5f;
+        const float inv = 1.0f / std::sqrt(dx * dx + dz * dz + 1.0f);
+        out[z * kTileSize + x] = pack_normal(-dx * inv, -dz * inv);
+      }
+    }
+  };
+  return Stage{
+      .name = "normals",
+      .reads_neighbors = true,
+      .derived = true,
+      .run = each_tile(kernel),
+      .tile = kernel,
+  };
+}
+
+Stage mesh(MeshOptions options) {
+  return Stage{
+      .name = "mesh",
+      .reads_neighbors = true,
+      .derived = true,
+      .run = [options](StageContext& ctx) {
+        mesh_chunk(ctx.neighbors, options, ctx.scratch, ctx.chunk.ensure_mesh());
+      },
+  };
+}
+
+Stage fuse(std::vector<Stage> members) {
+  if (members.empty()) throw std::invalid_argument("fuse: no stages");
+  Stage fused;
+  fused.reads_neighbors = members.front().reads_neighbors;
+  fused.derived = members.front().derived;
+  std::vector<TileKernel> kernels;
+  for (std::size_t i = 0; i < members.size(); ++i) {
+    Stage& s = members[i];
+    if (!s.tile) throw std::invalid_argument("fuse: stage '" + s.name + "' has no tile kernel");
+    // A later member would read neighbour tiles the group has not reached.
+    if (i > 0 && s.reads_neighbors) {
+      throw std::invalid_argument("fuse: stage '" + s.name + "' reads neighbours but is not first");
+    }
+    if (s.derived != fused.derived) {
+      throw std::invalid_argument("fuse: stage '" + s.name +
+                                  "' mixes derived and generation stages");
+    }
+    fused.name += (i > 0 ? "+" : "") + s.name;
+    kernels.push_back(std::move(s.tile));
+  }
+  fused.tile = [kernels = std::move(kernels)](StageContext& ctx, int tx, int tz) {
+    for (const TileKernel& k : kernels) k(ctx, tx, tz);
+  };
+  fused.run = each_tile(fused.tile);
+  return fused;
+}
+
+Pipeline fuse_tiles(Pipeline pipeline) {
+  Pipeline out;
+  for (std::size_t i = 0; i < pipeline.size();) {
+    std::size_t end = i + 1;
+    if (pipeline[i].tile) {
+      while (end < pipeline.size() && pipeline[end].tile && !pipeline[end].reads_neighbors &&
+             pipeline[end].derived == pipeline[i].derived) {
+        ++end;
+      }
+    }
+    if (end - i == 1) {
+      out.push_back(std::move(pipeline[i]));
+    } else {
+      out.push_back(fuse(std::vector<Stage>(
+          std::make_move_iterator(pipeline.begin() + static_cast<std::ptrdiff_t>(i)),
+          std::make_move_iterator(pipeline.begin() + static_cast<std::ptrdiff_t>(end)))));
+    }
+    i = end;
+  }
+  return out;
+}
+
+}  // namespace terram::stages
@@ -0,0 +1,28 @@
+#pragma once
+
+// Internal: sign-mask kernels of the surface extractor, one per
+// instruction set. A kernel turns rows of densities into bit masks of the
+// solid (positive) samples; every kernel computes the same masks.
+
+#include <cstdint>
+
+namespace terram::detail {
+
+/// Samples along each axis of a brick's block: the brick's 8 cells plus
+/// one on either side.
+inline constexpr int kSurfaceBlock = 10;
+/// Row stride of a block in bytes; the padding past the 10th sample is
+/// ignored.
+inline constexpr int kSurfaceRowStride = 16;
+inline constexpr int kSurfaceRows = kSurfaceBlock * kSurfaceBlock;
+
+/// Bit i of out[r] is set iff rows[r * kSurfaceRowStride + i] > 0, for
+/// i < kSurfaceBlock. `count` is even.
+using SignMaskFn = void (*)(const std::int8_t* rows, int count, std::uint16_t* out);
+
+void surface_signs_scalar(const std::int8_t* rows, int count, std::uint16_t* out);
+#if defined(TERRAM_HAVE_AVX2)
+void surface_signs_avx2(const std::int8_t* rows, int count, std::uint16_t* out);
+#endif
+
+}  // namespace terram::detail
@@ -0,0 +1,20 @@
+#include <immintrin.h>
+
+#include "surface/sign_kernels.hpp"
+
+namespace terram::detail {
+
+void surface_signs_avx2(const std::int8_t* rows, int count, std::uint16_t* out) {
+  const __m256i zero = _mm256_setzero_si256();
+  constexpr unsigned kRowMask = (1u << kSurfaceBlock) - 1;
+  // Two padded rows per compare; movemask packs the sign of every byte.
+  for (int r = 0; r < count; r += 2) {
+    const __m256i v =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rows + r * kSurfaceRowStride));
+    const auto bits = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpgt_epi8(v, zero)));
+    out[r] = static_cast<std::uint16_t>(bits & kRowMask);
+    out[r + 1] = static_cast<std::uint16_t>((bits >> kSurfaceRowStride) & kRowMask);
+  }
+}
+
+}  // namespace terram::detail
@@ -0,0 +1,416 @@
+#include "terram/surface.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+#include "surface/sign_kernels.hpp"
+#include "terram/noise.hpp"
+#include "terram/voxels.hpp"
+
+namespace terram {
+
+namespace detail {
+
+void surface_signs_scalar(const std::int8_t* rows, int count, std::uint16_t* out) {
+  for (int r = 0; r < count; ++r) {
+    const std::int8_t* row = rows + r * kSurfaceRowStride;
+    unsigned bits = 0;
+    for (int i = 0; i < kSurfaceBlock; ++i) bits |= static_cast<unsigned>(row[i] > 0) << i;
+    out[r] = static_cast<std::uint16_t>(bits);
+  }
+}
+
+}  // namespace detail
+
+namespace {
+
+using detail::kSurfaceBlock;
+using detail::kSurfaceRows;
+using detail::kSurfaceRowStride;
+
+/// Cells of a block: each has its lower corner at a sample of the block
+/// other than the last along any axis.
+constexpr int kCubeSide = kSurfaceBlock - 1;
+constexpr int kCubes = kCubeSide * kCubeSide * kCubeSide;
+/// Edges a brick owns start at block samples 1..8 along every axis.
+constexpr unsigned kOwnedBits = ((1u << kBrickSize) - 1) << 1;
+
+detail::SignMaskFn kernel_for(SimdIsa isa) {
+  switch (isa) {
+#if defined(TERRAM_HAVE_AVX2)
+    // AVX-512F has no byte compares, and every CPU with it has AVX2.
+    case SimdIsa::Avx2:
+    case SimdIsa::Avx512: return detail::surface_signs_avx2;
+#endif
+    default: return detail::surface_signs_scalar;
+  }
+}
+
+constexpr int sample_index(int x, int y, int z) {
+  return (y * kSurfaceBlock + z) * kSurfaceRowStride + x;
+}
+constexpr int cube_index(int x, int y, int z) { return (y * kCubeSide + z) * kCubeSide + x; }
+
+/// The centre chunk's volume and its one-ring, in centre-local cells.
+class Volume {
+ public:
+  explicit Volume(const ChunkNeighborhood& neighbors) {
+    for (int dz = -1; dz <= 1; ++dz) {
+      for (int dx = -1; dx <= 1; ++dx) {
+        const Chunk* c = neighbors.at(dx, dz);
+        maps_[(dz + 1) * 3 + dx + 1] = c ? c->voxels() : nullptr;
+      }
+    }
+  }
+
+  const BrickMap* map(int dx, int dz) const { return maps_[(dz + 1) * 3 + dx + 1]; }
+  const BrickMap* center() const { return map(0, 0); }
+
+  /// Density at centre-local (x, z) in [-kChunkSize, 2 * kChunkSize). A
+  /// missing neighbour repeats the centre's border, as
+  /// ChunkNeighborhood::height() does.
+  Density at(int x, int y, int z) const {
+    const int dx = x < 0 ? -1 : (x >= kChunkSize ? 1 : 0);
+    const int dz = z < 0 ? -1 : (z >= kChunkSize ? 1 : 0);
+    if (const BrickMap* m = map(dx, dz)) {
+      return m->at(x - dx * kChunkSize, y, z - dz * kChunkSize);
+    }
+    return center()->at(std::clamp(x, 0, kChunkSize - 1), y,
+                        std::clamp(z, 0, kChunkSize - 1));
+  }
+
+  /// +1 if brick (bx, layer, bz), in centre-local bricks, is uniformly
+  /// solid, -1 if uniformly empty, 0 if dense or in a missing neighbour.
+  int brick_sign(int bx, int layer, int bz) const {
+    const int dx = bx < 0 ? -1 : (bx >= kBricksPerSide ? 1 : 0);
+    const int dz = bz < 0 ? -1 : (bz >= kBricksPerSide ? 1 : 0);
+    const BrickMap* m = map(dx, dz);
+    if (!m) return 0;
+    if (layer < m->base_layer()) return 1;
+    if (layer >= m->base_layer() + m->layers()) return -1;
+    Density uniform = 0;
+    if (m->brick(bx - dx * kBricksPerSide, layer, bz - dz * kBricksPerSide, &uniform)) return 0;
+    return uniform > 0 ? 1 : -1;
+  }
+
+  /// Layers that may own a crossing: from one below the lowest covered
+  /// layer (solid there, perhaps open above) to the highest.
+  std::pair<int, int> layers() const {
+    int lo = center()->base_layer();
+    int hi = lo + center()->layers();
+    for (const BrickMap* m : maps_) {
+      if (!m) continue;
+      lo = std::min(lo, m->base_layer());
+      hi = std::max(hi, m->base_layer() + m->layers());
+    }
+    return {lo - 1, hi};
+  }
+
+ private:
+  std::array<const BrickMap*, 9> maps_{};
+};
+
+struct Job {
+  int bx;
+  int layer;
+  int bz;
+};
+
+/// Where a job's output sits in its participant's buffers.
+struct JobRange {
+  unsigned part = 0;
+  std::uint32_t first_vertex = 0;
+  std::uint32_t vertex_count = 0;
+  std::uint32_t first_index = 0;
+  std::uint32_t index_count = 0;
+};
+
+}  // namespace
+
+struct SurfaceExtractor::Buffers {
+  std::vector<SurfaceVertex> vertices;
+  std::vector<std::uint32_t> indices;
+  alignas(32) std::int8_t samples[kSurfaceRows * kSurfaceRowStride];
+  std::uint16_t masks[kSurfaceRows];
+  /// Job-relative vertex of each cell, or -1 before it is needed.
+  std::int32_t cube_vertex[kCubes];
+};
+
+struct SurfaceExtractor::BufferPool {
+  std::mutex mutex;
+  std::vector<std::unique_ptr<Buffers>> free;
+
+  std::unique_ptr<Buffers> acquire() {
+    {
+      std::lock_guard lock(mutex);
+      if (!free.empty()) {
+        std::unique_ptr<Buffers> b = std::move(free.back());
+        free.pop_back();
+        b->vertices.clear();
+        b->indices.clear();
+        return b;
+      }
+    }
+    auto b = std::make_unique<Buffers>();
+    // The padding past each row's samples is loaded but never used.
+    std::memset(b->samples, 0, sizeof b->samples);
+    return b;
+  }
+
+  void release(std::unique_ptr<Buffers> b) {
+    std::lock_guard lock(mutex);
+    free.push_back(std::move(b));
+  }
+};
+
+/// One extract() call, shared with its helper tasks. A helper may start
+/// after the call has returned; it then finds no brick left and touches
+/// nothing but this.
+struct SurfaceExtractor::Run {
+  Run(const ChunkNeighborhood& neighbors, std::shared_ptr<BufferPool> pool)
+      : volume(neighbors), pool(std::move(pool)), signs(kernel_for(noise_isa())) {}
+  ~Run() {
+    for (auto& b : parts) pool->release(std::move(b));
+  }
+
+  /// Claims bricks until none are left, appending to parts[part].
+  void work(unsigned part) {
+    Buffers& b = *parts[part];
+    for (std::size_t i; (i = next.fetch_add(1)) < jobs.size();) {
+      ranges[i] = extract(jobs[i], b);
+      ranges[i].part = part;
+    }
+  }
+
+  JobRange extract(const Job& job, Buffers& b) const;
+  void gather(const Job& job, Buffers& b) const;
+
+  Volume volume;
+  std::shared_ptr<BufferPool> pool;
+  detail::SignMaskFn signs;
+  std::vector<Job> jobs;
+  std::vector<JobRange> ranges;
+  std::vector<std::unique_ptr<Buffers>> parts;
+  std::atomic<std::size_t> next{0};
+  /// Participants so far; the caller is part 0.
+  std::atomic<unsigned> joined{1};
+  /// Helpers between starting and finishing.
+  std::atomic<int> active{0};
+};
+
+void SurfaceExtractor::Run::gather(const Job& job, Buffers& b) const {
+  const int ox = job.bx * kBrickSize - 1;
+  const int oy = job.layer * kBrickSize - 1;
+  const int oz = job.bz * kBrickSize - 1;
+  const BrickMap& center = *volume.center();
+
+  // The brick's own cells straight from its block (or its one value).
+  Density uniform = kSolid;
+  const Density* cells = nullptr;
+  if (job.layer >= center.base_layer() + center.layers()) {
+    uniform = kEmpty;
+  } else if (job.layer >= center.base_layer()) {
+    cells = center.brick(job.bx, job.layer, job.bz, &uniform);
+  }
+  for (int y = 0; y < kBrickSize; ++y) {
+    for (int z = 0; z < kBrickSize; ++z) {
+      std::int8_t* row = b.samples + sample_index(1, y + 1, z + 1);
+      if (cells) {
+        std::memcpy(row, cells + (y * kBrickSize + z) * kBrickSize, kBrickSize);
+      } else {
+        std::memset(row, uniform, kBrickSize);
+      }
+    }
+  }
+  // The one-sample shell around it, from whichever chunk holds it.
+  for (int y = 0; y < kSurfaceBlock; ++y) {
+    for (int z = 0; z < kSurfaceBlock; ++z) {
+      std::int8_t* row = b.samples + sample_index(0, y, z);
+      const bool inner = y > 0 && y <= kBrickSize && z > 0 && z <= kBrickSize;
+      const int step = inner ? kSurfaceBlock - 1 : 1;
+      for (int x = 0; x < kSurfaceBlock; x += step) row[x] = volume.at(ox + x, oy + y, oz + z);
+    }
+  }
+}
+
+JobRange SurfaceExtractor::Run::extract(const Job& job, Buffers& b) const {
+  JobRange range;
+  range.first_vertex = static_cast<std::uint32_t>(b.vertices.size());
+  range.first_index = static_cast<std::uint32_t>(b.indices.size());
+
+  gather(job, b);
+  signs(b.samples, kSurfaceRows, b.masks);
+  std::fill(std::begin(b.cube_vertex), std::end(b.cube_vertex), -1);
+
+  const float ox = static_cast<float>(job.bx * kBrickSize - 1);
+  const float oy = static_cast<float>(job.layer * kBrickSize - 1);
+  const float oz = static_cast<float>(job.bz * kBrickSize - 1);
+
+  // Vertex of the cell with lower corner at block sample (x, y, z): the
+  // mean of the crossings on its twelve edges.
+  auto vertex = [&](int x, int y, int z) -> std::uint32_t {
+    std::int32_t& slot = b.cube_vertex[cube_index(x, y, z)];
+    if (slot >= 0) return static_cast<std::uint32_t>(slot);
+    int v[8];
+    for (int i = 0; i < 8; ++i) {
+      v[i] = b.samples[sample_index(x + (i & 1), y + ((i >> 1) & 1), z + (i >> 2))];
+    }
+    static constexpr int kEdges[12][2] = {{0, 1}, {2, 3}, {4, 5}, {6, 7}, {0, 2}, {1, 3},
+                                          {4, 6}, {5, 7}, {0, 4}, {1, 5}, {2, 6}, {3, 7}};
+    float sum[3] = {0.0f, 0.0f, 0.0f};
+    int crossings = 0;
+    for (const auto& e : kEdges) {
+      const int a = v[e[0]];
+      const int c = v[e[1]];
+      if ((a > 0) == (c > 0)) continue;
+      const float t = static_cast<float>(a) / static_cast<float>(a - c);
+      for (int axis = 0; axis < 3; ++axis) {
+        const int bit = 1 << axis;
+        const int from = (e[0] & bit) ? 1 : 0;
+        const int to = (e[1] & bit) ? 1 : 0;
+        sum[axis] += static_cast<float>(from) + t * static_cast<float>(to - from);
+      }
+      ++crossings;
+    }
+    const float inv = 1.0f / static_cast<float>(std::max(crossings, 1));
+    // Density rises into the solid, so the outward normal is its negated
+    // gradient.
+    float g[3] = {0.0f, 0.0f, 0.0f};
+    for (int i = 0; i < 8; ++i) {
+      for (int axis = 0; axis < 3; ++axis) {
+        g[axis] += static_cast<float>((i >> axis) & 1 ? v[i] : -v[i]);
+      }
+    }
+    const float length = std::sqrt(g[0] * g[0] + g[1] * g[1] + g[2] * g[2]);
+    SurfaceVertex out{ox + static_cast<float>(x) + sum[0] * inv,
+                      oy + static_cast<float>(y) + sum[1] * inv,
+                      oz + static_cast<float>(z) + sum[2] * inv,
+                      0.0f,
+                      1.0f,
+                      0.0f};
+    if (length > 0.0f) {
+      out.nx = -g[0] / length;
+      out.ny = -g[1] / length;
+      out.nz = -g[2] / length;
+    }
+    slot = static_cast<std::int32_t>(b.vertices.size() - range.first_vertex);
+    b.vertices.push_back(out);
+    return static_cast<std::uint32_t>(slot);
+  };
+
+  // Quad over the four cells around an edge, listed counter-clockwise seen
+  // from the edge's +axis end; flipped when the solid is on that side.
+  auto quad = [&](std::uint32_t c00, std::uint32_t c10, std::uint32_t c11, std::uint32_t c01,
+                  bool solid_below) {
+    if (solid_below) {
+      b.indices.insert(b.indices.end(), {c00, c10, c11, c00, c11, c01});
+    } else {
+      b.indices.insert(b.indices.end(), {c00, c11, c10, c00, c01, c11});
+    }
+  };
+
+  // Sign changes along x, y and z for a whole row of owned edges at once.
+  const std::uint16_t* m = b.masks;
+  for (int y = 1; y <= kBrickSize; ++y) {
+    for (int z = 1; z <= kBrickSize; ++z) {
+      const unsigned row = m[y * kSurfaceBlock + z];
+      for (unsigned ex = (row ^ (row >> 1)) & kOwnedBits; ex; ex &= ex - 1) {
+        const int x = __builtin_ctz(ex);
+        quad(vertex(x, y - 1, z - 1), vertex(x, y, z - 1), vertex(x, y, z),
+             vertex(x, y - 1, z), (row >> x) & 1);
+      }
+      for (unsigned ey = (row ^ m[(y + 1) * kSurfaceBlock + z]) & kOwnedBits; ey;
+           ey &= ey - 1) {
+        const int x = __builtin_ctz(ey);
+        quad(vertex(x - 1, y, z - 1), vertex(x - 1, y, z), vertex(x, y, z),
+             vertex(x, y, z - 1), (row >> x) & 1);
+      }
+      for (unsigned ez = (row ^ m[y * kSurfaceBlock + z + 1]) & kOwnedBits; ez;
+           ez &= ez - 1) {
+        const int x = __builtin_ctz(ez);
+        quad(vertex(x - 1, y - 1, z), vertex(x, y - 1, z), vertex(x, y, z),
+             vertex(x - 1, y, z), (row >> x) & 1);
+      }
+    }
+  }
+
+  range.vertex_count = static_cast<std::uint32_t>(b.vertices.size()) - range.first_vertex;
+  range.index_count = static_cast<std::uint32_t>(b.indices.size()) - range.first_index;
+  return range;
+}
+
+SurfaceExtractor::SurfaceExtractor(SurfaceOptions options)
+    : options_(options), buffers_(std::make_shared<BufferPool>()) {}
+
+SurfaceExtractor::~SurfaceExtractor() = default;
+
+void SurfaceExtractor::extract(const ChunkNeighborhood& neighbors, SurfaceMesh& out,
+                               ThreadPool* pool) const {
+  out.clear();
+  if (!neighbors.center() || !neighbors.center()->voxels()) return;
+
+  auto run = std::make_shared<Run>(neighbors, buffers_);
+  const Volume& volume = run->volume;
+  const auto [lo, hi] = volume.layers();
+  run->jobs.reserve(static_cast<std::size_t>(std::max(hi - lo, 0)) * kBricksPerSide *
+                    kBricksPerSide);
+  for (int layer = lo; layer < hi; ++layer) {
+    for (int bz = 0; bz < kBricksPerSide; ++bz) {
+      for (int bx = 0; bx < kBricksPerSide; ++bx) {
+        const int sign = volume.brick_sign(bx, layer, bz);
+        if (sign != 0 && volume.brick_sign(bx + 1, layer, bz) == sign &&
+            volume.brick_sign(bx, layer + 1, bz) == sign &&
+            volume.brick_sign(bx, layer, bz + 1) == sign) {
+          continue;
+        }
+        run->jobs.push_back({bx, layer, bz});
+      }
+    }
+  }
+  if (run->jobs.empty()) return;
+  run->ranges.resize(run->jobs.size());
+
+  unsigned helpers = 0;
+  if (pool && options_.parallel) {
+    const unsigned idle = pool->size() - (ThreadPool::current_pool() == pool ? 1 : 0);
+    const auto per = static_cast<std::size_t>(std::max(options_.bricks_per_helper, 1));
+    helpers = static_cast<unsigned>(
+        std::min<std::size_t>(idle, run->jobs.size() / per > 0 ? run->jobs.size() / per - 1 : 0));
+  }
+  for (unsigned i = 0; i <= helpers; ++i) run->parts.push_back(buffers_->acquire());
+
+  for (unsigned i = 0; i < helpers; ++i) {
+    pool->spawn([run] {
+      run->active.fetch_add(1);
+      if (run->next.load() < run->jobs.size()) run->work(run->joined.fetch_add(1));
+      if (run->active.fetch_sub(1) == 1) run->active.notify_all();
+    });
+  }
+  run->work(0);
+  // Only helpers that started can hold a brick; the rest will find none.
+  for (int a; (a = run->active.load()) != 0;) run->active.wait(a);
+
+  std::size_t vertices = 0;
+  std::size_t indices = 0;
+  for (const JobRange& r : run->ranges) {
+    vertices += r.vertex_count;
+    indices += r.index_count;
+  }
+  out.vertices.reserve(vertices);
+  out.indices.reserve(indices);
+  for (const JobRange& r : run->ranges) {
+    const Buffers& b = *run->parts[r.part];
+    const auto base = static_cast<std::uint32_t>(out.vertices.size());
+    out.vertices.insert(out.vertices.end(), b.vertices.begin() + r.first_vertex,
+                        b.vertices.begin() + r.first_vertex + r.vertex_count);
+    const std::uint32_t* src = b.indices.data() + r.first_index;
+    for (std::uint32_t i = 0; i < r.index_count; ++i) out.indices.push_back(src[i] + base);
+  }
+}
+
+}  // namespace terram
@@ -0,0 +1,222 @@
+#include "terram/thread_pool.hpp"
+
+#include <algorithm>
+
+#include "terram/numa.hpp"
+#include "work_stealing_deque.hpp"
+
+namespace terram {
+namespace {
+
+thread_local ThreadPool* t_pool = nullptr;
+thread_local int t_worker = -1;
+
+// Spins before a worker parks; short enough not to burn a core when the
+// pool is genuinely idle, long enough to catch dependent tasks.
+constexpr int kIdleSpins = 64;
+
+std::uint64_t xorshift(std::uint64_t& s) {
+  s ^= s << 13;
+  s ^= s >> 7;
+  s ^= s << 17;
+  return s;
+}
+
+}  // namespace
+
+struct ThreadPool::Worker {
+  detail::WorkStealingDeque<Task*> deque;
+  int node = 0;
+  std::vector<int> cpus;
+};
+
+struct ThreadPool::NodeQueue {
+  std::mutex mutex;
+  std::deque<Task*> tasks;
+  std::atomic<std::size_t> size{0};
+
+  Task* pop() {
+    if (size.load(std::memory_order_acquire) == 0) return nullptr;
+    std::lock_guard lock(mutex);
+    if (tasks.empty()) return nullptr;
+    Task* t = tasks.front();
+    tasks.pop_front();
+    size.fetch_sub(1, std::memory_order_relaxed);
+    return t;
+  }
+};
+
+ThreadPool::ThreadPool(ThreadPoolOptions options) {
+  unsigned count = options.threads;
+  if (count == 0) count = std::max(1u, std::thread::hardware_concurrency());
+
+  const NumaTopology& topo = NumaTopology::system();
+  std::vector<int> nodes = options.numa_nodes;
+  nodes.erase(std::remove_if(nodes.begin(), nodes.end(),
+                             [&](int n) { return n < 0 || n >= topo.node_count(); }),
+              nodes.end());
+  if (nodes.empty()) {
+    for (int n = 0; n < topo.node_count(); ++n) nodes.push_back(n);
+  }
+
+  workers_.reserve(count);
+  for (unsigned i = 0; i < count; ++i) {
+    auto w = std::make_unique<Worker>();
+    // Consecutive indices share a node, so index-based locality (e.g.
+    // neighbouring chunks handed to neighbouring workers) stays on-node.
+    w->node = nodes[static_cast<std::size_t>(i) * nodes.size() / count];
+    const auto& node_cpus = topo.node_cpus[static_cast<std::size_t>(w->node)];
+    if (options.affinity == WorkerAffinity::NumaNode) {
+      w->cpus = node_cpus;
+    } else if (options.affinity == WorkerAffinity::Core) {
+      w->cpus = {node_cpus[i % node_cpus.size()]};
+    }
+    workers_.push_back(std::move(w));
+  }
+  std::vector<int> used;
+  for (const auto& w : workers_) used.push_back(w->node);
+  std::sort(used.begin(), used.end());
+  node_count_ = static_cast<unsigned>(std::unique(used.begin(), used.end()) - used.begin());
+  if (node_count_ > 1) {
+    for (int n = 0; n < topo.node_count(); ++n) {
+      node_queues_.push_back(std::make_unique<NodeQueue>());
+    }
+  }
+  threads_.reserve(count);
+  for (unsigned i = 0; i < count; ++i) threads_.emplace_back([this, i] { worker_main(i); });
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard lock(sleep_mutex_);
+    stop_.store(true);
+  }
+  sleep_cv_.notify_all();
+  for (auto& t : threads_) t.join();
+}
+
+int ThreadPool::worker_node(unsigned index) const { return workers_.at(index)->node; }
+
+int ThreadPool::current_worker() { return t_worker; }
+
+ThreadPool* ThreadPool::current_pool() { return t_pool; }
+
+int ThreadPool::current_node() {
+  return t_pool ? t_pool->workers_[static_cast<unsigned>(t_worker)]->node : -1;
+}
+
+void ThreadPool::submit(Task* task) {
+  if (t_pool == this) {
+    workers_[static_cast<unsigned>(t_worker)]->deque.push(task);
+  } else {
+    std::lock_guard lock(inject_mutex_);
+    inject_.push_back(task);
+    inject_size_.fetch_add(1, std::memory_order_release);
+  }
+  notify();
+}
+
+void ThreadPool::submit(Task* task, int node) {
+  if (node < 0 || static_cast<std::size_t>(node) >= node_queues_.size()) {
+    submit(task);
+    return;
+  }
+  if (t_pool == this && workers_[static_cast<unsigned>(t_worker)]->node == node) {
+    workers_[static_cast<unsigned>(t_worker)]->deque.push(task);
+  } else {
+    NodeQueue& q = *node_queues_[static_cast<std::size_t>(node)];
+    std::lock_guard lock(q.mutex);
+    q.tasks.push_back(task);
+    q.size.fetch_add(1, std::memory_order_release);
+  }
+  notify();
+}
+
+void ThreadPool::notify() {
+  epoch_.fetch_add(1, std::memory_order_seq_cst);
+  if (sleepers_.load(std::memory_order_seq_cst) != 0) {
+    std::lock_guard lock(sleep_mutex_);
+    sleep_cv_.notify_one();
+  }
+}
+
+Task* ThreadPool::find_work(unsigned self, std::uint64_t& rng) {
+  if (Task* t = workers_[self]->deque.pop()) return t;
+  const int home = workers_[self]->node;
+  if (!node_queues_.empty()) {
+    if (Task* t = node_queues_[static_cast<std::size_t>(home)]->pop()) return t;
+  }
+
+  if (inject_size_.load(std::memory_order_acquire) != 0) {
+    std::lock_guard lock(inject_mutex_);
+    if (!inject_.empty()) {
+      Task* t = inject_.front();
+      inject_.pop_front();
+      inject_size_.fetch_sub(1, std::memory_order_relaxed);
+      return t;
+    }
+  }
+
+  if (node_queues_.empty()) return steal_from(self, rng, false);
+  // Same-node workers first; only then work placed on, or queued by,
+  // another node.
+  if (Task* t = steal_from(self, rng, false)) return t;
+  for (std::size_t n = 0; n < node_queues_.size(); ++n) {
+    if (static_cast<int>(n) == home) continue;
+    if (Task* t = node_queues_[n]->pop()) return t;
+  }
+  return steal_from(self, rng, true);
+}
+
+// Steals from a random starting victim among the workers on the thief's
+// node (`remote` false) or on other nodes. With one node, every worker is
+// local.
+Task* ThreadPool::steal_from(unsigned self, std::uint64_t& rng, bool remote) {
+  const auto n = static_cast<unsigned>(workers_.size());
+  if (n < 2) return nullptr;
+  const int home = workers_[self]->node;
+  const auto start = static_cast<unsigned>(xorshift(rng) % n);
+  for (unsigned k = 0; k < n; ++k) {
+    const unsigned victim = (start + k) % n;
+    if (victim == self || (workers_[victim]->node != home) != remote) continue;
+    if (Task* t = workers_[victim]->deque.steal()) return t;
+  }
+  return nullptr;
+}
+
+void ThreadPool::worker_main(unsigned index) {
+  t_pool = this;
+  t_worker = static_cast<int>(index);
+  if (!workers_[index]->cpus.empty()) pin_current_thread(workers_[index]->cpus);
+
+  std::uint64_t rng = 0x9e3779b97f4a7c15ULL * (index + 1);
+  while (!stop_.load(std::memory_order_relaxed)) {
+    if (Task* t = find_work(index, rng)) {
+      t->run();
+      continue;
+    }
+
+    const std::uint64_t seen = epoch_.load(std::memory_order_seq_cst);
+    Task* t = nullptr;
+    for (int spin = 0; spin < kIdleSpins && !t; ++spin) {
+      std::this_thread::yield();
+      t = find_work(index, rng);
+    }
+    if (t) {
+      t->run();
+      continue;
+    }
+
+    std::unique_lock lock(sleep_mutex_);
+    sleepers_.fetch_add(1, std::memory_order_seq_cst);
+    sleep_cv_.wait(lock, [&] {
+      return stop_.load(std::memory_order_relaxed) ||
+             epoch_.load(std::memory_order_seq_cst) != seen;
+    });
+    sleepers_.fetch_sub(1, std::memory_order_seq_cst);
+  }
+  t_pool = nullptr;
+  t_worker = -1;
+}
+
+}  // namespace terram
@@ -0,0 +1,125 @@
+#include "terram/voxels.hpp"
+
+#include <algorithm>
+
+namespace terram {
+namespace {
+
+bool uniform(const Density* cells, int count) {
+  return std::all_of(cells + 1, cells + count, [&](Density d) { return d == cells[0]; });
+}
+
+}  // namespace
+
+void BrickMap::reset(int base_layer, int layers) {
+  base_layer_ = base_layer;
+  layers_ = std::max(layers, 0);
+  slots_.assign(static_cast<std::size_t>(layers_) * kBricksPerSide * kBricksPerSide,
+                uniform_slot(kEmpty));
+  free_.clear();
+  for (std::size_t i = dense_; i-- > 0;) free_.push_back(static_cast<std::uint32_t>(i));
+}
+
+Density BrickMap::at(int x, int y, int z) const {
+  if (y < min_y()) return kSolid;
+  if (y >= max_y()) return kEmpty;
+  const int layer = y >> kBrickShift;
+  const std::uint32_t s = slots_[slot_index(x >> kBrickShift, layer, z >> kBrickShift)];
+  if (!(s & kDenseBit)) return static_cast<Density>(s & 0xff);
+  const int ly = y & (kBrickSize - 1);
+  return block(s)[((ly * kBrickSize) + (z & (kBrickSize - 1))) * kBrickSize +
+                  (x & (kBrickSize - 1))];
+}
+
+void BrickMap::set(int x, int y, int z, Density value) {
+  if (y < min_y() || y >= max_y()) return;
+  std::uint32_t& s = slots_[slot_index(x >> kBrickShift, y >> kBrickShift, z >> kBrickShift)];
+  if (!(s & kDenseBit)) {
+    const auto current = static_cast<Density>(s & 0xff);
+    if (current == value) return;
+    const std::uint32_t dense = allocate_block();
+    std::fill_n(block(dense), kBrickCells, current);
+    s = dense;
+  }
+  const int ly = y & (kBrickSize - 1);
+  block(s)[(ly * kBrickSize + (z & (kBrickSize - 1))) * kBrickSize + (x & (kBrickSize - 1))] =
+      value;
+}
+
+void BrickMap::store_layer(int layer, const Density* cells) {
+  if (layer < base_layer_ || layer >= base_layer_ + layers_) return;
+  Density gathered[kBrickCells];
+  for (int bz = 0; bz < kBricksPerSide; ++bz) {
+    for (int bx = 0; bx < kBricksPerSide; ++bx) {
+      for (int y = 0; y < kBrickSize; ++y) {
+        for (int z = 0; z < kBrickSize; ++z) {
+          const Density* row =
+              cells + (y * kChunkSize + bz * kBrickSize + z) * kChunkSize + bx * kBrickSize;
+          std::copy(row, row + kBrickSize, gathered + (y * kBrickSize + z) * kBrickSize);
+        }
+      }
+      std::uint32_t& s = slots_[slot_index(bx, layer, bz)];
+      if (uniform(gathered, kBrickCells)) {
+        if (s & kDenseBit) release_block(s);
+        s = uniform_slot(gathered[0]);
+        continue;
+      }
+      if (!(s & kDenseBit)) s = allocate_block();
+      std::copy(gathered, gathered + kBrickCells, block(s));
+    }
+  }
+}
+
+void BrickMap::store_brick(int bx, int layer, int bz, const Density* cells, Density value) {
+  if (layer < base_layer_ || layer >= base_layer_ + layers_) return;
+  std::uint32_t& s = slots_[slot_index(bx, layer, bz)];
+  if (!cells || uniform(cells, kBrickCells)) {
+    if (s & kDenseBit) release_block(s);
+    s = uniform_slot(cells ? cells[0] : value);
+    return;
+  }
+  if (!(s & kDenseBit)) s = allocate_block();
+  std::copy(cells, cells + kBrickCells, block(s));
+}
+
+std::size_t BrickMap::compact() {
+  std::size_t collapsed = 0;
+  for (std::uint32_t& s : slots_) {
+    if (!(s & kDenseBit) || !uniform(block(s), kBrickCells)) continue;
+    const Density value = block(s)[0];
+    release_block(s);
+    s = uniform_slot(value);
+    ++collapsed;
+  }
+  return collapsed;
+}
+
+const Density* BrickMap::brick(int bx, int layer, int bz, Density* uniform) const {
+  if (layer < base_layer_ || layer >= base_layer_ + layers_) {
+    *uniform = layer < base_layer_ ? kSolid : kEmpty;
+    return nullptr;
+  }
+  const std::uint32_t s = slots_[slot_index(bx, layer, bz)];
+  if (s & kDenseBit) return block(s);
+  *uniform = static_cast<Density>(s & 0xff);
+  return nullptr;
+}
+
+std::size_t BrickMap::memory_bytes() const {
+  return slots_.capacity() * sizeof(std::uint32_t) + bricks_.capacity() * sizeof(Density) +
+         free_.capacity() * sizeof(std::uint32_t);
+}
+
+std::uint32_t BrickMap::allocate_block() {
+  if (!free_.empty()) {
+    const std::uint32_t index = free_.back();
+    free_.pop_back();
+    return index | kDenseBit;
+  }
+  bricks_.resize(bricks_.size() + kBrickCells);
+  return static_cast<std::uint32_t>(dense_++) | kDenseBit;
+}
+
+void BrickMap::release_block(std::uint32_t slot) { free_.push_back(slot & ~kDenseBit); }
+
+}  // namespace terram
@@ -0,0 +1,282 @@
+#include "terram/wire.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+namespace terram {
+namespace {
+
+constexpr std::uint32_t kMagic = 0x4c445254;  // "TRDL" little-endian
+constexpr std::uint8_t kVersion = 1;
+constexpr std::uint8_t kIdentical = 1;
+constexpr std::size_t kHeaderBytes = 24;
+
+constexpr int kProbBits = 12;
+constexpr std::uint32_t kProbScale = 1u << kProbBits;
+constexpr std::uint32_t kRansLow = 1u << 23;
+static_assert(kChunkCells == kProbScale, "symbol counts double as rANS frequencies");
+
+constexpr std::uint8_t kEscape = 255;
+// Bound on quantized values, well inside int64 for the Lorenzo sums.
+constexpr std::int64_t kMaxValue = std::int64_t{1} << 30;
+constexpr double kMaxQuantized = double(kMaxValue);
+// A residual is a value minus a prediction of at most three of them, and
+// zigzags to at most twice its magnitude.
+constexpr std::uint64_t kMaxZigzag = 2 * 4 * static_cast<std::uint64_t>(kMaxValue);
+
+[[noreturn]] void malformed(const char* what) {
+  throw std::runtime_error(std::string("delta record: ") + what);
+}
+
+void put_u16(std::vector<std::uint8_t>& out, std::uint16_t v) {
+  out.push_back(static_cast<std::uint8_t>(v));
+  out.push_back(static_cast<std::uint8_t>(v >> 8));
+}
+
+void put_u32(std::vector<std::uint8_t>& out, std::uint32_t v) {
+  for (int i = 0; i < 4; ++i) out.push_back(static_cast<std::uint8_t>(v >> (8 * i)));
+}
+
+void put_varint(std::vector<std::uint8_t>& out, std::uint64_t v) {
+  while (v >= 0x80) {
+    out.push_back(static_cast<std::uint8_t>(v | 0x80));
+    v >>= 7;
+  }
+  out.push_back(static_cast<std::uint8_t>(v));
+}
+
+class Reader {
+ public:
+  explicit Reader(std::span<const std::uint8_t> in) : in_(in) {}
+
+  std::size_t offset() const { return pos_; }
+  std::span<const std::uint8_t> take(std::size_t n) {
+    if (in_.size() - pos_ < n) malformed("truncated");
+    auto s = in_.subspan(pos_, n);
+    pos_ += n;
+    return s;
+  }
+  std::uint8_t u8() { return take(1)[0]; }
+  std::uint16_t u16() {
+    auto b = take(2);
+    return static_cast<std::uint16_t>(b[0] | (b[1] << 8));
+  }
+  std::uint32_t u32() {
+    auto b = take(4);
+    return std::uint32_t{b[0]} | (std::uint32_t{b[1]} << 8) | (std::uint32_t{b[2]} << 16) |
+           (std::uint32_t{b[3]} << 24);
+  }
+  std::uint64_t varint() {
+    std::uint64_t v = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+      const std::uint8_t b = u8();
+      v |= std::uint64_t{b & 0x7fu} << shift;
+      if (!(b & 0x80)) return v;
+    }
+    malformed("bad varint");
+  }
+
+ private:
+  std::span<const std::uint8_t> in_;
+  std::size_t pos_ = 0;
+};
+
+std::uint64_t zigzag(std::int64_t v) {
+  return (static_cast<std::uint64_t>(v) << 1) ^ static_cast<std::uint64_t>(v >> 63);
+}
+
+std::int64_t unzigzag(std::uint64_t v) {
+  return static_cast<std::int64_t>(v >> 1) ^ -static_cast<std::int64_t>(v & 1);
+}
+
+// Lorenzo prediction over a row-major kChunkSize grid; cells outside it
+// count as zero.
+std::int64_t predict(const std::int64_t* q, int x, int z) {
+  const std::int64_t left = x > 0 ? q[z * kChunkSize + x - 1] : 0;
+  const std::int64_t above = z > 0 ? q[(z - 1) * kChunkSize + x] : 0;
+  const std::int64_t diag = x > 0 && z > 0 ? q[(z - 1) * kChunkSize + x - 1] : 0;
+  return left + above - diag;
+}
+
+DeltaRecord read_header(Reader& r) {
+  if (r.u32() != kMagic) malformed("bad magic");
+  if (r.u8() != kVersion) malformed("unsupported version");
+  DeltaRecord rec;
+  rec.identical = (r.u8() & kIdentical) != 0;
+  rec.stage = r.u16();
+  rec.coord.x = static_cast<std::int32_t>(r.u32());
+  rec.coord.z = static_cast<std::int32_t>(r.u32());
+  const std::uint32_t q = r.u32();
+  std::memcpy(&rec.quantum, &q, sizeof q);
+  rec.size = kHeaderBytes + r.u32();
+  if (!(rec.quantum > 0.0f) || !std::isfinite(rec.quantum)) malformed("bad quantum");
+  return rec;
+}
+
+}  // namespace
+
+void encode_delta(ChunkCoord coord, int stage, const TiledPlane<float>& heights,
+                  const TiledPlane<float>& baseline, float quantum,
+                  std::vector<std::uint8_t>& out) {
+  if (!(quantum > 0.0f)) throw std::invalid_argument("encode_delta: quantum must be positive");
+
+  std::array<std::int64_t, kChunkCells> q;
+  bool identical = true;
+  for (int z = 0; z < kChunkSize; ++z) {
+    for (int x = 0; x < kChunkSize; ++x) {
+      const double d = (static_cast<double>(heights.at(x, z)) - baseline.at(x, z)) / quantum;
+      const double v = std::round(std::clamp(d, -kMaxQuantized, kMaxQuantized));
+      q[z * kChunkSize + x] = static_cast<std::int64_t>(v);
+      identical &= v == 0.0;
+    }
+  }
+
+  const std::size_t start = out.size();
+  put_u32(out, kMagic);
+  out.push_back(kVersion);
+  out.push_back(identical ? kIdentical : 0);
+  put_u16(out, static_cast<std::uint16_t>(stage));
+  put_u32(out, static_cast<std::uint32_t>(coord.x));
+  put_u32(out, static_cast<std::uint32_t>(coord.z));
+  std::uint32_t bits;
+  std::memcpy(&bits, &quantum, sizeof bits);
+  put_u32(out, bits);
+  const std::size_t size_at = out.size();
+  put_u32(out, 0);
+  if (identical) return;
+
+  std::array<std::uint8_t, kChunkCells> symbols;
+  std::vector<std::uint8_t> escapes;
+  std::array<std::uint32_t, 256> freq{};
+  for (int z = 0; z < kChunkSize; ++z) {
+    for (int x = 0; x < kChunkSize; ++x) {
+      const int i = z * kChunkSize + x;
+      const std::uint64_t v = zigzag(q[i] - predict(q.data(), x, z));
+      if (v < kEscape) {
+        symbols[i] = static_cast<std::uint8_t>(v);
+      } else {
+        symbols[i] = kEscape;
+        put_varint(escapes, v - kEscape);
+      }
+      ++freq[symbols[i]];
+    }
+  }
+
+  std::array<std::uint32_t, 256> cum{};
+  std::uint16_t present = 0;
+  for (int s = 0, c = 0; s < 256; c += static_cast<int>(freq[s]), ++s) {
+    cum[s] = static_cast<std::uint32_t>(c);
+    present += freq[s] != 0;
+  }
+  put_u16(out, present);
+  for (int s = 0; s < 256; ++s) {
+    if (freq[s] == 0) continue;
+    out.push_back(static_cast<std::uint8_t>(s));
+    // A lone symbol has count 4096, which wraps to 0 in 16 bits; the
+    // decoder knows it from `present` == 1.
+    put_u16(out, static_cast<std::uint16_t>(freq[s]));
+  }
+  put_u32(out, static_cast<std::uint32_t>(escapes.size()));
+  out.insert(out.end(), escapes.begin(), escapes.end());
+
+  // rANS emits in reverse; encode backwards into the tail of a buffer so
+  // the decoder reads forwards. At most 12 bits per symbol plus the state.
+  std::array<std::uint8_t, kChunkCells * 2 + 4> buffer;
+  std::uint8_t* ptr = buffer.data() + buffer.size();
+  std::uint32_t x = kRansLow;
+  for (int i = kChunkCells - 1; i >= 0; --i) {
+    const std::uint32_t f = freq[symbols[i]];
+    const std::uint32_t x_max = ((kRansLow >> kProbBits) << 8) * f;
+    while (x >= x_max) {
+      *--ptr = static_cast<std::uint8_t>(x);
+      x >>= 8;
+    }
+    x = ((x / f) << kProbBits) + (x % f) + cum[symbols[i]];
+  }
+  ptr -= 4;
+  for (int i = 0; i < 4; ++i) ptr[i] = static_cast<std::uint8_t>(x >> (8 * i));
+  out.insert(out.end(), ptr, buffer.data() + buffer.size());
+
+  const auto payload = static_cast<std::uint32_t>(out.size() - start - kHeaderBytes);
+  for (int i = 0; i < 4; ++i) out[size_at + i] = static_cast<std::uint8_t>(payload >> (8 * i));
+}
+
+DeltaRecord peek_delta(std::span<const std::uint8_t> in) {
+  Reader r(in);
+  DeltaRecord rec = read_header(r);
+  if (in.size() < rec.size) malformed("truncated");
+  return rec;
+}
+
+DeltaRecord decode_delta(std::span<const std::uint8_t> in, const TiledPlane<float>& baseline,
+                         TiledPlane<float>& out) {
+  const DeltaRecord rec = peek_delta(in);
+  out.copy_from(baseline);
+  if (rec.identical) return rec;
+
+  Reader r(in.subspan(0, rec.size));
+  r.take(kHeaderBytes);
+  std::array<std::uint32_t, 256> freq{};
+  std::array<std::uint32_t, 256> cum{};
+  const std::uint16_t present = r.u16();
+  if (present == 0) malformed("empty symbol table");
+  for (std::uint16_t i = 0; i < present; ++i) {
+    const std::uint8_t s = r.u8();
+    const std::uint16_t f = r.u16();
+    freq[s] = present == 1 ? kProbScale : f;
+  }
+  std::array<std::uint8_t, kProbScale> slot_symbol;
+  std::uint32_t total = 0;
+  for (int s = 0; s < 256; ++s) {
+    if (total + freq[s] > kProbScale) malformed("bad symbol table");
+    cum[s] = total;
+    std::fill_n(slot_symbol.begin() + total, freq[s], static_cast<std::uint8_t>(s));
+    total += freq[s];
+  }
+  if (total != kProbScale) malformed("bad symbol table");
+
+  const std::uint32_t escape_bytes = r.u32();
+  Reader escapes(r.take(escape_bytes));
+  std::span<const std::uint8_t> stream = r.take(rec.size - r.offset());
+  if (stream.size() < 4) malformed("truncated");
+  std::size_t pos = 4;
+  std::uint32_t x = std::uint32_t{stream[0]} | (std::uint32_t{stream[1]} << 8) |
+                    (std::uint32_t{stream[2]} << 16) | (std::uint32_t{stream[3]} << 24);
+
+  std::array<std::int64_t, kChunkCells> q;
+  for (int z = 0; z < kChunkSize; ++z) {
+    for (int xx = 0; xx < kChunkSize; ++xx) {
+      const std::uint32_t slot = x & (kProbScale - 1);
+      const std::uint8_t s = slot_symbol[slot];
+      x = freq[s] * (x >> kProbBits) + slot - cum[s];
+      while (x < kRansLow) {
+        if (pos == stream.size()) malformed("truncated");
+        x = (x << 8) | stream[pos++];
+      }
+      const std::uint64_t v = s == kEscape ? escapes.varint() + kEscape : s;
+      // Bounded before they are summed, so hostile residuals cannot
+      // overflow: every value stays within what the encoder writes.
+      if (v > kMaxZigzag || v < s) malformed("residual out of range");
+      const int i = z * kChunkSize + xx;
+      q[i] = unzigzag(v) + predict(q.data(), xx, z);
+      if (q[i] > kMaxValue || q[i] < -kMaxValue) malformed("height out of range");
+    }
+  }
+
+  for (int z = 0; z < kChunkSize; ++z) {
+    for (int xx = 0; xx < kChunkSize; ++xx) {
+      const std::int64_t v = q[z * kChunkSize + xx];
+      if (v != 0) {
+        out.at(xx, z) = static_cast<float>(baseline.at(xx, z) +
+                                           static_cast<double>(v) * rec.quantum);
+      }
+    }
+  }
+  return rec;
+}
+
+}  // namespace terram
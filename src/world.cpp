@@ -0,0 +1,415 @@
+#include "terram/world.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <unordered_set>
+
+#include "terram/hash.hpp"
+#include "terram/stages.hpp"
+#include "terram/wire.hpp"
+
+namespace terram {
+
+World::World(WorldOptions options)
+    : options_(std::move(options)),
+      noise_(std::make_shared<SimplexNoise>(options_.seed)),
+      pool_(std::make_unique<ThreadPool>(options_.threads)) {
+  if (options_.store_directory) {
+    store_ = std::make_unique<RegionStore>(*options_.store_directory, options_.io);
+  }
+  cache_ = std::make_unique<ChunkCache>(field_, options_.cache_budget_bytes);
+  cache_->set_evict_callback([this](const std::shared_ptr<Chunk>& c) { write_back(c); });
+
+  Pipeline pipeline = options_.pipeline;
+  if (pipeline.empty()) {
+    if (options_.erosion) {
+      // Erosion regenerates its own input heights, so it stands in for the
+      // heightmap stage.
+      ErosionParams erosion = *options_.erosion;
+      erosion.seed = options_.seed;
+      pipeline.push_back(
+          stages::erosion(erosion, stages::fbm_source(noise_, options_.terrain)));
+    } else {
+      pipeline.push_back(stages::heightmap(noise_, options_.terrain));
+    }
+    // Normals and biomes both read only the heights, and run fused over
+    // each tile.
+    pipeline.push_back(stages::normals());
+    if (options_.biomes) pipeline.push_back(stages::biomes(options_.seed, *options_.biomes));
+    if (options_.caves) {
+      pipeline.push_back(stages::caves(options_.seed, *options_.caves));
+      if (options_.surface) pipeline.push_back(stages::surface(*options_.surface));
+    }
+    if (options_.mesh) pipeline.push_back(stages::mesh(*options_.mesh));
+    pipeline = stages::fuse_tiles(std::move(pipeline));
+  }
+  persisted_stage_ = first_derived_stage(pipeline);
+  dirty_ = std::make_unique<DirtyTracker>(pipeline);
+  baseline_field_ = std::make_unique<Heightfield>();
+  baseline_scheduler_ = std::make_unique<ChunkScheduler>(
+      *pool_, *baseline_field_,
+      Pipeline(pipeline.begin(), pipeline.begin() + persisted_stage_));
+  scheduler_ = std::make_unique<ChunkScheduler>(*pool_, field_, std::move(pipeline));
+  if (store_) scheduler_->set_loader([this](ChunkCoord c) { return store_->load(c); });
+}
+
+World::~World() {
+  // The scheduler's tasks and the cache's callback refer to the pool and
+  // the store; tear down in dependency order.
+  scheduler_.reset();
+  baseline_scheduler_.reset();
+  cache_.reset();
+  pool_.reset();
+}
+
+std::shared_ptr<Chunk> World::load_stored(ChunkCoord c) {
+  if (!store_) return nullptr;
+  auto chunk = store_->load(c);
+  if (chunk) field_.insert(chunk);
+  return chunk;
+}
+
+void World::write_back(const std::shared_ptr<Chunk>& chunk) {
+  // Borrowed planes are unchanged since they were loaded; empty chunks
+  // never ran a stage. Edits are written whatever persist_generated says:
+  // the seed cannot bring them back.
+  if (!store_ || chunk->stage() == 0 || chunk->height().borrowed()) return;
+  if (!options_.persist_generated && !edited(chunk->coord())) return;
+  persist(*chunk);
+  store_->submit();
+}
+
+bool World::edited(ChunkCoord c) const {
+  std::lock_guard lock(edited_mutex_);
+  return edited_.contains(c);
+}
+
+void World::record_edited(std::span<const ChunkCoord> coords) {
+  std::lock_guard lock(edited_mutex_);
+  for (ChunkCoord c : coords) {
+    // Without a store the resident chunk is the only copy of an edit, so
+    // it stays pinned.
+    if (edited_.insert(c).second && !store_) cache_->pin(c);
+  }
+}
+
+void World::persist(const Chunk& chunk) {
+  store_->queue_save(chunk, std::min(chunk.stage(), persisted_stage_));
+}
+
+std::shared_ptr<Chunk> World::chunk(ChunkCoord c) {
+  return chunks(std::span<const ChunkCoord>(&c, 1)).front();
+}
+
+std::vector<std::shared_ptr<Chunk>> World::chunks(std::span<const ChunkCoord> coords,
+                                                  const GenerateOptions& options) {
+  const int complete = stage_count();
+  std::vector<std::shared_ptr<Chunk>> out(coords.size());
+  std::vector<ChunkCoord> missing;
+  std::unordered_set<ChunkCoord, ChunkCoordHash> seen;
+  for (std::size_t i = 0; i < coords.size(); ++i) {
+    auto chunk = cache_->lookup(coords[i]);
+    if (!chunk) chunk = load_stored(coords[i]);
+    if (chunk && chunk->stage() >= complete) {
+      out[i] = std::move(chunk);
+    } else if (seen.insert(coords[i]).second) {
+      missing.push_back(coords[i]);
+    }
+  }
+  if (missing.empty()) return out;
+
+  // Counted from before the scheduler is entered, so prefetch() gives way.
+  const int demand = options.priority == Priority::Visible ? 1 : 0;
+  demand_waiting_.fetch_add(demand, std::memory_order_relaxed);
+  // Taken while still pinned: once unpinned, a tight budget may evict them.
+  auto collect = [&] {
+    for (std::size_t i = 0; i < coords.size(); ++i) {
+      if (out[i]) continue;
+      auto chunk = field_.find(coords[i]);
+      if (chunk && chunk->stage() >= complete) out[i] = std::move(chunk);
+    }
+  };
+  try {
+    generate_pinned(missing, options, collect);
+  } catch (...) {
+    demand_waiting_.fetch_sub(demand, std::memory_order_relaxed);
+    throw;
+  }
+  demand_waiting_.fetch_sub(demand, std::memory_order_relaxed);
+  return out;
+}
+
+std::size_t World::sample_points(std::span<const double> x, std::span<const double> z,
+                                 PointSamples& out, const GenerateOptions& options) {
+  const int complete = stage_count();
+  std::size_t missing = terram::sample_points(field_, x, z, out, complete);
+  if (missing == 0) return 0;
+
+  // Resample only the points that missed, once their chunks are in.
+  std::vector<std::size_t> retry;
+  std::vector<double> rx, rz;
+  std::unordered_set<ChunkCoord, ChunkCoordHash> needed;
+  for (std::size_t i = 0; i < x.size(); ++i) {
+    if (out.found[i] || !std::isfinite(x[i]) || !std::isfinite(z[i])) continue;
+    const auto wx = static_cast<std::int64_t>(std::floor(x[i]));
+    const auto wz = static_cast<std::int64_t>(std::floor(z[i]));
+    // The four corners may straddle into the +x / +z neighbours.
+    needed.insert(chunk_of(wx, wz));
+    needed.insert(chunk_of(wx + 1, wz));
+    needed.insert(chunk_of(wx, wz + 1));
+    needed.insert(chunk_of(wx + 1, wz + 1));
+    retry.push_back(i);
+    rx.push_back(x[i]);
+    rz.push_back(z[i]);
+  }
+  if (retry.empty()) return missing;
+  const std::vector<ChunkCoord> coords(needed.begin(), needed.end());
+  for (ChunkCoord c : coords) cache_->pin(c);
+  PointSamples again;
+  try {
+    chunks(coords, options);
+    missing -= retry.size() - terram::sample_points(field_, rx, rz, again, complete);
+  } catch (...) {
+    for (ChunkCoord c : coords) cache_->unpin(c);
+    throw;
+  }
+  for (ChunkCoord c : coords) cache_->unpin(c);
+  for (std::size_t k = 0; k < retry.size(); ++k) {
+    const std::size_t i = retry[k];
+    out.height[i] = again.height[k];
+    out.normal_x[i] = again.normal_x[k];
+    out.normal_y[i] = again.normal_y[k];
+    out.normal_z[i] = again.normal_z[k];
+    out.biome[i] = again.biome[k];
+    out.found[i] = again.found[k];
+  }
+  return missing;
+}
+
+std::size_t World::prefetch(std::span<const ChunkCoord> coords, std::stop_token stop) {
+  const int complete = stage_count();
+  auto resident = [&](ChunkCoord c) {
+    auto chunk = field_.find(c);
+    return chunk && chunk->stage() >= complete;
+  };
+  // No cache lookups: speculative work must not mark chunks as recently
+  // used or count as hits.
+  std::vector<ChunkCoord> missing;
+  std::unordered_set<ChunkCoord, ChunkCoordHash> seen;
+  for (ChunkCoord c : coords) {
+    if (!resident(c) && seen.insert(c).second) missing.push_back(c);
+  }
+  if (missing.empty()) return 0;
+
+  std::vector<ChunkCoord> generate;
+  if (store_) store_->prefetch(missing);
+  for (ChunkCoord c : missing) {
+    if (!field_.find(c)) load_stored(c);
+    if (!resident(c)) generate.push_back(c);
+  }
+  if (!generate.empty() && demand_waiting() == 0) {
+    generate_pinned(generate, GenerateOptions{.priority = Priority::Prefetch, .stop = stop});
+  }
+  return static_cast<std::size_t>(std::count_if(missing.begin(), missing.end(), resident));
+}
+
+void World::generate_pinned(std::span<const ChunkCoord> coords, const GenerateOptions& options,
+                            const std::function<void()>& collect) {
+  // Pinned while generating so halo admissions cannot evict the targets.
+  for (ChunkCoord c : coords) cache_->pin(c);
+  try {
+    scheduler_->generate(coords, options);
+    if (collect) collect();
+  } catch (...) {
+    for (ChunkCoord c : coords) cache_->unpin(c);
+    throw;
+  }
+  for (ChunkCoord c : coords) cache_->unpin(c);
+}
+
+void World::apply(const Edit& edit) {
+  const std::vector<ChunkCoord> touched = edit.bounds.chunks();
+  if (touched.empty()) return;
+  // Pinned so the edited chunks stay resident between generation and the
+  // edit itself.
+  for (ChunkCoord c : touched) cache_->pin(c);
+  try {
+    std::vector<ChunkCoord> stale = touched;
+    for (;;) {
+      chunks(stale);
+      // Found again under the lock: an edit that landed since the chunks
+      // were generated replaced them, and copying the old ones would drop
+      // it. Any rolled back below the edited stage are generated again.
+      auto lock = scheduler_->exclusive();
+      std::vector<std::shared_ptr<Chunk>> current;
+      stale.clear();
+      for (ChunkCoord c : touched) {
+        current.push_back(field_.find(c));
+        if (!current.back() || current.back()->stage() < persisted_stage_) stale.push_back(c);
+      }
+      if (!stale.empty()) continue;
+      for (const auto& found : current) {
+        // Edited as a copy, rolled back to its first derived stage, then
+        // published; readers of the current chunk never see the edit land.
+        auto chunk = found->copy(persisted_stage_);
+        const std::int64_t ox = chunk_origin(chunk->coord().x);
+        const std::int64_t oz = chunk_origin(chunk->coord().z);
+        const std::int64_t x0 = std::max(edit.bounds.x0, ox);
+        const std::int64_t z0 = std::max(edit.bounds.z0, oz);
+        const std::int64_t x1 = std::min(edit.bounds.x1, ox + kChunkSize);
+        const std::int64_t z1 = std::min(edit.bounds.z1, oz + kChunkSize);
+        auto& height = chunk->height();
+        for (std::int64_t z = z0; z < z1; ++z) {
+          for (std::int64_t x = x0; x < x1; ++x) {
+            edit.apply(x, z, height.at(static_cast<int>(x - ox), static_cast<int>(z - oz)));
+          }
+        }
+        field_.insert(std::move(chunk));
+      }
+      dirty_->mark_edited(field_, touched);
+      record_edited(touched);
+      break;
+    }
+  } catch (...) {
+    for (ChunkCoord c : touched) cache_->unpin(c);
+    throw;
+  }
+  for (ChunkCoord c : touched) cache_->unpin(c);
+}
+
+GenerationStats World::regenerate_dirty() {
+  std::vector<ChunkCoord> dirty = dirty_->take();
+  // Chunks evicted since they were marked come back fully regenerated or
+  // loaded on their next access instead.
+  dirty.erase(std::remove_if(dirty.begin(), dirty.end(),
+                             [&](ChunkCoord c) { return !field_.find(c); }),
+              dirty.end());
+  return scheduler_->generate(dirty);
+}
+
+std::vector<ChunkCoord> World::edited_chunks() const {
+  std::lock_guard lock(edited_mutex_);
+  return {edited_.begin(), edited_.end()};
+}
+
+std::vector<std::shared_ptr<Chunk>> World::baselines(std::span<const ChunkCoord> coords) {
+  // One caller at a time: another's clear() must not land between this
+  // generate() and its find()s.
+  std::lock_guard lock(baseline_mutex_);
+  baseline_scheduler_->generate(coords);
+  std::vector<std::shared_ptr<Chunk>> out;
+  out.reserve(coords.size());
+  for (ChunkCoord c : coords) out.push_back(baseline_field_->find(c));
+  // Regenerating is cheaper than keeping a second copy of the world.
+  baseline_field_->clear();
+  return out;
+}
+
+void World::encode_deltas(std::span<const ChunkCoord> coords, std::vector<std::uint8_t>& out) {
+  const auto current = chunks(coords);
+  const auto base = baselines(coords);
+  auto lock = scheduler_->exclusive();  // no edit lands mid-encode
+  for (std::size_t i = 0; i < coords.size(); ++i) {
+    encode_delta(coords[i], persisted_stage_, std::as_const(*current[i]).height(),
+                 std::as_const(*base[i]).height(), options_.delta_quantum, out);
+  }
+}
+
+std::size_t World::apply_deltas(std::span<const std::uint8_t> in) {
+  std::vector<DeltaRecord> records;
+  std::vector<ChunkCoord> coords;
+  for (std::size_t at = 0; at < in.size();) {
+    const DeltaRecord rec = peek_delta(in.subspan(at));
+    if (rec.stage != persisted_stage_) {
+      throw std::runtime_error("delta record: baseline stage does not match the pipeline");
+    }
+    records.push_back(rec);
+    coords.push_back(rec.coord);
+    at += rec.size;
+  }
+  if (coords.empty()) return 0;
+
+  const auto base = baselines(coords);
+  std::vector<std::shared_ptr<Chunk>> decoded;
+  decoded.reserve(coords.size());
+  std::size_t at = 0;
+  for (std::size_t i = 0; i < coords.size(); ++i) {
+    TiledPlane<float> height;
+    decode_delta(in.subspan(at), std::as_const(*base[i]).height(), height);
+    at += records[i].size;
+    decoded.push_back(std::make_shared<Chunk>(coords[i], std::move(height), persisted_stage_));
+  }
+
+  auto lock = scheduler_->exclusive();
+  for (auto& chunk : decoded) field_.insert(chunk);
+  dirty_->mark_edited(field_, coords);
+  record_edited(coords);
+  return decoded.size();
+}
+
+void World::save() {
+  if (!store_) return;
+  for (ChunkCoord c : field_.coords()) {
+    auto chunk = field_.find(c);
+    if (chunk && chunk->stage() > 0 && !chunk->height().borrowed()) persist(*chunk);
+  }
+  store_->flush();
+}
+
+SnapshotKey World::snapshot_key() const {
+  const FbmParams& t = options_.terrain;
+  const float terrain[] = {t.frequency, t.lacunarity, t.gain, t.amplitude, t.offset};
+  const std::int32_t layout[] = {kChunkSize, kTileSize, kBrickSize, t.octaves,
+                                 stage_count()};
+  std::uint64_t h = hash_bytes(terrain, sizeof terrain, options_.seed);
+  h = hash_bytes(layout, sizeof layout, h);
+  for (const Stage& stage : scheduler_->pipeline()) {
+    h = hash_bytes(stage.name.data(), stage.name.size(), h);
+  }
+  return {options_.seed, h};
+}
+
+std::size_t World::save_snapshot(const std::filesystem::path& path) {
+  const int complete = stage_count();
+  auto lock = scheduler_->exclusive();  // no edit lands mid-write
+  std::vector<SnapshotChunk> chunks;
+  {
+    std::lock_guard edited(edited_mutex_);
+    for (ChunkCoord c : field_.coords()) {
+      auto chunk = field_.find(c);
+      if (chunk && chunk->stage() >= complete) {
+        chunks.push_back({std::move(chunk), edited_.contains(c)});
+      }
+    }
+  }
+  write_snapshot(path, snapshot_key(), chunks);
+  return chunks.size();
+}
+
+std::size_t World::load_snapshot(const std::filesystem::path& path) {
+  const Snapshot snapshot(path);
+  if (snapshot.key() != snapshot_key()) {
+    throw std::runtime_error("snapshot from another seed or pipeline: " + path.string());
+  }
+  auto lock = scheduler_->exclusive();
+  std::size_t loaded = 0;
+  // Counted here rather than asking the cache per chunk, which walks every
+  // resident chunk each time.
+  std::size_t resident = cache_->stats().resident_bytes;
+  const std::size_t budget = cache_->budget();
+  for (std::size_t i = 0; i < snapshot.size(); ++i) {
+    const ChunkCoord c = snapshot.coord(i);
+    if (field_.find(c)) continue;
+    auto chunk = snapshot.load(i);
+    const std::size_t bytes = ChunkCache::charge(*chunk);
+    if (resident + bytes > budget) break;
+    resident += bytes;
+    field_.insert(chunk);
+    ++loaded;
+    if (snapshot.edited(i)) record_edited(std::span<const ChunkCoord>(&c, 1));
+  }
+  return loaded;
+}
+
+}  // namespace terram
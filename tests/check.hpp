@@ -0,0 +1,31 @@
+#pragma once
+
+// Assertions for the functional tests. A failed CHECK prints its location
+// and expression and the test carries on; main() returns
+// terram_test::exit_code() so ctest sees every failure of a run at once.
+
+#include <cstdio>
+
+namespace terram_test {
+
+inline int& failures() {
+  static int count = 0;
+  return count;
+}
+
+inline bool check(bool ok, const char* expr, const char* file, int line) {
+  if (!ok) {
+    std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", file, line, expr);
+    ++failures();
+  }
+  return ok;
+}
+
+inline int exit_code() {
+  if (failures() != 0) std::fprintf(stderr, "%d check(s) failed\n", failures());
+  return failures() == 0 ? 0 : 1;
+}
+
+}  // namespace terram_test
+
+#define CHECK(expr) ::terram_test::check(static_cast<bool>(expr), #expr, __FILE__, __LINE__)
@@ -0,0 +1,161 @@
+// terram_test_determinism: the guarantee WorldOptions::pipeline documents.
+// Built-in pipelines must produce bit-identical chunks whatever the thread
+// count, scheduling order, cache budget or SIMD path.
+//
+//   terram_test_determinism golden.txt [--update]
+//
+// Each configuration below is generated at 1 and 4 worker threads, in
+// forward and reverse request order, and with the default and a tiny cache
+// budget. Every run's hash_chunks() must equal the configuration's line
+// in the checked-in golden file. ctest runs this once per instruction set
+// through TERRAM_SIMD, and skips an ISA the CPU lacks. Philox4x32-10 is
+// also checked against the Random123 known-answer vectors.
+//
+// --update rewrites the golden file from this build's scalar results. Only
+// use it for a deliberate change to generated output.
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "check.hpp"
+#include "terram/hash.hpp"
+#include "terram/random.hpp"
+#include "terram/world.hpp"
+
+using namespace terram;
+
+namespace {
+
+// ctest's SKIP_RETURN_CODE.
+constexpr int kSkipped = 77;
+
+struct Config {
+  const char* name;
+  int grid;
+  std::function<void(WorldOptions&)> setup;
+};
+
+const std::vector<Config>& configs() {
+  static const std::vector<Config> all = {
+      {"terrain", 4, [](WorldOptions&) {}},
+      {"biomes_mesh", 3,
+       [](WorldOptions& o) {
+         o.biomes = BiomeOptions{};
+         o.mesh = MeshOptions{};
+       }},
+      {"caves_surface", 3,
+       [](WorldOptions& o) {
+         o.caves = CaveOptions{};
+         o.surface = SurfaceOptions{};
+       }},
+      {"erosion", 2, [](WorldOptions& o) { o.erosion = ErosionParams{}; }},
+  };
+  return all;
+}
+
+void philox_known_answers() {
+  // Random123's kat_vectors for philox4x32_10.
+  using P = Philox4x32;
+  CHECK((P::generate({0, 0, 0, 0}, {0, 0}) ==
+         P::Counter{0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8}));
+  CHECK((P::generate({0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff},
+                     {0xffffffff, 0xffffffff}) ==
+         P::Counter{0x408f276d, 0x41c83b0e, 0xa20bc7c6, 0x6d5451fd}));
+  CHECK((P::generate({0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344},
+                     {0xa4093822, 0x299f31d0}) ==
+         P::Counter{0xd16cfe09, 0x94fdcceb, 0x5001e420, 0x24126ea1}));
+}
+
+std::uint64_t world_hash(const Config& config, unsigned threads, bool reverse,
+                         std::size_t budget) {
+  WorldOptions options;
+  options.seed = 0x5eed;
+  options.threads.threads = threads;
+  options.cache_budget_bytes = budget;
+  config.setup(options);
+  World world(options);
+  std::vector<ChunkCoord> coords;
+  for (int z = 0; z < config.grid; ++z) {
+    for (int x = 0; x < config.grid; ++x) coords.push_back({x - 1, z - 1});
+  }
+  if (reverse) std::reverse(coords.begin(), coords.end());
+  const auto chunks = world.chunks(coords);
+  for (const auto& chunk : chunks) {
+    if (!CHECK(chunk != nullptr)) return 0;
+  }
+  return hash_chunks(chunks);
+}
+
+std::map<std::string, std::uint64_t> read_golden(const char* path) {
+  std::map<std::string, std::uint64_t> golden;
+  std::ifstream in(path);
+  std::string line;
+  while (std::getline(in, line)) {
+    if (line.empty() || line[0] == '#') continue;
+    std::istringstream fields(line);
+    std::string name, hex;
+    if (fields >> name >> hex) golden[name] = std::strtoull(hex.c_str(), nullptr, 16);
+  }
+  return golden;
+}
+
+bool write_golden(const char* path) {
+  std::FILE* f = std::fopen(path, "w");
+  if (!f) return false;
+  std::fprintf(f, "# terram determinism golden hashes: configuration hash_chunks()\n");
+  std::fprintf(f, "# Regenerate with terram_test_determinism <this file> --update.\n");
+  for (const Config& config : configs()) {
+    std::fprintf(f, "%s %016" PRIx64 "\n", config.name, world_hash(config, 1, false, 1u << 30));
+  }
+  return std::fclose(f) == 0;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    std::fprintf(stderr, "usage: terram_test_determinism golden.txt [--update]\n");
+    return 2;
+  }
+  if (argc > 2 && std::strcmp(argv[2], "--update") == 0) {
+    set_noise_isa(SimdIsa::Scalar);
+    return write_golden(argv[1]) ? 0 : 1;
+  }
+  if (const char* want = std::getenv("TERRAM_SIMD")) {
+    if (std::strcmp(want, to_string(noise_isa())) != 0) {
+      std::printf("%s not supported here; skipped\n", want);
+      return kSkipped;
+    }
+  }
+  std::printf("isa %s\n", to_string(noise_isa()));
+
+  philox_known_answers();
+  const auto golden = read_golden(argv[1]);
+  // A few chunks' worth, so halos and targets are evicted and regenerated
+  // mid-batch.
+  constexpr std::size_t kTinyBudget = std::size_t{1} << 20;
+  for (const Config& config : configs()) {
+    auto it = golden.find(config.name);
+    if (!CHECK(it != golden.end())) continue;
+    for (unsigned threads : {1u, 4u}) {
+      for (bool reverse : {false, true}) {
+        for (std::size_t budget : {std::size_t{1} << 30, kTinyBudget}) {
+          const std::uint64_t h = world_hash(config, threads, reverse, budget);
+          std::printf("%-14s threads %u %-7s budget %10zu  %016" PRIx64 "\n", config.name,
+                      threads, reverse ? "reverse" : "forward", budget, h);
+          CHECK(h == it->second);
+        }
+      }
+    }
+  }
+  return terram_test::exit_code();
+}
@@ -0,0 +1,189 @@
+// terram_test_edits: edits outlive the eviction of the chunks they touch,
+// with a store that does not persist generated chunks and with no store at
+// all, and still encode as non-empty deltas afterwards. Chunks held across
+// an edit keep their old heights and meshes. Concurrent edits of the same
+// chunks all land, a background batch preempted by edits still returns
+// every chunk, and concurrent delta encoders share the world's baseline
+// generator safely.
+
+#include <unistd.h>
+
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "check.hpp"
+#include "terram/world.hpp"
+
+using namespace terram;
+
+namespace {
+
+constexpr ChunkCoord kEdited{2, 3};
+constexpr ChunkCoord kUntouched{9, 9};
+
+std::vector<float> heights(const Chunk& chunk) {
+  std::vector<float> out(kChunkCells);
+  chunk.height().copy_to_row_major(out.data());
+  return out;
+}
+
+std::size_t delta_bytes(World& world, ChunkCoord c) {
+  std::vector<std::uint8_t> out;
+  world.encode_deltas(std::span<const ChunkCoord>(&c, 1), out);
+  return out.size();
+}
+
+void edit_survives_eviction(WorldOptions options) {
+  World world(options);
+  const std::vector<float> generated = heights(*world.chunk(kEdited));
+  world.apply(brushes::raise(static_cast<double>(chunk_origin(kEdited.x)) + 32.0,
+                             static_cast<double>(chunk_origin(kEdited.z)) + 32.0, 20.0, 5.0f));
+  const std::vector<float> edited = heights(*world.chunk(kEdited));
+  CHECK(edited != generated);
+
+  const std::size_t budget = world.cache().budget();
+  world.cache().set_budget(0);
+  // Without a store the edited chunk is the edit's only copy and stays.
+  CHECK(static_cast<bool>(world.field().find(kEdited)) == !options.store_directory);
+  world.cache().set_budget(budget);
+  if (world.store()) world.store()->flush();
+
+  CHECK(heights(*world.chunk(kEdited)) == edited);
+  CHECK(delta_bytes(world, kEdited) > delta_bytes(world, kUntouched));
+}
+
+std::vector<float> mesh_heights(const Chunk& chunk) {
+  std::vector<float> out;
+  for (const MeshVertex& v : chunk.mesh()->vertices()) out.push_back(v.y);
+  return out;
+}
+
+void held_chunks_unchanged() {
+  WorldOptions options;
+  options.seed = 13;
+  options.threads.threads = 2;
+  options.mesh = MeshOptions{};
+  World world(options);
+  // The brush straddles kEdited's east edge, so both chunks are edited.
+  const ChunkCoord beside{kEdited.x + 1, kEdited.z};
+  const auto held = world.chunk(kEdited);
+  const auto held_beside = world.chunk(beside);
+  const std::vector<float> before = heights(*held);
+  const std::vector<float> mesh_before = mesh_heights(*held);
+  const std::vector<float> beside_before = mesh_heights(*held_beside);
+
+  world.apply(brushes::raise(static_cast<double>(chunk_origin(kEdited.x)) + 60.0,
+                             static_cast<double>(chunk_origin(kEdited.z)) + 32.0, 6.0, 5.0f));
+  world.regenerate_dirty();
+
+  CHECK(held->stage() == world.stage_count());
+  CHECK(heights(*held) == before);
+  CHECK(mesh_heights(*held) == mesh_before);
+  CHECK(mesh_heights(*held_beside) == beside_before);
+  const auto now = world.chunk(kEdited);
+  CHECK(now != held);
+  CHECK(heights(*now) != before);
+  CHECK(mesh_heights(*now) != mesh_before);
+}
+
+void concurrent_edits() {
+  WorldOptions options;
+  options.seed = 14;
+  options.threads.threads = 2;
+  World world(options);
+  // Straddles the corner of four chunks; every cell rises by one per edit.
+  const std::int64_t ox = chunk_origin(kEdited.x);
+  const std::int64_t oz = chunk_origin(kEdited.z);
+  const Edit bump{{ox - 8, oz - 8, ox + 8, oz + 8}, [](std::int64_t, std::int64_t, float& h) {
+                    h += 1.0f;
+                  }};
+  std::vector<float> expected = heights(*world.chunk(kEdited));
+  constexpr int kThreads = 4;
+  constexpr int kEdits = 16;
+  for (int i = 0; i < kThreads * kEdits; ++i) {
+    for (int z = 0; z < 8; ++z) {
+      for (int x = 0; x < 8; ++x) expected[z * kChunkSize + x] += 1.0f;
+    }
+  }
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; ++t) {
+    threads.emplace_back([&] {
+      for (int i = 0; i < kEdits; ++i) world.apply(bump);
+    });
+  }
+  for (auto& t : threads) t.join();
+  CHECK(heights(*world.chunk(kEdited)) == expected);
+}
+
+void edits_preempt_batches() {
+  WorldOptions options;
+  options.seed = 15;
+  options.threads.threads = 2;
+  options.mesh = MeshOptions{};
+  World world(options);
+  std::vector<ChunkCoord> coords;
+  for (int z = 0; z < 6; ++z) {
+    for (int x = 0; x < 6; ++x) coords.push_back({x, z});
+  }
+  GenerateOptions prefetch;
+  prefetch.priority = Priority::Prefetch;
+  std::vector<std::shared_ptr<Chunk>> got;
+  std::thread background([&] { got = world.chunks(coords, prefetch); });
+  for (int i = 0; i < 24; ++i) {
+    const double at = 16.0 + 48.0 * (i % 6);
+    world.apply(brushes::raise(at, at, 10.0, 1.0f));
+  }
+  background.join();
+  bool all = got.size() == coords.size();
+  for (const auto& chunk : got) all &= chunk && chunk->stage() == world.stage_count();
+  CHECK(all);
+}
+
+void concurrent_encodes() {
+  WorldOptions options;
+  options.seed = 12;
+  options.threads.threads = 2;
+  World world(options);
+  world.apply(brushes::crater(40.0, 40.0, 24.0, 6.0f));
+  const std::vector<ChunkCoord> coords = {{0, 0}, {1, 0}, {0, 1}, {1, 1}, {5, 5}};
+  std::vector<std::uint8_t> expected;
+  world.encode_deltas(coords, expected);
+
+  std::vector<std::vector<std::uint8_t>> got(4);
+  std::vector<std::thread> threads;
+  for (auto& out : got) {
+    threads.emplace_back([&] {
+      for (int i = 0; i < 8; ++i) {
+        out.clear();
+        world.encode_deltas(coords, out);
+      }
+    });
+  }
+  for (auto& t : threads) t.join();
+  for (const auto& out : got) CHECK(out == expected);
+}
+
+}  // namespace
+
+int main() {
+  WorldOptions options;
+  options.seed = 11;
+  options.threads.threads = 2;
+  edit_survives_eviction(options);
+
+  const auto dir = std::filesystem::temp_directory_path() /
+                   ("terram-test-edits-" + std::to_string(::getpid()));
+  options.store_directory = dir;
+  options.persist_generated = false;
+  edit_survives_eviction(options);
+  std::filesystem::remove_all(dir);
+
+  held_chunks_unchanged();
+  concurrent_edits();
+  edits_preempt_batches();
+  concurrent_encodes();
+  return terram_test::exit_code();
+}
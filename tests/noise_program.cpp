@@ -0,0 +1,154 @@
+// terram_test_noise_program: bytecode transcriptions of compiled noise
+// graphs produce the same heights bit for bit, before and after an
+// encode/decode round trip; an unwarped graph fBm matches
+// SimplexNoise::fill(). Malformed bytecode and invalid programs throw.
+
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#include "check.hpp"
+#include "terram/noise_graph.hpp"
+#include "terram/noise_program.hpp"
+
+using namespace terram;
+
+namespace {
+
+constexpr ChunkCoord kCoords[] = {{0, 0}, {-1, 0}, {3, -7}, {-40, 25}, {100000, -100000}};
+
+const FbmParams kPeaks{.frequency = 1.0f / 384.0f, .octaves = 6, .amplitude = 90.0f};
+const FbmParams kWobble{.frequency = 1.0f / 512.0f, .octaves = 3, .amplitude = 1.0f};
+const FbmParams kHills{.frequency = 1.0f / 160.0f, .octaves = 4, .amplitude = 14.0f};
+
+bool same(const TiledPlane<float>& a, const TiledPlane<float>& b) {
+  return std::memcmp(a.data(), b.data(), kChunkCells * sizeof(float)) == 0;
+}
+
+template <graph::Expression E>
+void check_matches(const E& expr, const NoiseProgram& program) {
+  const SimplexNoise noise(21);
+  std::vector<std::uint8_t> bytes;
+  program.encode(bytes);
+  const NoiseProgram decoded = NoiseProgram::decode(bytes);
+  for (ChunkCoord c : kCoords) {
+    TiledPlane<float> expected;
+    TiledPlane<float> got;
+    graph::fill(expr, noise, c, expected);
+    program.fill(noise, c, got);
+    CHECK(same(expected, got));
+    decoded.fill(noise, c, got);
+    CHECK(same(expected, got));
+  }
+}
+
+// presets::alpine(), as bench.cpp transcribes it.
+void alpine() {
+  using enum Opcode;
+  constexpr std::uint8_t G = NoiseProgram::kGrid;
+  const NoiseProgram program(
+      {kPeaks, kWobble, kHills},
+      {
+          {.op = GridX, .dst = 0},
+          {.op = GridZ, .dst = 1},
+          {.op = Fbm, .dst = 2, .a = G, .b = G, .param = 1},
+          {.op = Fbm, .dst = 3, .a = G, .b = G, .param = 1, .k0 = 7919, .k1 = -3571},
+          {.op = MulAdd, .dst = 2, .a = 2, .b = 0, .k0 = 48},
+          {.op = MulAdd, .dst = 3, .a = 3, .b = 1, .k0 = 48},
+          {.op = Ridged, .dst = 4, .a = 2, .b = 3, .param = 0},
+          {.op = ScaleBias, .dst = 4, .a = 4, .k0 = 0.8f},
+          {.op = Billow, .dst = 5, .a = G, .b = G, .param = 2},
+          {.op = Add, .dst = 4, .a = 4, .b = 5},
+          {.op = ScaleBias, .dst = 4, .a = 4, .k0 = 1, .k1 = -20},
+          {.op = Const, .dst = 6},
+          {.op = Min, .dst = 7, .a = 4, .b = 6},
+          {.op = Max, .dst = 5, .a = 4, .b = 6},
+          {.op = MulAdd, .dst = 4, .a = 7, .b = 5, .k0 = 0.25f},
+      },
+      4);
+  check_matches(graph::presets::alpine(), program);
+}
+
+// The ops alpine() does not use.
+void remaining_ops() {
+  using namespace graph;
+  using enum Opcode;
+  constexpr std::uint8_t G = NoiseProgram::kGrid;
+  const auto expr =
+      blend(remap(fbm(kWobble), [](float v) { return std::fabs(v); }) * 30.0f - billow(kHills),
+            ridged(kPeaks) * fbm(kWobble), clamp(fbm(kWobble) + 0.5f, 0.1f, 0.9f));
+  const NoiseProgram program({kPeaks, kWobble, kHills},
+                             {
+                                 {.op = Fbm, .dst = 0, .a = G, .b = G, .param = 1},
+                                 {.op = Abs, .dst = 1, .a = 0},
+                                 {.op = Const, .dst = 2, .k0 = 30},
+                                 {.op = Mul, .dst = 1, .a = 1, .b = 2},
+                                 {.op = Billow, .dst = 3, .a = G, .b = G, .param = 2},
+                                 {.op = Sub, .dst = 1, .a = 1, .b = 3},
+                                 {.op = Ridged, .dst = 4, .a = G, .b = G, .param = 0},
+                                 {.op = Mul, .dst = 4, .a = 4, .b = 0},
+                                 {.op = ScaleBias, .dst = 5, .a = 0, .k0 = 1, .k1 = 0.5f},
+                                 {.op = Clamp, .dst = 5, .a = 5, .k0 = 0.1f, .k1 = 0.9f},
+                                 {.op = Blend, .dst = 6, .a = 1, .b = 4, .c = 5},
+                             },
+                             6);
+  check_matches(expr, program);
+}
+
+void fbm_matches_fill() {
+  const SimplexNoise noise(21);
+  for (ChunkCoord c : kCoords) {
+    TiledPlane<float> expected;
+    TiledPlane<float> got;
+    noise.fill(c, kPeaks, expected);
+    graph::fill(graph::fbm(kPeaks), noise, c, got);
+    CHECK(same(expected, got));
+  }
+}
+
+void rejects_bad_programs() {
+  using enum Opcode;
+  bool threw = false;
+  try {
+    // Reads register 1 before anything writes it.
+    NoiseProgram({}, {{.op = Add, .dst = 0, .a = 1, .b = 1}}, 0);
+  } catch (const std::invalid_argument&) {
+    threw = true;
+  }
+  CHECK(threw);
+
+  std::vector<std::uint8_t> bytes;
+  NoiseProgram({kHills}, {{.op = Fbm, .dst = 0, .a = NoiseProgram::kGrid,
+                           .b = NoiseProgram::kGrid, .param = 0}},
+               0)
+      .encode(bytes);
+  int rejected = 0;
+  for (std::size_t n = 0; n < bytes.size(); ++n) {
+    try {
+      NoiseProgram::decode(std::span<const std::uint8_t>(bytes.data(), n));
+    } catch (const std::runtime_error&) {
+      ++rejected;
+    }
+  }
+  CHECK(rejected == static_cast<int>(bytes.size()));
+  bytes[bytes.size() - 10] = 0;  // the Fbm's parameter index, now past the one set
+  bytes[bytes.size() - 9] = 1;
+  threw = false;
+  try {
+    NoiseProgram::decode(bytes);
+  } catch (const std::runtime_error&) {
+    threw = true;
+  }
+  CHECK(threw);
+}
+
+}  // namespace
+
+int main() {
+  alpine();
+  remaining_ops();
+  fbm_matches_fill();
+  rejects_bad_programs();
+  return terram_test::exit_code();
+}
@@ -0,0 +1,397 @@
+// terram_perf_gate: the gate's performance assertions. Measures the same
+// paths as terram_bench and fails when a throughput drops below its floor
+// or a stage allocates more than its ceiling.
+//
+//   terram_perf_gate [output-path]
+//
+// Each result is one `name value unit limit status` line in
+// test_output.txt (by default in the working directory); ctest runs it as
+// the `perf` test. Floors sit at about 60% of a quiet reference run, so a
+// change that halves a rate fails while run-to-run noise does not. A rate
+// under its floor is measured again, twice at most, before it counts as a
+// failure. TERRAM_PERF_SCALE multiplies every floor, e.g. 0.25 for
+// sanitizer or debug builds and slow CI hosts.
+//
+// Throughputs are per thread (noise, meshing) or per worker (generation
+// stages) so the floors hold on any core count. Allocation counts come
+// from replacing the global operator new: every heap allocation a stage
+// makes on its worker, per chunk, once the arenas are warm.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <new>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "terram/heightfield.hpp"
+#include "terram/mesh.hpp"
+#include "terram/noise.hpp"
+#include "terram/scheduler.hpp"
+#include "terram/simd.hpp"
+#include "terram/stages.hpp"
+#include "terram/thread_pool.hpp"
+
+namespace {
+
+thread_local std::uint64_t t_allocations = 0;
+
+void* allocate(std::size_t bytes, std::size_t alignment) {
+  ++t_allocations;
+  if (bytes == 0) bytes = 1;
+  void* p = alignment <= alignof(std::max_align_t)
+                ? std::malloc(bytes)
+                : std::aligned_alloc(alignment, (bytes + alignment - 1) / alignment * alignment);
+  if (!p) throw std::bad_alloc();
+  return p;
+}
+
+}  // namespace
+
+void* operator new(std::size_t bytes) { return allocate(bytes, 0); }
+void* operator new[](std::size_t bytes) { return allocate(bytes, 0); }
+void* operator new(std::size_t bytes, std::align_val_t a) {
+  return allocate(bytes, static_cast<std::size_t>(a));
+}
+void* operator new[](std::size_t bytes, std::align_val_t a) {
+  return allocate(bytes, static_cast<std::size_t>(a));
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+
+using namespace terram;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr double kMinSeconds = 0.1;
+constexpr int kRounds = 3;
+constexpr int kAttempts = 3;
+constexpr int kGrid = 6;
+
+struct Result {
+  std::string name;
+  double value;
+  std::string unit;
+  double limit;
+  bool floor;  // else a ceiling
+  bool pass() const { return floor ? value >= limit : value <= limit; }
+};
+
+class Gate {
+ public:
+  explicit Gate(double scale) : scale_(scale) {}
+
+  double scaled(double floor) const { return floor * scale_; }
+
+  void floor(std::string name, double value, double floor, std::string unit) {
+    add({std::move(name), value, std::move(unit), scaled(floor), true});
+  }
+
+  /// Measures with `measure` until it reaches `floor`, at most kAttempts
+  /// times, and keeps the best value.
+  void floor(std::string name, double floor, std::string unit,
+             const std::function<double()>& measure) {
+    double best = 0.0;
+    for (int a = 0; a < kAttempts && best < scaled(floor); ++a) best = std::max(best, measure());
+    this->floor(std::move(name), best, floor, std::move(unit));
+  }
+
+  void ceiling(std::string name, double value, double ceiling, std::string unit) {
+    add({std::move(name), value, std::move(unit), ceiling, false});
+  }
+
+  bool passed() const {
+    return std::all_of(results_.begin(), results_.end(), [](const Result& r) { return r.pass(); });
+  }
+
+  bool write(const char* path) const {
+    std::FILE* f = std::fopen(path, "w");
+    if (!f) return false;
+    std::fprintf(f, "# terram-perf-gate 1\n# simd %s\n# scale %g\n", to_string(detect_simd()),
+                 scale_);
+    for (const Result& r : results_) {
+      std::fprintf(f, "%s %.6g %s %s%.6g %s\n", r.name.c_str(), r.value, r.unit.c_str(),
+                   r.floor ? ">=" : "<=", r.limit, r.pass() ? "ok" : "FAIL");
+    }
+    std::fprintf(f, "# %s\n", passed() ? "passed" : "FAILED");
+    return std::fclose(f) == 0;
+  }
+
+ private:
+  void add(Result r) {
+    std::printf("%-32s %12.6g %-16s %s %-12.6g %s\n", r.name.c_str(), r.value, r.unit.c_str(),
+                r.floor ? ">=" : "<=", r.limit, r.pass() ? "ok" : "FAIL");
+    std::fflush(stdout);
+    results_.push_back(std::move(r));
+  }
+
+  double scale_;
+  std::vector<Result> results_;
+};
+
+// Median over rounds of ops/second, as terram_bench measures it.
+template <typename F>
+double rate(double ops, F&& fn) {
+  fn();
+  std::vector<double> rates;
+  for (int r = 0; r < kRounds; ++r) {
+    std::size_t calls = 0;
+    const auto start = Clock::now();
+    double elapsed = 0.0;
+    do {
+      fn();
+      ++calls;
+      elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    } while (elapsed < kMinSeconds);
+    rates.push_back(ops * static_cast<double>(calls) / elapsed);
+  }
+  std::nth_element(rates.begin(), rates.begin() + rates.size() / 2, rates.end());
+  return rates[rates.size() / 2];
+}
+
+volatile float g_sink;
+
+void gate_noise(Gate& gate) {
+  const SimplexNoise noise(1);
+  const FbmParams params;
+  gate.floor("noise.point.scalar", 2.8e7, "samples/s", [&] {
+    float acc = 0.0f;
+    const double r = rate(4096, [&] {
+      for (int i = 0; i < 4096; ++i) acc += noise.sample(i * 0.37f, i * 0.11f);
+    });
+    g_sink = acc;
+    return r;
+  });
+
+  // Floors per kernel: the dispatch picks the best one the host has, and
+  // the gate checks every one it can run.
+  struct Floor {
+    SimdIsa isa;
+    double samples_per_second;
+  };
+  const SimdIsa initial = noise_isa();
+  TiledPlane<float> plane;
+  const double samples = static_cast<double>(kChunkCells) * params.octaves;
+  for (Floor f : {Floor{SimdIsa::Scalar, 2.8e7}, Floor{SimdIsa::Avx2, 1.6e8},
+                  Floor{SimdIsa::Avx512, 2.0e8}, Floor{SimdIsa::Neon, 8.0e7}}) {
+    if (!set_noise_isa(f.isa)) continue;
+    int i = 0;
+    gate.floor(std::string("noise.fbm.") + to_string(f.isa), f.samples_per_second, "samples/s",
+               [&] {
+                 return rate(samples, [&] {
+                   noise.fill({i, -i}, params, plane);
+                   ++i;
+                 });
+               });
+  }
+  set_noise_isa(initial);
+  g_sink = std::as_const(plane).at(0, 0);
+}
+
+// Per stage: summed run time, runs and heap allocations made while running.
+struct StageProbe {
+  std::vector<std::unique_ptr<std::atomic<std::int64_t>>> nanos;
+  std::vector<std::unique_ptr<std::atomic<std::int64_t>>> runs;
+  std::vector<std::unique_ptr<std::atomic<std::uint64_t>>> allocations;
+
+  Pipeline wrap(Pipeline pipeline) {
+    for (Stage& stage : pipeline) {
+      nanos.push_back(std::make_unique<std::atomic<std::int64_t>>(0));
+      runs.push_back(std::make_unique<std::atomic<std::int64_t>>(0));
+      allocations.push_back(std::make_unique<std::atomic<std::uint64_t>>(0));
+      auto* ns = nanos.back().get();
+      auto* count = runs.back().get();
+      auto* allocs = allocations.back().get();
+      stage.run = [run = std::move(stage.run), ns, count, allocs](StageContext& ctx) {
+        const std::uint64_t before = t_allocations;
+        const auto start = Clock::now();
+        run(ctx);
+        ns->fetch_add((Clock::now() - start).count(), std::memory_order_relaxed);
+        allocs->fetch_add(t_allocations - before, std::memory_order_relaxed);
+        count->fetch_add(1, std::memory_order_relaxed);
+      };
+    }
+    return pipeline;
+  }
+
+  void reset() {
+    for (std::size_t s = 0; s < nanos.size(); ++s) {
+      nanos[s]->store(0);
+      runs[s]->store(0);
+      allocations[s]->store(0);
+    }
+  }
+};
+
+// Floors in chunks/s per worker; ceilings in heap allocations per chunk.
+struct StageLimits {
+  double floor;
+  double ceiling;
+};
+
+// Generates fresh grid x grid regions through `stages` and gates the whole
+// pipeline's rate as generate.<name>, and each stage listed in `limits`.
+void gate_pipeline(Gate& gate, ThreadPool& pool, const std::string& name, Pipeline stages,
+                   int grid, double pipeline_floor,
+                   const std::vector<std::pair<std::string, StageLimits>>& limits) {
+  StageProbe probe;
+  const Pipeline pipeline = probe.wrap(std::move(stages));
+  const std::size_t n = pipeline.size();
+  std::vector<const StageLimits*> stage_limits(n, nullptr);
+  for (std::size_t s = 0; s < n; ++s) {
+    for (const auto& [stage, l] : limits) {
+      if (stage == pipeline[s].name) stage_limits[s] = &l;
+    }
+  }
+
+  // One scheduler throughout, so its arenas are warm after the first
+  // batch; each attempt then generates a region no batch has touched.
+  Heightfield field;
+  ChunkScheduler scheduler(pool, field, pipeline);
+  int region = 0;
+  auto generate = [&] {
+    std::vector<ChunkCoord> targets;
+    for (int z = 0; z < grid; ++z) {
+      for (int x = 0; x < grid; ++x) targets.push_back({x + region * 2 * grid, z});
+    }
+    ++region;
+    return scheduler.generate(targets);
+  };
+  generate();
+  const std::uint64_t warm_blocks = scheduler.scratch_stats().heap_allocations;
+
+  std::vector<double> rates(n, 0.0);
+  std::vector<double> allocations(n, 0.0);
+  double pipeline_rate = 0.0;
+  auto met = [&] {
+    for (std::size_t s = 0; s < n; ++s) {
+      if (stage_limits[s] && rates[s] < gate.scaled(stage_limits[s]->floor)) return false;
+    }
+    return pipeline_rate >= gate.scaled(pipeline_floor);
+  };
+  for (int a = 0; a < kAttempts && (a == 0 || !met()); ++a) {
+    probe.reset();
+    const GenerationStats stats = generate();
+    pipeline_rate = std::max(pipeline_rate, static_cast<double>(grid * grid) /
+                                                (stats.seconds * pool.size()));
+    for (std::size_t s = 0; s < n; ++s) {
+      const double secs = static_cast<double>(probe.nanos[s]->load()) * 1e-9;
+      const double runs = static_cast<double>(probe.runs[s]->load());
+      rates[s] = std::max(rates[s], secs > 0.0 ? runs / secs : 0.0);
+      // Allocations do not vary with timing: the last attempt's count
+      // stands.
+      allocations[s] = runs > 0.0 ? static_cast<double>(probe.allocations[s]->load()) / runs : 0;
+    }
+  }
+
+  gate.floor("generate." + name, pipeline_rate, pipeline_floor, "chunks/s/worker");
+  for (std::size_t s = 0; s < n; ++s) {
+    if (!stage_limits[s]) continue;
+    gate.floor("generate.stage." + pipeline[s].name, rates[s], stage_limits[s]->floor,
+               "chunks/s/worker");
+  }
+  for (std::size_t s = 0; s < n; ++s) {
+    if (!stage_limits[s]) continue;
+    gate.ceiling("alloc.stage." + pipeline[s].name, allocations[s], stage_limits[s]->ceiling,
+                 "allocs/chunk");
+  }
+  // Warm arenas take no further blocks from the heap.
+  gate.ceiling("alloc.scratch_blocks." + name,
+               static_cast<double>(scheduler.scratch_stats().heap_allocations - warm_blocks), 0,
+               "blocks");
+}
+
+void gate_generation(Gate& gate, ThreadPool& pool) {
+  auto noise = std::make_shared<const SimplexNoise>(7);
+  // Generation stages work in scratch only. Derived ones allocate their
+  // output once per fresh chunk: normals their plane, mesh its buffer.
+  gate_pipeline(gate, pool, "pipeline",
+                {
+                    stages::heightmap(noise, FbmParams{}),
+                    stages::erosion(ErosionParams{}, stages::fbm_source(noise, FbmParams{})),
+                    stages::normals(),
+                    stages::mesh(MeshOptions{}),
+                },
+                kGrid, 22,
+                {{"heightmap", {9000, 0}},
+                 {"erosion", {70, 0}},
+                 {"normals", {8000, 1}},
+                 {"mesh", {3500, 1}}});
+  // The optional stages, as World assembles them: normals and biomes fused
+  // over each tile, then caves and their surface. The fused stage allocates
+  // its members' two planes. Caves allocate the brick map, its slots and
+  // its dense storage, which grows as the surface's bricks are stored. The
+  // surface allocates its run, job lists and helper buffers, then its two
+  // output buffers at their final size.
+  gate_pipeline(gate, pool, "features",
+                stages::fuse_tiles({
+                    stages::heightmap(noise, FbmParams{}),
+                    stages::normals(),
+                    stages::biomes(7, BiomeOptions{}),
+                    stages::caves(7, CaveOptions{}),
+                    stages::surface(SurfaceOptions{}),
+                }),
+                3, 20,
+                {{"normals+biomes", {3500, 2}},
+                 {"caves", {70, 12}},
+                 {"surface", {160, 7}}});
+}
+
+void gate_mesh(Gate& gate) {
+  Heightfield field;
+  const SimplexNoise noise(5);
+  for (int z = -1; z <= 1; ++z) {
+    for (int x = -1; x <= 1; ++x) {
+      auto chunk = std::make_shared<Chunk>(ChunkCoord{x, z});
+      noise.fill(chunk->coord(), FbmParams{}, chunk->height());
+      field.insert(chunk);
+    }
+  }
+  const ChunkNeighborhood neighbors = field.neighborhood({0, 0}, nullptr);
+  const MeshOptions options;
+  Arena scratch;
+  MeshBuffers buffers;
+  mesh_chunk(neighbors, options, scratch, buffers);
+  const auto triangles = static_cast<double>(buffers.triangle_count());
+  gate.floor("mesh.rtin", 2.2e7, "tris/s", [&] {
+    return rate(triangles, [&] { mesh_chunk(neighbors, options, scratch, buffers); });
+  });
+  // Remeshing into warm buffers reuses them.
+  const std::uint64_t before = t_allocations;
+  mesh_chunk(neighbors, options, scratch, buffers);
+  gate.ceiling("alloc.mesh.rtin", static_cast<double>(t_allocations - before), 0, "allocs/chunk");
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  const char* output = argc > 1 ? argv[1] : "test_output.txt";
+  double scale = 1.0;
+  if (const char* env = std::getenv("TERRAM_PERF_SCALE")) scale = std::atof(env);
+  if (!(scale > 0.0)) scale = 1.0;
+
+  Gate gate(scale);
+  ThreadPool pool;
+  gate_noise(gate);
+  gate_generation(gate, pool);
+  gate_mesh(gate);
+
+  if (!gate.write(output)) {
+    std::fprintf(stderr, "terram_perf_gate: cannot write %s\n", output);
+    return 1;
+  }
+  return gate.passed() ? 0 : 1;
+}
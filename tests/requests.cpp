@@ -0,0 +1,125 @@
+// terram_test_requests: a ChunkRequestQueue answers every request it
+// accepted, those still queued when it is destroyed as cancelled, so
+// awaiting coroutines resume. A ChunkStream whose coord the full queue
+// refuses answers it as refused.
+
+#include <atomic>
+#include <chrono>
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include "check.hpp"
+#include "terram/async.hpp"
+#include "terram/world.hpp"
+
+using namespace terram;
+
+namespace {
+
+struct Detached {
+  struct promise_type {
+    Detached get_return_object() { return {}; }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() { std::terminate(); }
+  };
+};
+
+// Holds the Visible dispatcher inside its callback until released, so the
+// lane behind it stays queued.
+struct Blocker {
+  std::atomic<bool> entered{false};
+  std::atomic<bool> released{false};
+
+  static void hold(const ChunkCompletion&, void* user) {
+    auto* self = static_cast<Blocker*>(user);
+    self->entered.store(true);
+    self->entered.notify_all();
+    self->released.wait(false);
+  }
+};
+
+struct Tally {
+  std::atomic<int> answered{0};
+  std::atomic<int> cancelled{0};
+
+  static void count(const ChunkCompletion& completion, void* user) {
+    auto* self = static_cast<Tally*>(user);
+    if (completion.cancelled && !completion.chunk) self->cancelled.fetch_add(1);
+    self->answered.fetch_add(1);
+  }
+};
+
+Detached await_chunk(ChunkRequestQueue& queue, ChunkCoord c, std::optional<ChunkCompletion>& out) {
+  out = co_await request_chunk(queue, c);
+}
+
+Detached drain(ChunkStream& stream, std::vector<ChunkCompletion>& out, bool& finished) {
+  while (auto c = co_await stream.next()) out.push_back(*c);
+  finished = true;
+}
+
+void queued_requests_answered() {
+  WorldOptions options;
+  options.seed = 11;
+  World world(options);
+
+  Blocker blocker;
+  Tally tally;
+  std::optional<ChunkCompletion> awaited;
+  std::thread release;
+  {
+    ChunkRequestQueue queue(world, RequestQueueOptions{.capacity = 4, .max_batch = 1});
+    CHECK(queue.request({0, 0}, 0, &Blocker::hold, &blocker));
+    blocker.entered.wait(false);
+
+    int accepted = 0;
+    for (int i = 1; i <= 3; ++i) accepted += queue.request({i, 0}, 0, &Tally::count, &tally);
+    CHECK(accepted == 3);
+    await_chunk(queue, {4, 0}, awaited);
+    CHECK(!queue.request(ChunkCoord{5, 0}));
+
+    // The queue is full and none of the stream's requests are in flight.
+    const std::vector<ChunkCoord> coords{{6, 0}};
+    std::vector<ChunkCompletion> streamed;
+    bool finished = false;
+    {
+      ChunkStream stream(queue, coords, ChunkStreamOptions{.window = 1});
+      drain(stream, streamed, finished);
+    }
+    CHECK(finished);
+    CHECK(streamed.size() == 1);
+    if (!streamed.empty()) {
+      CHECK(streamed[0].refused);
+      CHECK(!streamed[0].chunk);
+      CHECK(streamed[0].coord == (ChunkCoord{6, 0}));
+    }
+
+    // Let the dispatcher go only once the destructor has stopped it, so
+    // what is queued is left for the destructor to answer.
+    release = std::thread([&] {
+      std::this_thread::sleep_for(std::chrono::milliseconds(200));
+      blocker.released.store(true);
+      blocker.released.notify_all();
+    });
+  }
+  release.join();
+  CHECK(tally.answered.load() == 3);
+  CHECK(tally.cancelled.load() == 3);
+  CHECK(awaited.has_value());
+  if (awaited) {
+    CHECK(awaited->cancelled);
+    CHECK(!awaited->chunk);
+  }
+}
+
+}  // namespace
+
+int main() {
+  queued_requests_answered();
+  return terram_test::exit_code();
+}
@@ -0,0 +1,134 @@
+// terram_test_surface: the isosurfaces of neighbouring chunks, with caves
+// breaking through the terrain, join into one closed, consistently wound
+// surface: away from the region's rim, every edge is crossed by as many
+// triangles one way as the other. Holds whether or not helpers extract
+// bricks.
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <map>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+#include "check.hpp"
+#include "terram/world.hpp"
+
+using namespace terram;
+
+namespace {
+
+constexpr int kGrid = 3;
+
+// Chunks compute a shared vertex in their own local frames, so the world
+// positions they land on can differ in the last bits: vertices within
+// kWeld of each other are one.
+constexpr double kWeld = 1e-3;
+
+class Welder {
+ public:
+  std::uint32_t id(double x, double y, double z) {
+    const auto key = [](double v) { return static_cast<std::int64_t>(std::floor(v / kWeld)); };
+    const std::int64_t kx = key(x), ky = key(y), kz = key(z);
+    for (std::int64_t dx = -1; dx <= 1; ++dx) {
+      for (std::int64_t dy = -1; dy <= 1; ++dy) {
+        for (std::int64_t dz = -1; dz <= 1; ++dz) {
+          auto it = buckets_.find({kx + dx, ky + dy, kz + dz});
+          if (it == buckets_.end()) continue;
+          for (std::uint32_t v : it->second) {
+            const auto& p = points_[v];
+            if (std::abs(p[0] - x) <= kWeld && std::abs(p[1] - y) <= kWeld &&
+                std::abs(p[2] - z) <= kWeld) {
+              return v;
+            }
+          }
+        }
+      }
+    }
+    const auto v = static_cast<std::uint32_t>(points_.size());
+    points_.push_back({x, y, z});
+    buckets_[{kx, ky, kz}].push_back(v);
+    return v;
+  }
+
+  const std::array<double, 3>& point(std::uint32_t v) const { return points_[v]; }
+
+ private:
+  std::vector<std::array<double, 3>> points_;
+  std::map<std::tuple<std::int64_t, std::int64_t, std::int64_t>, std::vector<std::uint32_t>>
+      buckets_;
+};
+
+void closed_across_chunks(bool parallel) {
+  WorldOptions options;
+  options.seed = 0x5eed;
+  options.threads.threads = 2;
+  options.caves = CaveOptions{};
+  options.surface = SurfaceOptions{.parallel = parallel, .bricks_per_helper = 1};
+  World world(options);
+  std::vector<ChunkCoord> coords;
+  for (int z = 0; z < kGrid; ++z) {
+    for (int x = 0; x < kGrid; ++x) coords.push_back({x, z});
+  }
+  const auto chunks = world.chunks(coords);
+
+  Welder welder;
+  // Directed edge (a, b) counts +1, (b, a) -1, keyed by the smaller first.
+  std::unordered_map<std::uint64_t, int> edges;
+  std::size_t triangles = 0;
+  int meshes = 0;
+  for (const auto& chunk : chunks) {
+    if (!CHECK(chunk != nullptr) || !CHECK(chunk->surface() != nullptr)) return;
+    const SurfaceMesh& mesh = *chunk->surface();
+    meshes += !mesh.indices.empty();
+    const double ox = static_cast<double>(chunk_origin(chunk->coord().x));
+    const double oz = static_cast<double>(chunk_origin(chunk->coord().z));
+    std::vector<std::uint32_t> ids;
+    for (const SurfaceVertex& v : mesh.vertices) {
+      ids.push_back(welder.id(ox + v.x, v.y, oz + v.z));
+    }
+    for (std::size_t i = 0; i + 2 < mesh.indices.size(); i += 3) {
+      ++triangles;
+      for (int e = 0; e < 3; ++e) {
+        std::uint32_t a = ids[mesh.indices[i + e]];
+        std::uint32_t b = ids[mesh.indices[i + (e + 1) % 3]];
+        int sign = 1;
+        if (b < a) {
+          std::swap(a, b);
+          sign = -1;
+        }
+        edges[(std::uint64_t{a} << 32) | b] += sign;
+      }
+    }
+  }
+  CHECK(meshes == kGrid * kGrid);
+
+  // The rim of the region is open where its neighbours were not meshed.
+  const double lo = 2.0;
+  const double hi = static_cast<double>(kGrid * kChunkSize) - 2.0;
+  auto inside = [&](std::uint32_t v) {
+    const auto& p = welder.point(v);
+    return p[0] > lo && p[0] < hi && p[2] > lo && p[2] < hi;
+  };
+  std::size_t checked = 0;
+  std::size_t open = 0;
+  for (const auto& [key, balance] : edges) {
+    const auto a = static_cast<std::uint32_t>(key >> 32);
+    const auto b = static_cast<std::uint32_t>(key);
+    if (a == b || !inside(a) || !inside(b)) continue;
+    ++checked;
+    open += balance != 0;
+  }
+  CHECK(triangles > 1000);
+  CHECK(checked > 1000);
+  CHECK(open == 0);
+}
+
+}  // namespace
+
+int main() {
+  closed_across_chunks(false);
+  closed_across_chunks(true);
+  return terram_test::exit_code();
+}
@@ -0,0 +1,183 @@
+// terram_test_wire: delta records round-trip to within half a quantum,
+// including edits large enough to escape and to clamp, and concatenate.
+// Truncated, corrupted and hostile records throw std::runtime_error rather
+// than read out of bounds or overflow while decoding.
+
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+#include "check.hpp"
+#include "terram/noise.hpp"
+#include "terram/wire.hpp"
+
+using namespace terram;
+
+namespace {
+
+constexpr float kQuantum = 1.0f / 64.0f;
+
+TiledPlane<float> baseline(ChunkCoord c) {
+  static const SimplexNoise noise(3);
+  TiledPlane<float> plane;
+  noise.fill(c, FbmParams{}, plane);
+  return plane;
+}
+
+bool throws(std::span<const std::uint8_t> record) {
+  const TiledPlane<float> base = baseline({0, 0});
+  TiledPlane<float> out;
+  try {
+    decode_delta(record, base, out);
+  } catch (const std::runtime_error&) {
+    return true;
+  }
+  return false;
+}
+
+void put_u16(std::vector<std::uint8_t>& out, std::uint16_t v) {
+  out.push_back(static_cast<std::uint8_t>(v));
+  out.push_back(static_cast<std::uint8_t>(v >> 8));
+}
+
+void put_u32(std::vector<std::uint8_t>& out, std::uint32_t v) {
+  for (int i = 0; i < 4; ++i) out.push_back(static_cast<std::uint8_t>(v >> (8 * i)));
+}
+
+void round_trip() {
+  const ChunkCoord c{-3, 7};
+  const TiledPlane<float> base = baseline(c);
+
+  std::vector<std::uint8_t> bytes;
+  encode_delta(c, 2, base, base, kQuantum, bytes);
+  CHECK(bytes.size() == 24);
+
+  // A smooth raise, scattered spikes that escape, and one far enough out
+  // to clamp.
+  TiledPlane<float> edited(base);
+  std::mt19937 rng(5);
+  std::uniform_real_distribution<float> spike(-500.0f, 500.0f);
+  for (int z = 0; z < kChunkSize; ++z) {
+    for (int x = 0; x < kChunkSize; ++x) {
+      const float dx = static_cast<float>(x - 20);
+      const float dz = static_cast<float>(z - 40);
+      edited.at(x, z) += 6.0f * std::exp(-(dx * dx + dz * dz) / 200.0f);
+    }
+  }
+  for (int i = 0; i < 40; ++i) edited.at(rng() % kChunkSize, rng() % kChunkSize) += spike(rng);
+  edited.at(63, 63) = 1e12f;
+  const std::size_t first = bytes.size();
+  encode_delta(c, 2, edited, base, kQuantum, bytes);
+
+  const std::span<const std::uint8_t> all(bytes);
+  const DeltaRecord untouched = peek_delta(all);
+  CHECK(untouched.identical);
+  CHECK(untouched.size == first);
+  CHECK(untouched.coord == c);
+  CHECK(untouched.stage == 2);
+
+  TiledPlane<float> out;
+  decode_delta(all, base, out);
+  CHECK(std::memcmp(out.data(), base.data(), kChunkCells * sizeof(float)) == 0);
+
+  const DeltaRecord rec = decode_delta(all.subspan(first), base, out);
+  CHECK(!rec.identical);
+  CHECK(rec.quantum == kQuantum);
+  CHECK(rec.size == bytes.size() - first);
+  int off = 0;
+  for (int z = 0; z < kChunkSize; ++z) {
+    for (int x = 0; x < kChunkSize; ++x) {
+      if (x == 63 && z == 63) continue;
+      const double error = std::abs(static_cast<double>(out.at(x, z)) - edited.at(x, z));
+      // Half a quantum, plus float rounding of the decoded height.
+      off += error > kQuantum * 0.5 + 1e-4;
+    }
+  }
+  CHECK(off == 0);
+  // Clamped to the encoder's range, 2^30 quanta.
+  CHECK(std::abs(out.at(63, 63) - base.at(63, 63) - 16777216.0f) < 4.0f);
+}
+
+void malformed_input() {
+  const ChunkCoord c{0, 0};
+  const TiledPlane<float> base = baseline(c);
+  TiledPlane<float> edited(base);
+  for (int i = 0; i < kChunkCells; i += 7) edited.data()[i] += static_cast<float>(i % 300);
+  std::vector<std::uint8_t> bytes;
+  encode_delta(c, 0, edited, base, kQuantum, bytes);
+
+  // Every proper prefix is truncated.
+  bool all_throw = true;
+  for (std::size_t n = 0; n < bytes.size(); ++n) {
+    all_throw &= throws(std::span<const std::uint8_t>(bytes.data(), n));
+  }
+  CHECK(all_throw);
+
+  std::vector<std::uint8_t> bad = bytes;
+  bad[0] ^= 1;
+  CHECK(throws(bad));
+  bad = bytes;
+  bad[4] = 9;  // version
+  CHECK(throws(bad));
+  bad = bytes;
+  std::memset(bad.data() + 16, 0xff, 4);  // NaN quantum
+  CHECK(throws(bad));
+
+  // Corrupted payloads either throw or decode to something; under the
+  // sanitizers, neither reads out of bounds or overflows.
+  std::mt19937 rng(9);
+  TiledPlane<float> out;
+  for (int trial = 0; trial < 500; ++trial) {
+    bad = bytes;
+    for (int flips = 1 + trial % 4; flips > 0; --flips) {
+      bad[24 + rng() % (bad.size() - 24)] ^= static_cast<std::uint8_t>(1u << (rng() % 8));
+    }
+    try {
+      decode_delta(bad, base, out);
+    } catch (const std::runtime_error&) {
+    }
+  }
+
+  // Every cell escapes, by `escape` past the escape symbol: one beyond
+  // what a residual can be, one that wraps when the symbol is added back,
+  // and one in range that would integrate past the encoder's bound. Summed
+  // unchecked, such residuals overflow int64.
+  auto hostile = [&](std::uint64_t escape) {
+    std::vector<std::uint8_t> payload;
+    put_u16(payload, 1);  // one symbol, the escape, at full count
+    payload.push_back(255);
+    put_u16(payload, 0);
+    std::vector<std::uint8_t> escapes;
+    for (int i = 0; i < kChunkCells; ++i) {
+      std::uint64_t v = escape;
+      for (; v >= 0x80; v >>= 7) escapes.push_back(static_cast<std::uint8_t>(v | 0x80));
+      escapes.push_back(static_cast<std::uint8_t>(v));
+    }
+    put_u32(payload, static_cast<std::uint32_t>(escapes.size()));
+    payload.insert(payload.end(), escapes.begin(), escapes.end());
+    put_u32(payload, 1u << 23);  // rANS state; one symbol never renormalizes
+    std::vector<std::uint8_t> record(bytes.begin(), bytes.begin() + 24);
+    record[5] = 0;  // not identical
+    for (int i = 0; i < 4; ++i) {
+      record[20 + i] = static_cast<std::uint8_t>(payload.size() >> (8 * i));
+    }
+    record.insert(record.end(), payload.begin(), payload.end());
+    return record;
+  };
+  for (std::uint64_t escape : {std::uint64_t{1} << 40, ~std::uint64_t{0},
+                               (std::uint64_t{1} << 31) - 255}) {
+    const std::vector<std::uint8_t> record = hostile(escape);
+    CHECK(peek_delta(record).size == record.size());
+    CHECK(throws(record));
+  }
+}
+
+}  // namespace
+
+int main() {
+  round_trip();
+  malformed_input();
+  return terram_test::exit_code();
+}